@@ -0,0 +1,387 @@
+#ifndef GFX_UTILS_BVH_H_
+#define GFX_UTILS_BVH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "gfx_utils/frustum.h"
+
+namespace gfx_utils {
+
+struct Aabb {
+  glm::vec3 min = glm::vec3(0.f);
+  glm::vec3 max = glm::vec3(0.f);
+};
+
+// 32 bytes, so two nodes share a cache line. Nodes are stored depth first:
+// an interior node's first child directly follows it
+struct BvhNode {
+  glm::vec3 min;
+
+  // Interior nodes: index of the second child. Leaves: index of the first
+  // primitive in the primitive list
+  uint32_t offset;
+
+  glm::vec3 max;
+
+  // Primitives in a leaf. 0 for interior nodes
+  uint32_t count;
+};
+
+// Bounding volume hierarchy over a set of boxes, e.g. the world space bounds
+// of the scene's entities (see Scene::UpdateBvh()). Primitives are
+// identified by their index in the box list given to Build().
+//
+// Build() splits nodes with the surface area heuristic, evaluated at bin
+// boundaries. Moving a primitive with Update() refits the nodes above it
+// only, and tracks how much the tree's SAH cost has grown since the build,
+// so the owner can rebuild once NeedsRebuild().
+//
+// The queries call func(prim) for every primitive whose box passes, and
+// keep their traversal stack on the stack, so they never allocate
+class Bvh {
+public:
+  // Deepest a tree gets. Deeper nodes are made leaves, however many
+  // primitives they have
+  static const int kMaxDepth = 64;
+
+  static const uint32_t kMaxLeafSize = 4;
+  static const int kNumBins = 16;
+
+  // Rebuild once refits have made the tree this much more expensive to
+  // traverse than it was when built
+  static constexpr float kRebuildCostRatio = 1.5f;
+
+  void Build(const std::vector<Aabb>& boxes);
+  void Clear();
+
+  // Moves a primitive's box and refits the nodes above it, stopping at the
+  // first one whose bounds don't change
+  void Update(uint32_t prim, const Aabb& box);
+
+  bool NeedsRebuild() const {
+    return GetCost() > build_cost_ * kRebuildCostRatio;
+  }
+
+  // Expected cost of a traversal by the surface area heuristic, relative to
+  // testing one primitive
+  float GetCost() const;
+
+  bool IsEmpty() const {
+    return nodes_.empty();
+  }
+
+  size_t GetNumPrimitives() const {
+    return prim_boxes_.size();
+  }
+
+  size_t GetNumNodes() const {
+    return nodes_.size();
+  }
+
+  const Aabb& GetPrimitiveBox(uint32_t prim) const {
+    return prim_boxes_[prim];
+  }
+
+  // Primitives whose boxes are at least partly in the frustum. Subtrees
+  // fully inside it are reported without further tests
+  template <typename Func>
+  void QueryFrustum(const Frustum& frustum, Func func) const;
+
+  // Primitives whose boxes overlap the sphere
+  template <typename Func>
+  void QuerySphere(const glm::vec3& center, float radius, Func func) const;
+
+  // Primitives whose boxes the ray enters within max_dist, nearest subtree
+  // first. func(prim, entry_dist) returns the new max_dist, so a closest hit
+  // query returns the distance of each exact hit to prune farther boxes, and
+  // anything else keeps the current one
+  template <typename Func>
+  void QueryRay(const glm::vec3& origin, const glm::vec3& dir, float max_dist,
+                Func func) const;
+
+private:
+  static const uint32_t kNoParent = 0xffffffff;
+
+  // Builds the node over prim_indices_[begin, end) and its subtree. Returns
+  // the node's index
+  uint32_t BuildNode(uint32_t begin, uint32_t end, uint32_t parent, int depth,
+                     const std::vector<glm::vec3>& centroids);
+
+  // Bounds from the node's primitives or children
+  void ComputeNodeBounds(uint32_t node, glm::vec3* out_min,
+                         glm::vec3* out_max) const;
+
+  // Surface area weighted by the node's cost
+  float GetWeightedArea(const BvhNode& node) const;
+
+  template <typename Func>
+  void VisitSubtree(uint32_t root, Func& func) const;
+
+  static float GetSurfaceArea(const glm::vec3& min, const glm::vec3& max);
+
+  static bool Overlaps(const glm::vec3& min, const glm::vec3& max,
+                       const glm::vec3& center, float radius);
+
+  // Distance along the ray to where it enters the box, if it does so
+  // before max_dist
+  static bool IntersectRay(const glm::vec3& origin, const glm::vec3& inv_dir,
+                           const glm::vec3& min, const glm::vec3& max,
+                           float max_dist, float* out_dist);
+
+private:
+  std::vector<BvhNode> nodes_;
+  std::vector<uint32_t> parents_;
+
+  // Leaves index ranges of prim_indices_
+  std::vector<uint32_t> prim_indices_;
+
+  std::vector<Aabb> prim_boxes_;
+  std::vector<uint32_t> prim_leaves_;
+
+  // Sum of every node's weighted area. Divided by the root's area it is the
+  // SAH cost, so refits keep it up to date a node at a time
+  float weighted_area_ = 0.f;
+  float build_cost_ = 0.f;
+};
+
+template <typename Func>
+void Bvh::VisitSubtree(uint32_t root, Func& func) const {
+  uint32_t stack[kMaxDepth];
+  int stack_size = 0;
+
+  uint32_t node_index = root;
+  while (true) {
+    const BvhNode& node = nodes_[node_index];
+
+    if (node.count > 0) {
+      for (uint32_t i = 0; i < node.count; ++i) {
+        func(prim_indices_[node.offset + i]);
+      }
+
+      if (stack_size == 0) {
+        break;
+      }
+      node_index = stack[--stack_size];
+    }
+    else {
+      stack[stack_size++] = node.offset;
+      node_index = node_index + 1;
+    }
+  }
+}
+
+template <typename Func>
+void Bvh::QueryFrustum(const Frustum& frustum, Func func) const {
+  if (nodes_.empty()) {
+    return;
+  }
+
+  uint32_t stack[kMaxDepth];
+  int stack_size = 0;
+
+  uint32_t node_index = 0;
+  while (true) {
+    const BvhNode& node = nodes_[node_index];
+
+    FrustumOverlap overlap = TestBoxInFrustum(frustum, node.min, node.max);
+
+    if (overlap == kFrustumInside) {
+      VisitSubtree(node_index, func);
+    }
+    else if (overlap == kFrustumIntersects) {
+      if (node.count > 0) {
+        for (uint32_t i = 0; i < node.count; ++i) {
+          uint32_t prim = prim_indices_[node.offset + i];
+          const Aabb& box = prim_boxes_[prim];
+          if (TestBoxInFrustum(frustum, box.min, box.max) !=
+                  kFrustumOutside) {
+            func(prim);
+          }
+        }
+      }
+      else {
+        stack[stack_size++] = node.offset;
+        node_index = node_index + 1;
+        continue;
+      }
+    }
+
+    if (stack_size == 0) {
+      break;
+    }
+    node_index = stack[--stack_size];
+  }
+}
+
+template <typename Func>
+void Bvh::QuerySphere(const glm::vec3& center, float radius,
+                      Func func) const {
+  if (nodes_.empty()) {
+    return;
+  }
+
+  uint32_t stack[kMaxDepth];
+  int stack_size = 0;
+
+  uint32_t node_index = 0;
+  while (true) {
+    const BvhNode& node = nodes_[node_index];
+
+    if (Overlaps(node.min, node.max, center, radius)) {
+      if (node.count > 0) {
+        for (uint32_t i = 0; i < node.count; ++i) {
+          uint32_t prim = prim_indices_[node.offset + i];
+          const Aabb& box = prim_boxes_[prim];
+          if (Overlaps(box.min, box.max, center, radius)) {
+            func(prim);
+          }
+        }
+      }
+      else {
+        stack[stack_size++] = node.offset;
+        node_index = node_index + 1;
+        continue;
+      }
+    }
+
+    if (stack_size == 0) {
+      break;
+    }
+    node_index = stack[--stack_size];
+  }
+}
+
+template <typename Func>
+void Bvh::QueryRay(const glm::vec3& origin, const glm::vec3& dir,
+                   float max_dist, Func func) const {
+  if (nodes_.empty()) {
+    return;
+  }
+
+  // Zero components become infinities, which the slab test handles
+  glm::vec3 inv_dir = 1.f / dir;
+
+  float dist = 0.f;
+  if (!IntersectRay(origin, inv_dir, nodes_[0].min, nodes_[0].max, max_dist,
+                    &dist)) {
+    return;
+  }
+
+  // Entry distances are stacked with the nodes, so that subtrees behind a
+  // hit found since they were pushed are skipped
+  uint32_t stack[kMaxDepth];
+  float stack_dists[kMaxDepth];
+  int stack_size = 0;
+
+  uint32_t node_index = 0;
+  while (true) {
+    const BvhNode& node = nodes_[node_index];
+
+    if (node.count > 0) {
+      for (uint32_t i = 0; i < node.count; ++i) {
+        uint32_t prim = prim_indices_[node.offset + i];
+        const Aabb& box = prim_boxes_[prim];
+
+        float prim_dist = 0.f;
+        if (IntersectRay(origin, inv_dir, box.min, box.max, max_dist,
+                         &prim_dist)) {
+          max_dist = std::min(max_dist, func(prim, prim_dist));
+        }
+      }
+    }
+    else {
+      uint32_t near_index = node_index + 1;
+      uint32_t far_index = node.offset;
+
+      float near_dist = 0.f;
+      float far_dist = 0.f;
+      bool is_near_hit = IntersectRay(origin, inv_dir, nodes_[near_index].min,
+                                      nodes_[near_index].max, max_dist,
+                                      &near_dist);
+      bool is_far_hit = IntersectRay(origin, inv_dir, nodes_[far_index].min,
+                                     nodes_[far_index].max, max_dist,
+                                     &far_dist);
+
+      if (is_near_hit && is_far_hit) {
+        if (far_dist < near_dist) {
+          std::swap(near_index, far_index);
+          std::swap(near_dist, far_dist);
+        }
+
+        stack[stack_size] = far_index;
+        stack_dists[stack_size] = far_dist;
+        ++stack_size;
+
+        node_index = near_index;
+        continue;
+      }
+      if (is_near_hit || is_far_hit) {
+        node_index = is_near_hit ? near_index : far_index;
+        continue;
+      }
+    }
+
+    // Pop the next subtree the ray still reaches
+    bool has_next = false;
+    while (stack_size > 0) {
+      --stack_size;
+      if (stack_dists[stack_size] <= max_dist) {
+        node_index = stack[stack_size];
+        has_next = true;
+        break;
+      }
+    }
+
+    if (!has_next) {
+      break;
+    }
+  }
+}
+
+inline float Bvh::GetSurfaceArea(const glm::vec3& min, const glm::vec3& max) {
+  glm::vec3 size = glm::max(max - min, glm::vec3(0.f));
+  return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+inline bool Bvh::Overlaps(const glm::vec3& min, const glm::vec3& max,
+                          const glm::vec3& center, float radius) {
+  glm::vec3 closest = glm::clamp(center, min, max);
+  glm::vec3 offset = closest - center;
+  return glm::dot(offset, offset) <= radius * radius;
+}
+
+inline bool Bvh::IntersectRay(const glm::vec3& origin,
+                              const glm::vec3& inv_dir, const glm::vec3& min,
+                              const glm::vec3& max, float max_dist,
+                              float* out_dist) {
+  glm::vec3 t0 = (min - origin) * inv_dir;
+  glm::vec3 t1 = (max - origin) * inv_dir;
+
+  // A ray parallel to an axis that starts on one of the box's planes gives
+  // 0 * inf = NaN for that axis, which std::min/max would pass on depending
+  // on argument order. The ray runs along the box's surface then, so the
+  // slab doesn't bound it and the axis is ignored
+  float enter = 0.f;
+  float exit = max_dist;
+  for (int i = 0; i < 3; ++i) {
+    bool is_nan = t0[i] != t0[i] || t1[i] != t1[i];
+    if (is_nan) {
+      continue;
+    }
+
+    enter = std::max(enter, std::min(t0[i], t1[i]));
+    exit = std::min(exit, std::max(t0[i], t1[i]));
+  }
+
+  *out_dist = enter;
+  return enter <= exit;
+}
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_BVH_H_
\ No newline at end of file
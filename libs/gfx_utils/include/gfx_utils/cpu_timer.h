@@ -0,0 +1,40 @@
+#ifndef GFX_UTILS_CPU_TIMER_H_
+#define GFX_UTILS_CPU_TIMER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace gfx_utils {
+
+// Accumulates the CPU time spent in a section of code (e.g. submitting the
+// draws of a pass) over many frames, and reports the average
+class CpuTimer {
+public:
+  void Begin();
+  void End();
+
+  // Average time per Begin()/End() pair in milliseconds
+  double GetAverageMs() const;
+
+  uint32_t GetNumSamples() const {
+    return num_samples_;
+  }
+
+  void Reset();
+
+  // Prints "<label>: <average> ms" and resets once every num_samples samples.
+  // Call after End()
+  void ReportEvery(uint32_t num_samples, const std::string& label);
+
+private:
+  std::chrono::steady_clock::time_point begin_time_;
+
+  std::chrono::steady_clock::duration total_time_ = 
+      std::chrono::steady_clock::duration::zero();
+  uint32_t num_samples_ = 0;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_CPU_TIMER_H_
\ No newline at end of file
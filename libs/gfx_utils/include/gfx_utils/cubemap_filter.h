@@ -0,0 +1,40 @@
+#ifndef GFX_UTILS_CUBEMAP_FILTER_H_
+#define GFX_UTILS_CUBEMAP_FILTER_H_
+
+#include <string>
+#include <cstdint>
+
+#include "file_utils.h"
+#include "texture.h"
+
+namespace gfx_utils {
+
+struct CubemapFilterOptions {
+  // Face size of the first level of the specular chain
+  uint32_t specular_size = 128;
+  // Clamped to the number of mips of specular_size
+  uint32_t num_specular_levels = 6;
+
+  uint32_t irradiance_size = 32;
+
+  // GGX importance samples per texel of the specular chain
+  uint32_t num_samples = 128;
+
+  // 0 uses one thread per hardware thread
+  uint32_t num_threads = 0;
+
+  // Directory where filtered results are cached, created on the first
+  // write. Empty disables the cache
+  std::string cache_directory = kDefaultCacheDirectory;
+};
+
+// Fills in the cubemap's specular mip chain and irradiance map by filtering
+// its faces on the CPU. The results are cached on disk keyed by the hash of
+// the face files and the options, so only the first run pays for filtering
+bool PrefilterCubemap(Cubemap* cubemap,
+                      const CubemapFilterOptions& options =
+                          CubemapFilterOptions());
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_CUBEMAP_FILTER_H_
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef GFX_UTILS_ENTITY_H_
 #define GFX_UTILS_ENTITY_H_
 
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <string>
@@ -13,6 +14,11 @@
 
 namespace gfx_utils {
 
+class Entity;
+
+// Entities whose transforms changed, in the order they first moved
+using EntityMoveList = std::vector<Entity*>;
+
 class Entity {
 
 public:
@@ -27,6 +33,10 @@ public:
   void SetScale(glm::vec3 scale);
   void SetRotation(float yaw, float pitch, float roll);
 
+  std::shared_ptr<Entity> GetParent() const {
+    return parent_;
+  }
+
   std::shared_ptr<Model> GetModel();
 
   bool HasModel() const;
@@ -35,6 +45,22 @@ public:
     return name_;
   }
 
+  // Set by the scene while the entity is in it. The entity is primitive prim
+  // of the scene's BVH, and changing its transform adds it to move_list the
+  // first time after ClearMoved(), so that only moved entities are refit
+  void SetBvhPrimitive(uint32_t prim, EntityMoveList* move_list);
+
+  uint32_t GetBvhPrimitive() const {
+    return bvh_prim_;
+  }
+
+  void ClearMoved() {
+    is_moved_ = false;
+  }
+
+private:
+  void MarkMoved();
+
 private:
   std::string name_;
 
@@ -45,6 +71,10 @@ private:
   glm::vec3 location_;
   glm::quat rotation_;
   glm::vec3 scale_;
+
+  uint32_t bvh_prim_ = 0;
+  EntityMoveList* move_list_ = nullptr;
+  bool is_moved_ = false;
 };
 
 } // namespace gfx_utils
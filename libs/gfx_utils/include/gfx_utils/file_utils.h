@@ -0,0 +1,18 @@
+#ifndef GFX_UTILS_FILE_UTILS_H_
+#define GFX_UTILS_FILE_UTILS_H_
+
+#include <string>
+
+namespace gfx_utils {
+
+// Directory of the on-disk caches (program binaries, prefiltered cubemaps),
+// relative to the working directory
+extern const char* const kDefaultCacheDirectory;
+
+// Creates the directory if it doesn't exist. Only the last path component
+// is created. Returns false if it is missing and can't be created
+bool CreateDirectoryIfMissing(const std::string& path);
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_FILE_UTILS_H_
\ No newline at end of file
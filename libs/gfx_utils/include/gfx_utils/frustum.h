@@ -0,0 +1,47 @@
+#ifndef GFX_UTILS_FRUSTUM_H_
+#define GFX_UTILS_FRUSTUM_H_
+
+#include <glm/glm.hpp>
+
+namespace gfx_utils {
+
+enum FrustumPlane {
+  kFrustumPlaneLeft,
+  kFrustumPlaneRight,
+  kFrustumPlaneBottom,
+  kFrustumPlaneTop,
+  kFrustumPlaneNear,
+  kFrustumPlaneFar,
+  kNumFrustumPlanes
+};
+
+// Planes as (normal, distance) with normalized normals pointing into the
+// frustum, so a point p is inside a plane if dot(normal, p) + distance >= 0.
+// The layout matches a GLSL vec4[6], for culling shaders
+struct Frustum {
+  glm::vec4 planes[kNumFrustumPlanes];
+};
+
+// Planes of the space that view_proj_mat maps into the clip volume, e.g.
+// world space for proj * view
+Frustum ExtractFrustum(const glm::mat4& view_proj_mat);
+
+enum FrustumOverlap {
+  kFrustumOutside,
+  kFrustumIntersects,
+  kFrustumInside
+};
+
+// Where an axis aligned box is relative to the frustum. Conservative - boxes
+// that straddle two planes outside the frustum's corners can intersect
+FrustumOverlap TestBoxInFrustum(const Frustum& frustum, const glm::vec3& min,
+                                const glm::vec3& max);
+
+// Axis aligned box that bounds the box moved by model_mat
+void TransformBox(const glm::mat4& model_mat, const glm::vec3& min,
+                  const glm::vec3& max, glm::vec3* out_min, 
+                  glm::vec3* out_max);
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_FRUSTUM_H_
\ No newline at end of file
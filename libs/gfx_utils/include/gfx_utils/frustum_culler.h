@@ -0,0 +1,84 @@
+#ifndef GFX_UTILS_FRUSTUM_CULLER_H_
+#define GFX_UTILS_FRUSTUM_CULLER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "gfx_utils/frustum.h"
+
+namespace gfx_utils {
+
+// Tests boxes against a frustum and records which ones are visible in a
+// bitset. Add() moves each object space box into world space, and Cull()
+// tests eight boxes at a time with AVX, four with SSE, or one at a time
+// where neither is targeted (see GFX_UTILS_AVX in gfx_utils' CMakeLists).
+// The boxes are kept as a structure of arrays of centers and half extents,
+// so a SIMD group is one load per component.
+//
+//   culler.Clear();
+//   for (...) {
+//     uint32_t index = culler.Add(mesh.bounds_min, mesh.bounds_max, 
+//                                 model_mat);
+//   }
+//   culler.Cull(ExtractFrustum(proj_mat * view_mat));
+//   if (culler.IsVisible(index)) { ... }
+class FrustumCuller {
+public:
+  void Clear();
+  void Reserve(size_t num_boxes);
+
+  // Returns the box's index in the visibility bitset. The world space box
+  // bounds the transformed box, so it may be larger than it
+  uint32_t Add(const glm::vec3& min, const glm::vec3& max, 
+               const glm::mat4& model_mat);
+
+  // Rewrites the visibility of every box added since Clear()
+  void Cull(const Frustum& frustum);
+
+  // Bit i of word i / 64 is set if box i is at least partly in the frustum.
+  // Conservative - boxes near the frustum's corners can pass while outside
+  const std::vector<uint64_t>& GetVisibility() const {
+    return visibility_;
+  }
+
+  bool IsVisible(uint32_t index) const {
+    return (visibility_[index >> 6] >> (index & 63)) & 1;
+  }
+
+  size_t GetNumBoxes() const {
+    return center_x_.size();
+  }
+
+  // Of the last Cull()
+  size_t GetNumVisible() const {
+    return num_visible_;
+  }
+
+  float GetCulledFraction() const {
+    size_t num_boxes = GetNumBoxes();
+    return num_boxes > 0 ? 
+        1.f - static_cast<float>(num_visible_) / num_boxes : 0.f;
+  }
+
+  // Boxes Cull() tests at once: 8, 4 or 1
+  static int GetSimdWidth();
+
+private:
+  std::vector<float> center_x_;
+  std::vector<float> center_y_;
+  std::vector<float> center_z_;
+
+  std::vector<float> extent_x_;
+  std::vector<float> extent_y_;
+  std::vector<float> extent_z_;
+
+  std::vector<uint64_t> visibility_;
+  size_t num_visible_ = 0;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_FRUSTUM_CULLER_H_
\ No newline at end of file
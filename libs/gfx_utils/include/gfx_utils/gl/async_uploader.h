@@ -0,0 +1,97 @@
+#ifndef GFX_UTILS_GL_ASYNC_UPLOADER_H_
+#define GFX_UTILS_GL_ASYNC_UPLOADER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+#include "gfx_utils/window/window.h"
+
+namespace gfx_utils {
+
+// Buffers owned by the upload context that upload functions can reuse
+// instead of creating their own each time
+struct UploadStaging {
+  GLuint pixel_buffer_id = 0;
+  GLuint vertex_buffer_id = 0;
+};
+
+// Runs GL uploads on a worker thread with its own context, shared with the
+// main window's. Each upload is fenced, and its completion function runs on
+// the main thread in ProcessCompleted() once the GPU has finished it, at
+// which point the uploaded objects are safe to use from the main context.
+//
+// Only objects that are shared between contexts (buffers and textures) can
+// be touched by upload functions. Don't create VAOs or FBOs in them
+class AsyncUploader {
+public:
+  // Runs on the upload thread with the upload context current
+  using UploadFunc = std::function<void(UploadStaging&)>;
+
+  // Runs on the main thread once the upload has completed on the GPU
+  using CompleteFunc = std::function<void()>;
+
+  bool Initialize(Window* window);
+  void Destroy();
+
+  void Enqueue(UploadFunc upload, CompleteFunc complete);
+
+  // Runs the completion functions of finished uploads. Call once per frame
+  // on the main thread. Returns how many uploads completed
+  int ProcessCompleted();
+
+  // Blocks until every queued upload has completed and its completion
+  // function has run
+  void Finish();
+
+  // Uploads that are queued, running, or waiting on the GPU
+  int GetNumPending() const {
+    return num_pending_.load();
+  }
+
+  bool IsInitialized() const {
+    return is_initialized_;
+  }
+
+private:
+  struct Job {
+    UploadFunc upload;
+    CompleteFunc complete;
+  };
+
+  struct InFlightUpload {
+    GLsync fence = nullptr;
+    CompleteFunc complete;
+  };
+
+  void WorkerMain();
+
+private:
+  Window* window_ = nullptr;
+  GLFWwindow* context_ = nullptr;
+
+  std::thread worker_;
+
+  std::mutex mutex_;
+  std::condition_variable queue_cv_;
+  std::deque<Job> queue_;
+  std::vector<InFlightUpload> in_flight_;
+  bool should_quit_ = false;
+
+  std::atomic<int> num_pending_{0};
+
+  bool is_initialized_ = false;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_GL_ASYNC_UPLOADER_H_
\ No newline at end of file
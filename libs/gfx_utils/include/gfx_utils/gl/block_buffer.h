@@ -0,0 +1,55 @@
+#ifndef GFX_UTILS_GL_BLOCK_BUFFER_H_
+#define GFX_UTILS_GL_BLOCK_BUFFER_H_
+
+#include <cstddef>
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+namespace gfx_utils {
+
+// Buffer of std140/std430 blocks (see shader_blocks.h) for uniform or shader
+// storage binding points. Unlike StreamBuffer its contents persist between
+// frames, so it suits data that rarely changes, such as materials and
+// lights. Updating any part of it is one glBufferSubData()
+class BlockBuffer {
+public:
+  // target is GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER
+  bool Initialize(GLenum target, size_t size);
+  void Destroy();
+
+  // Grows the buffer to at least size bytes, keeping its contents. The
+  // buffer id changes, so bindings made before have to be redone
+  void Reserve(size_t size);
+
+  void Write(size_t offset, size_t size, const void* data);
+
+  // Offsets passed to BindRange() must be multiples of this
+  size_t GetOffsetAlignment() const {
+    return alignment_;
+  }
+
+  void BindRange(GLuint binding, size_t offset, size_t size) const;
+  void BindBase(GLuint binding) const;
+
+  GLuint GetBufferId() const {
+    return buffer_id_;
+  }
+
+  size_t GetSize() const {
+    return size_;
+  }
+
+private:
+  GLenum target_ = GL_UNIFORM_BUFFER;
+  GLuint buffer_id_ = 0;
+
+  size_t size_ = 0;
+  size_t alignment_ = 256;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_GL_BLOCK_BUFFER_H_
\ No newline at end of file
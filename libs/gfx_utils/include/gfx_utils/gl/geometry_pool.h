@@ -0,0 +1,239 @@
+#ifndef GFX_UTILS_GL_GEOMETRY_POOL_H_
+#define GFX_UTILS_GL_GEOMETRY_POOL_H_
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+#include "gfx_utils/mesh.h"
+#include "gfx_utils/range_allocator.h"
+#include "gfx_utils/gl/async_uploader.h"
+#include "gfx_utils/gl/gl_state_cache.h"
+
+namespace gfx_utils {
+
+enum VertType {
+  kVertTypePosition,
+  kVertTypeNormal,
+  kVertTypeTexcoord,
+  kVertTypeMtlId,
+  kNumVertTypes
+};
+
+// Bitmask of the vertex attributes a pass reads. Attribute locations match
+// the VertType values (position at location 0, normal at 1, ...)
+using VertexLayout = uint32_t;
+
+const VertexLayout kVertexLayoutPosition = 1 << kVertTypePosition;
+const VertexLayout kVertexLayoutNormal = 1 << kVertTypeNormal;
+const VertexLayout kVertexLayoutTexcoord = 1 << kVertTypeTexcoord;
+const VertexLayout kVertexLayoutMtlId = 1 << kVertTypeMtlId;
+
+const VertexLayout kVertexLayoutAll = (1 << kNumVertTypes) - 1;
+
+// Where a mesh lives in the pool. Indices are relative to base_vertex
+struct GeometryRange {
+  int32_t base_vertex = 0;
+  uint32_t num_verts = 0;
+
+  uint32_t first_index = 0;
+  uint32_t index_count = 0;
+};
+
+// Sub-allocates the vertex and index data of every mesh from one buffer per
+// vertex attribute plus one index buffer, so draws only differ in their
+// GeometryRange and the buffers are bound once per pass. Non-indexed meshes
+// get sequential indices so every mesh is drawn the same way.
+// The buffers are reallocated (and their ids change) when the pool grows,
+// which also invalidates the VAOs returned by GetVertexArrayId()
+class GeometryPool {
+public:
+  void Destroy();
+
+  // Grows the pool so that the given number of additional vertices and
+  // indices fit without another reallocation
+  void Reserve(uint32_t num_extra_verts, uint32_t num_extra_indices);
+
+  // Uploads the mesh and returns where it was placed. Missing normals,
+  // texcoords or material ids are zero-filled. Returns false if the mesh is
+  // empty or the pool can't grow to fit it
+  bool AddMesh(const Mesh& mesh, GeometryRange* out_range);
+
+  // AddMesh() in two steps, for uploads from another context. Allocation may
+  // grow (and reallocate) the buffers, so it has to happen on the main
+  // thread; growing first waits for the uploads in flight on the uploader
+  // given to SetUploader(). The upload only writes into the mesh's range and
+  // can run on any context sharing the buffers
+  bool AllocateMesh(const Mesh& mesh, GeometryRange* out_range);
+
+  // Writes the mesh into a range from AllocateMesh(). With a staging buffer
+  // id, the data is written to it in one go and copied into place on the
+  // GPU; the staging buffer is reallocated to fit
+  void UploadMesh(const Mesh& mesh, const GeometryRange& range, 
+                  GLuint staging_buffer_id = 0) const;
+
+  void RemoveMesh(const GeometryRange& range);
+
+  // Reads the attributes in the layout and the indices of a range back into
+  // the mesh. Non-indexed meshes come back indexed. Stalls until the GPU is
+  // done with the buffers, so keep it off the per-frame path
+  void ReadbackMesh(const GeometryRange& range, VertexLayout layout,
+                    Mesh* out_mesh) const;
+
+  // GPU bytes that the range takes up across all the buffers
+  static size_t CalcRangeByteSize(const GeometryRange& range);
+
+  GLuint GetVertexBufferId(VertType vert_type) const {
+    return vertex_buffer_ids_[vert_type];
+  }
+
+  GLuint GetIndexBufferId() const {
+    return index_buffer_id_;
+  }
+
+  // Binds the attribute's buffer and points the given attribute location at
+  // it. Expects a VAO to be bound
+  void BindVertexAttribute(VertType vert_type, GLuint location) const;
+
+  void BindIndexBuffer() const;
+
+  // VAO with the layout's attributes and the index buffer bound, created on
+  // first use. Since all meshes share the pool's buffers, one VAO per layout
+  // serves every mesh
+  GLuint GetVertexArrayId(VertexLayout layout);
+
+  // Uploads on the uploader read the buffer ids, so the pool finishes them
+  // before it reallocates the buffers
+  void SetUploader(AsyncUploader* uploader) {
+    uploader_ = uploader;
+  }
+
+  // Invalidated whenever the pool deletes its VAOs or buffers, since GL may
+  // hand their ids out again and the cache would skip binding the new ones
+  void SetStateCache(GLStateCache* state_cache) {
+    state_cache_ = state_cache;
+  }
+
+  // Incremented whenever the buffers are reallocated
+  uint32_t GetGeneration() const {
+    return generation_;
+  }
+
+  uint32_t GetUsedVerts() const {
+    return vertex_allocator_.GetUsed();
+  }
+
+  uint32_t GetUsedIndices() const {
+    return index_allocator_.GetUsed();
+  }
+
+private:
+  void UploadMeshStaged(const void* const* attrib_data, 
+                        const uint32_t* index_data, 
+                        const GeometryRange& range,
+                        GLuint staging_buffer_id) const;
+
+  void GrowVertexBuffers(uint32_t new_capacity);
+  void GrowIndexBuffer(uint32_t new_capacity);
+
+  void DestroyVertexArrays();
+
+  void FinishUploads();
+
+private:
+  GLuint vertex_buffer_ids_[kNumVertTypes] = {0, 0, 0, 0};
+  GLuint index_buffer_id_ = 0;
+
+  RangeAllocator vertex_allocator_;
+  RangeAllocator index_allocator_;
+
+  uint32_t generation_ = 0;
+
+  // Indexed by layout. Cleared whenever the buffers are reallocated
+  GLuint vao_ids_[kVertexLayoutAll + 1] = {};
+
+  AsyncUploader* uploader_ = nullptr;
+  GLStateCache* state_cache_ = nullptr;
+};
+
+inline void DrawGeometryRange(const GeometryRange& range) {
+  glDrawElementsBaseVertex(
+      GL_TRIANGLES, range.index_count, GL_UNSIGNED_INT,
+      reinterpret_cast<void*>(range.first_index * sizeof(uint32_t)),
+      range.base_vertex);
+}
+
+// Draws instance_count copies of the range. Shaders tell them apart with
+// gl_InstanceID
+inline void DrawGeometryRangeInstanced(const GeometryRange& range, 
+                                       GLsizei instance_count) {
+  glDrawElementsInstancedBaseVertex(
+      GL_TRIANGLES, range.index_count, GL_UNSIGNED_INT,
+      reinterpret_cast<void*>(range.first_index * sizeof(uint32_t)),
+      instance_count, range.base_vertex);
+}
+
+// Layout glMultiDrawElementsIndirect() reads its commands in. Ranges of the
+// pool become commands as is, since they are all drawn from the same index
+// buffer
+struct DrawElementsIndirectCommand {
+  uint32_t count = 0;
+  uint32_t instance_count = 0;
+  uint32_t first_index = 0;
+  int32_t base_vertex = 0;
+  uint32_t base_instance = 0;
+};
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, 
+              "DrawElementsIndirectCommand layout");
+
+inline DrawElementsIndirectCommand MakeDrawCommand(const GeometryRange& range,
+                                                   uint32_t instance_count,
+                                                   uint32_t base_instance) {
+  DrawElementsIndirectCommand command;
+  command.count = range.index_count;
+  command.instance_count = instance_count;
+  command.first_index = range.first_index;
+  command.base_vertex = range.base_vertex;
+  command.base_instance = base_instance;
+  return command;
+}
+
+// Draws num_commands consecutive commands from the buffer bound to
+// GL_DRAW_INDIRECT_BUFFER, starting offset bytes in
+inline void MultiDrawGeometryIndirect(GLintptr offset, GLsizei num_commands) {
+  glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 
+                              reinterpret_cast<const void*>(offset), 
+                              num_commands, 0);
+}
+
+// Same, with the number of commands read from the GLuint at count_offset in
+// the buffer bound to GL_PARAMETER_BUFFER, up to max_commands. Lets the GPU
+// decide how many commands it wrote
+inline void MultiDrawGeometryIndirectCount(GLintptr offset, 
+                                           GLintptr count_offset,
+                                           GLsizei max_commands) {
+  if (GLEW_VERSION_4_6) {
+    glMultiDrawElementsIndirectCount(
+        GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(offset), 
+        count_offset, max_commands, 0);
+  }
+  else {
+    glMultiDrawElementsIndirectCountARB(
+        GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(offset), 
+        count_offset, max_commands, 0);
+  }
+}
+
+// Multi-draw indirect passes need GL 4.3 for the draw call and shader
+// storage blocks, and shader draw parameters (core in 4.6) so shaders can
+// read gl_BaseInstance
+bool IsMultiDrawIndirectSupported();
+
+// GL 4.6 or ARB_indirect_parameters, on top of the above
+bool IsMultiDrawIndirectCountSupported();
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_GL_GEOMETRY_POOL_H_
\ No newline at end of file
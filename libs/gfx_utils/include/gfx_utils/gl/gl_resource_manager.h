@@ -1,61 +1,352 @@
 #ifndef GFX_UTILS_GL_GL_RESOURCE_MANAGER_H_
 #define GFX_UTILS_GL_GL_RESOURCE_MANAGER_H_
 
-#include <unordered_map>
-
 #include <GL/glew.h>
 #if defined(WIN32)
 #include <GL/gl.h>
 #endif
 
+#include <vector>
+
+#include "gfx_utils/handle.h"
 #include "gfx_utils/mesh.h"
 #include "gfx_utils/texture.h"
+#include "gfx_utils/range_allocator.h"
+#include "gfx_utils/gl/async_uploader.h"
+#include "gfx_utils/gl/block_buffer.h"
+#include "gfx_utils/gl/geometry_pool.h"
+#include "gfx_utils/gl/gpu_memory_tracker.h"
+#include "gfx_utils/gl/shader_blocks.h"
 #include "gfx_utils/scene/scene.h"
 
 namespace gfx_utils {
 
-enum VertType {
-  kVertTypePosition,
-  kVertTypeNormal,
-  kVertTypeTexcoord,
-  kVertTypeMtlId
+// Everything the GL side knows about a mesh
+struct MeshRecord {
+  MeshId mesh_id = 0;
+
+  // The model keeps the mesh alive for reloads and uploads in flight
+  ModelPtr model;
+  Mesh* mesh = nullptr;
+
+  GeometryRange range;
+
+  // Attributes that the mesh actually has data for. The rest read zeros
+  VertexLayout layout = 0;
+
+  // False while an asynchronous upload is in flight. The range is allocated
+  // but may not hold the mesh's data yet
+  bool is_uploaded = true;
+
+  // Evicted meshes have no range, and are reloaded from their CPU-side data
+  // the frame after they are next drawn
+  bool is_evicted = false;
+  bool is_reload_requested = false;
+
+  // Frame of the last GetMeshRange() call, for LRU eviction
+  uint64_t last_used_frame = 0;
+
+  size_t gpu_bytes = 0;
+
+  // The mesh's MaterialBlocks in the material buffer, in allocation units.
+  // Units are aligned for glBindBufferRange(), so a mesh's materials can be
+  // bound on their own. Not affected by eviction
+  uint32_t material_offset = 0;
+  uint32_t material_units = 0;
+  uint32_t num_materials = 0;
+};
+
+struct TextureRecord {
+  TextureId texture_id = 0;
+
+  TexturePtr texture;
+
+  // 0 while an asynchronous upload is in flight or after eviction
+  GLuint gl_id = 0;
+
+  bool is_uploaded = true;
+
+  // Evicted textures are reloaded from their CPU-side image, or from their
+  // file if the image was released
+  bool is_evicted = false;
+  bool is_reload_requested = false;
+
+  // Frame of the last GetTextureId() call, for LRU eviction
+  uint64_t last_used_frame = 0;
+
+  size_t gpu_bytes = 0;
+};
+
+struct CubemapRecord {
+  CubemapId cubemap_id = 0;
+
+  GLuint gl_id = 0;
+
+  // 0 if the cubemap wasn't prefiltered
+  GLuint specular_gl_id = 0;
+  GLuint irradiance_gl_id = 0;
+
+  size_t gpu_bytes = 0;
 };
 
 class GLResourceManager {
 public:
+  // Creates the GL resources of the assets added to the scene since the last
+  // call, recreates those of modified ones, and releases those of removed
+  // ones (see Scene::TakeChanges()). Only the changed assets are visited, so
+  // calling it after adding a model costs as much as that model.
+  //
+  // Without an uploader, uploads everything before returning. With one,
+  // only allocates and queues the uploads of meshes and textures; until
+  // they land, the getters below return a placeholder mesh and texture
   void CreateGLResources();
 
+  // Queues mesh and texture uploads on the uploader in CreateGLResources()
+  // instead of uploading them synchronously. Cubemaps are always uploaded
+  // synchronously
+  void SetUploader(AsyncUploader* uploader) {
+    uploader_ = uploader;
+    geometry_pool_.SetUploader(uploader);
+  }
+
+  // Call at the start of every frame. Processes finished uploads, reloads
+  // evicted assets that were drawn last frame, and evicts the least
+  // recently used meshes and textures while over the memory budget
+  void BeginFrame();
+
+  // Makes the meshes and textures whose uploads have finished drawable, and
+  // releases their CPU-side data. Called by BeginFrame(). Returns how many
+  // uploads completed
+  int ProcessUploads();
+
+  // Meshes and textures whose uploads haven't completed yet
+  int GetNumPendingUploads() const {
+    return uploader_ ? uploader_->GetNumPending() : 0;
+  }
+
   void Cleanup();
 
-  GLuint GetMeshVboId(MeshId id, VertType vert_type);
-  GLuint GetMeshIboId(MeshId id);
+  // Frees the CPU-side copies of uploaded meshes and textures in the scene
+  // according to each asset's residency policy. Each asset's copy is already
+  // freed as its upload completes, so this only matters after changing the
+  // policies. Images of textures that other scenes share through the
+  // TextureCache are kept, as those scenes may not have uploaded them yet.
+  // Returns the number of bytes reclaimed by this call
+  size_t ReleaseCpuData();
+
+  // Total bytes reclaimed by ReleaseCpuData() so far
+  size_t GetReclaimedCpuBytes() const {
+    return reclaimed_cpu_bytes_;
+  }
+
+  // Frees the mesh's space in the geometry pool so that it can be reused by
+  // meshes added later, and invalidates its handle
+  void RemoveMesh(Mesh* mesh);
+
+  // Deletes the texture's GL texture and invalidates its handle
+  void RemoveTexture(Texture* texture);
+
+  // Byte counts of everything this manager allocated. Apps add their render
+  // targets under kGpuMemoryRenderTarget so that the budget sees them
+  GpuMemoryTracker& GetMemoryTracker() {
+    return memory_tracker_;
+  }
+
+  // Meshes and textures not used in the previous frame are evicted, least
+  // recently used first, while the tracked total is over the budget.
+  // Evicted assets reload transparently when next drawn, so anything whose
+  // CPU-side data was released is read back from the GPU before eviction
+  // (textures with a source file are reloaded from it instead). 0 disables
+  // the budget
+  void SetMemoryBudget(size_t bytes);
+
+  // Assets evicted so far
+  uint32_t GetNumEvictions() const {
+    return num_evictions_;
+  }
+
+  // Return nullptr if the mesh has no GL resources in this manager (never
+  // created or removed). Records of other managers are in other pools
+  const MeshRecord* GetMeshRecord(const Mesh& mesh) const {
+    return meshes_.Get(mesh.gl_handles);
+  }
+
+  // Stamps the mesh as used this frame. Returns the placeholder mesh's range
+  // while the mesh is uploading or evicted
+  const GeometryRange* GetMeshRange(const Mesh& mesh) {
+    MeshRecord* record = meshes_.Get(mesh.gl_handles);
+    if (!record) {
+      return nullptr;
+    }
 
-  GLuint GetTextureId(TextureId id);
+    record->last_used_frame = frame_;
+
+    if (record->is_evicted) {
+      RequestReload(record, mesh.gl_handles.Find(meshes_.GetId()));
+      return &placeholder_range_;
+    }
+
+    return record->is_uploaded ? &record->range : &placeholder_range_;
+  }
+
+  // Binds the mesh's materials to a uniform block binding point, as an array
+  // of MaterialBlocks indexed by the mesh's material ids:
+  //   layout(std140) uniform Materials {
+  //     Material materials[MAX_MATERIALS_PER_BLOCK];
+  //   };
+  // The full kMaterialsBlockSize is bound, so ids past the mesh's own
+  // materials read other meshes' blocks. Returns false if the mesh has no
+  // materials
+  bool BindMaterials(const Mesh& mesh, 
+                     GLuint binding = kBlockBindingMaterials) const;
+
+  // Binds the whole material buffer, for passes that draw meshes with
+  // different materials in one call. target is GL_SHADER_STORAGE_BUFFER
+  // (which has no size limit) or GL_UNIFORM_BUFFER
+  void BindAllMaterials(GLenum target, GLuint binding) const;
+
+  // Index of the mesh's first MaterialBlock in the material buffer, for
+  // indexing it as a whole. Returns false if the mesh has no materials
+  bool GetFirstMaterialIndex(const Mesh& mesh, uint32_t* out_index) const;
+
+  // Rewrites the mesh's MaterialBlocks after its material list changed, in
+  // one buffer write
+  void UpdateMaterials(const Mesh& mesh);
+
+  // All meshes share the buffers of the pool
+  const GeometryPool& GetGeometryPool() const {
+    return geometry_pool_;
+  }
+
+  // VAO to draw any mesh's GeometryRange with. Cached per layout, so binding
+  // it is all a pass needs to do to set up its vertex attributes
+  GLuint GetVertexArrayId(VertexLayout layout) {
+    return geometry_pool_.GetVertexArrayId(layout);
+  }
+
+  // The GL ids below are 0 if there is no such resource
+
+  // Stamps the texture as used this frame. Returns the placeholder texture
+  // while the texture is uploading or evicted
+  GLuint GetTextureId(const Texture& texture) {
+    TextureRecord* record = textures_.Get(texture.gl_handles);
+    if (!record) {
+      return 0;
+    }
+
+    record->last_used_frame = frame_;
+
+    if (record->is_evicted) {
+      RequestReload(record, texture.gl_handles.Find(textures_.GetId()));
+      return placeholder_texture_id_;
+    }
+
+    return record->is_uploaded ? record->gl_id : placeholder_texture_id_;
+  }
+
+  // Looks the texture up in the scene by name first. Prefer the overload
+  // above (e.g. with Material::diffuse_texture) in per-draw code
   GLuint GetTextureId(const std::string& texname);
 
+  // Returns nullptr if the cubemap has no GL resources
+  const CubemapRecord* GetCubemapRecord(const Cubemap& cubemap) const {
+    return cubemaps_.Get(cubemap.gl_handles);
+  }
+
   GLuint GetCubemapId(const std::string& name);
 
+  // Specular mip chain and irradiance map of a prefiltered cubemap (see
+  // PrefilterCubemap()). Return 0 if the cubemap wasn't prefiltered
+  GLuint GetPrefilteredCubemapId(const std::string& name);
+  GLuint GetIrradianceCubemapId(const std::string& name);
+
   void SetScene(Scene* scene) {
     scene_ = scene;
   }
 
+  // The cache the frame's binds go through, if any. Invalidated when VAOs,
+  // buffers or textures that it may shadow are deleted, since GL hands their
+  // ids out again
+  void SetStateCache(GLStateCache* state_cache) {
+    state_cache_ = state_cache;
+    geometry_pool_.SetStateCache(state_cache);
+  }
+
 private:
-  void CreateMeshResources(const Mesh& mesh);
-  void CreateTextureResources(const Texture& texture);
-  void CreateCubemapResources(const Cubemap& cubemap);
+  // The model keeps the mesh alive while its upload is in flight
+  void CreateMeshResources(const ModelPtr& model, Mesh* mesh);
+  void CreateTextureResources(const TexturePtr& texture);
+  void CreateCubemapResources(Cubemap* cubemap);
+
+  // Uploads the record's data, synchronously or through the uploader.
+  // Meshes need their range allocated first
+  void UploadMesh(Handle handle);
+  void UploadTexture(Handle handle);
+
+  void CreatePlaceholders();
+
+  // Allocate room for, and write, the MaterialBlocks of the record's mesh
+  bool AllocateMaterials(MeshRecord* record);
+  void WriteMaterials(const MeshRecord& record);
+  void FreeMaterials(MeshRecord* record);
+
+  // Frees the asset's CPU-side copy once it is on the GPU
+  size_t ReleaseCpuData(MeshRecord* record);
+  size_t ReleaseCpuData(TextureRecord* record);
+  bool CanReleaseImage(const Texture& texture);
+
+  // Queues the reload of an evicted asset for the next BeginFrame()
+  void RequestReload(MeshRecord* record, Handle handle);
+  void RequestReload(TextureRecord* record, Handle handle);
+
+  void ReloadRequested();
+
+  void EvictMesh(MeshRecord* record);
+  void EvictTexture(TextureRecord* record);
+
+  void EnforceMemoryBudget();
+
+  const CubemapRecord* FindCubemapRecord(const std::string& name);
 
 private:
-  Scene* scene_;
+  Scene* scene_ = nullptr;
+
+  GLStateCache* state_cache_ = nullptr;
+
+  size_t reclaimed_cpu_bytes_ = 0;
+
+  HandlePool<MeshRecord> meshes_;
+  HandlePool<TextureRecord> textures_;
+  HandlePool<CubemapRecord> cubemaps_;
+
+  GeometryPool geometry_pool_;
+
+  // Materials of every mesh, sub-allocated in units of material_unit_size_
+  // bytes - the smallest multiple of sizeof(MaterialBlock) that meets the
+  // buffer offset alignment. kMaterialsBlockSize bytes of slack follow the
+  // last unit
+  BlockBuffer material_buffer_;
+  RangeAllocator material_allocator_;
+  size_t material_unit_size_ = 0;
+
+  AsyncUploader* uploader_ = nullptr;
+
+  // Stand-ins for meshes and textures that are uploading or evicted
+  GeometryRange placeholder_range_;
+  GLuint placeholder_texture_id_ = 0;
+  bool has_placeholders_ = false;
+
+  GpuMemoryTracker memory_tracker_;
+
+  uint64_t frame_ = 0;
 
-  std::unordered_map<TextureId, GLuint> texture_gl_id_map_;
-  std::unordered_map<CubemapId, GLuint> cubemap_gl_id_map_;
+  std::vector<Handle> mesh_reloads_;
+  std::vector<Handle> texture_reloads_;
 
-  std::unordered_map<MeshId, GLuint> mesh_pos_gl_id_map_;
-  std::unordered_map<MeshId, GLuint> mesh_normal_gl_id_map_;
-  std::unordered_map<MeshId, GLuint> mesh_texcoord_gl_id_map_;
-  std::unordered_map<MeshId, GLuint> mesh_mtl_id_gl_id_map_;
+  uint32_t num_evictions_ = 0;
 
-  std::unordered_map<MeshId, GLuint> mesh_ibo_gl_id_map_;
+  // Only warns once when even evicting everything idle isn't enough
+  bool has_warned_budget_ = false;
 };
 
 } // namespace gfx_utils
@@ -0,0 +1,146 @@
+#ifndef GFX_UTILS_GL_GL_STATE_CACHE_H_
+#define GFX_UTILS_GL_GL_STATE_CACHE_H_
+
+#include <cstdint>
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+namespace gfx_utils {
+
+struct GLStateCounters {
+  // Calls that reached GL
+  uint32_t issued = 0;
+  // Calls that were filtered out because the state was already set
+  uint32_t skipped = 0;
+};
+
+inline GLStateCounters operator-(const GLStateCounters& a,
+                                 const GLStateCounters& b) {
+  GLStateCounters result;
+  result.issued = a.issued - b.issued;
+  result.skipped = a.skipped - b.skipped;
+  return result;
+}
+
+// Shadows the GL binding state and drops calls that wouldn't change it.
+// Only tracks state that goes through the cache - after other code changes
+// bindings (or deletes a bound object) call Invalidate(). BeginFrame()
+// invalidates too, so resources can be created between frames without
+// going through the cache
+class GLStateCache {
+public:
+  static const int kMaxTextureUnits = 32;
+
+  GLStateCache();
+
+  // Resets the per-frame counters and forgets the shadowed state
+  void BeginFrame();
+
+  // Forgets the shadowed state so that the next call of each kind is issued
+  void Invalidate();
+
+  void UseProgram(GLuint program);
+
+  // Also forgets the element array buffer binding, which is VAO state
+  void BindVertexArray(GLuint vao);
+
+  void BindBuffer(GLenum target, GLuint buffer);
+
+  void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+  // unit is the index of the texture unit (0 for GL_TEXTURE0). Only issues
+  // glActiveTexture() when the binding actually changes
+  void BindTexture(GLuint unit, GLenum target, GLuint texture);
+
+  void ActiveTexture(GLuint unit);
+
+  void SetEnabled(GLenum cap, bool enabled);
+  void Enable(GLenum cap) {
+    SetEnabled(cap, true);
+  }
+  void Disable(GLenum cap) {
+    SetEnabled(cap, false);
+  }
+
+  void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+  // Counts since BeginFrame(). Take the difference of two snapshots to get
+  // the counts of a single pass
+  const GLStateCounters& GetCounters() const {
+    return counters_;
+  }
+
+  // Counts of the frame before the last BeginFrame()
+  const GLStateCounters& GetLastFrameCounters() const {
+    return last_frame_counters_;
+  }
+
+private:
+  enum BufferTarget {
+    kBufferTargetArray,
+    kBufferTargetElementArray,
+    kBufferTargetUniform,
+    kBufferTargetShaderStorage,
+    kBufferTargetDrawIndirect,
+    kBufferTargetDispatchIndirect,
+    kBufferTargetCopyRead,
+    kBufferTargetCopyWrite,
+    kBufferTargetPixelPack,
+    kBufferTargetPixelUnpack,
+    kNumBufferTargets
+  };
+
+  enum TextureTarget {
+    kTextureTarget2D,
+    kTextureTargetCubeMap,
+    kTextureTarget2DArray,
+    kTextureTarget3D,
+    kNumTextureTargets
+  };
+
+  enum Capability {
+    kCapabilityDepthTest,
+    kCapabilityCullFace,
+    kCapabilityBlend,
+    kCapabilityStencilTest,
+    kCapabilityScissorTest,
+    kCapabilityPolygonOffsetFill,
+    kCapabilityCubeMapSeamless,
+    kCapabilityFramebufferSrgb,
+    kNumCapabilities
+  };
+
+  // Return -1 for targets and capabilities that aren't tracked, whose calls
+  // are always issued
+  static int GetBufferTargetIndex(GLenum target);
+  static int GetTextureTargetIndex(GLenum target);
+  static int GetCapabilityIndex(GLenum cap);
+
+  // Returns true if the call needs to be issued, and records the new value
+  bool Update(GLuint* cached, GLuint value);
+
+private:
+  GLuint program_;
+  GLuint vao_;
+  GLuint buffers_[kNumBufferTargets];
+  GLuint draw_framebuffer_;
+  GLuint read_framebuffer_;
+  GLuint active_texture_unit_;
+  GLuint textures_[kMaxTextureUnits][kNumTextureTargets];
+
+  // Enable bits are stored as 0, 1 or unknown
+  GLuint capabilities_[kNumCapabilities];
+
+  GLint viewport_[4];
+  bool is_viewport_known_;
+
+  GLStateCounters counters_;
+  GLStateCounters last_frame_counters_;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_GL_GL_STATE_CACHE_H_
\ No newline at end of file
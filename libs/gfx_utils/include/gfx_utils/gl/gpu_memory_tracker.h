@@ -0,0 +1,70 @@
+#ifndef GFX_UTILS_GL_GPU_MEMORY_TRACKER_H_
+#define GFX_UTILS_GL_GPU_MEMORY_TRACKER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+namespace gfx_utils {
+
+enum GpuMemoryCategory {
+  kGpuMemoryMesh,
+  kGpuMemoryTexture,
+  kGpuMemoryRenderTarget,
+  kGpuMemoryCubemap,
+  kNumGpuMemoryCategories
+};
+
+const char* GetGpuMemoryCategoryName(GpuMemoryCategory category);
+
+// Estimated size of a texture level chain. Drivers usually pad 3-channel
+// 8-bit formats to 4 bytes per texel, so GL_RGB counts the same as GL_RGBA
+size_t CalcTextureByteSize(GLenum internal_format, uint32_t width, 
+                           uint32_t height, uint32_t num_levels = 1);
+
+// Dedicated video memory reported by the driver, or 0 if it doesn't expose
+// it (only NVX_gpu_memory_info and ATI_meminfo are queried)
+size_t QueryDedicatedVideoMemory();
+
+// Byte counts of GPU allocations, by category. The counts are only as good
+// as the Add()/Remove() calls made by whoever allocates
+class GpuMemoryTracker {
+public:
+  void Add(GpuMemoryCategory category, size_t bytes);
+  void Remove(GpuMemoryCategory category, size_t bytes);
+
+  size_t GetUsed(GpuMemoryCategory category) const {
+    return used_[category];
+  }
+
+  size_t GetTotalUsed() const;
+
+  // 0 means no budget
+  void SetBudget(size_t bytes) {
+    budget_ = bytes;
+  }
+
+  size_t GetBudget() const {
+    return budget_;
+  }
+
+  bool IsOverBudget() const {
+    return budget_ > 0 && GetTotalUsed() > budget_;
+  }
+
+  // Prints the usage of each category and the budget
+  void Report() const;
+
+private:
+  size_t used_[kNumGpuMemoryCategories] = {};
+
+  size_t budget_ = 0;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_GL_GPU_MEMORY_TRACKER_H_
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef GFX_UTILS_GL_HIZ_PYRAMID_H_
+#define GFX_UTILS_GL_HIZ_PYRAMID_H_
+
+#include <cstddef>
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+#include "gfx_utils/program.h"
+
+namespace gfx_utils {
+
+// Hierarchical depth pyramid of a depth texture, for occlusion culling on
+// the GPU. Level 0 is half the depth texture's size, and every texel of
+// every level holds the farthest depth of the texels it covers. A box whose
+// nearest depth is behind the texels under its screen rectangle is hidden,
+// and at the level where the rectangle spans two texels a side that is four
+// fetches. Odd sizes fold their last row or column into the texel before,
+// so a depth pixel p is always under texel p / 2^(level + 1), clamped to the
+// level's size.
+//
+// Build() reduces a level at a time with a compute shader (GL 4.3). It
+// changes the current program and the bindings of texture unit 0 and image
+// unit 0 directly, so invalidate a GLStateCache after it
+class HiZPyramid {
+public:
+  bool Initialize(int depth_width, int depth_height);
+  void Destroy();
+
+  // depth_tex_id is a depth_width x depth_height depth texture. It must be
+  // complete without mips (e.g. a GL_NEAREST min filter) and not compare
+  void Build(GLuint depth_tex_id);
+
+  // GL_R32F, with GetNumLevels() levels
+  GLuint GetTextureId() const {
+    return texture_id_;
+  }
+
+  int GetDepthWidth() const {
+    return depth_width_;
+  }
+
+  int GetDepthHeight() const {
+    return depth_height_;
+  }
+
+  int GetNumLevels() const {
+    return num_levels_;
+  }
+
+  // Of the whole level chain, for memory tracking
+  size_t GetByteSize() const;
+
+private:
+  Program program_;
+
+  GLuint texture_id_ = 0;
+
+  int depth_width_ = 0;
+  int depth_height_ = 0;
+
+  // Of level 0
+  int width_ = 0;
+  int height_ = 0;
+  int num_levels_ = 0;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_GL_HIZ_PYRAMID_H_
\ No newline at end of file
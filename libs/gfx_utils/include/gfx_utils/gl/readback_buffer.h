@@ -0,0 +1,69 @@
+#ifndef GFX_UTILS_GL_READBACK_BUFFER_H_
+#define GFX_UTILS_GL_READBACK_BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+namespace gfx_utils {
+
+// Reads results the GPU wrote to a buffer back to the CPU without stalling
+// it, the buffer to buffer counterpart of reading pixels into a PBO. Each
+// Copy() goes to one of kNumSlots readback buffers and is fenced. Poll()
+// only maps buffers whose fence has signaled, so the data arrives a frame
+// or two late but mapping never waits on the GPU. Copies made while every
+// slot is still in flight are dropped instead of waited on:
+//
+//   readback.Copy(counters_buffer_id, counters_offset);
+//   ...
+//   if (readback.Poll(&counters)) { ... }
+//
+// Copy() and Poll() bind GL_COPY_READ_BUFFER and GL_COPY_WRITE_BUFFER
+// directly, and leave them unbound
+class ReadbackBuffer {
+public:
+  static const int kNumSlots = 3;
+
+  // size is the bytes of each copy
+  bool Initialize(size_t size);
+  void Destroy();
+
+  // Copies GetSize() bytes of the buffer from offset. Shader writes to it
+  // need a glMemoryBarrier() with GL_BUFFER_UPDATE_BARRIER_BIT first.
+  // Returns false if every slot is in flight, and the copy is dropped
+  bool Copy(GLuint buffer_id, GLintptr offset);
+
+  // Copies the data of the latest Copy() the GPU has finished to out_data,
+  // and frees the slots of every finished copy. Returns false if none has
+  // finished since the last call
+  bool Poll(void* out_data);
+
+  size_t GetSize() const {
+    return size_;
+  }
+
+  // Copies dropped because no slot was free
+  uint32_t GetNumDropped() const {
+    return num_dropped_;
+  }
+
+private:
+  GLuint buffer_ids_[kNumSlots] = {};
+  GLsync fences_[kNumSlots] = {};
+
+  // The slots in flight, oldest first, wrapping around
+  int first_slot_ = 0;
+  int num_in_flight_ = 0;
+
+  size_t size_ = 0;
+
+  uint32_t num_dropped_ = 0;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_GL_READBACK_BUFFER_H_
\ No newline at end of file
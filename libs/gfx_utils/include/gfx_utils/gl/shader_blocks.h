@@ -0,0 +1,206 @@
+#ifndef GFX_UTILS_GL_SHADER_BLOCKS_H_
+#define GFX_UTILS_GL_SHADER_BLOCKS_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "gfx_utils/lights.h"
+#include "gfx_utils/material.h"
+#include "gfx_utils/program_variants.h"
+
+namespace gfx_utils {
+
+// Buffer binding points used by gfx_utils and its apps' shaders. Uniform and
+// shader storage bindings are separate, but they use the same numbers so a
+// block can move between the two without renumbering
+enum BlockBinding : GLuint {
+  kBlockBindingDrawTransforms = 0,
+  kBlockBindingMaterials = 1,
+  kBlockBindingPointLights = 2,
+  kBlockBindingSpotlights = 3,
+  kBlockBindingDraws = 4
+};
+
+// Smallest GL_MAX_UNIFORM_BLOCK_SIZE an implementation may have. The array
+// sizes below keep blocks within it, so shaders can declare them as is
+static const size_t kMinUniformBlockSize = 16384;
+
+// The structs below mirror the GLSL structs of the same name member for
+// member. Every vec3 is padded to a vec4 and every struct is a multiple of
+// 16 bytes, which makes the std140 and std430 layouts identical:
+//
+//   struct Material {
+//     vec4 ambient_color;
+//     vec4 diffuse_color;
+//     vec4 specular_color;
+//     vec4 emission_color;
+//     float shininess;
+//     bool has_ambient_tex;
+//     bool has_diffuse_tex;
+//     bool has_specular_tex;
+//   };
+//
+//   struct PointLight {
+//     vec4 position;
+//     vec4 diffuse_intensity;
+//     vec4 specular_intensity;
+//   };
+//
+//   struct Spotlight {
+//     vec4 position;
+//     vec4 diffuse_intensity;
+//     vec4 specular_intensity;
+//     vec4 direction;
+//     float cone_angle;
+//   };
+//
+// Samplers can't live in buffers, so materials only flag which textures
+// they have, and the textures are bound to texture units as before
+
+struct MaterialBlock {
+  glm::vec4 ambient_color;
+  glm::vec4 diffuse_color;
+  glm::vec4 specular_color;
+  glm::vec4 emission_color;
+
+  float shininess = 0.f;
+
+  // GLSL bools are 4 bytes in both layouts
+  int32_t has_ambient_tex = 0;
+  int32_t has_diffuse_tex = 0;
+  int32_t has_specular_tex = 0;
+};
+
+struct PointLightBlock {
+  glm::vec4 position;
+  glm::vec4 diffuse_intensity;
+  glm::vec4 specular_intensity;
+};
+
+struct SpotlightBlock {
+  glm::vec4 position;
+  glm::vec4 diffuse_intensity;
+  glm::vec4 specular_intensity;
+  glm::vec4 direction;
+
+  float cone_angle = 0.f;
+  float padding[3] = {0.f, 0.f, 0.f};
+};
+
+// Precedes the array in light blocks:
+//   layout(std140) uniform PointLights {
+//     int num_point_lights;
+//     PointLight point_lights[kMaxPointLightsPerBlock];
+//   };
+// The array starts at the next multiple of 16
+struct LightBlockHeader {
+  int32_t num_lights = 0;
+  int32_t padding[3] = {0, 0, 0};
+};
+
+// Per-draw data of multi-draw indirect passes. Each command's base instance
+// is the index of its DrawBlock, so the block is found with gl_BaseInstance,
+// which unlike gl_DrawID keeps counting across draw calls. Only used in
+// std430 storage blocks:
+//   struct Draw {
+//     uint first_instance;
+//     uint first_material;
+//   };
+//   layout(std430) readonly buffer Draws {
+//     Draw draws[];
+//   };
+// first_instance indexes the pass's per-instance data (add gl_InstanceID)
+// and first_material the whole material buffer (add the vertex's material
+// id), see GLResourceManager::BindAllMaterials()
+struct DrawBlock {
+  uint32_t first_instance = 0;
+  uint32_t first_material = 0;
+};
+
+static_assert(sizeof(MaterialBlock) == 80, "MaterialBlock layout");
+static_assert(sizeof(PointLightBlock) == 48, "PointLightBlock layout");
+static_assert(sizeof(SpotlightBlock) == 80, "SpotlightBlock layout");
+static_assert(sizeof(LightBlockHeader) == 16, "LightBlockHeader layout");
+static_assert(sizeof(DrawBlock) == 8, "DrawBlock layout");
+
+// Array sizes for GLSL declarations of uniform blocks. Shaders get them as
+// MAX_MATERIALS_PER_BLOCK and so on from GetShaderBlockDefines()
+static const uint32_t kMaxMaterialsPerBlock = 
+    kMinUniformBlockSize / sizeof(MaterialBlock);
+static const uint32_t kMaxPointLightsPerBlock = 
+    (kMinUniformBlockSize - sizeof(LightBlockHeader)) / sizeof(PointLightBlock);
+static const uint32_t kMaxSpotlightsPerBlock = 
+    (kMinUniformBlockSize - sizeof(LightBlockHeader)) / sizeof(SpotlightBlock);
+
+// Byte sizes of the blocks declared with those arrays. A uniform block has to
+// be bound with at least its declared size, even if only part of it is read
+static const size_t kMaterialsBlockSize = 
+    kMaxMaterialsPerBlock * sizeof(MaterialBlock);
+static const size_t kPointLightsBlockSize = 
+    sizeof(LightBlockHeader) + kMaxPointLightsPerBlock * sizeof(PointLightBlock);
+static const size_t kSpotlightsBlockSize = 
+    sizeof(LightBlockHeader) + kMaxSpotlightsPerBlock * sizeof(SpotlightBlock);
+
+// #defines of the array sizes above, for Program::SetDefines() and
+// ProgramVariants::SetDefines():
+//   #define MAX_MATERIALS_PER_BLOCK 204
+//   #define MAX_POINT_LIGHTS_PER_BLOCK 341
+//   #define MAX_SPOTLIGHTS_PER_BLOCK 204
+std::string GetShaderBlockDefines();
+
+MaterialBlock MakeMaterialBlock(const Material& material);
+PointLightBlock MakePointLightBlock(const PointLight& light);
+SpotlightBlock MakeSpotlightBlock(const Spotlight& light);
+
+// Lay out a whole light block (header and array) in out_data, ready for one
+// buffer write. out_data is the block's full size (kPointLightsBlockSize or
+// kSpotlightsBlockSize), so a buffer sized to it can be bound as is. Lights
+// past the block's capacity are dropped with a warning
+void FillPointLightsBlock(
+    const std::vector<std::shared_ptr<PointLight>>& lights,
+    std::vector<uint8_t>* out_data);
+void FillSpotlightsBlock(
+    const std::vector<std::shared_ptr<Spotlight>>& lights,
+    std::vector<uint8_t>* out_data);
+
+// Program variant features for a set of materials drawn together, e.g. a
+// mesh's. "Any" is set if some material has the texture, and "All" if every
+// one does, with "Any". AddMaterialFeatures() defines them as ANY_AMBIENT_TEX,
+// ALL_AMBIENT_TEX and so on, so shaders can drop the texture when no
+// material has it and the has_*_tex branch when every material does:
+//
+//   #if defined(ALL_AMBIENT_TEX)
+//     ambient *= texture(ambient_texture, frag_texcoord).rgb;
+//   #elif defined(ANY_AMBIENT_TEX)
+//     if (materials[frag_mtl_id].has_ambient_tex) { ... }
+//   #endif
+//
+// Takes the low bits of the feature mask. Apps put their own features above
+// kMaterialFeatureBits
+enum MaterialFeature : uint32_t {
+  kMaterialFeatureAnyAmbientTex = 1 << 0,
+  kMaterialFeatureAllAmbientTex = 1 << 1,
+  kMaterialFeatureAnyDiffuseTex = 1 << 2,
+  kMaterialFeatureAllDiffuseTex = 1 << 3,
+  kMaterialFeatureAnySpecularTex = 1 << 4,
+  kMaterialFeatureAllSpecularTex = 1 << 5
+};
+
+static const int kMaterialFeatureBits = 6;
+
+uint32_t CalcMaterialFeatures(const std::vector<Material>& materials);
+
+void AddMaterialFeatures(ProgramVariants* variants);
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_GL_SHADER_BLOCKS_H_
\ No newline at end of file
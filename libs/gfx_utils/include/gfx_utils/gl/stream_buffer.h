@@ -0,0 +1,146 @@
+#ifndef GFX_UTILS_GL_STREAM_BUFFER_H_
+#define GFX_UTILS_GL_STREAM_BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <vector>
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+namespace gfx_utils {
+
+// Block of a StreamBuffer's current frame region. data is write-only memory
+// (it may be uncached and write-combined), so fill it with memcpy or plain
+// stores and never read it back
+struct StreamAllocation {
+  void* data = nullptr;
+
+  // Offset from the start of the buffer, as passed to glBindBufferRange()
+  GLintptr offset = 0;
+  GLsizeiptr size = 0;
+};
+
+// Streams per-frame uniform or shader storage data to the GPU.
+//
+// With GL 4.4 (or ARB_buffer_storage) the buffer is created with
+// glBufferStorage() and stays persistently and coherently mapped. It is split
+// into kNumRegions regions used round-robin, one per frame, and each region
+// is fenced at the end of its frame so the CPU only waits when it gets more
+// than kNumRegions - 1 frames ahead of the GPU.
+//
+// Without it, allocations go to a CPU staging copy which Flush() uploads
+// into an orphaned buffer with glBufferData().
+//
+// Allocate() is thread-safe, so per-draw data can be written from worker
+// threads. Everything else must be called on the GL thread:
+//
+//   stream.BeginFrame();
+//   ... Allocate() and fill the blocks ...
+//   stream.Flush();
+//   ... glBindBufferRange() / BindRange() and draw ...
+//   stream.EndFrame();
+class StreamBuffer {
+public:
+  static const int kNumRegions = 3;
+
+  // target is GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER and decides the
+  // alignment of allocations. region_size is the most data one frame can
+  // allocate, including alignment padding (see CalcRegionSize()).
+  // max_bind_size is the largest size passed to the sized BindRange(), which
+  // the buffer is padded for
+  bool Initialize(GLenum target, size_t region_size, 
+                  size_t max_bind_size = 0);
+  void Destroy();
+
+  // Alignment of the offsets of the target's indexed bindings, which every
+  // allocation starts on. Needs a current context
+  static size_t GetOffsetAlignment(GLenum target);
+
+  // Region size that fits num_blocks allocations of block_size bytes, each
+  // padded to the target's offset alignment
+  static size_t CalcRegionSize(GLenum target, size_t block_size, 
+                               size_t num_blocks);
+
+  // Moves to the next region, waiting for the GPU to finish the frame that
+  // last used it
+  void BeginFrame();
+
+  // Makes everything allocated so far visible to subsequently issued GL
+  // commands. Only does work on the fallback path
+  void Flush();
+
+  // Fences the frame's region
+  void EndFrame();
+
+  // Returns false if the frame's region is full
+  bool Allocate(size_t size, StreamAllocation* out_allocation);
+
+  // Binds the block to an indexed binding point of the buffer's target
+  void BindRange(GLuint binding, const StreamAllocation& allocation) const;
+
+  // Binds size bytes from the start of the block, for uniform blocks
+  // declared larger than the data allocated for them. Binding less than the
+  // declared size is undefined. size is at most Initialize()'s
+  // max_bind_size, and what lies past the block is whatever else the buffer
+  // holds
+  void BindRange(GLuint binding, const StreamAllocation& allocation, 
+                 size_t size) const;
+
+  GLuint GetBufferId() const {
+    return buffer_id_;
+  }
+
+  bool IsPersistentlyMapped() const {
+    return is_persistent_;
+  }
+
+  size_t GetRegionSize() const {
+    return region_size_;
+  }
+
+  // Bytes allocated in the current frame, including alignment padding
+  size_t GetUsed() const {
+    return used_.load();
+  }
+
+  // Frames in which BeginFrame() had to block on the GPU
+  uint32_t GetNumStalls() const {
+    return num_stalls_;
+  }
+
+private:
+  void WaitForRegion(int region);
+
+private:
+  GLenum target_ = GL_UNIFORM_BUFFER;
+  GLuint buffer_id_ = 0;
+
+  bool is_persistent_ = false;
+
+  size_t region_size_ = 0;
+  size_t alignment_ = 256;
+
+  // Padding past the last region, so sized binds stay inside the buffer
+  size_t max_bind_size_ = 0;
+
+  // Persistent path. Start of the mapping and one fence per region
+  uint8_t* mapped_data_ = nullptr;
+  GLsync fences_[kNumRegions] = {};
+  int region_ = 0;
+
+  // Fallback path. The frame's data, uploaded on Flush()
+  std::vector<uint8_t> staging_data_;
+  size_t flushed_size_ = 0;
+
+  std::atomic<size_t> used_{0};
+
+  uint32_t num_stalls_ = 0;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_GL_STREAM_BUFFER_H_
\ No newline at end of file
@@ -0,0 +1,228 @@
+#ifndef GFX_UTILS_HANDLE_H_
+#define GFX_UTILS_HANDLE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+
+namespace gfx_utils {
+
+// Refers to a record in a HandlePool. The generation detects handles to
+// records that were removed, even if their slot was reused since, and the
+// pool id detects handles to records of another pool
+struct Handle {
+  static const uint32_t kInvalidIndex = 0xffffffff;
+
+  uint32_t index = kInvalidIndex;
+  uint32_t generation = 0;
+
+  // 0 is no pool
+  uint32_t pool = 0;
+
+  bool IsValid() const {
+    return index != kInvalidIndex;
+  }
+};
+
+// Handles of an asset that has records in several pools, one per pool. A
+// texture shared between scenes through a TextureCache, for example, has a
+// record in each scene's GLResourceManager
+class HandleList {
+public:
+  // Handle() if the pool has no record of the asset
+  Handle Find(uint32_t pool) const {
+    for (const Handle& handle : handles_) {
+      if (handle.pool == pool) {
+        return handle;
+      }
+    }
+    return Handle();
+  }
+
+  // Replaces the handle of the same pool, if there is one
+  void Set(Handle handle) {
+    for (Handle& existing : handles_) {
+      if (existing.pool == handle.pool) {
+        existing = handle;
+        return;
+      }
+    }
+    handles_.push_back(handle);
+  }
+
+  void Remove(uint32_t pool) {
+    for (size_t i = 0; i < handles_.size(); ++i) {
+      if (handles_[i].pool == pool) {
+        handles_[i] = handles_.back();
+        handles_.pop_back();
+        return;
+      }
+    }
+  }
+
+private:
+  // Usually one
+  std::vector<Handle> handles_;
+};
+
+// Ids of the pools, from 1
+inline uint32_t NextHandlePoolId() {
+  static std::atomic<uint32_t> next_id(1);
+  return next_id++;
+}
+
+// Dense array of records addressed by generational handles. Lookups are an
+// index, a generation and a pool id compare, and stale, invalid or foreign
+// handles return nullptr instead of creating an entry. Slots of removed
+// records are reused
+template <typename T>
+class HandlePool {
+public:
+  HandlePool() : id_(NextHandlePoolId()) {}
+
+  // A copy would accept the original's handles
+  HandlePool(const HandlePool&) = delete;
+  HandlePool& operator=(const HandlePool&) = delete;
+
+  uint32_t GetId() const {
+    return id_;
+  }
+
+  Handle Add(const T& record) {
+    Handle handle;
+    handle.pool = id_;
+
+    if (!free_indices_.empty()) {
+      handle.index = free_indices_.back();
+      free_indices_.pop_back();
+    }
+    else {
+      handle.index = static_cast<uint32_t>(slots_.size());
+      slots_.push_back(Slot());
+    }
+
+    Slot& slot = slots_[handle.index];
+    slot.record = record;
+    slot.is_alive = true;
+
+    handle.generation = slot.generation;
+
+    ++size_;
+
+    return handle;
+  }
+
+  // Returns false if the handle was stale
+  bool Remove(Handle handle) {
+    if (!Get(handle)) {
+      return false;
+    }
+
+    Slot& slot = slots_[handle.index];
+    slot.record = T();
+    slot.is_alive = false;
+
+    // Invalidates every outstanding handle to the slot
+    ++slot.generation;
+
+    free_indices_.push_back(handle.index);
+    --size_;
+
+    return true;
+  }
+
+  T* Get(Handle handle) {
+    if (handle.pool != id_ || handle.index >= slots_.size()) {
+      return nullptr;
+    }
+
+    Slot& slot = slots_[handle.index];
+    if (!slot.is_alive || slot.generation != handle.generation) {
+      return nullptr;
+    }
+
+    return &slot.record;
+  }
+
+  const T* Get(Handle handle) const {
+    return const_cast<HandlePool*>(this)->Get(handle);
+  }
+
+  // The record of this pool's handle in the list
+  T* Get(const HandleList& handles) {
+    return Get(handles.Find(id_));
+  }
+
+  const T* Get(const HandleList& handles) const {
+    return Get(handles.Find(id_));
+  }
+
+  // Removes the record of this pool's handle in the list, and the handle
+  bool Remove(HandleList* handles) {
+    bool is_removed = Remove(handles->Find(id_));
+    handles->Remove(id_);
+    return is_removed;
+  }
+
+  // Calls func(T&) on every live record
+  template <typename Func>
+  void ForEach(Func func) {
+    for (Slot& slot : slots_) {
+      if (slot.is_alive) {
+        func(slot.record);
+      }
+    }
+  }
+
+  // Calls func(Handle, T&) on every live record
+  template <typename Func>
+  void ForEachWithHandle(Func func) {
+    for (uint32_t i = 0; i < slots_.size(); ++i) {
+      Slot& slot = slots_[i];
+      if (slot.is_alive) {
+        Handle handle;
+        handle.index = i;
+        handle.generation = slot.generation;
+        handle.pool = id_;
+        func(handle, slot.record);
+      }
+    }
+  }
+
+  void Clear() {
+    // Bump the generations rather than dropping the slots so that handles
+    // from before the clear stay stale
+    for (uint32_t i = 0; i < slots_.size(); ++i) {
+      if (slots_[i].is_alive) {
+        Handle handle;
+        handle.index = i;
+        handle.generation = slots_[i].generation;
+        handle.pool = id_;
+        Remove(handle);
+      }
+    }
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+private:
+  struct Slot {
+    T record = T();
+    uint32_t generation = 0;
+    bool is_alive = false;
+  };
+
+  uint32_t id_;
+
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> free_indices_;
+
+  size_t size_ = 0;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_HANDLE_H_
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef GFX_UTILS_HASH_H_
+#define GFX_UTILS_HASH_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace gfx_utils {
+
+// Fast non-cryptographic 64-bit hash (xxHash64 algorithm). Used to identify
+// asset files by their contents
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+using NameHash = uint64_t;
+
+static const NameHash kNameHashBasis = 14695981039346656037ULL;
+static const NameHash kNameHashPrime = 1099511628211ULL;
+
+// FNV-1a hash of a short null-terminated name, such as a shader uniform's.
+// constexpr so that literal names can be hashed at compile time:
+//   constexpr NameHash kMvpMat = HashName("mvp_mat");
+// Passing a previous hash as the seed continues it, so the result is the
+// hash of the concatenated names
+constexpr NameHash HashName(const char* name, NameHash seed = kNameHashBasis) {
+  return *name == '\0' ? seed : 
+      HashName(name + 1, (seed ^ static_cast<uint8_t>(*name)) * kNameHashPrime);
+}
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_HASH_H_
\ No newline at end of file
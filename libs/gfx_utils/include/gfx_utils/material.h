@@ -29,6 +29,13 @@ struct Material {
   std::string ambient_texname;
   std::string diffuse_texname;
   std::string specular_texname;
+
+  // Resolved from the texnames when the scene loads the model, so binding a
+  // material doesn't need to look textures up by name. nullptr if the
+  // material has no such texture or it failed to load
+  TexturePtr ambient_texture;
+  TexturePtr diffuse_texture;
+  TexturePtr specular_texture;
 };
 
 }
@@ -8,7 +8,9 @@
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
+#include "handle.h"
 #include "material.h"
+#include "residency.h"
 
 namespace gfx_utils {
 
@@ -35,6 +37,21 @@ struct Mesh {
   bool is_textured = false;
   glm::vec3 color = kDefaultMeshColor;
 
+  ResidencyPolicy residency = kResidencyKeep;
+
+  // Object space bounding box and sphere of pos_data, set by
+  // ComputeMeshBounds(). ModelLoader and the primitives compute them, and
+  // GLResourceManager fills in any that are missing, so they outlive the
+  // vertex data
+  glm::vec3 bounds_min = glm::vec3(0.f);
+  glm::vec3 bounds_max = glm::vec3(0.f);
+  glm::vec3 bounds_center = glm::vec3(0.f);
+  float bounds_radius = 0.f;
+  bool has_bounds = false;
+
+  // Records of the mesh's GL resources, one per GLResourceManager
+  HandleList gl_handles;
+
   // Constructor to assign the id
   Mesh();
 };
@@ -45,6 +62,15 @@ using MeshList = std::vector<std::shared_ptr<Mesh>>;
 
 void ClearMesh(Mesh *mesh);
 
+// Bounds the positions with a box, and with a sphere centered on the box,
+// which is close to the smallest sphere for most meshes and takes two
+// passes over the positions
+void ComputeMeshBounds(Mesh* mesh);
+
+// Frees the vertex data that the policy doesn't keep. Returns the number of
+// bytes freed
+size_t ReleaseMeshData(Mesh* mesh, ResidencyPolicy policy);
+
 }
 
 #endif
\ No newline at end of file
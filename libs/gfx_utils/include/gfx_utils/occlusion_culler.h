@@ -0,0 +1,223 @@
+#ifndef GFX_UTILS_OCCLUSION_CULLER_H_
+#define GFX_UTILS_OCCLUSION_CULLER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace gfx_utils {
+
+// Software occlusion culling. Occluder triangles are rasterized on the CPU
+// into a small depth buffer, and occludees are tested against it by the
+// screen space rectangle and nearest depth of their bounding boxes. Needs
+// no GL, so it can be run and inspected without a GPU.
+//
+// The depth buffer is split into kTileWidth x kTileHeight tiles, stored one
+// after the other so each tile is contiguous. RasterizeOccluders() sets up
+// and bins the occluders' triangles, then rasterizes the tiles, both spread
+// over worker threads. Rows of a tile are rasterized eight pixels at a time
+// with AVX, four with SSE, or one at a time where neither is targeted (see
+// GFX_UTILS_AVX in gfx_utils' CMakeLists) or SIMD is turned off. Each tile
+// also keeps its farthest depth, so most occludees are rejected without
+// touching its pixels.
+//
+// Depth is window space z in [0, 1] as with glDepthRange(0, 1), nearest
+// wins. Occluders are sampled at pixel centers like a GPU rasterizer, so
+// occludees only covered at occluder edges can be culled by a pixel's worth.
+// Occluder triangles crossing the near plane are dropped, which only loses
+// occlusion:
+//
+//   culler.BeginFrame(proj_mat * view_mat);
+//   for (...) {
+//     culler.AddOccluder(mesh.pos_data, mesh.index_data, model_mat);
+//   }
+//   culler.RasterizeOccluders();
+//   if (culler.TestBox(mesh.bounds_min, mesh.bounds_max, model_mat)) { ... }
+class OcclusionCuller {
+public:
+  static const int kTileWidth = 32;
+  static const int kTileHeight = 16;
+
+  ~OcclusionCuller();
+
+  // width and height must be multiples of the tile size. The calling
+  // thread works alongside num_threads - 1 workers; 0 uses one thread per
+  // hardware thread
+  bool Initialize(int width, int height, uint32_t num_threads = 0);
+  void Destroy();
+
+  // Clears the occluders and statistics of the last frame
+  void BeginFrame(const glm::mat4& view_proj_mat);
+
+  // Triangles of positions, as indexed by indices or, if there are no
+  // indices, of consecutive vertices. The vectors are read by
+  // RasterizeOccluders(), so they must live until it returns
+  void AddOccluder(const std::vector<glm::vec3>& positions,
+                   const std::vector<uint32_t>& indices,
+                   const glm::mat4& model_mat);
+
+  void RasterizeOccluders();
+
+  // Returns false if the box moved by model_mat is hidden behind the
+  // occluders, or outside the screen. Boxes crossing the near plane are
+  // always visible
+  bool TestBox(const glm::vec3& min, const glm::vec3& max,
+               const glm::mat4& model_mat);
+
+  int GetWidth() const {
+    return width_;
+  }
+
+  int GetHeight() const {
+    return height_;
+  }
+
+  // Depth of pixel (x, y), with y = 0 at the bottom as in GL
+  float GetDepth(int x, int y) const;
+
+  uint32_t GetNumThreads() const {
+    return static_cast<uint32_t>(workers_.size()) + 1;
+  }
+
+  // Of the current frame
+
+  uint32_t GetNumOccluderTriangles() const {
+    return num_occluder_triangles_;
+  }
+
+  uint32_t GetNumTested() const {
+    return num_tested_;
+  }
+
+  uint32_t GetNumOccluded() const {
+    return num_occluded_;
+  }
+
+  float GetOccludedFraction() const {
+    return num_tested_ > 0 ?
+        static_cast<float>(num_occluded_) / num_tested_ : 0.f;
+  }
+
+  // Wall clock time of the last RasterizeOccluders()
+  double GetRasterizeMs() const {
+    return rasterize_ms_;
+  }
+
+  // Pixels of a row rasterized and tested at once: 8, 4 or 1
+  static int GetSimdWidth();
+
+  // Off rasterizes and tests a pixel at a time, which gives the same depths
+  // and results, e.g. to check the SIMD loops against
+  void SetSimdEnabled(bool is_enabled) {
+    is_simd_enabled_ = is_enabled;
+  }
+
+  bool IsSimdEnabled() const {
+    return is_simd_enabled_;
+  }
+
+private:
+  struct Occluder {
+    const std::vector<glm::vec3>* positions = nullptr;
+    const std::vector<uint32_t>* indices = nullptr;
+    glm::mat4 mvp_mat;
+  };
+
+  // Set up for rasterization in window space, with pixel centers at
+  // half-integer coordinates. Inside is where all three edge functions
+  // a * x + b * y + c are non-negative
+  struct Triangle {
+    float edge_a[3];
+    float edge_b[3];
+    float edge_c[3];
+
+    // z = z_c + z_dx * x + z_dy * y
+    float z_c;
+    float z_dx;
+    float z_dy;
+
+    // Inclusive pixel bounds, clamped to the screen
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+  };
+
+  // Each thread sets up triangles into its own list and bins, so binning
+  // needs no locks. Triangle order doesn't matter to a nearest depth test
+  struct ThreadBins {
+    std::vector<Triangle> triangles;
+
+    // Per tile, indices into triangles
+    std::vector<std::vector<uint32_t>> tiles;
+
+    // Clip space positions of the occluder being set up
+    std::vector<glm::vec4> clip_positions;
+  };
+
+  using ParallelFunc = std::function<void(uint32_t item, uint32_t thread)>;
+
+  // Runs func(item, thread) for items [0, num_items) on the calling thread
+  // (thread 0) and the workers
+  void RunParallel(uint32_t num_items, const ParallelFunc& func);
+  void RunItems(uint32_t thread);
+  void WorkerMain(uint32_t thread);
+
+  void SetupOccluder(const Occluder& occluder, ThreadBins* bins);
+
+  // Ops is the SIMD or the scalar set of operations
+  template <typename Ops>
+  void RasterizeTile(uint32_t tile);
+
+  // Whether any pixel of the tile in [x0, x1] x [y0, y1] is at or behind
+  // depth
+  template <typename Ops>
+  bool IsTileRectVisible(uint32_t tile, int x0, int y0, int x1, int y1,
+                         float depth) const;
+
+private:
+  int width_ = 0;
+  int height_ = 0;
+  int num_tiles_x_ = 0;
+  int num_tiles_y_ = 0;
+
+  std::vector<float> depth_;
+  std::vector<float> tile_max_depth_;
+
+  glm::mat4 view_proj_mat_;
+
+  std::vector<Occluder> occluders_;
+  std::vector<ThreadBins> thread_bins_;
+
+  uint32_t num_occluder_triangles_ = 0;
+  uint32_t num_tested_ = 0;
+  uint32_t num_occluded_ = 0;
+  double rasterize_ms_ = 0.0;
+
+  bool is_simd_enabled_ = true;
+
+  // Workers sleep until job_generation_ changes, then take items until
+  // there are none left
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable job_cv_;
+  std::condition_variable done_cv_;
+  uint64_t job_generation_ = 0;
+  uint32_t num_busy_workers_ = 0;
+  bool should_quit_ = false;
+
+  const ParallelFunc* job_func_ = nullptr;
+  uint32_t job_num_items_ = 0;
+  std::atomic<uint32_t> next_item_{0};
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_OCCLUSION_CULLER_H_
\ No newline at end of file
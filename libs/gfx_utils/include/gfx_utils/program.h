@@ -6,35 +6,95 @@
 #include <GL/gl.h>
 #endif
 
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include <glm/matrix.hpp>
 
+#include "gfx_utils/hash.h"
+
 namespace gfx_utils {
 
+class Program;
+
 // Don't create directly. Use only when a Program object returns a Uniform
-// class
+// class. Cheap to copy, so render loops can fetch the uniforms they set once
+// at setup and keep them. Setting a uniform the program doesn't have does
+// nothing.
+//
+// The program keeps a copy of each uniform's last value, and Set() only calls
+// glUniform when the value changes. Uniform values are program state, so the
+// copy stays valid across glUseProgram() calls, but set uniforms only through
+// this class, with the program current.
+//
+// A Uniform is only valid until its program is destroyed or created again.
+// Setting a stale one asserts, and does nothing in release builds. The
+// Program object itself has to outlive it
 class Uniform {
 public:
+  Uniform() {}
+
+  bool IsValid() const;
+
   void Set(bool val);
   void Set(int val);
   void Set(float val);
   void Set(const glm::vec3& val);
+  void Set(const glm::vec4& val);
   void Set(const glm::mat3& val);
   void Set(const glm::mat4& val);
 
 private:
-  Uniform(GLint location) { location_ = location; }
+  Uniform(const Program* program, GLint location, uint32_t shadow_index,
+          uint32_t generation) 
+      : program_(program), location_(location), 
+        shadow_index_(shadow_index), generation_(generation) {}
+
+  // Updates the program's copy. False if the value is unchanged
+  bool IsChanged(const void* value, size_t size) const;
 
 private:
-  GLint location_;
+  const Program* program_ = nullptr;
+  GLint location_ = -1;
+  uint32_t shadow_index_ = 0;
+
+  // Program::generation_ when the uniform was looked up
+  uint32_t generation_ = 0;
 
 private:
   friend class Program;
 };
 
+struct UniformCounters {
+  // glUniform calls made
+  uint32_t issued = 0;
+  // Sets that were dropped because the uniform already had the value
+  uint32_t skipped = 0;
+};
+
+// Linked programs are cached on disk with glGetProgramBinary(), keyed by the
+// hash of their sources and the GL vendor, renderer and version strings.
+// Later runs load the binary instead of compiling, and fall back to
+// compiling from source if it is missing or the driver rejects it
 class Program {
 public:
+  // Directory where program binaries are cached, for all programs. It is
+  // created on the first write. Empty disables the cache. Defaults to
+  // kDefaultCacheDirectory
+  static void SetBinaryCacheDirectory(const std::string& directory);
+
+  // KHR_parallel_shader_compile, or the ARB version
+  static bool IsParallelCompileSupported();
+
+  // Lines of #defines inserted after the #version line of every shader the
+  // program is created from, e.g. GetShaderBlockDefines(). Set before
+  // creating the program
+  void SetDefines(const std::string& defines) {
+    defines_ = defines;
+  }
+
   bool CreateFromFiles(const std::string& vert_shader_path, 
                        const std::string& frag_shader_path,
                        const std::string& geom_shader_path = "");
@@ -43,22 +103,203 @@ public:
                         const std::string& geom_shader_src = "");
   void Destroy();
 
+  // Compute programs (GL 4.3). They aren't put in the binary cache
+  bool CreateComputeFromFile(const std::string& comp_shader_path);
+  bool CreateComputeFromSource(const std::string& comp_shader_src);
+
+  // Split versions of the above, for creating many programs at once (see
+  // ProgramBatch). Begin submits the compiles and the link without asking
+  // for their status, so the driver can keep working on them while more
+  // programs are submitted. FinishCreate() waits for the link, reports
+  // errors and completes the program. Begin only fails if a file is missing
+  bool BeginCreateFromFiles(const std::string& vert_shader_path, 
+                            const std::string& frag_shader_path,
+                            const std::string& geom_shader_path = "");
+  bool BeginCreateFromSource(const std::string& vert_shader_src, 
+                             const std::string& frag_shader_src,
+                             const std::string& geom_shader_src = "");
+  bool FinishCreate();
+
+  // True if FinishCreate() won't block. Without KHR_parallel_shader_compile
+  // there is no way to tell, and this is always true
+  bool IsCreateComplete() const;
+
   // e.g. program.GetUniform("mvp_mat").Set(...)
-  Uniform GetUniform(const std::string& var);
-  Uniform GetUniform(const std::string& array, int index);
-  Uniform GetUniform(const std::string& array, int index, 
-                     const std::string& var);
+  //
+  // The program's active uniforms are reflected once when it links, so
+  // these are lookups in a table sorted by name hash, and don't allocate or
+  // call into GL. Array elements are found with the index overloads, e.g.
+  // GetUniform("materials", i, "ambient_color") for materials[i].ambient_color
+  Uniform GetUniform(const char* var) const;
+  Uniform GetUniform(const char* array, int index) const;
+  Uniform GetUniform(const char* array, int index, const char* var) const;
+
+  // With a hash computed at compile time, e.g. 
+  // GetUniform(HashName("mvp_mat"))
+  Uniform GetUniform(NameHash var_hash) const;
+
+  // Assigns the uniform block to a buffer binding point, to be filled with
+  // glBindBufferRange(). Returns false if the program has no such block
+  bool BindUniformBlock(const std::string& block, GLuint binding);
+
+  // Same for shader storage blocks (GL 4.3)
+  bool BindShaderStorageBlock(const std::string& block, GLuint binding);
 
   GLuint GetProgramId() const { return program_id_; }
 
+  bool IsCreated() const { return is_created_; }
+
+  // True if the last Create call loaded a cached binary
+  bool IsFromBinaryCache() const { return is_from_binary_cache_; }
+
+  // Counts of Uniform::Set() calls on this program since it was created or
+  // the counters were last reset
+  const UniformCounters& GetUniformCounters() const {
+    return uniform_counters_;
+  }
+
+  void ResetUniformCounters() {
+    uniform_counters_ = UniformCounters();
+  }
+
 private:
+  struct UniformEntry {
+    NameHash name_hash;
+    GLint location;
+
+    // Names that share a location (e.g. "x" and "x[0]") share a shadow
+    uint32_t shadow_index;
+  };
+
+  // Big enough for the largest type Uniform can set, a mat4
+  static const size_t kMaxUniformValueSize = 64;
+
+  // Last value set through a Uniform. size is 0 until the first set, since
+  // the program's initial values aren't read back
+  struct UniformShadow {
+    uint8_t size = 0;
+    uint8_t value[kMaxUniformValueSize];
+  };
+
+  // Issues the compiles and the link without waiting on either
+  void SubmitFromSource(const std::string& vert_shader_src, 
+                        const std::string& frag_shader_src,
+                        const std::string& geom_shader_src);
+
+  // Print the info log on failure
+  static bool CheckCompileStatus(GLuint shader_id);
+  static bool CheckLinkStatus(GLuint program_id);
+
+  // Needs GL 4.1 or ARB_get_program_binary, and a driver with at least one
+  // binary format
+  static bool IsBinaryCacheSupported();
+
+  static std::string GetBinaryCachePath(const std::string& vert_shader_src, 
+                                        const std::string& frag_shader_src,
+                                        const std::string& geom_shader_src);
+
+  bool LoadBinary(const std::string& path, GLuint* out_program_id);
+  void SaveBinary(const std::string& path);
+
   bool LoadShaderSource(std::string* out_str, const std::string& path);
-  bool CompilerShader(GLuint shader_id, const char* shader_src);
+
+  // Fills uniforms_ and uniform_shadows_ from the linked program
+  void ReflectUniforms();
+  void AddUniform(const std::string& name, GLint location);
+
+  // See Uniform::IsChanged()
+  bool UpdateUniformShadow(uint32_t shadow_index, const void* value, 
+                           size_t size) const;
 
 private:
   GLuint program_id_;
 
-  bool is_created_;
+  // Sorted by name hash
+  std::vector<UniformEntry> uniforms_;
+
+  // One per uniform location. A cache of GL state, so Uniforms update it
+  // through const programs
+  mutable std::vector<UniformShadow> uniform_shadows_;
+  mutable UniformCounters uniform_counters_;
+
+  // Bumped whenever uniforms_ is cleared, so Uniforms handed out before can
+  // tell they are stale
+  uint32_t generation_ = 0;
+
+  bool is_created_ = false;
+
+  bool is_from_binary_cache_ = false;
+
+  std::string defines_;
+
+  // Between BeginCreate and FinishCreate()
+  bool is_pending_ = false;
+  std::vector<GLuint> pending_shader_ids_;
+  std::string pending_cache_path_;
+
+  static std::string binary_cache_directory_;
+
+private:
+  friend class Uniform;
+};
+
+// Returns the shader source with the lines of defines inserted right after
+// its #version line, which has to stay first
+std::string InsertShaderDefines(const std::string& src, 
+                                const std::string& defines);
+
+// Creates a project's programs together. Every program's compiles and link
+// are submitted before any status is queried, so drivers that compile in the
+// background overlap them, and with KHR_parallel_shader_compile they run on
+// several threads and Finish() completes programs in the order they finish.
+// Programs loaded from the binary cache are ready as soon as they are added.
+//
+//   ProgramBatch batch;
+//   batch.AddFiles(&geom_program, "geometry pass", ...);
+//   batch.AddFiles(&light_program, "light pass", ...);
+//   if (!batch.Finish()) { ... }
+class ProgramBatch {
+public:
+  // The name labels the program in the timing report. Return false if a
+  // shader file is missing
+  bool AddFiles(Program* program, const std::string& name,
+                const std::string& vert_shader_path, 
+                const std::string& frag_shader_path,
+                const std::string& geom_shader_path = "");
+  bool AddSource(Program* program, const std::string& name,
+                 const std::string& vert_shader_src, 
+                 const std::string& frag_shader_src,
+                 const std::string& geom_shader_src = "");
+
+  // Completes every program added, then prints how long each one took from
+  // being added until it was ready, and the time for the whole batch. With
+  // parallel compiles the per-program times overlap. Returns false if any
+  // program failed, or failed to be added
+  bool Finish();
+
+private:
+  struct Entry {
+    Program* program = nullptr;
+    std::string name;
+
+    std::chrono::steady_clock::time_point begin_time;
+    std::chrono::steady_clock::time_point end_time;
+
+    bool is_finished = false;
+    bool is_created = false;
+  };
+
+  void AddEntry(Program* program, const std::string& name,
+                std::chrono::steady_clock::time_point begin_time);
+
+  void PrintReport(std::chrono::steady_clock::time_point end_time) const;
+
+private:
+  std::vector<Entry> entries_;
+
+  std::chrono::steady_clock::time_point begin_time_;
+
+  bool has_failed_ = false;
 };
 
 } // namespace gfx_utils
@@ -0,0 +1,116 @@
+#ifndef GFX_UTILS_PROGRAM_VARIANTS_H_
+#define GFX_UTILS_PROGRAM_VARIANTS_H_
+
+#include <GL/glew.h>
+#if defined(WIN32)
+#include <GL/gl.h>
+#endif
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gfx_utils/program.h"
+
+namespace gfx_utils {
+
+// A feature that variants are specialized on, as part of a bitmask. A mask
+// with one bit is a flag, #defined without a value when the bit is set. A
+// mask with several contiguous bits is a field (e.g. a light count), always
+// #defined to its value
+struct ShaderFeature {
+  uint32_t mask;
+  std::string define;
+};
+
+// Permutations of one program, specialized with #defines so that branches on
+// features a draw doesn't use compile out. Variants are keyed by a feature
+// bitmask, compiled the first time they are asked for and kept until
+// Destroy(). Their sources differ, so each variant also gets its own entry in
+// the program binary cache.
+//
+//   variants.CreateFromFiles("geometry pass", vert_path, frag_path);
+//   variants.AddFeature(kFeatureTextured, "TEXTURED");
+//   variants.AddFeature(kLightCountMask, "NUM_LIGHTS");
+//   ...
+//   Program* program = variants.GetVariant(features);
+class ProgramVariants {
+public:
+  // Runs once for each variant after it is created, with the variant's
+  // program current. Sets up what uniforms can't change afterwards, like
+  // sampler units and uniform block bindings
+  using SetupFunc = std::function<void(Program& program)>;
+
+  // Only stores the sources. The name labels the variants in reports
+  bool CreateFromFiles(const std::string& name,
+                       const std::string& vert_shader_path, 
+                       const std::string& frag_shader_path,
+                       const std::string& geom_shader_path = "");
+  void CreateFromSource(const std::string& name,
+                        const std::string& vert_shader_src, 
+                        const std::string& frag_shader_src,
+                        const std::string& geom_shader_src = "");
+
+  // Destroys every variant
+  void Destroy();
+
+  void AddFeature(uint32_t mask, const std::string& define);
+
+  // Lines of #defines that every variant gets ahead of its feature defines,
+  // e.g. GetShaderBlockDefines()
+  void SetDefines(const std::string& defines) {
+    defines_ = defines;
+  }
+
+  void SetSetupFunc(SetupFunc setup) {
+    setup_ = std::move(setup);
+  }
+
+  // Compiles the variants that don't exist yet in one ProgramBatch, so
+  // startup doesn't compile them one at a time as draws first need them.
+  // Returns false if any failed
+  bool Precompile(const std::vector<uint32_t>& features_list);
+
+  // Compiles the variant on first use, which stalls. Returns nullptr if it
+  // failed to compile. Failed variants aren't retried
+  Program* GetVariant(uint32_t features);
+
+  // The lines inserted after #version for the variant
+  std::string GetDefines(uint32_t features) const;
+
+  size_t GetNumVariants() const {
+    return variants_.size();
+  }
+
+private:
+  struct Variant {
+    Program program;
+    bool is_created = false;
+  };
+
+  std::string GetSource(const std::string& src, uint32_t features) const;
+  std::string GetVariantName(uint32_t features) const;
+
+  void SetupVariant(Variant* variant);
+
+private:
+  std::string name_;
+
+  std::string vert_shader_src_;
+  std::string frag_shader_src_;
+  std::string geom_shader_src_;
+
+  std::vector<ShaderFeature> features_;
+  std::string defines_;
+
+  SetupFunc setup_;
+
+  // Nodes don't move, so Program pointers stay valid as variants are added
+  std::map<uint32_t, Variant> variants_;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_PROGRAM_VARIANTS_H_
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef GFX_UTILS_RANGE_ALLOCATOR_H_
+#define GFX_UTILS_RANGE_ALLOCATOR_H_
+
+#include <cstdint>
+#include <map>
+
+namespace gfx_utils {
+
+// First-fit free-list allocator over an abstract range of [0, capacity)
+// elements. Only hands out offsets - the caller owns the storage. Adjacent
+// free blocks are merged when a range is freed
+class RangeAllocator {
+public:
+  explicit RangeAllocator(uint32_t capacity = 0);
+
+  // Returns false if there is no free block large enough
+  bool Allocate(uint32_t size, uint32_t* out_offset);
+
+  void Free(uint32_t offset, uint32_t size);
+
+  // Extends the range to new_capacity. Shrinking is not supported
+  void Grow(uint32_t new_capacity);
+
+  void Clear();
+
+  uint32_t GetCapacity() const {
+    return capacity_;
+  }
+
+  uint32_t GetUsed() const {
+    return used_;
+  }
+
+  // Size of the largest free block, which bounds the largest allocation that
+  // can succeed without growing
+  uint32_t GetLargestFreeBlock() const;
+
+private:
+  uint32_t capacity_ = 0;
+  uint32_t used_ = 0;
+
+  // Maps the offset of each free block to its size
+  std::map<uint32_t, uint32_t> free_blocks_;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_RANGE_ALLOCATOR_H_
\ No newline at end of file
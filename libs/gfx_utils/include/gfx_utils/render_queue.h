@@ -0,0 +1,173 @@
+#ifndef GFX_UTILS_RENDER_QUEUE_H_
+#define GFX_UTILS_RENDER_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace gfx_utils {
+
+// Fields of a render queue sort key, from most to least significant:
+//
+//   | pass (4) | program (12) | material (16) | texture set (12) | depth (20) |
+//
+// so a sorted queue is grouped by pass, then program, then material, then
+// textures, and each group is drawn in depth order. Apps decide what the
+// fields mean - e.g. a material can be a mesh's whole material range
+enum RenderKeyField : uint32_t {
+  kRenderKeyPass = 1 << 0,
+  kRenderKeyProgram = 1 << 1,
+  kRenderKeyMaterial = 1 << 2,
+  kRenderKeyTextureSet = 1 << 3,
+  kRenderKeyDepth = 1 << 4,
+
+  kRenderKeyAll = 0x1f
+};
+
+static const int kRenderKeyPassBits = 4;
+static const int kRenderKeyProgramBits = 12;
+static const int kRenderKeyMaterialBits = 16;
+static const int kRenderKeyTextureSetBits = 12;
+static const int kRenderKeyDepthBits = 20;
+
+static const int kRenderKeyDepthShift = 0;
+static const int kRenderKeyTextureSetShift = 
+    kRenderKeyDepthShift + kRenderKeyDepthBits;
+static const int kRenderKeyMaterialShift = 
+    kRenderKeyTextureSetShift + kRenderKeyTextureSetBits;
+static const int kRenderKeyProgramShift = 
+    kRenderKeyMaterialShift + kRenderKeyMaterialBits;
+static const int kRenderKeyPassShift = 
+    kRenderKeyProgramShift + kRenderKeyProgramBits;
+
+static_assert(kRenderKeyPassShift + kRenderKeyPassBits == 64, 
+              "Render key fields must fill 64 bits");
+
+struct RenderItem {
+  uint64_t key;
+
+  // Whatever the app needs to find the draw again, e.g. an index into its
+  // own array of draws
+  uint32_t payload;
+};
+
+// Dense ids for the objects behind a key field, e.g. GL program or texture
+// names, which are too big to pack as they are. Ids are handed out in order
+// of first use. Once the field is full, every new object gets the field's
+// all-ones value, which RenderQueue::Submit() treats as a change on every
+// item, so overflowing costs state changes but never draws with the wrong
+// state
+class RenderKeyIds {
+public:
+  explicit RenderKeyIds(int num_bits);
+
+  uint32_t GetId(uint64_t object);
+
+  // Call once per frame so ids stay dense
+  void Clear() {
+    ids_.clear();
+  }
+
+private:
+  uint32_t overflow_id_;
+
+  std::unordered_map<uint64_t, uint32_t> ids_;
+};
+
+// Draw items of one or more passes, sorted by key so that state only changes
+// between groups of draws that need it:
+//
+//   queue.Clear();
+//   queue.Push(RenderQueue::MakeKey(...), draw_index);
+//   ...
+//   queue.Sort();
+//   queue.Submit([&](uint32_t payload, uint32_t changed_fields) {
+//     if (changed_fields & kRenderKeyProgram) { ... bind the program ... }
+//     ...
+//     ... draw ...
+//   });
+class RenderQueue {
+public:
+  // Fields are masked to their widths. Keys with the all-ones value of a
+  // field always count as changed in that field (see RenderKeyIds)
+  static uint64_t MakeKey(uint32_t pass, uint32_t program, uint32_t material,
+                          uint32_t texture_set, uint32_t depth);
+
+  // Maps view space depth between the clip planes linearly onto the depth
+  // field, nearest first, for front to back order. Subtract the result from
+  // GetMaxDepth() for back to front
+  static uint32_t QuantizeDepth(float depth, float near_plane, 
+                                float far_plane);
+
+  static uint32_t GetMaxDepth() {
+    return (1u << kRenderKeyDepthBits) - 1;
+  }
+
+  // The fields that differ between two keys, as RenderKeyFields
+  static uint32_t CalcChangedFields(uint64_t prev_key, uint64_t key);
+
+  void Clear() {
+    items_.clear();
+  }
+
+  void Reserve(size_t num_items) {
+    items_.reserve(num_items);
+    scratch_.reserve(num_items);
+  }
+
+  void Push(uint64_t key, uint32_t payload) {
+    RenderItem item;
+    item.key = key;
+    item.payload = payload;
+    items_.push_back(item);
+  }
+
+  // Stable LSD radix sort on the key, one byte per pass. Histograms for all
+  // the bytes are built in a single read of the items, and bytes that are
+  // the same in every key (e.g. the pass in a single pass queue) are skipped
+  void Sort();
+
+  // Calls func(payload, changed_fields) for every item in order, where
+  // changed_fields are the RenderKeyFields that differ from the previous
+  // item. All of them are set for the first item
+  template <typename Func>
+  void Submit(Func func) const {
+    uint64_t prev_key = 0;
+
+    for (size_t i = 0; i < items_.size(); ++i) {
+      const RenderItem& item = items_[i];
+
+      uint32_t changed_fields = 
+          i == 0 ? kRenderKeyAll : CalcChangedFields(prev_key, item.key);
+      func(item.payload, changed_fields);
+
+      prev_key = item.key;
+    }
+  }
+
+  const std::vector<RenderItem>& GetItems() const {
+    return items_;
+  }
+
+  size_t GetSize() const {
+    return items_.size();
+  }
+
+  // Byte passes the last Sort() made, out of 8
+  int GetNumSortPasses() const {
+    return num_sort_passes_;
+  }
+
+private:
+  std::vector<RenderItem> items_;
+
+  // Ping-pong buffer for the sort passes
+  std::vector<RenderItem> scratch_;
+
+  int num_sort_passes_ = 0;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_RENDER_QUEUE_H_
\ No newline at end of file
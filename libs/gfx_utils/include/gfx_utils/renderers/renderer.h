@@ -4,6 +4,7 @@
 #include "gfx_utils/window/camera.h"
 #include "gfx_utils/window/window.h"
 #include "gfx_utils/gl/gl_resource_manager.h"
+#include "gfx_utils/gl/gl_state_cache.h"
 
 namespace gfx_utils {
 
@@ -15,15 +16,18 @@ public:
   virtual void Render(const EntityList& entities) = 0;
 
   void SetResourceManager(GLResourceManager* manager);
+  void SetStateCache(GLStateCache* state_cache);
   void SetWindow(Window* window);
   void SetCamera(Camera* camera);
 
   GLResourceManager* GetResourceManager();
+  GLStateCache* GetStateCache();
   Window* GetWindow();
   Camera* GetCamera();
 
 private:
   GLResourceManager* resource_manager_;
+  GLStateCache* state_cache_;
   Window* window_;
   Camera* camera_;
 };
@@ -1,16 +1,33 @@
 #ifndef GFX_UTILS_RENDERERS_SIMPLE_RENDERER_H_
 #define GFX_UTILS_RENDERERS_SIMPLE_RENDERER_H_
 
+#include <vector>
+
 #include <GL/glew.h>
 #if defined(WIN32)
 #include <GL/gl.h>
 #endif
 
+#include "gfx_utils/frustum_culler.h"
 #include "gfx_utils/renderers/renderer.h"
-#include "gfx_utils/program.h"
+#include "gfx_utils/program_variants.h"
+#include "gfx_utils/render_queue.h"
+#include "gfx_utils/gl/stream_buffer.h"
 
 namespace gfx_utils {
 
+// Draws each mesh with its materials' ambient, diffuse and emission colors.
+// Meshes outside the view frustum are culled before they are queued.
+//
+// Entities sharing a model draw the same meshes with the same materials, so
+// the visible draws of one mesh are instanced: their matrices go to the
+// DrawTransforms block and the mesh is drawn once for all of them.
+//
+// Where multi-draw indirect is supported (see IsMultiDrawIndirectSupported())
+// each mesh's instances are one indirect command, drawn with one
+// glMultiDrawElementsIndirect() per program and texture set, reading their
+// matrices and materials from shader storage. Otherwise each mesh is one
+// instanced draw call per uniform block of matrices
 class SimpleRenderer : public Renderer {
 public:
   bool Initialize() override;
@@ -18,17 +35,94 @@ public:
 
   void Render(const EntityList& entities) override;
 
+  bool IsIndirect() const {
+    return is_indirect_;
+  }
+
+  // Of the last frame
+  uint32_t GetNumDrawCalls() const {
+    return num_draw_calls_;
+  }
+
+  // Fraction of the mesh instances frustum culled in the last frame
+  float GetCulledFraction() const {
+    return culler_.GetCulledFraction();
+  }
+
 private:
-  void SetTransformUniforms_Mesh(gfx_utils::Mesh& mesh,
-                                 glm::mat4& model_mat,
-                                 glm::mat4& view_mat,
-                                 glm::mat4& proj_mat);
-  void SetMaterialUniforms_Mesh(gfx_utils::Mesh& mesh);
+  struct Draw {
+    const Program* program = nullptr;
+    const Mesh* mesh = nullptr;
+    const GeometryRange* range = nullptr;
+
+    glm::mat4 mvp_mat;
+
+    GLuint ambient_tex_id = 0;
+    GLuint diffuse_tex_id = 0;
+
+    uint64_t key = 0;
+  };
+
+  // Consecutive queued draws of the same mesh, drawn as instances. Their
+  // matrices are [first_instance, first_instance + num_instances) of
+  // instance_mvp_mats_
+  struct Run {
+    const Draw* draw = nullptr;
+    uint32_t changed_fields = 0;
+
+    uint32_t first_instance = 0;
+    uint32_t num_instances = 0;
+  };
+
+  // Consecutive indirect commands with the same program and textures
+  struct Group {
+    const Draw* draw = nullptr;
+    uint32_t changed_fields = 0;
+
+    uint32_t first_command = 0;
+    uint32_t num_commands = 0;
+  };
+
+  bool InitializeIndirect();
+
+  // Splits the sorted queue into runs of at most max_instances
+  void CollectRuns(uint32_t max_instances);
+
+  void SubmitDirect();
+  void SubmitIndirect();
+
+  void BindDrawState(const Draw& draw, uint32_t changed_fields);
 
 private:
-  Program program_;
+  // Specialized on the material features of each mesh
+  ProgramVariants program_variants_;
+
+  // Matrices of the direct path, a DrawTransforms block per draw call
+  StreamBuffer transforms_buffer_;
+
+  bool is_indirect_ = false;
+
+  // Same features, for the indirect path
+  ProgramVariants indirect_variants_;
+
+  // Matrices, draw blocks and commands of the indirect path
+  StreamBuffer stream_buffer_;
+  std::vector<Group> groups_;
+
+  uint32_t num_draw_calls_ = 0;
+
+  // Rebuilt every frame. The culler holds a box per draw, and the queue
+  // the indices of the visible draws
+  std::vector<Draw> draws_;
+  FrustumCuller culler_;
+  RenderQueue queue_;
+
+  std::vector<Run> runs_;
+  std::vector<glm::mat4> instance_mvp_mats_;
 
-  GLuint vao_id_;
+  RenderKeyIds program_ids_{kRenderKeyProgramBits};
+  RenderKeyIds material_ids_{kRenderKeyMaterialBits};
+  RenderKeyIds texture_set_ids_{kRenderKeyTextureSetBits};
 };
 
 } // namespace gfx_utils
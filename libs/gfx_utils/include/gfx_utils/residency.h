@@ -0,0 +1,28 @@
+#ifndef GFX_UTILS_RESIDENCY_H_
+#define GFX_UTILS_RESIDENCY_H_
+
+#include <string>
+
+namespace gfx_utils {
+
+// What CPU-side data an asset keeps after its GL resources are created.
+// Ordered from least to most resident
+enum ResidencyPolicy {
+  kResidencyDropAfterUpload,
+  // Meshes keep their positions and indices (e.g. for picking and culling).
+  // Textures treat this the same as kResidencyDropAfterUpload
+  kResidencyKeepPositions,
+  kResidencyKeep
+};
+
+inline ResidencyPolicy MostResident(ResidencyPolicy a, ResidencyPolicy b) {
+  return a > b ? a : b;
+}
+
+// Parses "keep", "drop" or "positions". Returns false if the string is none
+// of them
+bool ParseResidencyPolicy(const std::string& str, ResidencyPolicy* out_policy);
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_RESIDENCY_H_
\ No newline at end of file
@@ -7,7 +7,9 @@
 #include <memory>
 
 #include "model_loader.h"
+#include "texture_cache.h"
 
+#include "gfx_utils/bvh.h"
 #include "gfx_utils/lights.h"
 #include "gfx_utils/model.h"
 #include "gfx_utils/entity.h"
@@ -17,7 +19,6 @@ namespace gfx_utils {
 
 using ModelPtr = std::shared_ptr<Model>;
 using EntityPtr = std::shared_ptr<Entity>;
-using TexturePtr = std::shared_ptr<Texture>;
 using CubemapPtr = std::shared_ptr<Cubemap>;
 using LightPtr = std::shared_ptr<Light>;
 
@@ -33,12 +34,97 @@ using TextureNameMap = std::unordered_map<std::string, TexturePtr>;
 using CubemapNameMap = std::unordered_map<std::string, CubemapPtr>;
 using LightNameMap = std::unordered_map<std::string, LightPtr>;
 
+// A mesh whose vertex data was changed after it was added to the scene. The
+// model keeps the mesh alive until the change is consumed
+struct MeshChange {
+  ModelPtr model;
+  Mesh* mesh = nullptr;
+};
+
+// Everything added, removed or modified since the last TakeChanges() call,
+// so that GLResourceManager only has to look at those assets instead of
+// walking the whole scene
+struct SceneChanges {
+  ModelList added_models;
+  ModelList removed_models;
+  std::vector<MeshChange> modified_meshes;
+
+  std::vector<TexturePtr> added_textures;
+  std::vector<TexturePtr> removed_textures;
+  std::vector<TexturePtr> modified_textures;
+
+  std::vector<CubemapPtr> added_cubemaps;
+
+  bool IsEmpty() const {
+    return added_models.empty() && removed_models.empty() &&
+        modified_meshes.empty() && added_textures.empty() &&
+        removed_textures.empty() && modified_textures.empty() &&
+        added_cubemaps.empty();
+  }
+};
+
 class Scene {
 public:
+  Scene();
+  ~Scene();
+
+  // Entities in the BVH point back at the scene's list of moved entities,
+  // so a copied or moved scene would leave them reporting to the old one
+  Scene(const Scene&) = delete;
+  Scene& operator=(const Scene&) = delete;
+  Scene(Scene&&) = delete;
+  Scene& operator=(Scene&&) = delete;
+
   bool LoadSceneFromJson(const std::string& path);
 
+  // Also adds the entity's model, and any textures its materials point to
+  // that the scene doesn't have yet. Texnames without a texture are looked up
+  // among the scene's textures, or loaded relative to the working directory
   void AddEntity(EntityPtr entity);
 
+  // Leaves the entity's model in the scene
+  bool RemoveEntity(const std::string& name);
+
+  // Removes the model along with the entities using it, and the textures
+  // that no other model uses any more
+  bool RemoveModel(const std::string& name);
+
+  // Call after changing a mesh's vertex or index data, or a texture's image,
+  // so that the GPU copy is updated
+  void MarkMeshModified(ModelPtr model, Mesh* mesh);
+  void MarkTextureModified(const std::string& name);
+
+  // Moves the changes made since the last call into out_changes. Loading
+  // counts as adding everything loaded. Only one consumer (normally the
+  // scene's GLResourceManager) should take the changes
+  void TakeChanges(SceneChanges* out_changes);
+
+  // Brings the BVH over the entities' world space bounds up to date. The
+  // entities moved since the last call (and every entity with a parent, as
+  // its parent may have moved) are refit. Adding or removing entities,
+  // modifying meshes, or refits degrading the tree rebuild it. Call once a
+  // frame before querying
+  void UpdateBvh();
+
+  // Primitive i of the BVH is the entity GetBvhEntity(i), or nullptr if
+  // the entity was removed since the last UpdateBvh()
+  const Bvh& GetBvh() const {
+    return bvh_;
+  }
+
+  Entity* GetBvhEntity(uint32_t prim) const {
+    return bvh_entities_[prim];
+  }
+
+  uint32_t GetNumBvhRebuilds() const {
+    return num_bvh_rebuilds_;
+  }
+
+  // Share a texture cache between scenes so that textures are deduplicated
+  // across them. Must be set before loading
+  void SetTextureCache(std::shared_ptr<TextureCache> texture_cache);
+  std::shared_ptr<TextureCache> GetTextureCache();
+
   const ModelList& GetModels();
   const EntityList& GetEntities();
 
@@ -60,6 +146,24 @@ private:
     LightPtr ptr;
   };
 
+  // Points the model's materials at the textures named by their texnames,
+  // loading the ones the scene doesn't have yet through the texture cache.
+  // Materials that already point at a texture are left alone
+  void ResolveTextures(const ModelPtr& model, 
+                       const std::string& tex_directory);
+
+  // Counts the model's material references to textures, adding textures
+  // the scene doesn't know yet under their texname
+  void AddTextureRefs(const ModelPtr& model);
+
+  // Textures whose count drops to zero are removed from the scene
+  void RemoveTextureRefs(const ModelPtr& model);
+
+  void RebuildBvh();
+
+  // Stops tracking the entity's moves and schedules a rebuild
+  void RemoveFromBvh(Entity* entity);
+
 private:
   ModelNameMap models_;
   EntityNameMap entities_;    
@@ -71,7 +175,27 @@ private:
   EntityList entities_list_;
   std::vector<LightListEntry> lights_list_;
 
+  // Number of material texture slots that point to each texture
+  std::unordered_map<const Texture*, uint32_t> texture_refs_;
+
+  SceneChanges changes_;
+
+  Bvh bvh_;
+  std::vector<Entity*> bvh_entities_;
+
+  // Entities with a parent, refit whenever anything moved
+  std::vector<Entity*> bvh_child_entities_;
+
+  // Build input, kept to reuse its memory
+  std::vector<Aabb> bvh_boxes_;
+
+  EntityMoveList moved_entities_;
+  bool is_bvh_dirty_ = true;
+  uint32_t num_bvh_rebuilds_ = 0;
+
   ModelLoader model_loader_;
+
+  std::shared_ptr<TextureCache> texture_cache_;
 };
 
 template<typename T>
@@ -0,0 +1,66 @@
+#ifndef GFX_UTILS_SCENE_TEXTURE_CACHE_H_
+#define GFX_UTILS_SCENE_TEXTURE_CACHE_H_
+
+#include <string>
+#include <unordered_map>
+
+#include "gfx_utils/texture.h"
+
+namespace gfx_utils {
+
+struct TextureCacheStats {
+  // Number of distinct images that were decoded
+  size_t num_decoded = 0;
+
+  // Number of requests that resolved to an already decoded image, either
+  // by path or because the file contents were identical
+  size_t num_aliased = 0;
+
+  // Decoded image bytes (and hence texture upload bytes) that did not have to
+  // be duplicated because of aliasing
+  size_t saved_bytes = 0;
+};
+
+// Loads textures and deduplicates them by the hash of their source file
+// bytes, so identical images under different names (or in different models)
+// share one decoded Texture. Can be shared between scenes with
+// Scene::SetTextureCache().
+//
+// A texture's CPU-side image may only be released once every scene holding
+// it has uploaded it, so scenes count themselves in with AddSceneRef() and
+// GLResourceManager keeps the image of textures held by several scenes
+class TextureCache {
+public:
+  // Returns nullptr if the file could not be read or decoded. A texture that
+  // is shared by several requests keeps the most resident of their policies
+  TexturePtr LoadTexture(const std::string& tex_directory,
+                         const std::string& texname,
+                         ResidencyPolicy residency = kResidencyKeep);
+
+  // Called by Scene as a texture enters and leaves it
+  void AddSceneRef(const Texture* texture);
+  void RemoveSceneRef(const Texture* texture);
+
+  // Scenes currently holding the texture. 0 for textures set up by hand
+  uint32_t GetNumSceneRefs(const Texture& texture) const;
+
+  const TextureCacheStats& GetStats() const {
+    return stats_;
+  }
+
+private:
+  // Maps the file contents hash to the texture decoded from it
+  std::unordered_map<ContentHash, TexturePtr> hash_map_;
+
+  // Maps the file path to the texture loaded from it so that requesting the
+  // same file again doesn't even need to read it
+  std::unordered_map<std::string, TexturePtr> path_map_;
+
+  std::unordered_map<const Texture*, uint32_t> scene_refs_;
+
+  TextureCacheStats stats_;
+};
+
+} // namespace gfx_utils
+
+#endif // GFX_UTILS_SCENE_TEXTURE_CACHE_H_
\ No newline at end of file
@@ -3,8 +3,12 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <cstdint>
 
+#include "handle.h"
+#include "residency.h"
+
 namespace gfx_utils {
 
 enum ImageFormat {
@@ -24,16 +28,32 @@ struct Image {
 
 using TextureId = uint64_t;
 
+// Hash of the bytes of the file that the image was decoded from
+using ContentHash = uint64_t;
+
 // Currently only supports RGB and RGBA
 struct Texture {
   TextureId id; // Assigned on construction
 
+  ContentHash hash = 0;
+
   Image image;
 
+  // File the image was decoded from, if any. Lets the pixels be reloaded
+  // after the CPU copy was released
+  std::string path;
+
+  ResidencyPolicy residency = kResidencyKeep;
+
+  // Records of the texture's GL resources, one per GLResourceManager
+  HandleList gl_handles;
+
   // Constructor to assign the id
   Texture();
 };
 
+using TexturePtr = std::shared_ptr<Texture>;
+
 using CubemapId = uint64_t;
 
 struct Cubemap {
@@ -44,12 +64,39 @@ struct Cubemap {
   // when we call glTexImage2D() for each face
   std::vector<Image> images;
 
+  // Combined hash of the face files
+  ContentHash hash = 0;
+
+  // Optional, filled in by PrefilterCubemap()
+  // specular_mips[level][face] is the environment convolved with a GGX lobe
+  // whose roughness goes from 0 at level 0 to 1 at the last level
+  std::vector<std::vector<Image>> specular_mips;
+  // Cosine-convolved environment for diffuse lighting (one image per face)
+  std::vector<Image> irradiance;
+
+  // Records of the cubemap's GL resources, one per GLResourceManager
+  HandleList gl_handles;
+
   // Constructor to assign the id
   Cubemap();
 };
 
 // flip should be true for 2D textures, and false for cubemaps
 bool LoadImageFromFile(Image* out_img, const std::string& path, bool flip);
+bool LoadImageFromMemory(Image* out_img, const uint8_t* data, size_t size,
+                         bool flip);
+
+// Size of the decoded pixels in bytes - valid even after the data is released
+size_t GetImageByteSize(const Image& image);
+
+// Frees the pixel data. Returns the number of bytes freed
+size_t ReleaseImageData(Image* image);
+
+// Reloads the texture's image from its path if the pixel data was released.
+// Returns false if there is no data and it can't be reloaded
+bool EnsureImageData(Texture* texture);
+
+bool LoadFileBytes(std::vector<uint8_t>* out_bytes, const std::string& path);
 
 bool CreateTextureFromFile(Texture* out_tex, const std::string& tex_directory,
                            const std::string& texname);
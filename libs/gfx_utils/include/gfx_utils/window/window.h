@@ -67,6 +67,13 @@ public:
     return window_height_;
   }
 
+  // Creates a hidden window whose GL context shares objects (buffers,
+  // textures, syncs - but not VAOs or FBOs) with the main one, so that
+  // another thread can make it current. Destroy it with
+  // DestroySharedContext(). Must be called from the main thread
+  GLFWwindow* CreateSharedContext();
+  void DestroySharedContext(GLFWwindow* context);
+
 private:
   struct KeyActionInfo {
     bool status = false;
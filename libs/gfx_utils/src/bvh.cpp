@@ -0,0 +1,269 @@
+#include "gfx_utils/bvh.h"
+
+#include <limits>
+
+namespace gfx_utils {
+
+namespace {
+
+// Costs of the surface area heuristic, relative to testing a primitive
+const float kTraversalCost = 1.f;
+const float kIntersectionCost = 1.f;
+
+struct Bin {
+  uint32_t count = 0;
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+};
+
+} // namespace
+
+void Bvh::Build(const std::vector<Aabb>& boxes) {
+  Clear();
+
+  if (boxes.empty()) {
+    return;
+  }
+
+  uint32_t num_prims = static_cast<uint32_t>(boxes.size());
+
+  prim_boxes_ = boxes;
+  prim_leaves_.resize(num_prims);
+
+  prim_indices_.resize(num_prims);
+  std::vector<glm::vec3> centroids(num_prims);
+  for (uint32_t i = 0; i < num_prims; ++i) {
+    prim_indices_[i] = i;
+    centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+  }
+
+  // A binary tree over n leaves has at most 2n - 1 nodes
+  nodes_.reserve(2 * num_prims - 1);
+  parents_.reserve(2 * num_prims - 1);
+
+  BuildNode(0, num_prims, kNoParent, 0, centroids);
+
+  for (const BvhNode& node : nodes_) {
+    weighted_area_ += GetWeightedArea(node);
+  }
+  build_cost_ = GetCost();
+}
+
+void Bvh::Clear() {
+  nodes_.clear();
+  parents_.clear();
+  prim_indices_.clear();
+  prim_boxes_.clear();
+  prim_leaves_.clear();
+
+  weighted_area_ = 0.f;
+  build_cost_ = 0.f;
+}
+
+void Bvh::Update(uint32_t prim, const Aabb& box) {
+  prim_boxes_[prim] = box;
+
+  uint32_t node_index = prim_leaves_[prim];
+  while (node_index != kNoParent) {
+    BvhNode& node = nodes_[node_index];
+
+    glm::vec3 min;
+    glm::vec3 max;
+    ComputeNodeBounds(node_index, &min, &max);
+
+    // Nothing above can change either
+    if (min == node.min && max == node.max) {
+      break;
+    }
+
+    weighted_area_ -= GetWeightedArea(node);
+    node.min = min;
+    node.max = max;
+    weighted_area_ += GetWeightedArea(node);
+
+    node_index = parents_[node_index];
+  }
+}
+
+float Bvh::GetCost() const {
+  if (nodes_.empty()) {
+    return 0.f;
+  }
+
+  float root_area = GetSurfaceArea(nodes_[0].min, nodes_[0].max);
+  return root_area > 0.f ? weighted_area_ / root_area : 0.f;
+}
+
+uint32_t Bvh::BuildNode(uint32_t begin, uint32_t end, uint32_t parent, 
+                        int depth, const std::vector<glm::vec3>& centroids) {
+  uint32_t node_index = static_cast<uint32_t>(nodes_.size());
+  nodes_.push_back(BvhNode());
+  parents_.push_back(parent);
+
+  glm::vec3 min = prim_boxes_[prim_indices_[begin]].min;
+  glm::vec3 max = prim_boxes_[prim_indices_[begin]].max;
+  glm::vec3 centroid_min = centroids[prim_indices_[begin]];
+  glm::vec3 centroid_max = centroid_min;
+  for (uint32_t i = begin + 1; i < end; ++i) {
+    uint32_t prim = prim_indices_[i];
+    min = glm::min(min, prim_boxes_[prim].min);
+    max = glm::max(max, prim_boxes_[prim].max);
+    centroid_min = glm::min(centroid_min, centroids[prim]);
+    centroid_max = glm::max(centroid_max, centroids[prim]);
+  }
+
+  uint32_t count = end - begin;
+  uint32_t mid = begin;
+
+  if (count > 1 && depth < kMaxDepth - 1) {
+    // Costs are left unnormalized by the node's area, which saves dividing
+    // by zero for flat nodes
+    float area = GetSurfaceArea(min, max);
+    float leaf_cost = kIntersectionCost * count * area;
+
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    int best_split = 0;
+
+    glm::vec3 centroid_extent = centroid_max - centroid_min;
+
+    for (int axis = 0; axis < 3; ++axis) {
+      if (centroid_extent[axis] <= 0.f) {
+        continue;
+      }
+
+      float scale = kNumBins / centroid_extent[axis];
+
+      Bin bins[kNumBins];
+      for (uint32_t i = begin; i < end; ++i) {
+        uint32_t prim = prim_indices_[i];
+        int bin_index = std::min(
+            static_cast<int>(
+                (centroids[prim][axis] - centroid_min[axis]) * scale), 
+            kNumBins - 1);
+
+        Bin& bin = bins[bin_index];
+        ++bin.count;
+        bin.min = glm::min(bin.min, prim_boxes_[prim].min);
+        bin.max = glm::max(bin.max, prim_boxes_[prim].max);
+      }
+
+      // Split s puts bins [0, s] on the left. Sweep from the left storing
+      // each side's area and count, then from the right costing each split
+      float left_areas[kNumBins - 1];
+      uint32_t left_counts[kNumBins - 1];
+
+      Bin left;
+      for (int s = 0; s < kNumBins - 1; ++s) {
+        left.count += bins[s].count;
+        left.min = glm::min(left.min, bins[s].min);
+        left.max = glm::max(left.max, bins[s].max);
+
+        left_areas[s] = GetSurfaceArea(left.min, left.max);
+        left_counts[s] = left.count;
+      }
+
+      Bin right;
+      for (int s = kNumBins - 2; s >= 0; --s) {
+        right.count += bins[s + 1].count;
+        right.min = glm::min(right.min, bins[s + 1].min);
+        right.max = glm::max(right.max, bins[s + 1].max);
+
+        if (left_counts[s] == 0 || right.count == 0) {
+          continue;
+        }
+
+        float cost = kTraversalCost * area + kIntersectionCost * 
+            (left_areas[s] * left_counts[s] + 
+             GetSurfaceArea(right.min, right.max) * right.count);
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_split = s;
+        }
+      }
+    }
+
+    if (best_axis < 0) {
+      // Every centroid is in the same place, so only the leaf size matters
+      if (count > kMaxLeafSize) {
+        mid = begin + count / 2;
+      }
+    }
+    else if (best_cost < leaf_cost || count > kMaxLeafSize) {
+      float scale = kNumBins / centroid_extent[best_axis];
+      float axis_min = centroid_min[best_axis];
+
+      uint32_t* split = std::partition(
+          &prim_indices_[begin], &prim_indices_[0] + end, 
+          [&](uint32_t prim) {
+            int bin_index = std::min(
+                static_cast<int>(
+                    (centroids[prim][best_axis] - axis_min) * scale), 
+                kNumBins - 1);
+            return bin_index <= best_split;
+          });
+      mid = static_cast<uint32_t>(split - &prim_indices_[0]);
+    }
+  }
+
+  // Both children would need primitives
+  if (mid == begin || mid == end) {
+    BvhNode& node = nodes_[node_index];
+    node.min = min;
+    node.max = max;
+    node.offset = begin;
+    node.count = count;
+
+    for (uint32_t i = begin; i < end; ++i) {
+      prim_leaves_[prim_indices_[i]] = node_index;
+    }
+
+    return node_index;
+  }
+
+  // The first child follows the node, so only the second's index is kept
+  BuildNode(begin, mid, node_index, depth + 1, centroids);
+  uint32_t second = BuildNode(mid, end, node_index, depth + 1, centroids);
+
+  BvhNode& node = nodes_[node_index];
+  node.min = min;
+  node.max = max;
+  node.offset = second;
+  node.count = 0;
+
+  return node_index;
+}
+
+void Bvh::ComputeNodeBounds(uint32_t node_index, glm::vec3* out_min,
+                            glm::vec3* out_max) const {
+  const BvhNode& node = nodes_[node_index];
+
+  if (node.count > 0) {
+    const Aabb& first = prim_boxes_[prim_indices_[node.offset]];
+    glm::vec3 min = first.min;
+    glm::vec3 max = first.max;
+    for (uint32_t i = 1; i < node.count; ++i) {
+      const Aabb& box = prim_boxes_[prim_indices_[node.offset + i]];
+      min = glm::min(min, box.min);
+      max = glm::max(max, box.max);
+    }
+
+    *out_min = min;
+    *out_max = max;
+    return;
+  }
+
+  const BvhNode& first = nodes_[node_index + 1];
+  const BvhNode& second = nodes_[node.offset];
+  *out_min = glm::min(first.min, second.min);
+  *out_max = glm::max(first.max, second.max);
+}
+
+float Bvh::GetWeightedArea(const BvhNode& node) const {
+  float cost = node.count > 0 ? 
+      kIntersectionCost * node.count : kTraversalCost;
+  return GetSurfaceArea(node.min, node.max) * cost;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
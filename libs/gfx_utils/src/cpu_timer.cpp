@@ -0,0 +1,39 @@
+#include "gfx_utils/cpu_timer.h"
+
+#include <iostream>
+
+namespace gfx_utils {
+
+void CpuTimer::Begin() {
+  begin_time_ = std::chrono::steady_clock::now();
+}
+
+void CpuTimer::End() {
+  total_time_ += std::chrono::steady_clock::now() - begin_time_;
+  ++num_samples_;
+}
+
+double CpuTimer::GetAverageMs() const {
+  if (num_samples_ == 0) {
+    return 0.0;
+  }
+
+  std::chrono::duration<double, std::milli> total_ms = total_time_;
+  return total_ms.count() / num_samples_;
+}
+
+void CpuTimer::Reset() {
+  total_time_ = std::chrono::steady_clock::duration::zero();
+  num_samples_ = 0;
+}
+
+void CpuTimer::ReportEvery(uint32_t num_samples, const std::string& label) {
+  if (num_samples_ < num_samples) {
+    return;
+  }
+
+  std::cout << label << ": " << GetAverageMs() << " ms" << std::endl;
+  Reset();
+}
+
+} // namespace gfx_utils
\ No newline at end of file
@@ -0,0 +1,732 @@
+#include "gfx_utils/cubemap_filter.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <cmath>
+
+#include "gfx_utils/hash.h"
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GFX_UTILS_CUBEMAP_FILTER_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace gfx_utils {
+
+namespace {
+
+const float kPi = 3.14159265358979f;
+
+// Bump when the filtering or the cache file layout changes so stale cache
+// files are ignored
+const uint32_t kCacheVersion = 1;
+const uint32_t kCacheMagic = 0x4d564e45; // "ENVM"
+
+// Faces are filtered at this size at most before being box-filtered down,
+// which bounds the cost of building the source chain
+const uint32_t kMaxIrradianceSourceSize = 16;
+
+// Linear RGBA float face. The fourth channel is padding so a texel is one SSE
+// register
+struct FloatFace {
+  uint32_t size = 0;
+  std::vector<float> texels;
+
+  const float* Texel(uint32_t x, uint32_t y) const {
+    return &texels[(static_cast<size_t>(y) * size + x) * 4];
+  }
+  float* Texel(uint32_t x, uint32_t y) {
+    return &texels[(static_cast<size_t>(y) * size + x) * 4];
+  }
+};
+
+// levels[level][face]
+using FloatCubeChain = std::vector<std::vector<FloatFace>>;
+
+struct Vec3 {
+  float x;
+  float y;
+  float z;
+};
+
+inline Vec3 Normalize(const Vec3& v) {
+  float inv_len = 1.0f / std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+  return {v.x * inv_len, v.y * inv_len, v.z * inv_len};
+}
+
+inline Vec3 Cross(const Vec3& a, const Vec3& b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+          a.x * b.y - a.y * b.x};
+}
+
+inline float Dot(const Vec3& a, const Vec3& b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Unnormalized direction through face coordinates (sc, tc) in [-1, 1], using
+// the face orientations from the GL spec. Row 0 of an image is t = 0
+inline Vec3 FaceCoordsToDir(int face, float sc, float tc) {
+  switch (face) {
+    case 0: return {1.0f, -tc, -sc};
+    case 1: return {-1.0f, -tc, sc};
+    case 2: return {sc, 1.0f, tc};
+    case 3: return {sc, -1.0f, -tc};
+    case 4: return {sc, -tc, 1.0f};
+    default: return {-sc, -tc, -1.0f};
+  }
+}
+
+inline Vec3 TexelToDir(int face, uint32_t x, uint32_t y, uint32_t size) {
+  float sc = 2.0f * (x + 0.5f) / size - 1.0f;
+  float tc = 2.0f * (y + 0.5f) / size - 1.0f;
+  return FaceCoordsToDir(face, sc, tc);
+}
+
+// Inverse of FaceCoordsToDir(). s and t are in [0, 1]
+inline int DirToFaceCoords(const Vec3& dir, float* s, float* t) {
+  float abs_x = std::fabs(dir.x);
+  float abs_y = std::fabs(dir.y);
+  float abs_z = std::fabs(dir.z);
+
+  int face;
+  float sc;
+  float tc;
+  float ma;
+
+  if (abs_x >= abs_y && abs_x >= abs_z) {
+    ma = abs_x;
+    face = dir.x > 0.0f ? 0 : 1;
+    sc = dir.x > 0.0f ? -dir.z : dir.z;
+    tc = -dir.y;
+  }
+  else if (abs_y >= abs_z) {
+    ma = abs_y;
+    face = dir.y > 0.0f ? 2 : 3;
+    sc = dir.x;
+    tc = dir.y > 0.0f ? dir.z : -dir.z;
+  }
+  else {
+    ma = abs_z;
+    face = dir.z > 0.0f ? 4 : 5;
+    sc = dir.z > 0.0f ? dir.x : -dir.x;
+    tc = -dir.y;
+  }
+
+  *s = 0.5f * (sc / ma + 1.0f);
+  *t = 0.5f * (tc / ma + 1.0f);
+
+  return face;
+}
+
+// Weighted RGBA sum
+class Accumulator {
+public:
+#ifdef GFX_UTILS_CUBEMAP_FILTER_SSE
+  Accumulator() : sum_(_mm_setzero_ps()) {}
+
+  void Add(const float* texel, float weight) {
+    sum_ = _mm_add_ps(sum_, _mm_mul_ps(_mm_loadu_ps(texel),
+                                       _mm_set1_ps(weight)));
+  }
+
+  void Store(float* out, float scale) const {
+    _mm_storeu_ps(out, _mm_mul_ps(sum_, _mm_set1_ps(scale)));
+  }
+
+private:
+  __m128 sum_;
+#else
+  Accumulator() : sum_{0.0f, 0.0f, 0.0f, 0.0f} {}
+
+  void Add(const float* texel, float weight) {
+    for (int i = 0; i < 4; ++i) {
+      sum_[i] += texel[i] * weight;
+    }
+  }
+
+  void Store(float* out, float scale) const {
+    for (int i = 0; i < 4; ++i) {
+      out[i] = sum_[i] * scale;
+    }
+  }
+
+private:
+  float sum_[4];
+#endif
+};
+
+// Bilinear sample of one level. Filtering doesn't cross face edges, which is
+// not noticeable at the sample counts used here
+void AddBilinearSample(const std::vector<FloatFace>& level, const Vec3& dir,
+                       float weight, Accumulator* accum) {
+  float s;
+  float t;
+  int face = DirToFaceCoords(dir, &s, &t);
+
+  const FloatFace& src = level[face];
+  int max_coord = static_cast<int>(src.size) - 1;
+
+  float fx = s * src.size - 0.5f;
+  float fy = t * src.size - 0.5f;
+  float floor_x = std::floor(fx);
+  float floor_y = std::floor(fy);
+  float frac_x = fx - floor_x;
+  float frac_y = fy - floor_y;
+
+  int x0 = std::min(std::max(static_cast<int>(floor_x), 0), max_coord);
+  int y0 = std::min(std::max(static_cast<int>(floor_y), 0), max_coord);
+  int x1 = std::min(static_cast<int>(floor_x) + 1, max_coord);
+  int y1 = std::min(static_cast<int>(floor_y) + 1, max_coord);
+  x1 = std::max(x1, 0);
+  y1 = std::max(y1, 0);
+
+  accum->Add(src.Texel(x0, y0), weight * (1.0f - frac_x) * (1.0f - frac_y));
+  accum->Add(src.Texel(x1, y0), weight * frac_x * (1.0f - frac_y));
+  accum->Add(src.Texel(x0, y1), weight * (1.0f - frac_x) * frac_y);
+  accum->Add(src.Texel(x1, y1), weight * frac_x * frac_y);
+}
+
+// Runs func(item) for items [0, num_items) on num_threads threads
+void ParallelFor(uint32_t num_items, uint32_t num_threads,
+                 const std::function<void(uint32_t)>& func) {
+  std::atomic<uint32_t> next_item(0);
+
+  auto worker = [&]() {
+    for (uint32_t item = next_item++; item < num_items; item = next_item++) {
+      func(item);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (uint32_t i = 1; i < num_threads; ++i) {
+    threads.push_back(std::thread(worker));
+  }
+
+  // The calling thread works too
+  worker();
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+float SrgbToLinear(uint8_t value) {
+  return std::pow(value / 255.0f, 2.2f);
+}
+
+uint8_t LinearToSrgb(float value) {
+  value = std::min(std::max(value, 0.0f), 1.0f);
+  return static_cast<uint8_t>(std::pow(value, 1.0f / 2.2f) * 255.0f + 0.5f);
+}
+
+// Box-filters the 8-bit faces straight down to base_size and builds the rest
+// of the chain from there, down to 1x1. Sizes needn't be powers of two: each
+// base texel covers its share of the face rounded to whole pixels, and the
+// last texel of an odd level's row or column takes in the leftover one
+bool BuildSourceChain(const Cubemap& cubemap, uint32_t base_size,
+                      uint32_t num_threads, FloatCubeChain* out_chain) {
+  uint32_t face_size = cubemap.images[0].width;
+  for (const Image& img : cubemap.images) {
+    if (img.width != face_size || img.height != face_size ||
+        img.data.empty() || img.format == kImageFormatInvalid) {
+      std::cerr << "Cubemap faces must be loaded, square and the same size to "
+                << "be prefiltered" << std::endl;
+      return false;
+    }
+  }
+
+  base_size = std::min(base_size, face_size);
+
+  float to_linear[256];
+  for (int i = 0; i < 256; ++i) {
+    to_linear[i] = SrgbToLinear(static_cast<uint8_t>(i));
+  }
+
+  out_chain->clear();
+  out_chain->push_back(std::vector<FloatFace>(6));
+
+  std::vector<FloatFace>& base = out_chain->back();
+  for (FloatFace& face : base) {
+    face.size = base_size;
+    face.texels.resize(static_cast<size_t>(base_size) * base_size * 4);
+  }
+
+  // One item per (face, row)
+  ParallelFor(6 * base_size, num_threads, [&](uint32_t item) {
+    uint32_t face = item / base_size;
+    uint32_t y = item % base_size;
+
+    const Image& img = cubemap.images[face];
+    uint32_t channels = img.format == kImageFormatRGBA ? 4 : 3;
+
+    uint32_t first_y = y * face_size / base_size;
+    uint32_t end_y = (y + 1) * face_size / base_size;
+
+    for (uint32_t x = 0; x < base_size; ++x) {
+      uint32_t first_x = x * face_size / base_size;
+      uint32_t end_x = (x + 1) * face_size / base_size;
+      float scale = 1.0f / ((end_x - first_x) * (end_y - first_y));
+
+      float sum[3] = {0.0f, 0.0f, 0.0f};
+
+      for (uint32_t sy = first_y; sy < end_y; ++sy) {
+        const uint8_t* row = &img.data[static_cast<size_t>(sy) * face_size *
+                                       channels];
+        for (uint32_t sx = first_x; sx < end_x; ++sx) {
+          const uint8_t* pixel = row + sx * channels;
+          sum[0] += to_linear[pixel[0]];
+          sum[1] += to_linear[pixel[1]];
+          sum[2] += to_linear[pixel[2]];
+        }
+      }
+
+      float* texel = base[face].Texel(x, y);
+      texel[0] = sum[0] * scale;
+      texel[1] = sum[1] * scale;
+      texel[2] = sum[2] * scale;
+      texel[3] = 1.0f;
+    }
+  });
+
+  while (out_chain->back()[0].size > 1) {
+    const std::vector<FloatFace>& prev = out_chain->back();
+    uint32_t prev_size = prev[0].size;
+    uint32_t size = prev_size / 2;
+
+    std::vector<FloatFace> level(6);
+    for (int face = 0; face < 6; ++face) {
+      level[face].size = size;
+      level[face].texels.resize(static_cast<size_t>(size) * size * 4);
+
+      for (uint32_t y = 0; y < size; ++y) {
+        uint32_t last_y = y == size - 1 ? prev_size - 1 : 2 * y + 1;
+
+        for (uint32_t x = 0; x < size; ++x) {
+          uint32_t last_x = x == size - 1 ? prev_size - 1 : 2 * x + 1;
+
+          Accumulator accum;
+          for (uint32_t sy = 2 * y; sy <= last_y; ++sy) {
+            for (uint32_t sx = 2 * x; sx <= last_x; ++sx) {
+              accum.Add(prev[face].Texel(sx, sy), 1.0f);
+            }
+          }
+
+          float count = static_cast<float>((last_x - 2 * x + 1) *
+                                           (last_y - 2 * y + 1));
+          accum.Store(level[face].Texel(x, y), 1.0f / count);
+        }
+      }
+    }
+
+    out_chain->push_back(std::move(level));
+  }
+
+  return true;
+}
+
+float RadicalInverse(uint32_t bits) {
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return bits * 2.3283064365386963e-10f;
+}
+
+// A GGX sample in tangent space, assuming N = V = R
+struct LobeSample {
+  Vec3 dir;
+  float weight;
+  // Source chain level to sample, picked from the sample's pdf so that
+  // undersampled lobes still integrate smoothly (filtered importance sampling)
+  uint32_t level;
+};
+
+std::vector<LobeSample> ComputeLobeSamples(float roughness,
+                                           uint32_t num_samples,
+                                           const FloatCubeChain& chain) {
+  float alpha = roughness * roughness;
+  float alpha2 = alpha * alpha;
+
+  uint32_t base_size = chain[0][0].size;
+  float texel_solid_angle = 4.0f * kPi / (6.0f * base_size * base_size);
+
+  std::vector<LobeSample> samples;
+
+  for (uint32_t i = 0; i < num_samples; ++i) {
+    float u = static_cast<float>(i) / num_samples;
+    float v = RadicalInverse(i);
+
+    float phi = 2.0f * kPi * u;
+    float cos_theta = std::sqrt((1.0f - v) / (1.0f + (alpha2 - 1.0f) * v));
+    float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+
+    Vec3 half = {sin_theta * std::cos(phi), sin_theta * std::sin(phi),
+                 cos_theta};
+
+    // Reflect V = (0, 0, 1) about the half vector
+    Vec3 light = {2.0f * cos_theta * half.x, 2.0f * cos_theta * half.y,
+                  2.0f * cos_theta * half.z - 1.0f};
+
+    float n_dot_l = light.z;
+    if (n_dot_l <= 0.0f) {
+      continue;
+    }
+
+    // pdf of the light direction is D * NdotH / (4 * VdotH) = D / 4 here
+    float d_denom = cos_theta * cos_theta * (alpha2 - 1.0f) + 1.0f;
+    float ndf = alpha2 / (kPi * d_denom * d_denom);
+    float pdf = ndf * 0.25f;
+
+    float sample_solid_angle = 1.0f / (num_samples * pdf + 0.0001f);
+    float lod = 0.5f * std::log2(sample_solid_angle / texel_solid_angle) +
+                1.0f;
+    lod = std::min(std::max(lod, 0.0f), static_cast<float>(chain.size() - 1));
+
+    LobeSample sample;
+    sample.dir = light;
+    sample.weight = n_dot_l;
+    sample.level = static_cast<uint32_t>(lod + 0.5f);
+
+    samples.push_back(sample);
+  }
+
+  return samples;
+}
+
+void ToImage(const FloatFace& face, Image* out_img) {
+  out_img->width = face.size;
+  out_img->height = face.size;
+  out_img->format = kImageFormatRGB;
+  out_img->data.resize(static_cast<size_t>(face.size) * face.size * 3);
+
+  size_t num_texels = static_cast<size_t>(face.size) * face.size;
+  for (size_t i = 0; i < num_texels; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      out_img->data[i * 3 + c] = LinearToSrgb(face.texels[i * 4 + c]);
+    }
+  }
+}
+
+void FilterSpecular(const FloatCubeChain& chain, uint32_t size,
+                    uint32_t num_levels, uint32_t num_samples,
+                    uint32_t num_threads, Cubemap* cubemap) {
+  cubemap->specular_mips.resize(num_levels);
+
+  for (uint32_t level = 0; level < num_levels; ++level) {
+    uint32_t level_size = std::max(size >> level, 1u);
+    float roughness = num_levels > 1 ?
+        static_cast<float>(level) / (num_levels - 1) : 0.0f;
+
+    std::vector<FloatFace> faces(6);
+    for (FloatFace& face : faces) {
+      face.size = level_size;
+      face.texels.resize(static_cast<size_t>(level_size) * level_size * 4);
+    }
+
+    // A mirror lobe is a plain lookup into the matching source level
+    uint32_t mirror_level = 0;
+    while (mirror_level + 1 < chain.size() &&
+           chain[mirror_level][0].size > level_size) {
+      ++mirror_level;
+    }
+
+    std::vector<LobeSample> samples;
+    if (level > 0) {
+      samples = ComputeLobeSamples(roughness, num_samples, chain);
+    }
+
+    ParallelFor(6 * level_size, num_threads, [&](uint32_t item) {
+      uint32_t face = item / level_size;
+      uint32_t y = item % level_size;
+
+      for (uint32_t x = 0; x < level_size; ++x) {
+        Vec3 normal = Normalize(TexelToDir(face, x, y, level_size));
+
+        Accumulator accum;
+        float total_weight = 0.0f;
+
+        if (samples.empty()) {
+          AddBilinearSample(chain[mirror_level], normal, 1.0f, &accum);
+          total_weight = 1.0f;
+        }
+        else {
+          Vec3 up = std::fabs(normal.z) < 0.999f ? Vec3{0.0f, 0.0f, 1.0f} :
+                                                    Vec3{1.0f, 0.0f, 0.0f};
+          Vec3 tangent = Normalize(Cross(up, normal));
+          Vec3 bitangent = Cross(normal, tangent);
+
+          for (const LobeSample& sample : samples) {
+            Vec3 dir = {
+              tangent.x * sample.dir.x + bitangent.x * sample.dir.y +
+                  normal.x * sample.dir.z,
+              tangent.y * sample.dir.x + bitangent.y * sample.dir.y +
+                  normal.y * sample.dir.z,
+              tangent.z * sample.dir.x + bitangent.z * sample.dir.y +
+                  normal.z * sample.dir.z
+            };
+
+            AddBilinearSample(chain[sample.level], dir, sample.weight,
+                              &accum);
+            total_weight += sample.weight;
+          }
+        }
+
+        accum.Store(faces[face].Texel(x, y), 1.0f / total_weight);
+      }
+    });
+
+    cubemap->specular_mips[level].resize(6);
+    for (int face = 0; face < 6; ++face) {
+      ToImage(faces[face], &cubemap->specular_mips[level][face]);
+    }
+  }
+}
+
+void FilterIrradiance(const FloatCubeChain& chain, uint32_t size,
+                      uint32_t num_threads, Cubemap* cubemap) {
+  // The cosine lobe is wide enough that a small source level suffices to
+  // integrate over every texel
+  uint32_t src_level = 0;
+  while (src_level + 1 < chain.size() &&
+         chain[src_level][0].size > kMaxIrradianceSourceSize) {
+    ++src_level;
+  }
+  const std::vector<FloatFace>& src = chain[src_level];
+  uint32_t src_size = src[0].size;
+
+  struct SourceTexel {
+    Vec3 dir;
+    float solid_angle;
+    const float* color;
+  };
+
+  std::vector<SourceTexel> src_texels;
+  for (int face = 0; face < 6; ++face) {
+    for (uint32_t y = 0; y < src_size; ++y) {
+      for (uint32_t x = 0; x < src_size; ++x) {
+        Vec3 dir = TexelToDir(face, x, y, src_size);
+        float len2 = Dot(dir, dir);
+
+        SourceTexel texel;
+        texel.dir = Normalize(dir);
+        texel.solid_angle = 4.0f / (src_size * src_size * len2 *
+                                    std::sqrt(len2));
+        texel.color = src[face].Texel(x, y);
+        src_texels.push_back(texel);
+      }
+    }
+  }
+
+  std::vector<FloatFace> faces(6);
+  for (FloatFace& face : faces) {
+    face.size = size;
+    face.texels.resize(static_cast<size_t>(size) * size * 4);
+  }
+
+  ParallelFor(6 * size, num_threads, [&](uint32_t item) {
+    uint32_t face = item / size;
+    uint32_t y = item % size;
+
+    for (uint32_t x = 0; x < size; ++x) {
+      Vec3 normal = Normalize(TexelToDir(face, x, y, size));
+
+      Accumulator accum;
+      for (const SourceTexel& texel : src_texels) {
+        float n_dot_l = Dot(normal, texel.dir);
+        if (n_dot_l > 0.0f) {
+          accum.Add(texel.color, n_dot_l * texel.solid_angle);
+        }
+      }
+
+      // Divided by pi so that a constant environment maps to itself
+      accum.Store(faces[face].Texel(x, y), 1.0f / kPi);
+    }
+  });
+
+  cubemap->irradiance.resize(6);
+  for (int face = 0; face < 6; ++face) {
+    ToImage(faces[face], &cubemap->irradiance[face]);
+  }
+}
+
+struct CacheKey {
+  ContentHash source_hash;
+  uint32_t version;
+  uint32_t specular_size;
+  uint32_t num_specular_levels;
+  uint32_t irradiance_size;
+  uint32_t num_samples;
+  uint32_t padding;
+};
+
+std::string GetCachePath(const Cubemap& cubemap,
+                         const CubemapFilterOptions& options,
+                         uint32_t num_levels) {
+  CacheKey key = {};
+  key.source_hash = cubemap.hash;
+  key.version = kCacheVersion;
+  key.specular_size = options.specular_size;
+  key.num_specular_levels = num_levels;
+  key.irradiance_size = options.irradiance_size;
+  key.num_samples = options.num_samples;
+
+  std::ostringstream path;
+  path << options.cache_directory << "/envmap_" << std::hex
+       << std::setw(16) << std::setfill('0') << HashBytes(&key, sizeof(key))
+       << ".cache";
+  return path.str();
+}
+
+struct CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t specular_size;
+  uint32_t num_specular_levels;
+  uint32_t irradiance_size;
+};
+
+bool ReadFaces(std::ifstream* file, uint32_t size, std::vector<Image>* faces) {
+  faces->resize(6);
+  for (Image& img : *faces) {
+    img.width = size;
+    img.height = size;
+    img.format = kImageFormatRGB;
+    img.data.resize(static_cast<size_t>(size) * size * 3);
+    file->read(reinterpret_cast<char*>(&img.data[0]), img.data.size());
+  }
+  return static_cast<bool>(*file);
+}
+
+bool LoadFromCache(const std::string& path, uint32_t specular_size,
+                   uint32_t num_levels, uint32_t irradiance_size,
+                   Cubemap* cubemap) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  CacheHeader header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || header.magic != kCacheMagic ||
+      header.version != kCacheVersion ||
+      header.specular_size != specular_size ||
+      header.num_specular_levels != num_levels ||
+      header.irradiance_size != irradiance_size) {
+    return false;
+  }
+
+  std::vector<std::vector<Image>> specular_mips(num_levels);
+  for (uint32_t level = 0; level < num_levels; ++level) {
+    if (!ReadFaces(&file, std::max(specular_size >> level, 1u),
+                   &specular_mips[level])) {
+      return false;
+    }
+  }
+
+  std::vector<Image> irradiance;
+  if (!ReadFaces(&file, irradiance_size, &irradiance)) {
+    return false;
+  }
+
+  cubemap->specular_mips = std::move(specular_mips);
+  cubemap->irradiance = std::move(irradiance);
+
+  return true;
+}
+
+void WriteToCache(const std::string& path, const Cubemap& cubemap) {
+  std::ofstream file(path, std::ios::out | std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Failed to write cubemap cache: " << path << std::endl;
+    return;
+  }
+
+  CacheHeader header;
+  header.magic = kCacheMagic;
+  header.version = kCacheVersion;
+  header.specular_size = cubemap.specular_mips[0][0].width;
+  header.num_specular_levels =
+      static_cast<uint32_t>(cubemap.specular_mips.size());
+  header.irradiance_size = cubemap.irradiance[0].width;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  for (const std::vector<Image>& level : cubemap.specular_mips) {
+    for (const Image& img : level) {
+      file.write(reinterpret_cast<const char*>(&img.data[0]),
+                 img.data.size());
+    }
+  }
+  for (const Image& img : cubemap.irradiance) {
+    file.write(reinterpret_cast<const char*>(&img.data[0]), img.data.size());
+  }
+}
+
+} // namespace
+
+bool PrefilterCubemap(Cubemap* cubemap, const CubemapFilterOptions& options) {
+  if (cubemap->images.size() != 6 || options.specular_size == 0 ||
+      options.irradiance_size == 0) {
+    return false;
+  }
+
+  uint32_t max_levels = 1;
+  while ((options.specular_size >> max_levels) > 0) {
+    ++max_levels;
+  }
+  uint32_t num_levels = std::min(std::max(options.num_specular_levels, 1u),
+                                 max_levels);
+
+  std::string cache_path;
+  if (!options.cache_directory.empty()) {
+    cache_path = GetCachePath(*cubemap, options, num_levels);
+
+    if (LoadFromCache(cache_path, options.specular_size, num_levels,
+                      options.irradiance_size, cubemap)) {
+      std::cout << "Loaded prefiltered cubemap from " << cache_path
+                << std::endl;
+      return true;
+    }
+  }
+
+  uint32_t num_threads = options.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  // Filtering from a source twice the size of the first specular level keeps
+  // the mirror level sharp while bounding the cost of the chain
+  FloatCubeChain chain;
+  if (!BuildSourceChain(*cubemap, 2 * options.specular_size, num_threads,
+                        &chain)) {
+    return false;
+  }
+
+  FilterSpecular(chain, options.specular_size, num_levels, options.num_samples,
+                 num_threads, cubemap);
+  FilterIrradiance(chain, options.irradiance_size, num_threads, cubemap);
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start_time);
+  std::cout << "Prefiltered cubemap in " << elapsed.count() << " ms on "
+            << num_threads << " threads" << std::endl;
+
+  if (!cache_path.empty() &&
+      CreateDirectoryIfMissing(options.cache_directory)) {
+    WriteToCache(cache_path, *cubemap);
+  }
+
+  return true;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
@@ -34,6 +34,7 @@ glm::mat4 Entity::ComputeTransform() const {
 
 void Entity::SetParent(std::shared_ptr<Entity> parent) {
   parent_ = parent;
+  MarkMoved();
 }
 
 void Entity::SetModel(std::shared_ptr<Model> model) {
@@ -42,14 +43,17 @@ void Entity::SetModel(std::shared_ptr<Model> model) {
 
 void Entity::SetLocation(glm::vec3 location) {
   location_ = location;
+  MarkMoved();
 }
 
 void Entity::SetScale(glm::vec3 scale) {
   scale_ = scale;
+  MarkMoved();
 }
 
 void Entity::SetRotation(float yaw, float pitch, float roll) {
   rotation_ = glm::quat(glm::vec3(pitch, yaw, roll));    
+  MarkMoved();
 }
 
 std::shared_ptr<Model> Entity::GetModel() { 
@@ -61,4 +65,17 @@ bool Entity::HasModel() const {
   return model_ != nullptr;
 }
 
+void Entity::SetBvhPrimitive(uint32_t prim, EntityMoveList* move_list) {
+  bvh_prim_ = prim;
+  move_list_ = move_list;
+  is_moved_ = false;
+}
+
+void Entity::MarkMoved() {
+  if (move_list_ && !is_moved_) {
+    is_moved_ = true;
+    move_list_->push_back(this);
+  }
+}
+
 } // namespace gfx_utils
\ No newline at end of file
@@ -0,0 +1,32 @@
+#include "gfx_utils/file_utils.h"
+
+#include <sys/stat.h>
+#include <cerrno>
+#include <iostream>
+
+#if defined(WIN32)
+#include <direct.h>
+#endif
+
+namespace gfx_utils {
+
+const char* const kDefaultCacheDirectory = "cache";
+
+bool CreateDirectoryIfMissing(const std::string& path) {
+#if defined(WIN32)
+  int result = _mkdir(path.c_str());
+#else
+  int result = mkdir(path.c_str(), 0755);
+#endif
+
+  // EEXIST is also returned for a file of that name, which the caller's
+  // write then reports
+  if (result != 0 && errno != EEXIST) {
+    std::cerr << "Could not create directory " << path << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
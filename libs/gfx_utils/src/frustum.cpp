@@ -0,0 +1,75 @@
+#include "gfx_utils/frustum.h"
+
+namespace gfx_utils {
+
+Frustum ExtractFrustum(const glm::mat4& view_proj_mat) {
+  // Gribb-Hartmann: each plane is the last row of the matrix plus or minus
+  // one of the others. glm is column-major, so rows are gathered by hand
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; ++i) {
+    rows[i] = glm::vec4(view_proj_mat[0][i], view_proj_mat[1][i], 
+                        view_proj_mat[2][i], view_proj_mat[3][i]);
+  }
+
+  Frustum frustum;
+  frustum.planes[kFrustumPlaneLeft] = rows[3] + rows[0];
+  frustum.planes[kFrustumPlaneRight] = rows[3] - rows[0];
+  frustum.planes[kFrustumPlaneBottom] = rows[3] + rows[1];
+  frustum.planes[kFrustumPlaneTop] = rows[3] - rows[1];
+  frustum.planes[kFrustumPlaneNear] = rows[3] + rows[2];
+  frustum.planes[kFrustumPlaneFar] = rows[3] - rows[2];
+
+  // Normalized so plane distances are in the space's units and can be
+  // compared against radii
+  for (glm::vec4& plane : frustum.planes) {
+    float length = glm::length(glm::vec3(plane));
+    if (length > 0.f) {
+      plane /= length;
+    }
+  }
+
+  return frustum;
+}
+
+FrustumOverlap TestBoxInFrustum(const Frustum& frustum, const glm::vec3& min,
+                                const glm::vec3& max) {
+  glm::vec3 center = (min + max) * 0.5f;
+  glm::vec3 extent = (max - min) * 0.5f;
+
+  FrustumOverlap overlap = kFrustumInside;
+  for (const glm::vec4& plane : frustum.planes) {
+    glm::vec3 normal(plane);
+
+    // The box's extent projected onto the plane normal
+    float radius = glm::dot(glm::abs(normal), extent);
+    float dist = glm::dot(normal, center) + plane.w;
+
+    if (dist < -radius) {
+      return kFrustumOutside;
+    }
+    if (dist < radius) {
+      overlap = kFrustumIntersects;
+    }
+  }
+  return overlap;
+}
+
+void TransformBox(const glm::mat4& model_mat, const glm::vec3& min,
+                  const glm::vec3& max, glm::vec3* out_min, 
+                  glm::vec3* out_max) {
+  glm::vec3 center = (min + max) * 0.5f;
+  glm::vec3 extent = (max - min) * 0.5f;
+
+  // Arvo's method, as in FrustumCuller::Add()
+  glm::vec3 world_center = glm::vec3(model_mat * glm::vec4(center, 1.f));
+
+  glm::mat3 abs_mat(glm::abs(glm::vec3(model_mat[0])), 
+                    glm::abs(glm::vec3(model_mat[1])), 
+                    glm::abs(glm::vec3(model_mat[2])));
+  glm::vec3 world_extent = abs_mat * extent;
+
+  *out_min = world_center - world_extent;
+  *out_max = world_center + world_extent;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include "gfx_utils/frustum_culler.h"
+
+#include <cmath>
+
+#if defined(__AVX__)
+#define GFX_UTILS_FRUSTUM_CULLER_AVX
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GFX_UTILS_FRUSTUM_CULLER_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace gfx_utils {
+
+namespace {
+
+#if defined(GFX_UTILS_FRUSTUM_CULLER_AVX)
+const int kSimdWidth = 8;
+#elif defined(GFX_UTILS_FRUSTUM_CULLER_SSE)
+const int kSimdWidth = 4;
+#else
+const int kSimdWidth = 1;
+#endif
+
+// Plane with its normal's absolute value, which projects a box's half
+// extents onto the normal
+struct CullPlane {
+  float x, y, z, w;
+  float abs_x, abs_y, abs_z;
+};
+
+inline int CountBits(uint32_t bits) {
+  int count = 0;
+  for (; bits != 0; bits &= bits - 1) {
+    ++count;
+  }
+  return count;
+}
+
+} // namespace
+
+void FrustumCuller::Clear() {
+  center_x_.clear();
+  center_y_.clear();
+  center_z_.clear();
+
+  extent_x_.clear();
+  extent_y_.clear();
+  extent_z_.clear();
+
+  visibility_.clear();
+  num_visible_ = 0;
+}
+
+void FrustumCuller::Reserve(size_t num_boxes) {
+  center_x_.reserve(num_boxes);
+  center_y_.reserve(num_boxes);
+  center_z_.reserve(num_boxes);
+
+  extent_x_.reserve(num_boxes);
+  extent_y_.reserve(num_boxes);
+  extent_z_.reserve(num_boxes);
+
+  visibility_.reserve((num_boxes + 63) / 64);
+}
+
+uint32_t FrustumCuller::Add(const glm::vec3& min, const glm::vec3& max, 
+                            const glm::mat4& model_mat) {
+  glm::vec3 center = (min + max) * 0.5f;
+  glm::vec3 extent = (max - min) * 0.5f;
+
+  // Arvo's method: the world space half extents are the object space ones
+  // through the absolute value of the rotation and scale
+  glm::vec3 world_center = glm::vec3(model_mat * glm::vec4(center, 1.f));
+
+  glm::mat3 abs_mat(glm::abs(glm::vec3(model_mat[0])), 
+                    glm::abs(glm::vec3(model_mat[1])), 
+                    glm::abs(glm::vec3(model_mat[2])));
+  glm::vec3 world_extent = abs_mat * extent;
+
+  uint32_t index = static_cast<uint32_t>(center_x_.size());
+
+  center_x_.push_back(world_center.x);
+  center_y_.push_back(world_center.y);
+  center_z_.push_back(world_center.z);
+
+  extent_x_.push_back(world_extent.x);
+  extent_y_.push_back(world_extent.y);
+  extent_z_.push_back(world_extent.z);
+
+  return index;
+}
+
+void FrustumCuller::Cull(const Frustum& frustum) {
+  size_t num_boxes = GetNumBoxes();
+
+  visibility_.assign((num_boxes + 63) / 64, 0);
+  num_visible_ = 0;
+
+  CullPlane planes[kNumFrustumPlanes];
+  for (int p = 0; p < kNumFrustumPlanes; ++p) {
+    const glm::vec4& plane = frustum.planes[p];
+    planes[p] = {plane.x, plane.y, plane.z, plane.w, 
+                 std::fabs(plane.x), std::fabs(plane.y), std::fabs(plane.z)};
+  }
+
+  // A box is outside a plane if even its corner furthest along the normal
+  // is behind it: dot(n, c) + w + dot(|n|, e) < 0
+  size_t i = 0;
+
+#if defined(GFX_UTILS_FRUSTUM_CULLER_AVX)
+  const __m256 zero = _mm256_setzero_ps();
+
+  for (; i + 8 <= num_boxes; i += 8) {
+    __m256 cx = _mm256_loadu_ps(&center_x_[i]);
+    __m256 cy = _mm256_loadu_ps(&center_y_[i]);
+    __m256 cz = _mm256_loadu_ps(&center_z_[i]);
+    __m256 ex = _mm256_loadu_ps(&extent_x_[i]);
+    __m256 ey = _mm256_loadu_ps(&extent_y_[i]);
+    __m256 ez = _mm256_loadu_ps(&extent_z_[i]);
+
+    __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+
+    for (const CullPlane& plane : planes) {
+      __m256 dist = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)),
+                        _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+          _mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)),
+                        _mm256_set1_ps(plane.w)));
+      __m256 radius = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(plane.abs_x)),
+                        _mm256_mul_ps(ey, _mm256_set1_ps(plane.abs_y))),
+          _mm256_mul_ps(ez, _mm256_set1_ps(plane.abs_z)));
+
+      inside = _mm256_and_ps(
+          inside, 
+          _mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_GE_OQ));
+    }
+
+    // Groups start on multiples of 8, so their bits never straddle words
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+    visibility_[i >> 6] |= static_cast<uint64_t>(mask) << (i & 63);
+    num_visible_ += CountBits(mask);
+  }
+#elif defined(GFX_UTILS_FRUSTUM_CULLER_SSE)
+  const __m128 zero = _mm_setzero_ps();
+
+  for (; i + 4 <= num_boxes; i += 4) {
+    __m128 cx = _mm_loadu_ps(&center_x_[i]);
+    __m128 cy = _mm_loadu_ps(&center_y_[i]);
+    __m128 cz = _mm_loadu_ps(&center_z_[i]);
+    __m128 ex = _mm_loadu_ps(&extent_x_[i]);
+    __m128 ey = _mm_loadu_ps(&extent_y_[i]);
+    __m128 ez = _mm_loadu_ps(&extent_z_[i]);
+
+    __m128 inside = _mm_cmpeq_ps(zero, zero);
+
+    for (const CullPlane& plane : planes) {
+      __m128 dist = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)),
+                     _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+          _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)),
+                     _mm_set1_ps(plane.w)));
+      __m128 radius = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(plane.abs_x)),
+                     _mm_mul_ps(ey, _mm_set1_ps(plane.abs_y))),
+          _mm_mul_ps(ez, _mm_set1_ps(plane.abs_z)));
+
+      inside = _mm_and_ps(inside, 
+                          _mm_cmpge_ps(_mm_add_ps(dist, radius), zero));
+    }
+
+    // Groups start on multiples of 4, so their bits never straddle words
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+    visibility_[i >> 6] |= static_cast<uint64_t>(mask) << (i & 63);
+    num_visible_ += CountBits(mask);
+  }
+#endif
+
+  // Whatever doesn't fill a SIMD group. Sums are grouped as in the SIMD
+  // loops, so a box gets the same result on every path
+  for (; i < num_boxes; ++i) {
+    bool is_inside = true;
+
+    for (const CullPlane& plane : planes) {
+      float dist = (center_x_[i] * plane.x + center_y_[i] * plane.y) + 
+                   (center_z_[i] * plane.z + plane.w);
+      float radius = extent_x_[i] * plane.abs_x + 
+                     extent_y_[i] * plane.abs_y + 
+                     extent_z_[i] * plane.abs_z;
+      if (dist + radius < 0.f) {
+        is_inside = false;
+        break;
+      }
+    }
+
+    if (is_inside) {
+      visibility_[i >> 6] |= uint64_t(1) << (i & 63);
+      ++num_visible_;
+    }
+  }
+}
+
+int FrustumCuller::GetSimdWidth() {
+  return kSimdWidth;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
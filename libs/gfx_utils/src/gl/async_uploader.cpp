@@ -0,0 +1,153 @@
+#include "gfx_utils/gl/async_uploader.h"
+
+#include <iostream>
+#include <chrono>
+
+namespace gfx_utils {
+
+bool AsyncUploader::Initialize(Window* window) {
+  window_ = window;
+
+  context_ = window_->CreateSharedContext();
+  if (context_ == nullptr) {
+    return false;
+  }
+
+  should_quit_ = false;
+  worker_ = std::thread(&AsyncUploader::WorkerMain, this);
+
+  is_initialized_ = true;
+
+  return true;
+}
+
+void AsyncUploader::Destroy() {
+  if (!is_initialized_) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    should_quit_ = true;
+  }
+  queue_cv_.notify_one();
+
+  // The worker drains the queue before it exits
+  worker_.join();
+
+  Finish();
+
+  window_->DestroySharedContext(context_);
+  context_ = nullptr;
+
+  is_initialized_ = false;
+}
+
+void AsyncUploader::Enqueue(UploadFunc upload, CompleteFunc complete) {
+  ++num_pending_;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Job job;
+    job.upload = std::move(upload);
+    job.complete = std::move(complete);
+    queue_.push_back(std::move(job));
+  }
+  queue_cv_.notify_one();
+}
+
+int AsyncUploader::ProcessCompleted() {
+  std::vector<CompleteFunc> completed;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (size_t i = 0; i < in_flight_.size(); ) {
+      // Sync objects are shared between contexts, so the main thread can
+      // poll fences the upload thread created
+      GLenum result = glClientWaitSync(in_flight_[i].fence, 0, 0);
+      if (result == GL_TIMEOUT_EXPIRED) {
+        ++i;
+        continue;
+      }
+
+      if (result == GL_WAIT_FAILED) {
+        std::cerr << "Failed to wait on upload fence" << std::endl;
+      }
+
+      glDeleteSync(in_flight_[i].fence);
+      completed.push_back(std::move(in_flight_[i].complete));
+
+      in_flight_[i] = std::move(in_flight_.back());
+      in_flight_.pop_back();
+    }
+  }
+
+  // Outside the lock, since completion functions may enqueue more uploads
+  for (CompleteFunc& complete : completed) {
+    if (complete) {
+      complete();
+    }
+    --num_pending_;
+  }
+
+  return static_cast<int>(completed.size());
+}
+
+void AsyncUploader::Finish() {
+  while (num_pending_.load() > 0) {
+    if (ProcessCompleted() == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+
+void AsyncUploader::WorkerMain() {
+  glfwMakeContextCurrent(context_);
+
+  UploadStaging staging;
+  glGenBuffers(1, &staging.pixel_buffer_id);
+  glGenBuffers(1, &staging.vertex_buffer_id);
+
+  while (true) {
+    Job job;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_cv_.wait(lock, [this]() {
+        return should_quit_ || !queue_.empty();
+      });
+
+      if (queue_.empty()) {
+        break;
+      }
+
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    job.upload(staging);
+
+    InFlightUpload upload;
+    upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    upload.complete = std::move(job.complete);
+
+    // Without a flush the fence might never reach the GPU, since nothing
+    // else is submitted on this context
+    glFlush();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_.push_back(std::move(upload));
+  }
+
+  glDeleteBuffers(1, &staging.pixel_buffer_id);
+  glDeleteBuffers(1, &staging.vertex_buffer_id);
+
+  // Deleting the staging buffers doesn't affect uploads still in flight
+  glFlush();
+
+  glfwMakeContextCurrent(nullptr);
+}
+
+} // namespace gfx_utils
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "gfx_utils/gl/block_buffer.h"
+
+#include <iostream>
+#include <algorithm>
+
+namespace gfx_utils {
+
+bool BlockBuffer::Initialize(GLenum target, size_t size) {
+  target_ = target;
+
+  GLint alignment = 0;
+  if (target_ == GL_UNIFORM_BUFFER) {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  }
+  else if (target_ == GL_SHADER_STORAGE_BUFFER) {
+    if (!GLEW_VERSION_4_3) {
+      std::cerr << "Shader storage buffers need GL 4.3" << std::endl;
+      return false;
+    }
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  }
+  alignment_ = alignment > 0 ? static_cast<size_t>(alignment) : 256;
+
+  glGenBuffers(1, &buffer_id_);
+
+  // Bound to GL_COPY_WRITE_BUFFER so the indexed binding points of the
+  // buffer's own target are left alone
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id_);
+  glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  size_ = size;
+
+  return true;
+}
+
+void BlockBuffer::Destroy() {
+  if (buffer_id_ != 0) {
+    glDeleteBuffers(1, &buffer_id_);
+    buffer_id_ = 0;
+  }
+
+  size_ = 0;
+}
+
+void BlockBuffer::Reserve(size_t size) {
+  if (size <= size_) {
+    return;
+  }
+
+  // Doubling keeps the number of copies logarithmic in the final size
+  size_t new_size = std::max(size, size_ * 2);
+
+  GLuint new_buffer_id = 0;
+  glGenBuffers(1, &new_buffer_id);
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer_id);
+  glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, GL_DYNAMIC_DRAW);
+
+  if (size_ > 0) {
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer_id_);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, 
+                        size_);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  glDeleteBuffers(1, &buffer_id_);
+
+  buffer_id_ = new_buffer_id;
+  size_ = new_size;
+}
+
+void BlockBuffer::Write(size_t offset, size_t size, const void* data) {
+  if (size == 0) {
+    return;
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id_);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void BlockBuffer::BindRange(GLuint binding, size_t offset, 
+                            size_t size) const {
+  glBindBufferRange(target_, binding, buffer_id_, offset, size);
+}
+
+void BlockBuffer::BindBase(GLuint binding) const {
+  glBindBufferBase(target_, binding, buffer_id_);
+}
+
+} // namespace gfx_utils
\ No newline at end of file
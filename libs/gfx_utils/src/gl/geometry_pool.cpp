@@ -0,0 +1,486 @@
+#include "gfx_utils/gl/geometry_pool.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace gfx_utils {
+
+// Size of one vertex of each attribute in bytes
+static const size_t kVertTypeSizes[kNumVertTypes] = {
+  3 * sizeof(float), // Position
+  3 * sizeof(float), // Normal
+  2 * sizeof(float), // Texcoord
+  sizeof(uint32_t)   // Material id
+};
+
+// Avoids a string of small reallocations when meshes are added one by one
+static const uint32_t kMinVertexCapacity = 64 * 1024;
+static const uint32_t kMinIndexCapacity = 3 * 64 * 1024;
+
+// Doubles the capacity until required fits, clamped to what a uint32_t
+// count holds. Returns false if required doesn't fit at all
+static bool CalcGrownCapacity(uint32_t capacity, uint32_t min_capacity,
+                              uint64_t required, uint32_t* out_capacity) {
+  const uint64_t kMaxCapacity = std::numeric_limits<uint32_t>::max();
+  if (required > kMaxCapacity) {
+    std::cerr << "Geometry pool can't grow past " << kMaxCapacity 
+              << " elements" << std::endl;
+    return false;
+  }
+
+  uint64_t new_capacity = std::max(std::max(capacity, min_capacity), 1u);
+  while (new_capacity < required) {
+    new_capacity *= 2;
+  }
+
+  *out_capacity = static_cast<uint32_t>(std::min(new_capacity, kMaxCapacity));
+  return true;
+}
+
+// Creates a buffer of new_size bytes and copies the old buffer's contents
+// into it on the GPU
+static GLuint ReallocateBuffer(GLuint old_buffer_id, size_t old_size,
+                               size_t new_size) {
+  GLuint buffer_id;
+  glGenBuffers(1, &buffer_id);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+  glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+
+  if (old_buffer_id != 0) {
+    if (old_size > 0) {
+      glBindBuffer(GL_COPY_READ_BUFFER, old_buffer_id);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                          old_size);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    glDeleteBuffers(1, &old_buffer_id);
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  return buffer_id;
+}
+
+void GeometryPool::Destroy() {
+  DestroyVertexArrays();
+
+  for (GLuint& buffer_id : vertex_buffer_ids_) {
+    if (buffer_id != 0) {
+      glDeleteBuffers(1, &buffer_id);
+      buffer_id = 0;
+    }
+  }
+
+  if (index_buffer_id_ != 0) {
+    glDeleteBuffers(1, &index_buffer_id_);
+    index_buffer_id_ = 0;
+  }
+
+  vertex_allocator_ = RangeAllocator();
+  index_allocator_ = RangeAllocator();
+
+  ++generation_;
+}
+
+void GeometryPool::Reserve(uint32_t num_extra_verts,
+                           uint32_t num_extra_indices) {
+  uint32_t new_capacity = 0;
+
+  uint64_t required_verts = 
+      static_cast<uint64_t>(vertex_allocator_.GetUsed()) + num_extra_verts;
+  if (required_verts > vertex_allocator_.GetCapacity() &&
+      CalcGrownCapacity(vertex_allocator_.GetCapacity(), kMinVertexCapacity,
+                        required_verts, &new_capacity)) {
+    GrowVertexBuffers(new_capacity);
+  }
+
+  uint64_t required_indices = 
+      static_cast<uint64_t>(index_allocator_.GetUsed()) + num_extra_indices;
+  if (required_indices > index_allocator_.GetCapacity() &&
+      CalcGrownCapacity(index_allocator_.GetCapacity(), kMinIndexCapacity,
+                        required_indices, &new_capacity)) {
+    GrowIndexBuffer(new_capacity);
+  }
+}
+
+bool GeometryPool::AddMesh(const Mesh& mesh, GeometryRange* out_range) {
+  if (!AllocateMesh(mesh, out_range)) {
+    return false;
+  }
+
+  UploadMesh(mesh, *out_range);
+
+  return true;
+}
+
+bool GeometryPool::AllocateMesh(const Mesh& mesh, GeometryRange* out_range) {
+  uint32_t num_verts = static_cast<uint32_t>(mesh.pos_data.size());
+  if (num_verts == 0) {
+    return false;
+  }
+
+  bool is_indexed = !mesh.index_data.empty();
+  uint32_t index_count = is_indexed ?
+      static_cast<uint32_t>(mesh.index_data.size()) : num_verts;
+
+  // Fragmentation can make an allocation fail even though there is enough
+  // space in total, so grow by the whole request
+  uint32_t new_capacity = 0;
+
+  uint32_t vertex_offset;
+  if (!vertex_allocator_.Allocate(num_verts, &vertex_offset)) {
+    if (!CalcGrownCapacity(
+            vertex_allocator_.GetCapacity(), kMinVertexCapacity,
+            static_cast<uint64_t>(vertex_allocator_.GetCapacity()) + num_verts,
+            &new_capacity)) {
+      return false;
+    }
+    GrowVertexBuffers(new_capacity);
+
+    if (!vertex_allocator_.Allocate(num_verts, &vertex_offset)) {
+      std::cerr << "Could not allocate " << num_verts 
+                << " vertices in the geometry pool" << std::endl;
+      return false;
+    }
+  }
+
+  uint32_t index_offset;
+  if (!index_allocator_.Allocate(index_count, &index_offset)) {
+    if (!CalcGrownCapacity(
+            index_allocator_.GetCapacity(), kMinIndexCapacity,
+            static_cast<uint64_t>(index_allocator_.GetCapacity()) + 
+                index_count,
+            &new_capacity)) {
+      vertex_allocator_.Free(vertex_offset, num_verts);
+      return false;
+    }
+    GrowIndexBuffer(new_capacity);
+
+    if (!index_allocator_.Allocate(index_count, &index_offset)) {
+      std::cerr << "Could not allocate " << index_count 
+                << " indices in the geometry pool" << std::endl;
+      vertex_allocator_.Free(vertex_offset, num_verts);
+      return false;
+    }
+  }
+
+  out_range->base_vertex = static_cast<int32_t>(vertex_offset);
+  out_range->num_verts = num_verts;
+  out_range->first_index = index_offset;
+  out_range->index_count = index_count;
+
+  return true;
+}
+
+void GeometryPool::UploadMesh(const Mesh& mesh, const GeometryRange& range,
+                              GLuint staging_buffer_id) const {
+  uint32_t num_verts = range.num_verts;
+  uint32_t index_count = range.index_count;
+  bool is_indexed = !mesh.index_data.empty();
+
+  const void* attrib_data[kNumVertTypes] = {
+    &mesh.pos_data[0],
+    mesh.normal_data.size() >= num_verts ? &mesh.normal_data[0] : nullptr,
+    mesh.texcoord_data.size() >= num_verts ? &mesh.texcoord_data[0] : nullptr,
+    mesh.mtl_id_data.size() >= num_verts ? &mesh.mtl_id_data[0] : nullptr
+  };
+
+  std::vector<uint32_t> sequential_indices;
+  const uint32_t* index_data = nullptr;
+  if (is_indexed) {
+    index_data = &mesh.index_data[0];
+  }
+  else {
+    sequential_indices.resize(index_count);
+    for (uint32_t i = 0; i < index_count; ++i) {
+      sequential_indices[i] = i;
+    }
+    index_data = &sequential_indices[0];
+  }
+
+  size_t vertex_offset = static_cast<size_t>(range.base_vertex);
+  size_t index_size = index_count * sizeof(uint32_t);
+
+  if (staging_buffer_id != 0) {
+    UploadMeshStaged(attrib_data, index_data, range, staging_buffer_id);
+    return;
+  }
+
+  std::vector<uint8_t> zeros;
+
+  for (int i = 0; i < kNumVertTypes; ++i) {
+    size_t size = num_verts * kVertTypeSizes[i];
+
+    const void* data = attrib_data[i];
+    if (!data) {
+      zeros.resize(size, 0);
+      data = &zeros[0];
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_ids_[i]);
+    glBufferSubData(GL_ARRAY_BUFFER, vertex_offset * kVertTypeSizes[i], size,
+                    data);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // Bound to GL_COPY_WRITE_BUFFER instead of GL_ELEMENT_ARRAY_BUFFER so the
+  // upload doesn't change the index buffer of whichever VAO is bound
+  glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer_id_);
+
+  glBufferSubData(GL_COPY_WRITE_BUFFER, range.first_index * sizeof(uint32_t),
+                  index_size, index_data);
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GeometryPool::UploadMeshStaged(const void* const* attrib_data,
+                                    const uint32_t* index_data,
+                                    const GeometryRange& range,
+                                    GLuint staging_buffer_id) const {
+  // Staging layout - each attribute's vertices, then the indices
+  size_t staging_offsets[kNumVertTypes + 1];
+  size_t staging_size = 0;
+  for (int i = 0; i < kNumVertTypes; ++i) {
+    staging_offsets[i] = staging_size;
+    staging_size += range.num_verts * kVertTypeSizes[i];
+  }
+  staging_offsets[kNumVertTypes] = staging_size;
+  staging_size += range.index_count * sizeof(uint32_t);
+
+  glBindBuffer(GL_COPY_READ_BUFFER, staging_buffer_id);
+
+  // Orphans the previous contents, so reusing the buffer never waits for the
+  // copies of the last upload
+  glBufferData(GL_COPY_READ_BUFFER, staging_size, nullptr, GL_STREAM_COPY);
+
+  uint8_t* staging_data = static_cast<uint8_t*>(glMapBufferRange(
+      GL_COPY_READ_BUFFER, 0, staging_size, 
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  if (!staging_data) {
+    std::cerr << "Failed to map geometry staging buffer" << std::endl;
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return;
+  }
+
+  for (int i = 0; i < kNumVertTypes; ++i) {
+    size_t size = range.num_verts * kVertTypeSizes[i];
+    if (attrib_data[i]) {
+      memcpy(staging_data + staging_offsets[i], attrib_data[i], size);
+    }
+    else {
+      memset(staging_data + staging_offsets[i], 0, size);
+    }
+  }
+
+  memcpy(staging_data + staging_offsets[kNumVertTypes], index_data,
+         range.index_count * sizeof(uint32_t));
+
+  glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+  size_t vertex_offset = static_cast<size_t>(range.base_vertex);
+
+  for (int i = 0; i < kNumVertTypes; ++i) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer_ids_[i]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+                        staging_offsets[i], vertex_offset * kVertTypeSizes[i],
+                        range.num_verts * kVertTypeSizes[i]);
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer_id_);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                      staging_offsets[kNumVertTypes],
+                      range.first_index * sizeof(uint32_t),
+                      range.index_count * sizeof(uint32_t));
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void GeometryPool::RemoveMesh(const GeometryRange& range) {
+  vertex_allocator_.Free(static_cast<uint32_t>(range.base_vertex),
+                         range.num_verts);
+  index_allocator_.Free(range.first_index, range.index_count);
+}
+
+void GeometryPool::ReadbackMesh(const GeometryRange& range, 
+                                VertexLayout layout, Mesh* out_mesh) const {
+  void* attrib_data[kNumVertTypes] = {nullptr, nullptr, nullptr, nullptr};
+
+  if (layout & kVertexLayoutPosition) {
+    out_mesh->pos_data.resize(range.num_verts);
+    attrib_data[kVertTypePosition] = &out_mesh->pos_data[0];
+  }
+  if (layout & kVertexLayoutNormal) {
+    out_mesh->normal_data.resize(range.num_verts);
+    attrib_data[kVertTypeNormal] = &out_mesh->normal_data[0];
+  }
+  if (layout & kVertexLayoutTexcoord) {
+    out_mesh->texcoord_data.resize(range.num_verts);
+    attrib_data[kVertTypeTexcoord] = &out_mesh->texcoord_data[0];
+  }
+  if (layout & kVertexLayoutMtlId) {
+    out_mesh->mtl_id_data.resize(range.num_verts);
+    attrib_data[kVertTypeMtlId] = &out_mesh->mtl_id_data[0];
+  }
+
+  size_t vertex_offset = static_cast<size_t>(range.base_vertex);
+
+  for (int i = 0; i < kNumVertTypes; ++i) {
+    if (!attrib_data[i]) {
+      continue;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, vertex_buffer_ids_[i]);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, vertex_offset * kVertTypeSizes[i],
+                       range.num_verts * kVertTypeSizes[i], attrib_data[i]);
+  }
+
+  out_mesh->index_data.resize(range.index_count);
+
+  glBindBuffer(GL_COPY_READ_BUFFER, index_buffer_id_);
+  glGetBufferSubData(GL_COPY_READ_BUFFER, range.first_index * sizeof(uint32_t),
+                     range.index_count * sizeof(uint32_t),
+                     &out_mesh->index_data[0]);
+
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+size_t GeometryPool::CalcRangeByteSize(const GeometryRange& range) {
+  size_t vertex_size = 0;
+  for (size_t size : kVertTypeSizes) {
+    vertex_size += size;
+  }
+
+  return range.num_verts * vertex_size + range.index_count * sizeof(uint32_t);
+}
+
+void GeometryPool::BindVertexAttribute(VertType vert_type,
+                                       GLuint location) const {
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_ids_[vert_type]);
+  glEnableVertexAttribArray(location);
+
+  switch (vert_type) {
+  case kVertTypePosition:
+  case kVertTypeNormal:
+    glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+    break;
+  case kVertTypeTexcoord:
+    glVertexAttribPointer(location, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+    break;
+  case kVertTypeMtlId:
+    // The shaders read material ids as uint, which needs the I variant
+    glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, 0, (GLvoid*)0);
+    break;
+  default:
+    break;
+  }
+}
+
+void GeometryPool::BindIndexBuffer() const {
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_id_);
+}
+
+GLuint GeometryPool::GetVertexArrayId(VertexLayout layout) {
+  layout &= kVertexLayoutAll;
+
+  if (vao_ids_[layout] != 0) {
+    return vao_ids_[layout];
+  }
+
+  // Restores the bindings afterwards so that this can be called in the middle
+  // of a frame without invalidating a GLStateCache
+  GLint prev_vao_id = 0;
+  GLint prev_array_buffer_id = 0;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prev_vao_id);
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prev_array_buffer_id);
+
+  GLuint vao_id;
+  glGenVertexArrays(1, &vao_id);
+  glBindVertexArray(vao_id);
+
+  for (int i = 0; i < kNumVertTypes; ++i) {
+    if (layout & (1 << i)) {
+      BindVertexAttribute(static_cast<VertType>(i), i);
+    }
+  }
+
+  // The element array binding is part of the VAO state
+  BindIndexBuffer();
+
+  glBindVertexArray(static_cast<GLuint>(prev_vao_id));
+  glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(prev_array_buffer_id));
+
+  vao_ids_[layout] = vao_id;
+
+  return vao_id;
+}
+
+void GeometryPool::GrowVertexBuffers(uint32_t new_capacity) {
+  FinishUploads();
+  DestroyVertexArrays();
+
+  uint32_t old_capacity = vertex_allocator_.GetCapacity();
+
+  for (int i = 0; i < kNumVertTypes; ++i) {
+    vertex_buffer_ids_[i] = ReallocateBuffer(
+        vertex_buffer_ids_[i], old_capacity * kVertTypeSizes[i],
+        new_capacity * kVertTypeSizes[i]);
+  }
+
+  vertex_allocator_.Grow(new_capacity);
+
+  ++generation_;
+}
+
+void GeometryPool::GrowIndexBuffer(uint32_t new_capacity) {
+  FinishUploads();
+  DestroyVertexArrays();
+
+  uint32_t old_capacity = index_allocator_.GetCapacity();
+
+  index_buffer_id_ = ReallocateBuffer(index_buffer_id_,
+                                      old_capacity * sizeof(uint32_t),
+                                      new_capacity * sizeof(uint32_t));
+
+  index_allocator_.Grow(new_capacity);
+
+  ++generation_;
+}
+
+void GeometryPool::DestroyVertexArrays() {
+  for (GLuint& vao_id : vao_ids_) {
+    if (vao_id != 0) {
+      glDeleteVertexArrays(1, &vao_id);
+      vao_id = 0;
+    }
+  }
+
+  // Called whenever the buffers are reallocated or destroyed too
+  if (state_cache_) {
+    state_cache_->Invalidate();
+  }
+}
+
+void GeometryPool::FinishUploads() {
+  // Their completion functions run too, and must not allocate from the pool
+  if (uploader_ && uploader_->GetNumPending() > 0) {
+    uploader_->Finish();
+  }
+}
+
+bool IsMultiDrawIndirectSupported() {
+  return GLEW_VERSION_4_3 && 
+         (GLEW_VERSION_4_6 || GLEW_ARB_shader_draw_parameters);
+}
+
+bool IsMultiDrawIndirectCountSupported() {
+  return IsMultiDrawIndirectSupported() && 
+         (GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters);
+}
+
+} // namespace gfx_utils
\ No newline at end of file
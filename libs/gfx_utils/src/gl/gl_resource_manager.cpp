@@ -1,213 +1,978 @@
 #include "gfx_utils/gl/gl_resource_manager.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <memory>
 
 namespace gfx_utils {
 
+// Unit cube drawn in place of meshes that are still uploading
+static Mesh CreatePlaceholderMesh() {
+  Mesh mesh;
+
+  for (int i = 0; i < 8; ++i) {
+    mesh.pos_data.push_back(glm::vec3((i & 1) ? 0.5f : -0.5f,
+                                      (i & 2) ? 0.5f : -0.5f,
+                                      (i & 4) ? 0.5f : -0.5f));
+  }
+
+  mesh.index_data = { 0, 2, 1, 1, 2, 3, // -z
+                      4, 5, 6, 5, 7, 6, // +z
+                      0, 1, 4, 1, 5, 4, // -y
+                      2, 6, 3, 3, 6, 7, // +y
+                      0, 4, 2, 2, 4, 6, // -x
+                      1, 3, 5, 3, 7, 5  // +x
+                    };
+  mesh.num_verts = static_cast<uint32_t>(mesh.index_data.size());
+
+  return mesh;
+}
+
+// Creates a 2D texture from the image. With a pixel buffer id the pixels go
+// through that pixel buffer object, which is reallocated to fit
+static GLuint CreateTexture2D(const Image& image, GLuint pixel_buffer_id) {
+  GLuint texture_id;
+  glGenTextures(1, &texture_id);
+  glBindTexture(GL_TEXTURE_2D, texture_id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  GLenum format = image.format == kImageFormatRGBA ? GL_RGBA : GL_RGB;
+
+  const void* pixels = &image.data[0];
+
+  if (pixel_buffer_id != 0) {
+    size_t size = image.data.size();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer_id);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+    void* staging_data = glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, size, 
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if (staging_data) {
+      memcpy(staging_data, pixels, size);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+      // Offset into the bound pixel buffer
+      pixels = nullptr;
+    }
+    else {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+  }
+
+  glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, 
+               format, GL_UNSIGNED_BYTE, pixels);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return texture_id;
+}
+
 void GLResourceManager::CreateGLResources() {
-  const auto& models = scene_->GetModels();
+  SceneChanges changes;
+  scene_->TakeChanges(&changes);
 
-  for (auto model_ptr : models) {
+  if (changes.IsEmpty()) {
+    return;
+  }
+
+  if ((uploader_ || memory_tracker_.GetBudget() > 0) && !has_placeholders_) {
+    CreatePlaceholders();
+  }
+
+  size_t prev_reclaimed_bytes = reclaimed_cpu_bytes_;
+
+  // Removals go first so that the pool can reuse their ranges for the meshes
+  // added below
+  for (auto model_ptr : changes.removed_models) {
     for (gfx_utils::Mesh& mesh : model_ptr->GetMeshes()) {
-      CreateMeshResources(mesh);
+      RemoveMesh(&mesh);
     }
   }
 
-  // Maps the texture name to the corresponding Texture pointer
-  auto& texture_name_map = scene_->GetTextureNameMap();
+  for (auto texture_ptr : changes.removed_textures) {
+    RemoveTexture(texture_ptr.get());
+  }
 
-  // Allocate textures 
-  for (auto it = texture_name_map.begin(); it != texture_name_map.end(); ++it) {
-    auto texture_ptr = it->second;
+  // Modified assets are recreated from their new data
+  std::vector<MeshChange> new_meshes;
 
-    CreateTextureResources(*texture_ptr);
+  for (const MeshChange& change : changes.modified_meshes) {
+    RemoveMesh(change.mesh);
+    new_meshes.push_back(change);
   }
 
-  auto& cubemap_name_map = scene_->GetCubemapNameMap();
+  for (auto model_ptr : changes.added_models) {
+    for (gfx_utils::Mesh& mesh : model_ptr->GetMeshes()) {
+      MeshChange change;
+      change.model = model_ptr;
+      change.mesh = &mesh;
+      new_meshes.push_back(change);
+    }
+  }
 
-  // Allocate cubemaps 
-  for (auto it = cubemap_name_map.begin(); it != cubemap_name_map.end(); ++it) {
-    auto cubemap_ptr = it->second;
+  // Size the pool for all the new meshes up front so it grows at most once
+  uint32_t num_new_verts = 0;
+  uint32_t num_new_indices = 0;
 
-    CreateCubemapResources(*cubemap_ptr);
+  for (const MeshChange& change : new_meshes) {
+    const Mesh& mesh = *change.mesh;
+    if (meshes_.Get(mesh.gl_handles)) {
+      continue;
+    }
+
+    num_new_verts += static_cast<uint32_t>(mesh.pos_data.size());
+    num_new_indices += static_cast<uint32_t>(mesh.index_data.empty() ? 
+        mesh.pos_data.size() : mesh.index_data.size());
+  }
+
+  // Growing the pool once up front saves reallocations. Fragmentation can
+  // still make an allocation grow it, which waits for the uploads in flight
+  geometry_pool_.Reserve(num_new_verts, num_new_indices);
+
+  for (const MeshChange& change : new_meshes) {
+    // Meshes added and modified since the last call show up twice
+    if (meshes_.Get(change.mesh->gl_handles)) {
+      continue;
+    }
+
+    CreateMeshResources(change.model, change.mesh);
+  }
+
+  for (auto texture_ptr : changes.modified_textures) {
+    RemoveTexture(texture_ptr.get());
+    changes.added_textures.push_back(texture_ptr);
+  }
+
+  for (auto texture_ptr : changes.added_textures) {
+    // Names that alias the same image share one GL texture. A texture
+    // shared with another scene has that scene manager's handle too, which
+    // this manager's pool doesn't accept
+    if (textures_.Get(texture_ptr->gl_handles)) {
+      continue;
+    }
+
+    CreateTextureResources(texture_ptr);
+  }
+
+  for (auto cubemap_ptr : changes.added_cubemaps) {
+    if (cubemaps_.Get(cubemap_ptr->gl_handles)) {
+      continue;
+    }
+
+    CreateCubemapResources(cubemap_ptr.get());
+  }
+
+  size_t reclaimed_bytes = reclaimed_cpu_bytes_ - prev_reclaimed_bytes;
+  if (reclaimed_bytes > 0) {
+    std::cout << "Released " << reclaimed_bytes / 1024 
+              << " KB of CPU-side asset data" << std::endl;
   }
 }
 
-void GLResourceManager::Cleanup() {
-  for (auto it : cubemap_gl_id_map_) {
-    glDeleteTextures(1, &it.second);
+void GLResourceManager::BeginFrame() {
+  ++frame_;
+
+  ProcessUploads();
+
+  ReloadRequested();
+
+  EnforceMemoryBudget();
+}
+
+int GLResourceManager::ProcessUploads() {
+  if (!uploader_) {
+    return 0;
   }
 
-  for (auto it : texture_gl_id_map_) {
-    glDeleteTextures(1, &it.second);
+  return uploader_->ProcessCompleted();
+}
+
+void GLResourceManager::SetMemoryBudget(size_t bytes) {
+  memory_tracker_.SetBudget(bytes);
+
+  // Evicted assets are drawn as placeholders until they are back
+  if (bytes > 0 && !has_placeholders_) {
+    CreatePlaceholders();
   }
 
-  for (auto it : mesh_pos_gl_id_map_) {
-    glDeleteBuffers(1, &it.second);
+  has_warned_budget_ = false;
+}
+
+void GLResourceManager::CreatePlaceholders() {
+  // Mid grey, so placeholders neither stand out nor disappear
+  const uint8_t texel[4] = {128, 128, 128, 255};
+
+  glGenTextures(1, &placeholder_texture_id_);
+  glBindTexture(GL_TEXTURE_2D, placeholder_texture_id_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+               texel);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (!geometry_pool_.AddMesh(CreatePlaceholderMesh(), &placeholder_range_)) {
+    std::cerr << "Failed to add the placeholder mesh" << std::endl;
   }
 
-  for (auto it : mesh_normal_gl_id_map_) {
-    glDeleteBuffers(1, &it.second);
+  has_placeholders_ = true;
+}
+
+size_t GLResourceManager::ReleaseCpuData(MeshRecord* record) {
+  size_t reclaimed_bytes = ReleaseMeshData(record->mesh, 
+                                           record->mesh->residency);
+  reclaimed_cpu_bytes_ += reclaimed_bytes;
+  return reclaimed_bytes;
+}
+
+size_t GLResourceManager::ReleaseCpuData(TextureRecord* record) {
+  if (!CanReleaseImage(*record->texture)) {
+    return 0;
   }
 
-  for (auto it : mesh_texcoord_gl_id_map_) {
-    glDeleteBuffers(1, &it.second);
+  size_t reclaimed_bytes = ReleaseImageData(&record->texture->image);
+  reclaimed_cpu_bytes_ += reclaimed_bytes;
+  return reclaimed_bytes;
+}
+
+bool GLResourceManager::CanReleaseImage(const Texture& texture) {
+  if (texture.residency == kResidencyKeep) {
+    return false;
+  }
+
+  // Shared textures are released by whichever scene holds them last
+  return scene_->GetTextureCache()->GetNumSceneRefs(texture) <= 1;
+}
+
+size_t GLResourceManager::ReleaseCpuData() {
+  size_t reclaimed_bytes = 0;
+
+  for (auto model_ptr : scene_->GetModels()) {
+    for (gfx_utils::Mesh& mesh : model_ptr->GetMeshes()) {
+      // Only release data that is on the GPU
+      const MeshRecord* record = meshes_.Get(mesh.gl_handles);
+      if (!record || !record->is_uploaded || record->is_evicted) {
+        continue;
+      }
+
+      reclaimed_bytes += ReleaseMeshData(&mesh, mesh.residency);
+    }
   }
 
-  for (auto it : mesh_mtl_id_gl_id_map_) {
-    glDeleteBuffers(1, &it.second);
+  for (auto& it : scene_->GetTextureNameMap()) {
+    Texture* texture = it.second.get();
+
+    if (!CanReleaseImage(*texture)) {
+      continue;
+    }
+
+    const TextureRecord* record = textures_.Get(texture->gl_handles);
+    if (!record || !record->is_uploaded || record->is_evicted) {
+      continue;
+    }
+
+    reclaimed_bytes += ReleaseImageData(&texture->image);
+  }
+
+  reclaimed_cpu_bytes_ += reclaimed_bytes;
+
+  return reclaimed_bytes;
+}
+
+void GLResourceManager::Cleanup() {
+  // Completion functions of uploads in flight refer to the records
+  if (uploader_) {
+    uploader_->Finish();
   }
 
-  for (auto it : mesh_ibo_gl_id_map_) {
-    glDeleteBuffers(1, &it.second);
+  cubemaps_.ForEach([this](CubemapRecord& record) {
+    GLuint gl_ids[] = {
+      record.gl_id, record.specular_gl_id, record.irradiance_gl_id
+    };
+    for (GLuint gl_id : gl_ids) {
+      if (gl_id != 0) {
+        glDeleteTextures(1, &gl_id);
+      }
+    }
+
+    memory_tracker_.Remove(kGpuMemoryCubemap, record.gpu_bytes);
+  });
+  cubemaps_.Clear();
+
+  textures_.ForEach([this](TextureRecord& record) {
+    if (record.gl_id != 0) {
+      glDeleteTextures(1, &record.gl_id);
+      memory_tracker_.Remove(kGpuMemoryTexture, record.gpu_bytes);
+    }
+  });
+  textures_.Clear();
+
+  if (has_placeholders_) {
+    glDeleteTextures(1, &placeholder_texture_id_);
+    placeholder_texture_id_ = 0;
+    placeholder_range_ = GeometryRange();
+    has_placeholders_ = false;
   }
+
+  meshes_.ForEach([this](MeshRecord& record) {
+    if (!record.is_evicted) {
+      memory_tracker_.Remove(kGpuMemoryMesh, record.gpu_bytes);
+    }
+  });
+
+  material_buffer_.Destroy();
+  material_allocator_.Clear();
+  material_unit_size_ = 0;
+
+  geometry_pool_.Destroy();
+  meshes_.Clear();
+
+  mesh_reloads_.clear();
+  texture_reloads_.clear();
 }
 
-void GLResourceManager::CreateMeshResources(const Mesh& mesh) {
-  MeshId id = mesh.id;
+void GLResourceManager::CreateMeshResources(const ModelPtr& model, 
+                                            Mesh* mesh) {
+  MeshId id = mesh->id;
+
+  if (mesh->pos_data.empty()) {
+    std::cerr << "Mesh " << id << " has no vertex data to upload" << std::endl;
+    return;
+  }
+
+  // Meshes built by hand may not have bounds yet. The positions are still
+  // around here, and culling needs the bounds after they are released
+  if (!mesh->has_bounds) {
+    ComputeMeshBounds(mesh);
+  }
       
-  GLuint pos_vbo_id;
-  glGenBuffers(1, &pos_vbo_id);
-  glBindBuffer(GL_ARRAY_BUFFER, pos_vbo_id);
-  glBufferData(GL_ARRAY_BUFFER, mesh.pos_data.size() * 3 * sizeof(float),
-                &mesh.pos_data[0], GL_STATIC_DRAW);
-  mesh_pos_gl_id_map_[id] = pos_vbo_id;
-
-  GLuint normal_vbo_id;
-  glGenBuffers(1, &normal_vbo_id);
-  glBindBuffer(GL_ARRAY_BUFFER, normal_vbo_id);
-  glBufferData(GL_ARRAY_BUFFER, mesh.normal_data.size() * 3 * sizeof(float),
-                &mesh.normal_data[0], GL_STATIC_DRAW);
-  mesh_normal_gl_id_map_[id] = normal_vbo_id;
-
-  GLuint texcoord_vbo_id;
-  glGenBuffers(1, &texcoord_vbo_id);
-  glBindBuffer(GL_ARRAY_BUFFER, texcoord_vbo_id);
-  glBufferData(GL_ARRAY_BUFFER, mesh.texcoord_data.size() * 2 * sizeof(float),
-                &mesh.texcoord_data[0], GL_STATIC_DRAW);
-  mesh_texcoord_gl_id_map_[id] = texcoord_vbo_id;
-
-  if (mesh.material_list.size() != 0) {
-    GLuint mtl_vbo_id;
-    glGenBuffers(1, &mtl_vbo_id);
-    glBindBuffer(GL_ARRAY_BUFFER, mtl_vbo_id);
-    glBufferData(GL_ARRAY_BUFFER,
-                  mesh.mtl_id_data.size() * sizeof(unsigned int),
-                  &mesh.mtl_id_data[0], GL_STATIC_DRAW);
-    mesh_mtl_id_gl_id_map_[id] = mtl_vbo_id;
-  }
-  else {
-    mesh_mtl_id_gl_id_map_[id] = 0;
-  }
-
-  if (mesh.index_data.size() != 0) {
-    GLuint ibo_id;
-    glGenBuffers(1, &ibo_id);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                mesh.index_data.size() * sizeof(uint32_t),
-                &mesh.index_data[0], GL_STATIC_DRAW);
-    mesh_ibo_gl_id_map_[id] = ibo_id;
-  }
-  else {
-    mesh_ibo_gl_id_map_[id] = 0;
-  }
-}
-
-void GLResourceManager::CreateTextureResources(const Texture& texture) {
-  GLuint texture_id;
-  glGenTextures(1, &texture_id);
-  glBindTexture(GL_TEXTURE_2D, texture_id);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  MeshRecord record;
+  record.mesh_id = id;
+  record.model = model;
+  record.mesh = mesh;
+
+  if (!geometry_pool_.AllocateMesh(*mesh, &record.range)) {
+    std::cerr << "Failed to add mesh " << id << " to the geometry pool" 
+              << std::endl;
+    return;
+  }
+
+  size_t num_verts = mesh->pos_data.size();
 
-  GLenum format;
-  if (texture.image.format == kImageFormatRGBA) {
-    format = GL_RGBA;
+  record.layout = kVertexLayoutPosition;
+  if (mesh->normal_data.size() >= num_verts) {
+    record.layout |= kVertexLayoutNormal;
   }
-  else if (texture.image.format == kImageFormatRGB) {
-    format = GL_RGB;
+  if (mesh->texcoord_data.size() >= num_verts) {
+    record.layout |= kVertexLayoutTexcoord;
+  }
+  if (mesh->mtl_id_data.size() >= num_verts) {
+    record.layout |= kVertexLayoutMtlId;
   }
 
-  glTexImage2D(GL_TEXTURE_2D, 0, format, texture.image.width,
-               texture.image.height, 0, format, GL_UNSIGNED_BYTE,
-               &texture.image.data[0]);
+  record.gpu_bytes = GeometryPool::CalcRangeByteSize(record.range);
+  record.last_used_frame = frame_;
 
-  glBindTexture(GL_TEXTURE_2D, 0);
+  // Materials are small, so they are written right away even when the
+  // geometry is uploaded asynchronously
+  if (AllocateMaterials(&record)) {
+    WriteMaterials(record);
+  }
+
+  Handle handle = meshes_.Add(record);
+  mesh->gl_handles.Set(handle);
+
+  UploadMesh(handle);
+}
+
+void GLResourceManager::UploadMesh(Handle handle) {
+  MeshRecord* record = meshes_.Get(handle);
+
+  if (!uploader_) {
+    geometry_pool_.UploadMesh(*record->mesh, record->range);
+
+    record->is_uploaded = true;
+    memory_tracker_.Add(kGpuMemoryMesh, record->gpu_bytes);
+    ReleaseCpuData(record);
+    return;
+  }
+
+  record->is_uploaded = false;
+
+  const GeometryPool* pool = &geometry_pool_;
+  ModelPtr model = record->model;
+  Mesh* mesh = record->mesh;
+  GeometryRange range = record->range;
+
+  uploader_->Enqueue(
+      [pool, model, mesh, range](UploadStaging& staging) {
+        pool->UploadMesh(*mesh, range, staging.vertex_buffer_id);
+      },
+      [this, handle]() {
+        // The mesh may have been removed in the meantime
+        MeshRecord* record = meshes_.Get(handle);
+        if (record) {
+          record->is_uploaded = true;
+          memory_tracker_.Add(kGpuMemoryMesh, record->gpu_bytes);
+          ReleaseCpuData(record);
+        }
+      });
+}
+
+void GLResourceManager::RemoveMesh(Mesh* mesh) {
+  MeshRecord* record = meshes_.Get(mesh->gl_handles);
+  if (!record) {
+    return;
+  }
+
+  // The range can't be reused while the upload may still write into it
+  if (!record->is_uploaded) {
+    uploader_->Finish();
+  }
+
+  // Evicted meshes already gave their range back
+  if (!record->is_evicted) {
+    geometry_pool_.RemoveMesh(record->range);
+    memory_tracker_.Remove(kGpuMemoryMesh, record->gpu_bytes);
+  }
+
+  FreeMaterials(record);
+
+  meshes_.Remove(&mesh->gl_handles);
+}
+
+bool GLResourceManager::BindMaterials(const Mesh& mesh, GLuint binding) const {
+  const MeshRecord* record = meshes_.Get(mesh.gl_handles);
+  if (!record || record->num_materials == 0) {
+    return false;
+  }
+
+  // The whole declared block is bound, reaching into the meshes after this
+  // one or the slack at the end of the buffer
+  material_buffer_.BindRange(binding, 
+                             record->material_offset * material_unit_size_,
+                             kMaterialsBlockSize);
+  return true;
+}
+
+void GLResourceManager::BindAllMaterials(GLenum target, GLuint binding) const {
+  glBindBufferBase(target, binding, material_buffer_.GetBufferId());
+}
+
+bool GLResourceManager::GetFirstMaterialIndex(const Mesh& mesh,
+                                              uint32_t* out_index) const {
+  const MeshRecord* record = meshes_.Get(mesh.gl_handles);
+  if (!record || record->num_materials == 0) {
+    return false;
+  }
+
+  // Units are whole multiples of sizeof(MaterialBlock)
+  *out_index = static_cast<uint32_t>(
+      record->material_offset * material_unit_size_ / sizeof(MaterialBlock));
+  return true;
+}
+
+void GLResourceManager::UpdateMaterials(const Mesh& mesh) {
+  MeshRecord* record = meshes_.Get(mesh.gl_handles);
+  if (!record) {
+    return;
+  }
 
-  texture_gl_id_map_[texture.id] = texture_id;
+  // Only reallocates if the list outgrew its allocation
+  size_t num_materials = mesh.material_list.size();
+  if (num_materials * sizeof(MaterialBlock) > 
+      record->material_units * material_unit_size_) {
+    FreeMaterials(record);
+    if (!AllocateMaterials(record)) {
+      return;
+    }
+  }
+
+  record->num_materials = static_cast<uint32_t>(num_materials);
+
+  WriteMaterials(*record);
+}
+
+// Smallest multiple of a that is also a multiple of b
+static size_t LeastCommonMultiple(size_t a, size_t b) {
+  size_t x = a;
+  size_t y = b;
+  while (y != 0) {
+    size_t t = x % y;
+    x = y;
+    y = t;
+  }
+  return a / x * b;
 }
 
-void GLResourceManager::CreateCubemapResources(const Cubemap& cubemap) {
+bool GLResourceManager::AllocateMaterials(MeshRecord* record) {
+  uint32_t num_materials = 
+      static_cast<uint32_t>(record->mesh->material_list.size());
+  if (num_materials == 0) {
+    return false;
+  }
+
+  if (num_materials > kMaxMaterialsPerBlock) {
+    std::cerr << "Mesh " << record->mesh_id << " has more materials than a "
+              << "uniform block is guaranteed to hold" << std::endl;
+  }
+
+  // Created on first use, since the alignment needs a GL context. The buffer
+  // holds one block past the allocator's capacity, so BindMaterials() can
+  // bind a whole block at any allocated offset
+  if (material_unit_size_ == 0) {
+    if (!material_buffer_.Initialize(GL_UNIFORM_BUFFER, kMaterialsBlockSize)) {
+      return false;
+    }
+
+    material_unit_size_ = LeastCommonMultiple(
+        sizeof(MaterialBlock), material_buffer_.GetOffsetAlignment());
+  }
+
+  uint32_t num_units = static_cast<uint32_t>(
+      (num_materials * sizeof(MaterialBlock) + material_unit_size_ - 1) / 
+      material_unit_size_);
+
+  uint32_t offset = 0;
+  if (!material_allocator_.Allocate(num_units, &offset)) {
+    // Reserve() at least doubles, so growth is amortized
+    material_buffer_.Reserve(
+        (material_allocator_.GetCapacity() + num_units) * material_unit_size_ +
+        kMaterialsBlockSize);
+    material_allocator_.Grow(static_cast<uint32_t>(
+        (material_buffer_.GetSize() - kMaterialsBlockSize) / 
+        material_unit_size_));
+
+    if (!material_allocator_.Allocate(num_units, &offset)) {
+      std::cerr << "Failed to allocate materials for mesh " 
+                << record->mesh_id << std::endl;
+      return false;
+    }
+  }
+
+  record->material_offset = offset;
+  record->material_units = num_units;
+  record->num_materials = num_materials;
+
+  return true;
+}
+
+void GLResourceManager::WriteMaterials(const MeshRecord& record) {
+  if (record.num_materials == 0) {
+    return;
+  }
+
+  const auto& mtl_list = record.mesh->material_list;
+
+  std::vector<MaterialBlock> blocks;
+  blocks.reserve(record.num_materials);
+  for (uint32_t i = 0; i < record.num_materials; ++i) {
+    blocks.push_back(MakeMaterialBlock(mtl_list[i]));
+  }
+
+  material_buffer_.Write(record.material_offset * material_unit_size_,
+                         blocks.size() * sizeof(MaterialBlock), &blocks[0]);
+}
+
+void GLResourceManager::FreeMaterials(MeshRecord* record) {
+  if (record->material_units == 0) {
+    return;
+  }
+
+  material_allocator_.Free(record->material_offset, record->material_units);
+
+  record->material_offset = 0;
+  record->material_units = 0;
+  record->num_materials = 0;
+}
+
+void GLResourceManager::RemoveTexture(Texture* texture) {
+  const TextureRecord* record = textures_.Get(texture->gl_handles);
+  if (!record) {
+    return;
+  }
+
+  // An upload in flight deletes its texture on completion when the record
+  // is gone. Evicted textures are already deleted
+  if (record->gl_id != 0) {
+    glDeleteTextures(1, &record->gl_id);
+    memory_tracker_.Remove(kGpuMemoryTexture, record->gpu_bytes);
+
+    if (state_cache_) {
+      state_cache_->Invalidate();
+    }
+  }
+
+  textures_.Remove(&texture->gl_handles);
+}
+
+void GLResourceManager::CreateTextureResources(const TexturePtr& texture) {
+  if (texture->image.data.empty()) {
+    std::cerr << "Texture " << texture->id << " has no pixel data to upload"
+              << std::endl;
+    return;
+  }
+
+  TextureRecord record;
+  record.texture_id = texture->id;
+  record.texture = texture;
+
+  GLenum format = 
+      texture->image.format == kImageFormatRGBA ? GL_RGBA : GL_RGB;
+  record.gpu_bytes = CalcTextureByteSize(format, texture->image.width,
+                                         texture->image.height);
+  record.last_used_frame = frame_;
+
+  Handle handle = textures_.Add(record);
+  texture->gl_handles.Set(handle);
+
+  UploadTexture(handle);
+}
+
+void GLResourceManager::UploadTexture(Handle handle) {
+  TextureRecord* record = textures_.Get(handle);
+
+  if (!uploader_) {
+    if (EnsureImageData(record->texture.get())) {
+      record->gl_id = CreateTexture2D(record->texture->image, 0);
+      memory_tracker_.Add(kGpuMemoryTexture, record->gpu_bytes);
+    }
+
+    record->is_uploaded = true;
+    ReleaseCpuData(record);
+    return;
+  }
+
+  record->is_uploaded = false;
+
+  TexturePtr texture = record->texture;
+
+  // Written by the upload thread, read on completion
+  std::shared_ptr<GLuint> gl_id = std::make_shared<GLuint>(0);
+
+  uploader_->Enqueue(
+      [texture, gl_id](UploadStaging& staging) {
+        // Reading the file here keeps the disk off the main thread too
+        if (EnsureImageData(texture.get())) {
+          *gl_id = CreateTexture2D(texture->image, staging.pixel_buffer_id);
+        }
+      },
+      [this, handle, gl_id]() {
+        TextureRecord* record = textures_.Get(handle);
+        if (!record) {
+          glDeleteTextures(1, gl_id.get());
+          return;
+        }
+
+        record->gl_id = *gl_id;
+        record->is_uploaded = true;
+
+        if (record->gl_id != 0) {
+          memory_tracker_.Add(kGpuMemoryTexture, record->gpu_bytes);
+        }
+
+        ReleaseCpuData(record);
+      });
+}
+
+void GLResourceManager::RequestReload(MeshRecord* record, Handle handle) {
+  if (!record->is_reload_requested) {
+    record->is_reload_requested = true;
+    mesh_reloads_.push_back(handle);
+  }
+}
+
+void GLResourceManager::RequestReload(TextureRecord* record, Handle handle) {
+  if (!record->is_reload_requested) {
+    record->is_reload_requested = true;
+    texture_reloads_.push_back(handle);
+  }
+}
+
+void GLResourceManager::ReloadRequested() {
+  if (mesh_reloads_.empty() && texture_reloads_.empty()) {
+    return;
+  }
+
+  if (!mesh_reloads_.empty()) {
+    // Allocating may grow the pool, which waits for the uploads in flight
+    for (Handle handle : mesh_reloads_) {
+      MeshRecord* record = meshes_.Get(handle);
+      if (!record || !record->is_evicted) {
+        continue;
+      }
+
+      record->is_evicted = false;
+      record->is_reload_requested = false;
+
+      if (!geometry_pool_.AllocateMesh(*record->mesh, &record->range)) {
+        std::cerr << "Failed to reload mesh " << record->mesh_id << std::endl;
+        continue;
+      }
+
+      UploadMesh(handle);
+    }
+  }
+
+  for (Handle handle : texture_reloads_) {
+    TextureRecord* record = textures_.Get(handle);
+    if (!record || !record->is_evicted) {
+      continue;
+    }
+
+    record->is_evicted = false;
+    record->is_reload_requested = false;
+
+    UploadTexture(handle);
+  }
+
+  mesh_reloads_.clear();
+  texture_reloads_.clear();
+}
+
+void GLResourceManager::EvictMesh(MeshRecord* record) {
+  Mesh* mesh = record->mesh;
+
+  // The reload needs every attribute the GPU copy has
+  size_t num_verts = record->range.num_verts;
+  bool has_cpu_data = mesh->pos_data.size() >= num_verts;
+  if (record->layout & kVertexLayoutNormal) {
+    has_cpu_data = has_cpu_data && mesh->normal_data.size() >= num_verts;
+  }
+  if (record->layout & kVertexLayoutTexcoord) {
+    has_cpu_data = has_cpu_data && mesh->texcoord_data.size() >= num_verts;
+  }
+  if (record->layout & kVertexLayoutMtlId) {
+    has_cpu_data = has_cpu_data && mesh->mtl_id_data.size() >= num_verts;
+  }
+
+  // Non-indexed meshes use their vertex count as the index count
+  bool has_indices = mesh->index_data.size() == record->range.index_count ||
+      (mesh->index_data.empty() && record->range.index_count == num_verts);
+
+  if (!has_cpu_data || !has_indices) {
+    geometry_pool_.ReadbackMesh(record->range, record->layout, mesh);
+  }
+
+  geometry_pool_.RemoveMesh(record->range);
+  record->range = GeometryRange();
+  record->is_evicted = true;
+
+  memory_tracker_.Remove(kGpuMemoryMesh, record->gpu_bytes);
+
+  ++num_evictions_;
+}
+
+void GLResourceManager::EvictTexture(TextureRecord* record) {
+  Texture* texture = record->texture.get();
+  Image& image = texture->image;
+
+  if (image.data.empty() && texture->path.empty()) {
+    size_t num_channels = image.format == kImageFormatRGBA ? 4 : 3;
+    GLenum format = image.format == kImageFormatRGBA ? GL_RGBA : GL_RGB;
+
+    image.data.resize(image.width * image.height * num_channels);
+
+    glBindTexture(GL_TEXTURE_2D, record->gl_id);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, format, GL_UNSIGNED_BYTE, &image.data[0]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  glDeleteTextures(1, &record->gl_id);
+  record->gl_id = 0;
+  record->is_evicted = true;
+
+  // The readback above changed the texture binding as well
+  if (state_cache_) {
+    state_cache_->Invalidate();
+  }
+
+  memory_tracker_.Remove(kGpuMemoryTexture, record->gpu_bytes);
+
+  ++num_evictions_;
+}
+
+void GLResourceManager::EnforceMemoryBudget() {
+  if (!memory_tracker_.IsOverBudget()) {
+    return;
+  }
+
+  struct Candidate {
+    uint64_t last_used_frame;
+    MeshRecord* mesh;
+    TextureRecord* texture;
+  };
+
+  std::vector<Candidate> candidates;
+
+  // Anything drawn last frame is part of the working set, and evicting it
+  // would only make it reload straight away
+  uint64_t min_idle_frame = frame_ > 1 ? frame_ - 1 : 0;
+
+  meshes_.ForEach([&](MeshRecord& record) {
+    if (record.is_uploaded && !record.is_evicted && 
+        record.last_used_frame < min_idle_frame) {
+      Candidate candidate = {record.last_used_frame, &record, nullptr};
+      candidates.push_back(candidate);
+    }
+  });
+
+  textures_.ForEach([&](TextureRecord& record) {
+    if (record.is_uploaded && !record.is_evicted && record.gl_id != 0 &&
+        record.last_used_frame < min_idle_frame) {
+      Candidate candidate = {record.last_used_frame, nullptr, &record};
+      candidates.push_back(candidate);
+    }
+  });
+
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate& a, const Candidate& b) {
+              return a.last_used_frame < b.last_used_frame;
+            });
+
+  for (const Candidate& candidate : candidates) {
+    if (!memory_tracker_.IsOverBudget()) {
+      break;
+    }
+
+    if (candidate.mesh) {
+      EvictMesh(candidate.mesh);
+    }
+    else {
+      EvictTexture(candidate.texture);
+    }
+  }
+
+  if (memory_tracker_.IsOverBudget() && !has_warned_budget_) {
+    std::cerr << "GPU memory budget is smaller than the working set" 
+              << std::endl;
+    memory_tracker_.Report();
+    has_warned_budget_ = true;
+  }
+}
+
+// Uploads the faces of each level as one cubemap texture with a mip chain
+static GLuint CreateCubemapTexture(
+    const std::vector<std::vector<Image>>& levels) {
   GLuint texture_id;
   glGenTextures(1, &texture_id);
   glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id);
 
-  for (int i = 0; i < cubemap.images.size(); ++i) {
-    const Image& image = cubemap.images[i];
+  // Rows of the smaller RGB levels are not 4-byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    GLenum format;
-    if (image.format == kImageFormatRGBA) {
-      format = GL_RGBA;
-    }
-    else if (image.format == kImageFormatRGB) {
-      format = GL_RGB;
-    }
+  for (size_t level = 0; level < levels.size(); ++level) {
+    for (size_t i = 0; i < levels[level].size(); ++i) {
+      const Image& image = levels[level][i];
+
+      GLenum format = 
+          image.format == kImageFormatRGBA ? GL_RGBA : GL_RGB;
 
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, image.width, 
-                 image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, &image.data[0]);
-    
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(i), 
+                   static_cast<GLint>(level), format, 
+                   image.width, image.height, 0, format, GL_UNSIGNED_BYTE, 
+                   &image.data[0]);
+    }
   }
 
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  GLenum min_filter = 
+      levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, min_filter);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 
+                  static_cast<GLint>(levels.size()) - 1);
+
   glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-  cubemap_gl_id_map_[cubemap.id] = texture_id;
-}
-
-GLuint GLResourceManager::GetMeshVboId(MeshId id, VertType vert_type) {
-  switch(vert_type) {
-  case kVertTypePosition:
-    return mesh_pos_gl_id_map_[id];
-    break;
-  case kVertTypeNormal:
-    return mesh_normal_gl_id_map_[id];
-    break;
-  case kVertTypeTexcoord:
-    return mesh_texcoord_gl_id_map_[id];
-    break;
-  case kVertTypeMtlId:
-    return mesh_mtl_id_gl_id_map_[id];
-    break;
-  default:
-    return 0;
-  }
+  return texture_id;
 }
 
-GLuint GLResourceManager::GetMeshIboId(MeshId id) {
-  return mesh_ibo_gl_id_map_[id];
+static size_t CalcCubemapByteSize(
+    const std::vector<std::vector<Image>>& levels) {
+  size_t size = 0;
+  for (const auto& faces : levels) {
+    for (const Image& image : faces) {
+      GLenum format = image.format == kImageFormatRGBA ? GL_RGBA : GL_RGB;
+      size += CalcTextureByteSize(format, image.width, image.height);
+    }
+  }
+  return size;
 }
 
-GLuint GLResourceManager::GetTextureId(TextureId id) {
-  return texture_gl_id_map_[id];
+void GLResourceManager::CreateCubemapResources(Cubemap* cubemap) {
+  CubemapRecord record;
+  record.cubemap_id = cubemap->id;
+
+  record.gl_id = CreateCubemapTexture(
+      std::vector<std::vector<Image>>(1, cubemap->images));
+  record.gpu_bytes += CalcCubemapByteSize(
+      std::vector<std::vector<Image>>(1, cubemap->images));
+
+  if (!cubemap->specular_mips.empty()) {
+    record.specular_gl_id = CreateCubemapTexture(cubemap->specular_mips);
+    record.gpu_bytes += CalcCubemapByteSize(cubemap->specular_mips);
+  }
+
+  if (!cubemap->irradiance.empty()) {
+    record.irradiance_gl_id = CreateCubemapTexture(
+        std::vector<std::vector<Image>>(1, cubemap->irradiance));
+    record.gpu_bytes += CalcCubemapByteSize(
+        std::vector<std::vector<Image>>(1, cubemap->irradiance));
+  }
+
+  memory_tracker_.Add(kGpuMemoryCubemap, record.gpu_bytes);
+
+  cubemap->gl_handles.Set(cubemaps_.Add(record));
 }
 
 GLuint GLResourceManager::GetTextureId(const std::string& texname) {
   auto texture_ptr = scene_->GetTexture(texname);
+  if (!texture_ptr) {
+    return 0;
+  }
 
-  return texture_gl_id_map_[texture_ptr->id];
+  return GetTextureId(*texture_ptr);
 }
 
-GLuint GLResourceManager::GetCubemapId(const std::string& name) {
+const CubemapRecord* GLResourceManager::FindCubemapRecord(
+    const std::string& name) {
   auto cubemap_ptr = scene_->GetCubemap(name);
+  if (!cubemap_ptr) {
+    return nullptr;
+  }
+
+  return cubemaps_.Get(cubemap_ptr->gl_handles);
+}
+
+GLuint GLResourceManager::GetCubemapId(const std::string& name) {
+  const CubemapRecord* record = FindCubemapRecord(name);
+  return record ? record->gl_id : 0;
+}
+
+GLuint GLResourceManager::GetPrefilteredCubemapId(const std::string& name) {
+  const CubemapRecord* record = FindCubemapRecord(name);
+  return record ? record->specular_gl_id : 0;
+}
 
-  return cubemap_gl_id_map_[cubemap_ptr->id];
+GLuint GLResourceManager::GetIrradianceCubemapId(const std::string& name) {
+  const CubemapRecord* record = FindCubemapRecord(name);
+  return record ? record->irradiance_gl_id : 0;
 }
 
 } // namespace gfx_utils
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "gfx_utils/gl/gl_state_cache.h"
+
+namespace gfx_utils {
+
+// Never a valid GL name, so the next call is always issued
+static const GLuint kUnknown = 0xffffffff;
+
+GLStateCache::GLStateCache() {
+  Invalidate();
+}
+
+void GLStateCache::BeginFrame() {
+  last_frame_counters_ = counters_;
+  counters_ = GLStateCounters();
+
+  Invalidate();
+}
+
+void GLStateCache::Invalidate() {
+  program_ = kUnknown;
+  vao_ = kUnknown;
+
+  for (GLuint& buffer : buffers_) {
+    buffer = kUnknown;
+  }
+
+  draw_framebuffer_ = kUnknown;
+  read_framebuffer_ = kUnknown;
+
+  active_texture_unit_ = kUnknown;
+  for (auto& unit_textures : textures_) {
+    for (GLuint& texture : unit_textures) {
+      texture = kUnknown;
+    }
+  }
+
+  for (GLuint& capability : capabilities_) {
+    capability = kUnknown;
+  }
+
+  is_viewport_known_ = false;
+}
+
+bool GLStateCache::Update(GLuint* cached, GLuint value) {
+  if (*cached == value) {
+    ++counters_.skipped;
+    return false;
+  }
+
+  *cached = value;
+  ++counters_.issued;
+  return true;
+}
+
+void GLStateCache::UseProgram(GLuint program) {
+  if (Update(&program_, program)) {
+    glUseProgram(program);
+  }
+}
+
+void GLStateCache::BindVertexArray(GLuint vao) {
+  if (Update(&vao_, vao)) {
+    glBindVertexArray(vao);
+
+    buffers_[kBufferTargetElementArray] = kUnknown;
+  }
+}
+
+void GLStateCache::BindBuffer(GLenum target, GLuint buffer) {
+  int index = GetBufferTargetIndex(target);
+  if (index < 0) {
+    ++counters_.issued;
+    glBindBuffer(target, buffer);
+    return;
+  }
+
+  if (Update(&buffers_[index], buffer)) {
+    glBindBuffer(target, buffer);
+  }
+}
+
+void GLStateCache::BindFramebuffer(GLenum target, GLuint framebuffer) {
+  if (target == GL_FRAMEBUFFER) {
+    if (draw_framebuffer_ == framebuffer && read_framebuffer_ == framebuffer) {
+      ++counters_.skipped;
+      return;
+    }
+
+    draw_framebuffer_ = framebuffer;
+    read_framebuffer_ = framebuffer;
+    ++counters_.issued;
+    glBindFramebuffer(target, framebuffer);
+  }
+  else if (target == GL_DRAW_FRAMEBUFFER) {
+    if (Update(&draw_framebuffer_, framebuffer)) {
+      glBindFramebuffer(target, framebuffer);
+    }
+  }
+  else if (target == GL_READ_FRAMEBUFFER) {
+    if (Update(&read_framebuffer_, framebuffer)) {
+      glBindFramebuffer(target, framebuffer);
+    }
+  }
+}
+
+void GLStateCache::ActiveTexture(GLuint unit) {
+  if (Update(&active_texture_unit_, unit)) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+  }
+}
+
+void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture) {
+  int index = GetTextureTargetIndex(target);
+  if (index < 0 || unit >= kMaxTextureUnits) {
+    ActiveTexture(unit);
+    ++counters_.issued;
+    glBindTexture(target, texture);
+    return;
+  }
+
+  if (textures_[unit][index] == texture) {
+    ++counters_.skipped;
+    return;
+  }
+
+  ActiveTexture(unit);
+
+  textures_[unit][index] = texture;
+  ++counters_.issued;
+  glBindTexture(target, texture);
+}
+
+void GLStateCache::SetEnabled(GLenum cap, bool enabled) {
+  int index = GetCapabilityIndex(cap);
+  if (index >= 0 && !Update(&capabilities_[index], enabled ? 1 : 0)) {
+    return;
+  }
+
+  if (index < 0) {
+    ++counters_.issued;
+  }
+
+  if (enabled) {
+    glEnable(cap);
+  }
+  else {
+    glDisable(cap);
+  }
+}
+
+void GLStateCache::Viewport(GLint x, GLint y, GLsizei width,
+                            GLsizei height) {
+  if (is_viewport_known_ && viewport_[0] == x && viewport_[1] == y &&
+      viewport_[2] == width && viewport_[3] == height) {
+    ++counters_.skipped;
+    return;
+  }
+
+  viewport_[0] = x;
+  viewport_[1] = y;
+  viewport_[2] = width;
+  viewport_[3] = height;
+  is_viewport_known_ = true;
+
+  ++counters_.issued;
+  glViewport(x, y, width, height);
+}
+
+int GLStateCache::GetBufferTargetIndex(GLenum target) {
+  switch (target) {
+  case GL_ARRAY_BUFFER:
+    return kBufferTargetArray;
+  case GL_ELEMENT_ARRAY_BUFFER:
+    return kBufferTargetElementArray;
+  case GL_UNIFORM_BUFFER:
+    return kBufferTargetUniform;
+  case GL_SHADER_STORAGE_BUFFER:
+    return kBufferTargetShaderStorage;
+  case GL_DRAW_INDIRECT_BUFFER:
+    return kBufferTargetDrawIndirect;
+  case GL_DISPATCH_INDIRECT_BUFFER:
+    return kBufferTargetDispatchIndirect;
+  case GL_COPY_READ_BUFFER:
+    return kBufferTargetCopyRead;
+  case GL_COPY_WRITE_BUFFER:
+    return kBufferTargetCopyWrite;
+  case GL_PIXEL_PACK_BUFFER:
+    return kBufferTargetPixelPack;
+  case GL_PIXEL_UNPACK_BUFFER:
+    return kBufferTargetPixelUnpack;
+  default:
+    return -1;
+  }
+}
+
+int GLStateCache::GetTextureTargetIndex(GLenum target) {
+  switch (target) {
+  case GL_TEXTURE_2D:
+    return kTextureTarget2D;
+  case GL_TEXTURE_CUBE_MAP:
+    return kTextureTargetCubeMap;
+  case GL_TEXTURE_2D_ARRAY:
+    return kTextureTarget2DArray;
+  case GL_TEXTURE_3D:
+    return kTextureTarget3D;
+  default:
+    return -1;
+  }
+}
+
+int GLStateCache::GetCapabilityIndex(GLenum cap) {
+  switch (cap) {
+  case GL_DEPTH_TEST:
+    return kCapabilityDepthTest;
+  case GL_CULL_FACE:
+    return kCapabilityCullFace;
+  case GL_BLEND:
+    return kCapabilityBlend;
+  case GL_STENCIL_TEST:
+    return kCapabilityStencilTest;
+  case GL_SCISSOR_TEST:
+    return kCapabilityScissorTest;
+  case GL_POLYGON_OFFSET_FILL:
+    return kCapabilityPolygonOffsetFill;
+  case GL_TEXTURE_CUBE_MAP_SEAMLESS:
+    return kCapabilityCubeMapSeamless;
+  case GL_FRAMEBUFFER_SRGB:
+    return kCapabilityFramebufferSrgb;
+  default:
+    return -1;
+  }
+}
+
+} // namespace gfx_utils
\ No newline at end of file
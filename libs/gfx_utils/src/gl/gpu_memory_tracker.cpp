@@ -0,0 +1,126 @@
+#include "gfx_utils/gl/gpu_memory_tracker.h"
+
+#include <iostream>
+#include <cassert>
+
+namespace gfx_utils {
+
+// Not in every glext.h
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+
+static const double kBytesPerMB = 1024.0 * 1024.0;
+
+const char* GetGpuMemoryCategoryName(GpuMemoryCategory category) {
+  switch (category) {
+  case kGpuMemoryMesh:
+    return "mesh";
+  case kGpuMemoryTexture:
+    return "texture";
+  case kGpuMemoryRenderTarget:
+    return "render target";
+  case kGpuMemoryCubemap:
+    return "cubemap";
+  default:
+    return "unknown";
+  }
+}
+
+static size_t GetBytesPerTexel(GLenum internal_format) {
+  switch (internal_format) {
+  case GL_RED:
+  case GL_R8:
+    return 1;
+  case GL_RG8:
+  case GL_R16F:
+  case GL_DEPTH_COMPONENT16:
+    return 2;
+  case GL_RGB:
+  case GL_RGBA:
+  case GL_RGB8:
+  case GL_RGBA8:
+  case GL_SRGB8:
+  case GL_SRGB8_ALPHA8:
+  case GL_R32F:
+  case GL_RG16F:
+  case GL_DEPTH_COMPONENT:
+  case GL_DEPTH_COMPONENT24:
+  case GL_DEPTH_COMPONENT32F:
+  case GL_DEPTH24_STENCIL8:
+    return 4;
+  case GL_RGB16F:
+  case GL_RGBA16F:
+  case GL_RG32F:
+    return 8;
+  case GL_RGB32F:
+  case GL_RGBA32F:
+    return 16;
+  default:
+    return 4;
+  }
+}
+
+size_t CalcTextureByteSize(GLenum internal_format, uint32_t width,
+                           uint32_t height, uint32_t num_levels) {
+  size_t bytes_per_texel = GetBytesPerTexel(internal_format);
+
+  size_t size = 0;
+  for (uint32_t level = 0; level < num_levels; ++level) {
+    size += static_cast<size_t>(width) * height * bytes_per_texel;
+
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+
+  return size;
+}
+
+size_t QueryDedicatedVideoMemory() {
+  GLint kilobytes[4] = {0, 0, 0, 0};
+
+  if (glewIsSupported("GL_NVX_gpu_memory_info")) {
+    glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, kilobytes);
+  }
+  else if (glewIsSupported("GL_ATI_meminfo")) {
+    // Only reports what is currently free, which is close enough at startup
+    glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, kilobytes);
+  }
+
+  return static_cast<size_t>(kilobytes[0]) * 1024;
+}
+
+void GpuMemoryTracker::Add(GpuMemoryCategory category, size_t bytes) {
+  used_[category] += bytes;
+}
+
+void GpuMemoryTracker::Remove(GpuMemoryCategory category, size_t bytes) {
+  assert(used_[category] >= bytes);
+  used_[category] -= bytes;
+}
+
+size_t GpuMemoryTracker::GetTotalUsed() const {
+  size_t total = 0;
+  for (size_t used : used_) {
+    total += used;
+  }
+  return total;
+}
+
+void GpuMemoryTracker::Report() const {
+  std::cout << "GPU memory:";
+  for (int i = 0; i < kNumGpuMemoryCategories; ++i) {
+    std::cout << " " << GetGpuMemoryCategoryName(
+                            static_cast<GpuMemoryCategory>(i))
+              << " " << used_[i] / kBytesPerMB << " MB,";
+  }
+  std::cout << " total " << GetTotalUsed() / kBytesPerMB << " MB";
+
+  if (budget_ > 0) {
+    std::cout << " of " << budget_ / kBytesPerMB << " MB budget";
+  }
+
+  std::cout << std::endl;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
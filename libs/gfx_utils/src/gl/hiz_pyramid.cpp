@@ -0,0 +1,144 @@
+#include "gfx_utils/gl/hiz_pyramid.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include "gfx_utils/gl/gpu_memory_tracker.h"
+
+namespace gfx_utils {
+
+// local_size_x and local_size_y of the reduction shader
+static const int kGroupSize = 8;
+
+static const char reduce_shader_src[] = 
+  "#version 430 core\n"
+  "layout(local_size_x = 8, local_size_y = 8) in;\n"
+  "\n"
+  "// The depth texture for level 0, the pyramid itself for the others\n"
+  "layout(binding = 0) uniform sampler2D src_tex;\n"
+  "uniform int src_level;\n"
+  "\n"
+  "layout(binding = 0, r32f) writeonly uniform image2D dst_image;\n"
+  "\n"
+  "void main() {\n"
+  "  ivec2 dst_size = imageSize(dst_image);\n"
+  "  ivec2 dst = ivec2(gl_GlobalInvocationID.xy);\n"
+  "  if (any(greaterThanEqual(dst, dst_size))) {\n"
+  "    return;\n"
+  "  }\n"
+  "\n"
+  "  // The last texel of a row or column also covers the odd texel of\n"
+  "  // the source\n"
+  "  ivec2 src_size = textureSize(src_tex, src_level);\n"
+  "  ivec2 first = dst * 2;\n"
+  "  ivec2 last = min(first + 1, src_size - 1);\n"
+  "  if (dst.x == dst_size.x - 1) {\n"
+  "    last.x = src_size.x - 1;\n"
+  "  }\n"
+  "  if (dst.y == dst_size.y - 1) {\n"
+  "    last.y = src_size.y - 1;\n"
+  "  }\n"
+  "\n"
+  "  float depth = 0.0;\n"
+  "  for (int y = first.y; y <= last.y; ++y) {\n"
+  "    for (int x = first.x; x <= last.x; ++x) {\n"
+  "      depth = max(depth, texelFetch(src_tex, ivec2(x, y), src_level).r);\n"
+  "    }\n"
+  "  }\n"
+  "\n"
+  "  imageStore(dst_image, dst, vec4(depth));\n"
+  "}";
+
+bool HiZPyramid::Initialize(int depth_width, int depth_height) {
+  if (!GLEW_VERSION_4_3) {
+    std::cerr << "Hi-Z pyramid needs GL 4.3 compute shaders" << std::endl;
+    return false;
+  }
+
+  if (!program_.CreateComputeFromSource(reduce_shader_src)) {
+    std::cerr << "Could not create Hi-Z reduction program" << std::endl;
+    return false;
+  }
+
+  depth_width_ = depth_width;
+  depth_height_ = depth_height;
+
+  width_ = std::max(depth_width / 2, 1);
+  height_ = std::max(depth_height / 2, 1);
+
+  // Down to 1x1, as glTexStorage2D() halves each level
+  num_levels_ = 1;
+  for (int size = std::max(width_, height_); size > 1; size /= 2) {
+    ++num_levels_;
+  }
+
+  glGenTextures(1, &texture_id_);
+  glBindTexture(GL_TEXTURE_2D, texture_id_);
+  glTexStorage2D(GL_TEXTURE_2D, num_levels_, GL_R32F, width_, height_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return true;
+}
+
+void HiZPyramid::Destroy() {
+  if (texture_id_ != 0) {
+    glDeleteTextures(1, &texture_id_);
+    texture_id_ = 0;
+  }
+
+  if (program_.IsCreated()) {
+    program_.Destroy();
+  }
+
+  num_levels_ = 0;
+}
+
+void HiZPyramid::Build(GLuint depth_tex_id) {
+  glUseProgram(program_.GetProgramId());
+  glActiveTexture(GL_TEXTURE0);
+
+  Uniform src_level = program_.GetUniform("src_level");
+
+  int width = width_;
+  int height = height_;
+  for (int level = 0; level < num_levels_; ++level) {
+    // Every level reads the one before it, in the same texture. Reading
+    // one level while writing another is not a feedback loop
+    if (level == 0) {
+      glBindTexture(GL_TEXTURE_2D, depth_tex_id);
+      src_level.Set(0);
+    }
+    else {
+      if (level == 1) {
+        glBindTexture(GL_TEXTURE_2D, texture_id_);
+      }
+      src_level.Set(level - 1);
+    }
+
+    glBindImageTexture(0, texture_id_, level, GL_FALSE, 0, GL_WRITE_ONLY, 
+                       GL_R32F);
+
+    glDispatchCompute((width + kGroupSize - 1) / kGroupSize, 
+                      (height + kGroupSize - 1) / kGroupSize, 1);
+
+    // The next level, and whoever tests against the pyramid, fetch what
+    // this one stored
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    width = std::max(width / 2, 1);
+    height = std::max(height / 2, 1);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+size_t HiZPyramid::GetByteSize() const {
+  return CalcTextureByteSize(GL_R32F, width_, height_, num_levels_);
+}
+
+} // namespace gfx_utils
\ No newline at end of file
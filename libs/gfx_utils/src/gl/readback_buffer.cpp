@@ -0,0 +1,116 @@
+#include "gfx_utils/gl/readback_buffer.h"
+
+#include <iostream>
+#include <cstring>
+
+namespace gfx_utils {
+
+bool ReadbackBuffer::Initialize(size_t size) {
+  size_ = size;
+
+  glGenBuffers(kNumSlots, buffer_ids_);
+
+  // GL_STREAM_READ asks for memory the CPU reads quickly, rather than the
+  // write-combined kind uploads get
+  for (GLuint buffer_id : buffer_ids_) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+    glBufferData(GL_COPY_WRITE_BUFFER, size_, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  first_slot_ = 0;
+  num_in_flight_ = 0;
+
+  return true;
+}
+
+void ReadbackBuffer::Destroy() {
+  for (GLsync& fence : fences_) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+  if (buffer_ids_[0] != 0) {
+    glDeleteBuffers(kNumSlots, buffer_ids_);
+    for (GLuint& buffer_id : buffer_ids_) {
+      buffer_id = 0;
+    }
+  }
+
+  num_in_flight_ = 0;
+}
+
+bool ReadbackBuffer::Copy(GLuint buffer_id, GLintptr offset) {
+  if (num_in_flight_ == kNumSlots) {
+    ++num_dropped_;
+    return false;
+  }
+
+  int slot = (first_slot_ + num_in_flight_) % kNumSlots;
+
+  glBindBuffer(GL_COPY_READ_BUFFER, buffer_id);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_ids_[slot]);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, 
+                      size_);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+  fences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  ++num_in_flight_;
+
+  return true;
+}
+
+bool ReadbackBuffer::Poll(void* out_data) {
+  int ready_slot = -1;
+
+  // Fences signal in submission order, so the first one that hasn't
+  // signaled ends the search. The flush makes sure it gets to the GPU
+  while (num_in_flight_ > 0) {
+    GLsync& fence = fences_[first_slot_];
+
+    GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+      break;
+    }
+
+    if (result == GL_WAIT_FAILED) {
+      std::cerr << "Failed to wait on readback fence" << std::endl;
+    }
+    else {
+      ready_slot = first_slot_;
+    }
+
+    glDeleteSync(fence);
+    fence = nullptr;
+
+    first_slot_ = (first_slot_ + 1) % kNumSlots;
+    --num_in_flight_;
+  }
+
+  if (ready_slot < 0) {
+    return false;
+  }
+
+  // The copy has finished, so mapping doesn't wait
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_ids_[ready_slot]);
+  const void* data = 
+      glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size_, GL_MAP_READ_BIT);
+
+  bool is_mapped = data != nullptr;
+  if (is_mapped) {
+    memcpy(out_data, data, size_);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+  }
+  else {
+    std::cerr << "Failed to map readback buffer" << std::endl;
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  return is_mapped;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "gfx_utils/gl/shader_blocks.h"
+
+#include <iostream>
+#include <cstring>
+#include <sstream>
+
+namespace gfx_utils {
+
+MaterialBlock MakeMaterialBlock(const Material& material) {
+  MaterialBlock block;
+  block.ambient_color = glm::vec4(material.ambient_color, 1.f);
+  block.diffuse_color = glm::vec4(material.diffuse_color, 1.f);
+  block.specular_color = glm::vec4(material.specular_color, 1.f);
+  block.emission_color = glm::vec4(material.emission_color, 1.f);
+  block.shininess = material.shininess;
+  block.has_ambient_tex = material.ambient_texture ? 1 : 0;
+  block.has_diffuse_tex = material.diffuse_texture ? 1 : 0;
+  block.has_specular_tex = material.specular_texture ? 1 : 0;
+  return block;
+}
+
+PointLightBlock MakePointLightBlock(const PointLight& light) {
+  PointLightBlock block;
+  block.position = glm::vec4(light.position, 1.f);
+  block.diffuse_intensity = glm::vec4(light.diffuse_intensity, 0.f);
+  block.specular_intensity = glm::vec4(light.specular_intensity, 0.f);
+  return block;
+}
+
+SpotlightBlock MakeSpotlightBlock(const Spotlight& light) {
+  SpotlightBlock block;
+  block.position = glm::vec4(light.position, 1.f);
+  block.diffuse_intensity = glm::vec4(light.diffuse_intensity, 0.f);
+  block.specular_intensity = glm::vec4(light.specular_intensity, 0.f);
+  block.direction = glm::vec4(light.direction, 0.f);
+  block.cone_angle = light.cone_angle;
+  return block;
+}
+
+std::string GetShaderBlockDefines() {
+  std::ostringstream defines;
+  defines << "#define MAX_MATERIALS_PER_BLOCK " << kMaxMaterialsPerBlock 
+          << "\n"
+          << "#define MAX_POINT_LIGHTS_PER_BLOCK " << kMaxPointLightsPerBlock
+          << "\n"
+          << "#define MAX_SPOTLIGHTS_PER_BLOCK " << kMaxSpotlightsPerBlock 
+          << "\n";
+  return defines.str();
+}
+
+// Header followed by the converted lights, zero-filled up to block_size
+template <typename Light, typename Block>
+static void FillLightsBlock(const std::vector<std::shared_ptr<Light>>& lights,
+                            uint32_t max_lights, size_t block_size,
+                            Block (*make_block)(const Light&),
+                            std::vector<uint8_t>* out_data) {
+  uint32_t num_lights = static_cast<uint32_t>(lights.size());
+  if (num_lights > max_lights) {
+    std::cerr << "Light block only holds " << max_lights << " lights, "
+              << "dropping " << num_lights - max_lights << std::endl;
+    num_lights = max_lights;
+  }
+
+  out_data->assign(block_size, 0);
+
+  LightBlockHeader header;
+  header.num_lights = static_cast<int32_t>(num_lights);
+  memcpy(&(*out_data)[0], &header, sizeof(header));
+
+  uint8_t* dest = &(*out_data)[0] + sizeof(LightBlockHeader);
+  for (uint32_t i = 0; i < num_lights; ++i) {
+    Block block = make_block(*lights[i]);
+    memcpy(dest + i * sizeof(Block), &block, sizeof(Block));
+  }
+}
+
+void FillPointLightsBlock(
+    const std::vector<std::shared_ptr<PointLight>>& lights,
+    std::vector<uint8_t>* out_data) {
+  FillLightsBlock(lights, kMaxPointLightsPerBlock, kPointLightsBlockSize,
+                  &MakePointLightBlock, out_data);
+}
+
+void FillSpotlightsBlock(
+    const std::vector<std::shared_ptr<Spotlight>>& lights,
+    std::vector<uint8_t>* out_data) {
+  FillLightsBlock(lights, kMaxSpotlightsPerBlock, kSpotlightsBlockSize,
+                  &MakeSpotlightBlock, out_data);
+}
+
+// Any and All bits of one texture slot
+static uint32_t CalcTextureFeatures(bool is_any, bool is_all, 
+                                    uint32_t any_bit, uint32_t all_bit) {
+  if (!is_any) {
+    return 0;
+  }
+  return is_all ? (any_bit | all_bit) : any_bit;
+}
+
+uint32_t CalcMaterialFeatures(const std::vector<Material>& materials) {
+  if (materials.empty()) {
+    return 0;
+  }
+
+  bool any_ambient = false, all_ambient = true;
+  bool any_diffuse = false, all_diffuse = true;
+  bool any_specular = false, all_specular = true;
+
+  for (const Material& material : materials) {
+    bool has_ambient = material.ambient_texture != nullptr;
+    bool has_diffuse = material.diffuse_texture != nullptr;
+    bool has_specular = material.specular_texture != nullptr;
+
+    any_ambient |= has_ambient;
+    all_ambient &= has_ambient;
+    any_diffuse |= has_diffuse;
+    all_diffuse &= has_diffuse;
+    any_specular |= has_specular;
+    all_specular &= has_specular;
+  }
+
+  return CalcTextureFeatures(any_ambient, all_ambient,
+                             kMaterialFeatureAnyAmbientTex, 
+                             kMaterialFeatureAllAmbientTex) |
+         CalcTextureFeatures(any_diffuse, all_diffuse,
+                             kMaterialFeatureAnyDiffuseTex, 
+                             kMaterialFeatureAllDiffuseTex) |
+         CalcTextureFeatures(any_specular, all_specular,
+                             kMaterialFeatureAnySpecularTex, 
+                             kMaterialFeatureAllSpecularTex);
+}
+
+void AddMaterialFeatures(ProgramVariants* variants) {
+  variants->AddFeature(kMaterialFeatureAnyAmbientTex, "ANY_AMBIENT_TEX");
+  variants->AddFeature(kMaterialFeatureAllAmbientTex, "ALL_AMBIENT_TEX");
+  variants->AddFeature(kMaterialFeatureAnyDiffuseTex, "ANY_DIFFUSE_TEX");
+  variants->AddFeature(kMaterialFeatureAllDiffuseTex, "ALL_DIFFUSE_TEX");
+  variants->AddFeature(kMaterialFeatureAnySpecularTex, "ANY_SPECULAR_TEX");
+  variants->AddFeature(kMaterialFeatureAllSpecularTex, "ALL_SPECULAR_TEX");
+}
+
+} // namespace gfx_utils
\ No newline at end of file
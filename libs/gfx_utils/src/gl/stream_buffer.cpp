@@ -0,0 +1,221 @@
+#include "gfx_utils/gl/stream_buffer.h"
+
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+
+namespace gfx_utils {
+
+// How long one glClientWaitSync() call may block before it is retried
+static const GLuint64 kFenceTimeoutNs = 1000000000;
+
+static size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool StreamBuffer::Initialize(GLenum target, size_t region_size, 
+                              size_t max_bind_size) {
+  target_ = target;
+  max_bind_size_ = max_bind_size;
+
+  if (target_ == GL_SHADER_STORAGE_BUFFER && !GLEW_VERSION_4_3) {
+    std::cerr << "Shader storage buffers need GL 4.3" << std::endl;
+    return false;
+  }
+  alignment_ = GetOffsetAlignment(target_);
+
+  // Keeps every region start aligned
+  region_size_ = AlignUp(region_size, alignment_);
+
+  is_persistent_ = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+  glGenBuffers(1, &buffer_id_);
+
+  // Bound to GL_COPY_WRITE_BUFFER so the indexed binding points of the
+  // buffer's own target are left alone
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id_);
+
+  if (is_persistent_) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr total_size = region_size_ * kNumRegions + max_bind_size_;
+
+    glBufferStorage(GL_COPY_WRITE_BUFFER, total_size, nullptr, flags);
+    mapped_data_ = static_cast<uint8_t*>(
+        glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total_size, flags));
+
+    if (!mapped_data_) {
+      std::cerr << "Failed to persistently map stream buffer" << std::endl;
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      Destroy();
+      return false;
+    }
+  }
+  else {
+    glBufferData(GL_COPY_WRITE_BUFFER, region_size_ + max_bind_size_, 
+                 nullptr, GL_STREAM_DRAW);
+    staging_data_.resize(region_size_);
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  // BeginFrame() advances first, so the first frame uses region 0
+  region_ = kNumRegions - 1;
+  used_ = 0;
+  flushed_size_ = 0;
+
+  return true;
+}
+
+size_t StreamBuffer::GetOffsetAlignment(GLenum target) {
+  GLint alignment = 0;
+  if (target == GL_UNIFORM_BUFFER) {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  }
+  else if (target == GL_SHADER_STORAGE_BUFFER && GLEW_VERSION_4_3) {
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  }
+
+  // 256 is the largest alignment GL allows
+  return alignment > 0 ? static_cast<size_t>(alignment) : 256;
+}
+
+size_t StreamBuffer::CalcRegionSize(GLenum target, size_t block_size, 
+                                    size_t num_blocks) {
+  return num_blocks * AlignUp(block_size, GetOffsetAlignment(target));
+}
+
+void StreamBuffer::Destroy() {
+  for (GLsync& fence : fences_) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+  if (buffer_id_ != 0) {
+    if (mapped_data_) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id_);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    glDeleteBuffers(1, &buffer_id_);
+    buffer_id_ = 0;
+  }
+
+  mapped_data_ = nullptr;
+  staging_data_.clear();
+}
+
+void StreamBuffer::BeginFrame() {
+  used_ = 0;
+  flushed_size_ = 0;
+
+  if (is_persistent_) {
+    region_ = (region_ + 1) % kNumRegions;
+    WaitForRegion(region_);
+  }
+}
+
+void StreamBuffer::Flush() {
+  if (is_persistent_) {
+    // Coherent mapping - the writes are visible to later commands
+    return;
+  }
+
+  // Failed allocations still advance the counter
+  size_t used = std::min(used_.load(), region_size_);
+  if (used == flushed_size_) {
+    return;
+  }
+
+  // Orphaning gives the driver fresh storage, so draws already issued keep
+  // reading the old contents and the upload doesn't wait on them
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id_);
+  glBufferData(GL_COPY_WRITE_BUFFER, region_size_ + max_bind_size_, nullptr, 
+               GL_STREAM_DRAW);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, 0, used, &staging_data_[0]);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  flushed_size_ = used;
+}
+
+void StreamBuffer::EndFrame() {
+  if (!is_persistent_) {
+    return;
+  }
+
+  GLsync& fence = fences_[region_];
+  if (fence) {
+    glDeleteSync(fence);
+  }
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool StreamBuffer::Allocate(size_t size, StreamAllocation* out_allocation) {
+  // Rounding the size keeps the next allocation aligned as well
+  size_t aligned_size = AlignUp(size, alignment_);
+
+  size_t offset = used_.fetch_add(aligned_size);
+  if (offset + aligned_size > region_size_) {
+    return false;
+  }
+
+  if (is_persistent_) {
+    size_t region_offset = region_ * region_size_;
+    out_allocation->data = mapped_data_ + region_offset + offset;
+    out_allocation->offset = static_cast<GLintptr>(region_offset + offset);
+  }
+  else {
+    out_allocation->data = &staging_data_[offset];
+    out_allocation->offset = static_cast<GLintptr>(offset);
+  }
+
+  out_allocation->size = static_cast<GLsizeiptr>(size);
+
+  return true;
+}
+
+void StreamBuffer::BindRange(GLuint binding,
+                             const StreamAllocation& allocation) const {
+  glBindBufferRange(target_, binding, buffer_id_, allocation.offset,
+                    allocation.size);
+}
+
+void StreamBuffer::BindRange(GLuint binding, 
+                             const StreamAllocation& allocation,
+                             size_t size) const {
+  assert(size >= static_cast<size_t>(allocation.size));
+  assert(size <= max_bind_size_);
+
+  glBindBufferRange(target_, binding, buffer_id_, allocation.offset,
+                    static_cast<GLsizeiptr>(size));
+}
+
+void StreamBuffer::WaitForRegion(int region) {
+  GLsync& fence = fences_[region];
+  if (!fence) {
+    return;
+  }
+
+  // Cheap check first, so only frames that actually block count as stalls
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    ++num_stalls_;
+
+    do {
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                kFenceTimeoutNs);
+    } while (result == GL_TIMEOUT_EXPIRED);
+  }
+
+  if (result == GL_WAIT_FAILED) {
+    std::cerr << "Failed to wait on stream buffer fence" << std::endl;
+  }
+
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
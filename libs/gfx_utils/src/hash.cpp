@@ -0,0 +1,105 @@
+#include "gfx_utils/hash.h"
+
+#include <cstring>
+
+namespace gfx_utils {
+
+static const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+static const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t RotateLeft(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// memcpy avoids unaligned reads - compilers turn it into a single load
+static inline uint64_t Read64(const uint8_t* p) {
+  uint64_t val;
+  std::memcpy(&val, p, sizeof(val));
+  return val;
+}
+
+static inline uint32_t Read32(const uint8_t* p) {
+  uint32_t val;
+  std::memcpy(&val, p, sizeof(val));
+  return val;
+}
+
+static inline uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = RotateLeft(acc, 31);
+  return acc * kPrime1;
+}
+
+static inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+  acc ^= Round(0, val);
+  return acc * kPrime1 + kPrime4;
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  const uint8_t* end = p + size;
+
+  uint64_t hash;
+
+  if (size >= 32) {
+    // Four independent lanes so that the loop isn't bound by the latency of
+    // a single multiply chain
+    uint64_t v1 = seed + kPrime1 + kPrime2;
+    uint64_t v2 = seed + kPrime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - kPrime1;
+
+    const uint8_t* limit = end - 32;
+    do {
+      v1 = Round(v1, Read64(p));
+      v2 = Round(v2, Read64(p + 8));
+      v3 = Round(v3, Read64(p + 16));
+      v4 = Round(v4, Read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) +
+           RotateLeft(v4, 18);
+    hash = MergeRound(hash, v1);
+    hash = MergeRound(hash, v2);
+    hash = MergeRound(hash, v3);
+    hash = MergeRound(hash, v4);
+  }
+  else {
+    hash = seed + kPrime5;
+  }
+
+  hash += static_cast<uint64_t>(size);
+
+  while (p + 8 <= end) {
+    hash ^= Round(0, Read64(p));
+    hash = RotateLeft(hash, 27) * kPrime1 + kPrime4;
+    p += 8;
+  }
+
+  if (p + 4 <= end) {
+    hash ^= static_cast<uint64_t>(Read32(p)) * kPrime1;
+    hash = RotateLeft(hash, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+
+  while (p < end) {
+    hash ^= static_cast<uint64_t>(*p) * kPrime5;
+    hash = RotateLeft(hash, 11) * kPrime1;
+    ++p;
+  }
+
+  // Final avalanche
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
@@ -2,10 +2,14 @@
 
 #include "tinyobjloader/tiny_obj_loader.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <tuple>
 #include <unordered_map>
 
+#include <glm/glm.hpp>
+
 #include "gfx_utils/texture.h"
 
 namespace gfx_utils {
@@ -32,4 +36,63 @@ void ClearMesh(Mesh *mesh) {
   mesh->material_list;
 }
 
+void ComputeMeshBounds(Mesh* mesh) {
+  if (mesh->pos_data.empty()) {
+    mesh->bounds_min = glm::vec3(0.f);
+    mesh->bounds_max = glm::vec3(0.f);
+    mesh->bounds_center = glm::vec3(0.f);
+    mesh->bounds_radius = 0.f;
+    mesh->has_bounds = false;
+    return;
+  }
+
+  glm::vec3 min_pos = mesh->pos_data[0];
+  glm::vec3 max_pos = mesh->pos_data[0];
+  for (const glm::vec3& pos : mesh->pos_data) {
+    min_pos = glm::min(min_pos, pos);
+    max_pos = glm::max(max_pos, pos);
+  }
+
+  glm::vec3 center = (min_pos + max_pos) * 0.5f;
+
+  float max_dist_sq = 0.f;
+  for (const glm::vec3& pos : mesh->pos_data) {
+    glm::vec3 offset = pos - center;
+    max_dist_sq = std::max(max_dist_sq, glm::dot(offset, offset));
+  }
+
+  mesh->bounds_min = min_pos;
+  mesh->bounds_max = max_pos;
+  mesh->bounds_center = center;
+  mesh->bounds_radius = std::sqrt(max_dist_sq);
+  mesh->has_bounds = true;
+}
+
+// Swap with an empty vector since clear() doesn't release the memory
+template <typename T>
+static size_t FreeVector(std::vector<T>* vec) {
+  size_t freed_bytes = vec->capacity() * sizeof(T);
+  std::vector<T>().swap(*vec);
+  return freed_bytes;
+}
+
+size_t ReleaseMeshData(Mesh* mesh, ResidencyPolicy policy) {
+  if (policy == kResidencyKeep) {
+    return 0;
+  }
+
+  size_t freed_bytes = 0;
+
+  freed_bytes += FreeVector(&mesh->normal_data);
+  freed_bytes += FreeVector(&mesh->texcoord_data);
+  freed_bytes += FreeVector(&mesh->mtl_id_data);
+
+  if (policy == kResidencyDropAfterUpload) {
+    freed_bytes += FreeVector(&mesh->pos_data);
+    freed_bytes += FreeVector(&mesh->index_data);
+  }
+
+  return freed_bytes;
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,704 @@
+#include "gfx_utils/occlusion_culler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#if defined(__AVX__)
+#define GFX_UTILS_OCCLUSION_CULLER_AVX
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GFX_UTILS_OCCLUSION_CULLER_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace gfx_utils {
+
+namespace {
+
+const int kTilePixels = 
+    OcclusionCuller::kTileWidth * OcclusionCuller::kTileHeight;
+
+// The rasterizer and the tests are written once against these, so the same
+// loops run a row of pixels per lane group at every SIMD width. Masks are
+// all ones or all zeros per lane. ScalarOps is always built, so SIMD can be
+// turned off at run time and compared against
+struct ScalarOps {
+  static const int kWidth = 1;
+
+  using FloatVec = float;
+  using MaskVec = bool;
+
+  static FloatVec Splat(float value) {
+    return value;
+  }
+
+  static FloatVec LaneIndices() {
+    return 0.f;
+  }
+
+  static FloatVec Load(const float* data) {
+    return *data;
+  }
+
+  static void Store(float* data, FloatVec value) {
+    *data = value;
+  }
+
+  static FloatVec Add(FloatVec a, FloatVec b) {
+    return a + b;
+  }
+
+  static FloatVec Mul(FloatVec a, FloatVec b) {
+    return a * b;
+  }
+
+  // Operand order as minps and maxps, so ties and NaNs resolve the same
+  static FloatVec Min(FloatVec a, FloatVec b) {
+    return a < b ? a : b;
+  }
+
+  static FloatVec Max(FloatVec a, FloatVec b) {
+    return a > b ? a : b;
+  }
+
+  static MaskVec GreaterEqual(FloatVec a, FloatVec b) {
+    return a >= b;
+  }
+
+  static MaskVec And(MaskVec a, MaskVec b) {
+    return a && b;
+  }
+
+  static FloatVec Select(MaskVec mask, FloatVec a, FloatVec b) {
+    return mask ? a : b;
+  }
+
+  static bool Any(MaskVec mask) {
+    return mask;
+  }
+
+  static float MaxLane(FloatVec value) {
+    return value;
+  }
+};
+
+#if defined(GFX_UTILS_OCCLUSION_CULLER_AVX)
+struct SimdOps {
+  static const int kWidth = 8;
+
+  using FloatVec = __m256;
+  using MaskVec = __m256;
+
+  static FloatVec Splat(float value) {
+    return _mm256_set1_ps(value);
+  }
+
+  // 0, 1, 2, ... across the lanes
+  static FloatVec LaneIndices() {
+    return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+  }
+
+  static FloatVec Load(const float* data) {
+    return _mm256_loadu_ps(data);
+  }
+
+  static void Store(float* data, FloatVec value) {
+    _mm256_storeu_ps(data, value);
+  }
+
+  static FloatVec Add(FloatVec a, FloatVec b) {
+    return _mm256_add_ps(a, b);
+  }
+
+  static FloatVec Mul(FloatVec a, FloatVec b) {
+    return _mm256_mul_ps(a, b);
+  }
+
+  static FloatVec Min(FloatVec a, FloatVec b) {
+    return _mm256_min_ps(a, b);
+  }
+
+  static FloatVec Max(FloatVec a, FloatVec b) {
+    return _mm256_max_ps(a, b);
+  }
+
+  static MaskVec GreaterEqual(FloatVec a, FloatVec b) {
+    return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+  }
+
+  static MaskVec And(MaskVec a, MaskVec b) {
+    return _mm256_and_ps(a, b);
+  }
+
+  // a where the mask is set, b elsewhere
+  static FloatVec Select(MaskVec mask, FloatVec a, FloatVec b) {
+    return _mm256_blendv_ps(b, a, mask);
+  }
+
+  static bool Any(MaskVec mask) {
+    return _mm256_movemask_ps(mask) != 0;
+  }
+
+  static float MaxLane(FloatVec value) {
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, value);
+    return *std::max_element(lanes, lanes + 8);
+  }
+};
+#elif defined(GFX_UTILS_OCCLUSION_CULLER_SSE)
+struct SimdOps {
+  static const int kWidth = 4;
+
+  using FloatVec = __m128;
+  using MaskVec = __m128;
+
+  static FloatVec Splat(float value) {
+    return _mm_set1_ps(value);
+  }
+
+  // 0, 1, 2, ... across the lanes
+  static FloatVec LaneIndices() {
+    return _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+  }
+
+  static FloatVec Load(const float* data) {
+    return _mm_loadu_ps(data);
+  }
+
+  static void Store(float* data, FloatVec value) {
+    _mm_storeu_ps(data, value);
+  }
+
+  static FloatVec Add(FloatVec a, FloatVec b) {
+    return _mm_add_ps(a, b);
+  }
+
+  static FloatVec Mul(FloatVec a, FloatVec b) {
+    return _mm_mul_ps(a, b);
+  }
+
+  static FloatVec Min(FloatVec a, FloatVec b) {
+    return _mm_min_ps(a, b);
+  }
+
+  static FloatVec Max(FloatVec a, FloatVec b) {
+    return _mm_max_ps(a, b);
+  }
+
+  static MaskVec GreaterEqual(FloatVec a, FloatVec b) {
+    return _mm_cmpge_ps(a, b);
+  }
+
+  static MaskVec And(MaskVec a, MaskVec b) {
+    return _mm_and_ps(a, b);
+  }
+
+  // a where the mask is set, b elsewhere
+  static FloatVec Select(MaskVec mask, FloatVec a, FloatVec b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+
+  static bool Any(MaskVec mask) {
+    return _mm_movemask_ps(mask) != 0;
+  }
+
+  static float MaxLane(FloatVec value) {
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, value);
+    return *std::max_element(lanes, lanes + 4);
+  }
+};
+#else
+using SimdOps = ScalarOps;
+#endif
+
+static_assert(OcclusionCuller::kTileWidth % SimdOps::kWidth == 0, 
+              "Tile rows must hold whole SIMD groups");
+
+} // namespace
+
+OcclusionCuller::~OcclusionCuller() {
+  Destroy();
+}
+
+bool OcclusionCuller::Initialize(int width, int height, 
+                                 uint32_t num_threads) {
+  if (width <= 0 || height <= 0 || width % kTileWidth != 0 || 
+      height % kTileHeight != 0) {
+    std::cerr << "Occlusion buffer size must be a multiple of " 
+              << kTileWidth << "x" << kTileHeight << std::endl;
+    return false;
+  }
+
+  Destroy();
+
+  width_ = width;
+  height_ = height;
+  num_tiles_x_ = width / kTileWidth;
+  num_tiles_y_ = height / kTileHeight;
+
+  int num_tiles = num_tiles_x_ * num_tiles_y_;
+  depth_.assign(width * height, 1.f);
+  tile_max_depth_.assign(num_tiles, 1.f);
+
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  thread_bins_.resize(num_threads);
+  for (ThreadBins& bins : thread_bins_) {
+    bins.tiles.resize(num_tiles);
+  }
+
+  should_quit_ = false;
+  job_generation_ = 0;
+
+  // The calling thread is thread 0
+  for (uint32_t i = 1; i < num_threads; ++i) {
+    workers_.push_back(std::thread(&OcclusionCuller::WorkerMain, this, i));
+  }
+
+  return true;
+}
+
+void OcclusionCuller::Destroy() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    should_quit_ = true;
+  }
+  job_cv_.notify_all();
+
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+
+  occluders_.clear();
+  thread_bins_.clear();
+  depth_.clear();
+  tile_max_depth_.clear();
+}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& view_proj_mat) {
+  view_proj_mat_ = view_proj_mat;
+
+  occluders_.clear();
+
+  // Cleared rather than freed, so their capacity is reused
+  for (ThreadBins& bins : thread_bins_) {
+    bins.triangles.clear();
+    for (std::vector<uint32_t>& tile : bins.tiles) {
+      tile.clear();
+    }
+  }
+
+  num_occluder_triangles_ = 0;
+  num_tested_ = 0;
+  num_occluded_ = 0;
+}
+
+void OcclusionCuller::AddOccluder(const std::vector<glm::vec3>& positions,
+                                  const std::vector<uint32_t>& indices,
+                                  const glm::mat4& model_mat) {
+  if (positions.empty()) {
+    return;
+  }
+
+  Occluder occluder;
+  occluder.positions = &positions;
+  occluder.indices = &indices;
+  occluder.mvp_mat = view_proj_mat_ * model_mat;
+  occluders_.push_back(occluder);
+}
+
+void OcclusionCuller::RasterizeOccluders() {
+  auto start_time = std::chrono::steady_clock::now();
+
+  RunParallel(static_cast<uint32_t>(occluders_.size()), 
+              [this](uint32_t item, uint32_t thread) {
+                SetupOccluder(occluders_[item], &thread_bins_[thread]);
+              });
+
+  num_occluder_triangles_ = 0;
+  for (const ThreadBins& bins : thread_bins_) {
+    num_occluder_triangles_ += static_cast<uint32_t>(bins.triangles.size());
+  }
+
+  // Every thread's bins are complete before any tile is rasterized
+  RunParallel(static_cast<uint32_t>(num_tiles_x_ * num_tiles_y_), 
+              [this](uint32_t item, uint32_t) {
+                if (is_simd_enabled_) {
+                  RasterizeTile<SimdOps>(item);
+                }
+                else {
+                  RasterizeTile<ScalarOps>(item);
+                }
+              });
+
+  std::chrono::duration<double, std::milli> elapsed = 
+      std::chrono::steady_clock::now() - start_time;
+  rasterize_ms_ = elapsed.count();
+}
+
+bool OcclusionCuller::TestBox(const glm::vec3& min, const glm::vec3& max,
+                              const glm::mat4& model_mat) {
+  ++num_tested_;
+
+  glm::mat4 mvp_mat = view_proj_mat_ * model_mat;
+
+  glm::vec2 rect_min(std::numeric_limits<float>::max());
+  glm::vec2 rect_max(-std::numeric_limits<float>::max());
+  float min_depth = std::numeric_limits<float>::max();
+
+  for (int i = 0; i < 8; ++i) {
+    glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, 
+                     (i & 4) ? max.z : min.z);
+    glm::vec4 clip = mvp_mat * glm::vec4(corner, 1.f);
+
+    // The rectangle of a box crossing the near plane is unbounded
+    if (clip.w <= 0.f || clip.z < -clip.w) {
+      return true;
+    }
+
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    glm::vec2 window((ndc.x * 0.5f + 0.5f) * width_, 
+                     (ndc.y * 0.5f + 0.5f) * height_);
+
+    rect_min = glm::min(rect_min, window);
+    rect_max = glm::max(rect_max, window);
+    min_depth = std::min(min_depth, ndc.z * 0.5f + 0.5f);
+  }
+
+  // Pixels the rectangle touches. Clamped as floats first, since the
+  // corners can project arbitrarily far off the screen
+  int x0 = static_cast<int>(std::floor(std::max(rect_min.x, 0.f)));
+  int y0 = static_cast<int>(std::floor(std::max(rect_min.y, 0.f)));
+  int x1 = static_cast<int>(std::floor(
+      std::min(rect_max.x, static_cast<float>(width_ - 1))));
+  int y1 = static_cast<int>(std::floor(
+      std::min(rect_max.y, static_cast<float>(height_ - 1))));
+
+  if (x0 > x1 || y0 > y1) {
+    return false;
+  }
+
+  for (int tile_y = y0 / kTileHeight; tile_y <= y1 / kTileHeight; ++tile_y) {
+    for (int tile_x = x0 / kTileWidth; tile_x <= x1 / kTileWidth; ++tile_x) {
+      uint32_t tile = tile_y * num_tiles_x_ + tile_x;
+
+      // Every pixel of the tile is in front of the box
+      if (min_depth > tile_max_depth_[tile]) {
+        continue;
+      }
+
+      int tile_x0 = tile_x * kTileWidth;
+      int tile_y0 = tile_y * kTileHeight;
+      int rect_x0 = std::max(x0, tile_x0);
+      int rect_y0 = std::max(y0, tile_y0);
+      int rect_x1 = std::min(x1, tile_x0 + kTileWidth - 1);
+      int rect_y1 = std::min(y1, tile_y0 + kTileHeight - 1);
+
+      bool is_visible = is_simd_enabled_ ? 
+          IsTileRectVisible<SimdOps>(tile, rect_x0, rect_y0, rect_x1, 
+                                     rect_y1, min_depth) :
+          IsTileRectVisible<ScalarOps>(tile, rect_x0, rect_y0, rect_x1, 
+                                       rect_y1, min_depth);
+      if (is_visible) {
+        return true;
+      }
+    }
+  }
+
+  ++num_occluded_;
+  return false;
+}
+
+float OcclusionCuller::GetDepth(int x, int y) const {
+  int tile = (y / kTileHeight) * num_tiles_x_ + x / kTileWidth;
+  int offset = (y % kTileHeight) * kTileWidth + x % kTileWidth;
+  return depth_[tile * kTilePixels + offset];
+}
+
+int OcclusionCuller::GetSimdWidth() {
+  return SimdOps::kWidth;
+}
+
+void OcclusionCuller::RunParallel(uint32_t num_items, 
+                                  const ParallelFunc& func) {
+  if (workers_.empty()) {
+    for (uint32_t item = 0; item < num_items; ++item) {
+      func(item, 0);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_func_ = &func;
+    job_num_items_ = num_items;
+    next_item_ = 0;
+    num_busy_workers_ = static_cast<uint32_t>(workers_.size());
+    ++job_generation_;
+  }
+  job_cv_.notify_all();
+
+  // The calling thread works too
+  RunItems(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this]() {
+    return num_busy_workers_ == 0;
+  });
+}
+
+void OcclusionCuller::RunItems(uint32_t thread) {
+  for (uint32_t item = next_item_++; item < job_num_items_; 
+       item = next_item_++) {
+    (*job_func_)(item, thread);
+  }
+}
+
+void OcclusionCuller::WorkerMain(uint32_t thread) {
+  uint64_t generation = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_cv_.wait(lock, [&]() {
+        return should_quit_ || job_generation_ != generation;
+      });
+
+      if (should_quit_) {
+        break;
+      }
+      generation = job_generation_;
+    }
+
+    RunItems(thread);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--num_busy_workers_ == 0) {
+      done_cv_.notify_one();
+    }
+  }
+}
+
+void OcclusionCuller::SetupOccluder(const Occluder& occluder, 
+                                    ThreadBins* bins) {
+  const std::vector<glm::vec3>& positions = *occluder.positions;
+  const std::vector<uint32_t>& indices = *occluder.indices;
+
+  std::vector<glm::vec4>& clip_positions = bins->clip_positions;
+  clip_positions.resize(positions.size());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    clip_positions[i] = occluder.mvp_mat * glm::vec4(positions[i], 1.f);
+  }
+
+  size_t num_corners = indices.empty() ? positions.size() : indices.size();
+
+  for (size_t i = 0; i + 2 < num_corners; i += 3) {
+    glm::vec3 window[3];
+    bool is_clipped = false;
+
+    for (int k = 0; k < 3; ++k) {
+      const glm::vec4& clip = 
+          clip_positions[indices.empty() ? i + k : indices[i + k]];
+
+      // Dropped rather than clipped against the near plane
+      if (clip.w <= 0.f || clip.z < -clip.w) {
+        is_clipped = true;
+        break;
+      }
+
+      glm::vec3 ndc = glm::vec3(clip) / clip.w;
+      window[k] = glm::vec3((ndc.x * 0.5f + 0.5f) * width_, 
+                            (ndc.y * 0.5f + 0.5f) * height_,
+                            ndc.z * 0.5f + 0.5f);
+    }
+
+    if (is_clipped) {
+      continue;
+    }
+
+    // Both windings are kept, since open meshes occlude with either side.
+    // Counterclockwise triangles have a positive area
+    float area = (window[1].x - window[0].x) * (window[2].y - window[0].y) - 
+                 (window[2].x - window[0].x) * (window[1].y - window[0].y);
+    if (std::fabs(area) < 1e-6f) {
+      continue;
+    }
+    if (area < 0.f) {
+      std::swap(window[1], window[2]);
+      area = -area;
+    }
+
+    glm::vec3 min_pos = glm::min(glm::min(window[0], window[1]), window[2]);
+    glm::vec3 max_pos = glm::max(glm::max(window[0], window[1]), window[2]);
+
+    // Pixels whose centers the bounds contain
+    Triangle tri;
+    tri.min_x = static_cast<int>(std::ceil(std::max(min_pos.x - 0.5f, 0.f)));
+    tri.min_y = static_cast<int>(std::ceil(std::max(min_pos.y - 0.5f, 0.f)));
+    tri.max_x = static_cast<int>(std::floor(
+        std::min(max_pos.x - 0.5f, static_cast<float>(width_ - 1))));
+    tri.max_y = static_cast<int>(std::floor(
+        std::min(max_pos.y - 0.5f, static_cast<float>(height_ - 1))));
+
+    if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) {
+      continue;
+    }
+
+    // Edge k runs from vertex k to the next. Its function is the cross
+    // product of the edge and the vector to the pixel
+    for (int k = 0; k < 3; ++k) {
+      const glm::vec3& from = window[k];
+      const glm::vec3& to = window[(k + 1) % 3];
+
+      tri.edge_a[k] = from.y - to.y;
+      tri.edge_b[k] = to.x - from.x;
+      tri.edge_c[k] = -(tri.edge_a[k] * from.x + tri.edge_b[k] * from.y);
+    }
+
+    // Window space z is linear across the triangle
+    glm::vec3 d1 = window[1] - window[0];
+    glm::vec3 d2 = window[2] - window[0];
+    tri.z_dx = (d1.z * d2.y - d2.z * d1.y) / area;
+    tri.z_dy = (d2.z * d1.x - d1.z * d2.x) / area;
+    tri.z_c = window[0].z - tri.z_dx * window[0].x - tri.z_dy * window[0].y;
+
+    uint32_t index = static_cast<uint32_t>(bins->triangles.size());
+    bins->triangles.push_back(tri);
+
+    for (int tile_y = tri.min_y / kTileHeight; 
+         tile_y <= tri.max_y / kTileHeight; ++tile_y) {
+      for (int tile_x = tri.min_x / kTileWidth; 
+           tile_x <= tri.max_x / kTileWidth; ++tile_x) {
+        bins->tiles[tile_y * num_tiles_x_ + tile_x].push_back(index);
+      }
+    }
+  }
+}
+
+template <typename Ops>
+void OcclusionCuller::RasterizeTile(uint32_t tile) {
+  using FloatVec = typename Ops::FloatVec;
+  using MaskVec = typename Ops::MaskVec;
+  const int kSimdWidth = Ops::kWidth;
+
+  int tile_x0 = (tile % num_tiles_x_) * kTileWidth;
+  int tile_y0 = (tile / num_tiles_x_) * kTileHeight;
+  int tile_x1 = tile_x0 + kTileWidth - 1;
+  int tile_y1 = tile_y0 + kTileHeight - 1;
+
+  float* tile_depth = &depth_[tile * kTilePixels];
+  std::fill(tile_depth, tile_depth + kTilePixels, 1.f);
+
+  const FloatVec zero = Ops::Splat(0.f);
+  const FloatVec lane_centers = Ops::Add(Ops::LaneIndices(), 
+                                         Ops::Splat(0.5f));
+
+  for (const ThreadBins& bins : thread_bins_) {
+    for (uint32_t index : bins.tiles[tile]) {
+      const Triangle& tri = bins.triangles[index];
+
+      int x0 = std::max(tri.min_x, tile_x0);
+      int y0 = std::max(tri.min_y, tile_y0);
+      int x1 = std::min(tri.max_x, tile_x1);
+      int y1 = std::min(tri.max_y, tile_y1);
+
+      // Down to a whole SIMD group. The edge functions reject the extra
+      // pixels
+      x0 = tile_x0 + (x0 - tile_x0) / kSimdWidth * kSimdWidth;
+
+      FloatVec edge_a[3];
+      for (int k = 0; k < 3; ++k) {
+        edge_a[k] = Ops::Splat(tri.edge_a[k]);
+      }
+      FloatVec z_dx = Ops::Splat(tri.z_dx);
+
+      for (int y = y0; y <= y1; ++y) {
+        float pixel_y = y + 0.5f;
+
+        FloatVec row_edge[3];
+        for (int k = 0; k < 3; ++k) {
+          row_edge[k] = Ops::Splat(tri.edge_b[k] * pixel_y + tri.edge_c[k]);
+        }
+        FloatVec row_z = Ops::Splat(tri.z_dy * pixel_y + tri.z_c);
+
+        float* row = tile_depth + (y - tile_y0) * kTileWidth - tile_x0;
+
+        for (int x = x0; x <= x1; x += kSimdWidth) {
+          FloatVec pixel_x = Ops::Add(Ops::Splat(static_cast<float>(x)), 
+                                      lane_centers);
+
+          MaskVec inside[3];
+          for (int k = 0; k < 3; ++k) {
+            inside[k] = Ops::GreaterEqual(
+                Ops::Add(Ops::Mul(edge_a[k], pixel_x), row_edge[k]), zero);
+          }
+          MaskVec all_inside = 
+              Ops::And(Ops::And(inside[0], inside[1]), inside[2]);
+          if (!Ops::Any(all_inside)) {
+            continue;
+          }
+
+          FloatVec z = Ops::Add(Ops::Mul(z_dx, pixel_x), row_z);
+          FloatVec depth = Ops::Load(row + x);
+          Ops::Store(row + x, 
+                     Ops::Select(all_inside, Ops::Min(depth, z), depth));
+        }
+      }
+    }
+  }
+
+  FloatVec max_depth = Ops::Load(tile_depth);
+  for (int i = kSimdWidth; i < kTilePixels; i += kSimdWidth) {
+    max_depth = Ops::Max(max_depth, Ops::Load(tile_depth + i));
+  }
+  tile_max_depth_[tile] = Ops::MaxLane(max_depth);
+}
+
+template <typename Ops>
+bool OcclusionCuller::IsTileRectVisible(uint32_t tile, int x0, int y0, 
+                                        int x1, int y1, float depth) const {
+  using FloatVec = typename Ops::FloatVec;
+  using MaskVec = typename Ops::MaskVec;
+  const int kSimdWidth = Ops::kWidth;
+
+  int tile_x0 = (tile % num_tiles_x_) * kTileWidth;
+  int tile_y0 = (tile / num_tiles_x_) * kTileHeight;
+
+  const float* tile_depth = &depth_[tile * kTilePixels];
+
+  const FloatVec box_depth = Ops::Splat(depth);
+  const FloatVec lanes = Ops::LaneIndices();
+  const FloatVec min_x = Ops::Splat(static_cast<float>(x0));
+  const FloatVec max_x = Ops::Splat(static_cast<float>(x1));
+
+  int group_x0 = tile_x0 + (x0 - tile_x0) / kSimdWidth * kSimdWidth;
+
+  for (int y = y0; y <= y1; ++y) {
+    const float* row = tile_depth + (y - tile_y0) * kTileWidth - tile_x0;
+
+    for (int x = group_x0; x <= x1; x += kSimdWidth) {
+      FloatVec pixel_x = Ops::Add(Ops::Splat(static_cast<float>(x)), lanes);
+
+      // Lanes of the group outside the rectangle don't count
+      MaskVec in_rect = Ops::And(Ops::GreaterEqual(pixel_x, min_x), 
+                                 Ops::GreaterEqual(max_x, pixel_x));
+      MaskVec visible = Ops::And(
+          in_rect, Ops::GreaterEqual(Ops::Load(row + x), box_depth));
+      if (Ops::Any(visible)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
@@ -48,6 +48,8 @@ Mesh CreatePlane(glm::vec3 pt0, glm::vec3 pt1, glm::vec3 pt2, glm::vec3 pt3) {
   mesh.index_data = {0, 1, 2, 0, 2, 3};
   mesh.num_verts = 6;
 
+  ComputeMeshBounds(&mesh);
+
   return std::move(mesh);
 }
 
@@ -80,6 +82,8 @@ Mesh CreatePerspectiveFrustum(float fov, float aspect_ratio, float near_plane,
                      };    
   mesh.num_verts = static_cast<uint32_t>(mesh.index_data.size());   
 
+  ComputeMeshBounds(&mesh);
+
   return std::move(mesh);                                                         
 }
 
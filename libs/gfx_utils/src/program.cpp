@@ -1,45 +1,159 @@
 #include "gfx_utils/program.h"
+#include "gfx_utils/file_utils.h"
 
 #include <cassert>
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <thread>
 
 #include <glm/gtc/type_ptr.hpp>
 
 namespace gfx_utils {
 
+static const uint32_t kProgramCacheVersion = 1;
+static const uint32_t kProgramCacheMagic = 0x47525050; // "PPRG"
+
+struct ProgramCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  GLenum format;
+  uint32_t length;
+};
+
+std::string Program::binary_cache_directory_ = kDefaultCacheDirectory;
+
 void Uniform::Set(bool val) {
-  glUniform1i(location_, val ? 1 : 0);
+  Set(val ? 1 : 0);
 }
 
 void Uniform::Set(int val) {
-  glUniform1i(location_, val);
+  if (IsChanged(&val, sizeof(val))) {
+    glUniform1i(location_, val);
+  }
 }
 
 void Uniform::Set(float val) {
-  glUniform1f(location_, val);
+  if (IsChanged(&val, sizeof(val))) {
+    glUniform1f(location_, val);
+  }
 }
 
 void Uniform::Set(const glm::vec3& val) {
-  glUniform3fv(location_, 1, glm::value_ptr(val));
+  if (IsChanged(glm::value_ptr(val), sizeof(val))) {
+    glUniform3fv(location_, 1, glm::value_ptr(val));
+  }
+}
+
+void Uniform::Set(const glm::vec4& val) {
+  if (IsChanged(glm::value_ptr(val), sizeof(val))) {
+    glUniform4fv(location_, 1, glm::value_ptr(val));
+  }
 }
 
 void Uniform::Set(const glm::mat3& val) {
-  glUniformMatrix3fv(location_, 1, GL_FALSE, glm::value_ptr(val));
+  if (IsChanged(glm::value_ptr(val), sizeof(val))) {
+    glUniformMatrix3fv(location_, 1, GL_FALSE, glm::value_ptr(val));
+  }
 }
 
 void Uniform::Set(const glm::mat4& val) {
-  glUniformMatrix4fv(location_, 1, GL_FALSE, glm::value_ptr(val));
+  if (IsChanged(glm::value_ptr(val), sizeof(val))) {
+    glUniformMatrix4fv(location_, 1, GL_FALSE, glm::value_ptr(val));
+  }
+}
+
+bool Uniform::IsValid() const {
+  return program_ != nullptr && program_->generation_ == generation_;
+}
+
+bool Uniform::IsChanged(const void* value, size_t size) const {
+  if (!program_) {
+    return false;
+  }
+
+  // Looked up before the program was destroyed or recreated. Its location
+  // and shadow index belong to the old program
+  assert(IsValid());
+  if (!IsValid()) {
+    return false;
+  }
+
+  return program_->UpdateUniformShadow(shadow_index_, value, size);
 }
 
 bool Program::CreateFromFiles(const std::string& vert_shader_path, 
                               const std::string& frag_shader_path,
                               const std::string& geom_shader_path) {
+  if (!BeginCreateFromFiles(vert_shader_path, frag_shader_path, 
+                            geom_shader_path)) {
+    return false;
+  }
+
+  return FinishCreate();
+}
+
+bool Program::CreateFromSource(const std::string& vert_shader_src, 
+                               const std::string& frag_shader_src,
+                               const std::string& geom_shader_src) {
+  if (!BeginCreateFromSource(vert_shader_src, frag_shader_src, 
+                             geom_shader_src)) {
+    return false;
+  }
+
+  return FinishCreate();
+}
+
+bool Program::CreateComputeFromFile(const std::string& comp_shader_path) {
+  std::string comp_shader_src;
+  if (!LoadShaderSource(&comp_shader_src, comp_shader_path)) {
+    std::cerr << "Failed to find compute shader source at: "
+              << comp_shader_path << std::endl;
+    return false;
+  }
+
+  return CreateComputeFromSource(comp_shader_src);
+}
+
+bool Program::CreateComputeFromSource(const std::string& comp_shader_src) {
+  assert(!is_pending_);
+
+  if (!GLEW_VERSION_4_3 && !GLEW_ARB_compute_shader) {
+    std::cerr << "Compute shaders need GL 4.3" << std::endl;
+    return false;
+  }
+
+  is_from_binary_cache_ = false;
+  pending_cache_path_.clear();
+
+  std::string defined_src = InsertShaderDefines(comp_shader_src, defines_);
+  const char* src = defined_src.c_str();
+
+  GLuint shader_id = glCreateShader(GL_COMPUTE_SHADER);
+  glShaderSource(shader_id, 1, &src, nullptr);
+  glCompileShader(shader_id);
+
+  program_id_ = glCreateProgram();
+  glAttachShader(program_id_, shader_id);
+  glLinkProgram(program_id_);
+
+  pending_shader_ids_.assign(1, shader_id);
+  is_pending_ = true;
+
+  return FinishCreate();
+}
+
+bool Program::BeginCreateFromFiles(const std::string& vert_shader_path, 
+                                   const std::string& frag_shader_path,
+                                   const std::string& geom_shader_path) {
   std::string vert_shader_src;
   if (!LoadShaderSource(&vert_shader_src, vert_shader_path)) {
     std::cerr << "Failed to find vertex shader source at "
@@ -63,45 +177,156 @@ bool Program::CreateFromFiles(const std::string& vert_shader_path,
     }
   }
 
-  return CreateFromSource(vert_shader_src, frag_shader_src, geom_shader_src);
+  return BeginCreateFromSource(vert_shader_src, frag_shader_src, 
+                               geom_shader_src);
 }
 
-bool Program::CreateFromSource(const std::string& vert_shader_src, 
-                               const std::string& frag_shader_src,
-                               const std::string& geom_shader_src) {
+bool Program::BeginCreateFromSource(const std::string& vert_shader_src, 
+                                    const std::string& frag_shader_src,
+                                    const std::string& geom_shader_src) {
+  assert(!is_pending_);
 
-  GLuint vert_shader_id = glCreateShader(GL_VERTEX_SHADER);
-  if (!CompilerShader(vert_shader_id, vert_shader_src.c_str())) {
-    return false;
+  is_from_binary_cache_ = false;
+
+  // The defines are part of the sources the binary cache is keyed by
+  std::string vert_src = InsertShaderDefines(vert_shader_src, defines_);
+  std::string frag_src = InsertShaderDefines(frag_shader_src, defines_);
+  std::string geom_src = InsertShaderDefines(geom_shader_src, defines_);
+
+  pending_cache_path_.clear();
+  if (!binary_cache_directory_.empty() && IsBinaryCacheSupported()) {
+    pending_cache_path_ = GetBinaryCachePath(vert_src, frag_src, geom_src);
   }
-  
-  GLuint frag_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
-  if (!CompilerShader(frag_shader_id, frag_shader_src.c_str())) {
-    return false;
+
+  GLuint program_id = 0;
+  if (!pending_cache_path_.empty() && 
+      LoadBinary(pending_cache_path_, &program_id)) {
+    program_id_ = program_id;
+    is_from_binary_cache_ = true;
   }
+  else {
+    SubmitFromSource(vert_src, frag_src, geom_src);
+  }
+
+  is_pending_ = true;
+
+  return true;
+}
+
+bool Program::FinishCreate() {
+  assert(is_pending_);
+
+  is_pending_ = false;
+
+  if (!is_from_binary_cache_) {
+    // The link fails if any stage failed to compile, so the compile status
+    // is only needed for the error logs
+    bool is_linked = CheckLinkStatus(program_id_);
+    if (!is_linked) {
+      for (GLuint shader_id : pending_shader_ids_) {
+        CheckCompileStatus(shader_id);
+      }
+    }
+
+    for (GLuint shader_id : pending_shader_ids_) {
+      glDeleteShader(shader_id);
+    }
+    pending_shader_ids_.clear();
 
-  GLuint geom_shader_id = 0;
-  if (!geom_shader_src.empty()) {
-    geom_shader_id = glCreateShader(GL_GEOMETRY_SHADER);
-    if (!CompilerShader(geom_shader_id, geom_shader_src.c_str())) {
+    if (!is_linked) {
+      glDeleteProgram(program_id_);
+      program_id_ = 0;
       return false;
     }
+
+    // A binary the driver rejected is overwritten with a fresh one
+    if (!pending_cache_path_.empty()) {
+      SaveBinary(pending_cache_path_);
+    }
+  }
+
+  ReflectUniforms();
+
+  is_created_ = true;
+
+  return true;
+}
+
+bool Program::IsCreateComplete() const {
+  if (!is_pending_ || is_from_binary_cache_ || 
+      !IsParallelCompileSupported()) {
+    return true;
   }
 
+  GLint is_complete = GL_FALSE;
+  glGetProgramiv(program_id_, GL_COMPLETION_STATUS_KHR, &is_complete);
+  return is_complete == GL_TRUE;
+}
+
+void Program::SubmitFromSource(const std::string& vert_shader_src, 
+                               const std::string& frag_shader_src,
+                               const std::string& geom_shader_src) {
+  const GLenum stages[] = {
+    GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER
+  };
+  const std::string* sources[] = {
+    &vert_shader_src, &frag_shader_src, &geom_shader_src
+  };
+
   GLuint program_id = glCreateProgram();
 
-  glAttachShader(program_id, vert_shader_id);
-  glAttachShader(program_id, frag_shader_id);
+  // Without the hint the driver may not keep a binary to hand out
+  if (IsBinaryCacheSupported()) {
+    glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, 
+                        GL_TRUE);
+  }
+
+  pending_shader_ids_.clear();
 
-  if (geom_shader_id != 0) {
-    glAttachShader(program_id, geom_shader_id);
+  for (int i = 0; i < 3; ++i) {
+    if (sources[i]->empty()) {
+      continue;
+    }
+
+    const char* src = sources[i]->c_str();
+
+    GLuint shader_id = glCreateShader(stages[i]);
+    glShaderSource(shader_id, 1, &src, nullptr);
+    glCompileShader(shader_id);
+    glAttachShader(program_id, shader_id);
+
+    pending_shader_ids_.push_back(shader_id);
   }
 
   glLinkProgram(program_id);
 
-  // Check that the program was successfully created
+  program_id_ = program_id;
+}
+
+bool Program::CheckCompileStatus(GLuint shader_id) {
+  GLint gl_result = GL_FALSE;
+  glGetShaderiv(shader_id, GL_COMPILE_STATUS, &gl_result);
+
+  if (gl_result == GL_FALSE) {
+    int log_length;
+    glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &log_length);
+
+    if (log_length > 0) {
+      std::vector<GLchar> error_log(log_length);
+      glGetShaderInfoLog(shader_id, log_length, nullptr, &error_log[0]);
+      std::cerr << &error_log[0] << std::endl;
+    }
+
+    return false;
+  }
+
+  return true;
+}
+
+bool Program::CheckLinkStatus(GLuint program_id) {
   GLint gl_result = GL_FALSE;
   glGetProgramiv(program_id, GL_LINK_STATUS, &gl_result);
+
   if (gl_result == GL_FALSE) {
     int log_length;
     glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &log_length);
@@ -115,41 +340,308 @@ bool Program::CreateFromSource(const std::string& vert_shader_src,
     return false;
   }
 
-  if (geom_shader_id != 0) {
-    glDeleteShader(geom_shader_id);
+  return true;
+}
+
+bool Program::IsParallelCompileSupported() {
+  return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+}
+
+void Program::Destroy() {
+  assert(is_created_);
+
+  glDeleteProgram(program_id_);
+
+  uniforms_.clear();
+  uniform_shadows_.clear();
+  ++generation_;
+
+  is_created_ = false;
+}
+
+// Continues the hash with "[index]"
+static NameHash HashIndex(NameHash hash, int index) {
+  // Enough for any int
+  char index_str[16];
+  snprintf(index_str, sizeof(index_str), "[%d]", index);
+
+  return HashName(index_str, hash);
+}
+
+Uniform Program::GetUniform(const char* var) const {
+  return GetUniform(HashName(var));
+}
+
+Uniform Program::GetUniform(const char* array, int index, 
+                            const char* var) const {
+  NameHash hash = HashIndex(HashName(array), index);
+  hash = HashName(".", hash);
+
+  return GetUniform(HashName(var, hash));
+}
+
+Uniform Program::GetUniform(const char* array, int index) const {
+  return GetUniform(HashIndex(HashName(array), index));
+}
+
+Uniform Program::GetUniform(NameHash var_hash) const {
+  auto it = std::lower_bound(uniforms_.begin(), uniforms_.end(), var_hash,
+                             [](const UniformEntry& entry, NameHash hash) {
+                               return entry.name_hash < hash;
+                             });
+
+  if (it == uniforms_.end() || it->name_hash != var_hash) {
+    return Uniform();
   }
 
-  glDeleteShader(frag_shader_id);
-  glDeleteShader(vert_shader_id);   
+  return Uniform(this, it->location, it->shadow_index, generation_);
+}
 
-  program_id_ = program_id;
+bool Program::UpdateUniformShadow(uint32_t shadow_index, const void* value,
+                                  size_t size) const {
+  assert(size <= kMaxUniformValueSize);
 
-  is_created_ = true;
+  UniformShadow& shadow = uniform_shadows_[shadow_index];
+  if (shadow.size == size && memcmp(shadow.value, value, size) == 0) {
+    ++uniform_counters_.skipped;
+    return false;
+  }
 
+  memcpy(shadow.value, value, size);
+  shadow.size = static_cast<uint8_t>(size);
+
+  ++uniform_counters_.issued;
   return true;
 }
 
-void Program::Destroy() {
-  assert(is_created_);
+void Program::ReflectUniforms() {
+  uniforms_.clear();
+  uniform_shadows_.clear();
+  ++generation_;
+  uniform_counters_ = UniformCounters();
 
-  glDeleteProgram(program_id_);
+  GLint num_uniforms = 0;
+  glGetProgramiv(program_id_, GL_ACTIVE_UNIFORMS, &num_uniforms);
+
+  GLint max_name_length = 0;
+  glGetProgramiv(program_id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+  std::vector<GLchar> name_buffer(std::max(max_name_length, 1));
+
+  for (GLint i = 0; i < num_uniforms; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program_id_, static_cast<GLuint>(i), 
+                       static_cast<GLsizei>(name_buffer.size()), &length, 
+                       &size, &type, &name_buffer[0]);
+
+    std::string name(&name_buffer[0], length);
+
+    // Members of uniform blocks have no location
+    GLint location = glGetUniformLocation(program_id_, name.c_str());
+    if (location < 0) {
+      continue;
+    }
+
+    AddUniform(name, location);
+
+    // Arrays of basic types are reported once, as "name[0]". Their elements
+    // can also be looked up by the bare name and each index
+    const std::string first_suffix = "[0]";
+    if (name.size() <= first_suffix.size() ||
+        name.compare(name.size() - first_suffix.size(), first_suffix.size(),
+                     first_suffix) != 0) {
+      continue;
+    }
+
+    std::string array_name = 
+        name.substr(0, name.size() - first_suffix.size());
+    AddUniform(array_name, location);
+
+    for (GLint index = 1; index < size; ++index) {
+      std::string element_name = 
+          array_name + "[" + std::to_string(index) + "]";
+      AddUniform(element_name, 
+                 glGetUniformLocation(program_id_, element_name.c_str()));
+    }
+  }
+
+  // One shadow per distinct location
+  std::vector<GLint> locations;
+  for (const UniformEntry& entry : uniforms_) {
+    locations.push_back(entry.location);
+  }
+  std::sort(locations.begin(), locations.end());
+  locations.erase(std::unique(locations.begin(), locations.end()), 
+                  locations.end());
+
+  for (UniformEntry& entry : uniforms_) {
+    entry.shadow_index = static_cast<uint32_t>(
+        std::lower_bound(locations.begin(), locations.end(), entry.location) -
+        locations.begin());
+  }
+  uniform_shadows_.resize(locations.size());
+
+  std::sort(uniforms_.begin(), uniforms_.end(),
+            [](const UniformEntry& a, const UniformEntry& b) {
+              return a.name_hash < b.name_hash;
+            });
+
+  for (size_t i = 1; i < uniforms_.size(); ++i) {
+    if (uniforms_[i].name_hash == uniforms_[i - 1].name_hash) {
+      std::cerr << "Uniform name hash collision in program " << program_id_ 
+                << std::endl;
+    }
+  }
 }
 
-Uniform Program::GetUniform(const std::string& var) {
-  return Uniform(glGetUniformLocation(program_id_, var.c_str()));
+void Program::AddUniform(const std::string& name, GLint location) {
+  UniformEntry entry;
+  entry.name_hash = HashName(name.c_str());
+  entry.location = location;
+  entry.shadow_index = 0;
+  uniforms_.push_back(entry);
 }
 
-Uniform Program::GetUniform(const std::string& array, int index, 
-                            const std::string& var) {
-  std::string actual_var = array + "[" + std::to_string(index) + "]." + var;
+bool Program::BindUniformBlock(const std::string& block, GLuint binding) {
+  GLuint block_index = glGetUniformBlockIndex(program_id_, block.c_str());
+  if (block_index == GL_INVALID_INDEX) {
+    return false;
+  }
 
-  return Uniform(glGetUniformLocation(program_id_, actual_var.c_str()));                         
+  glUniformBlockBinding(program_id_, block_index, binding);
+  return true;
 }
 
-Uniform Program::GetUniform(const std::string& array, int index) {
-  std::string var = array + "[" + std::to_string(index) + "]";
+bool Program::BindShaderStorageBlock(const std::string& block, 
+                                     GLuint binding) {
+  GLuint block_index = glGetProgramResourceIndex(
+      program_id_, GL_SHADER_STORAGE_BLOCK, block.c_str());
+  if (block_index == GL_INVALID_INDEX) {
+    return false;
+  }
 
-  return Uniform(glGetUniformLocation(program_id_, var.c_str()));                         
+  glShaderStorageBlockBinding(program_id_, block_index, binding);
+  return true;
+}
+
+void Program::SetBinaryCacheDirectory(const std::string& directory) {
+  binary_cache_directory_ = directory;
+}
+
+bool Program::IsBinaryCacheSupported() {
+  if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+    return false;
+  }
+
+  // Some drivers support the extension without any binary formats
+  GLint num_formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+  return num_formats > 0;
+}
+
+// Hashes a null-terminated GL string, which may be missing
+static uint64_t HashGLString(GLenum name, uint64_t seed) {
+  const char* str = reinterpret_cast<const char*>(glGetString(name));
+  if (!str) {
+    return seed;
+  }
+  return HashBytes(str, strlen(str), seed);
+}
+
+std::string Program::GetBinaryCachePath(const std::string& vert_shader_src, 
+                                        const std::string& frag_shader_src,
+                                        const std::string& geom_shader_src) {
+  // Chained so that moving text from one stage to another changes the key
+  uint64_t hash = kProgramCacheVersion;
+  const std::string* sources[] = {
+    &vert_shader_src, &frag_shader_src, &geom_shader_src
+  };
+  for (const std::string* src : sources) {
+    uint64_t size = src->size();
+    hash = HashBytes(&size, sizeof(size), hash);
+    hash = HashBytes(src->data(), src->size(), hash);
+  }
+
+  // A driver update or another GPU can't load the binaries of the old one
+  hash = HashGLString(GL_VENDOR, hash);
+  hash = HashGLString(GL_RENDERER, hash);
+  hash = HashGLString(GL_VERSION, hash);
+
+  std::ostringstream path;
+  path << binary_cache_directory_ << "/program_" << std::hex 
+       << std::setw(16) << std::setfill('0') << hash << ".bin";
+  return path.str();
+}
+
+bool Program::LoadBinary(const std::string& path, GLuint* out_program_id) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  ProgramCacheHeader header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || header.magic != kProgramCacheMagic || 
+      header.version != kProgramCacheVersion || header.length == 0) {
+    return false;
+  }
+
+  std::vector<char> binary(header.length);
+  file.read(&binary[0], binary.size());
+  if (!file) {
+    return false;
+  }
+
+  GLuint program_id = glCreateProgram();
+  glProgramBinary(program_id, header.format, &binary[0], 
+                  static_cast<GLsizei>(binary.size()));
+
+  // Drivers reject binaries they no longer understand by failing the link
+  GLint gl_result = GL_FALSE;
+  glGetProgramiv(program_id, GL_LINK_STATUS, &gl_result);
+  if (gl_result == GL_FALSE) {
+    std::cout << "Program binary " << path << " was rejected, recompiling"
+              << std::endl;
+    glDeleteProgram(program_id);
+    return false;
+  }
+
+  *out_program_id = program_id;
+
+  return true;
+}
+
+void Program::SaveBinary(const std::string& path) {
+  GLint length = 0;
+  glGetProgramiv(program_id_, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program_id_, length, nullptr, &format, &binary[0]);
+
+  if (!CreateDirectoryIfMissing(binary_cache_directory_)) {
+    return;
+  }
+
+  std::ofstream file(path, std::ios::out | std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Failed to write program binary: " << path << std::endl;
+    return;
+  }
+
+  ProgramCacheHeader header;
+  header.magic = kProgramCacheMagic;
+  header.version = kProgramCacheVersion;
+  header.format = format;
+  header.length = static_cast<uint32_t>(length);
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(&binary[0], binary.size());
 }
 
 bool Program::LoadShaderSource(std::string* out_str, const std::string& path) {
@@ -169,28 +661,151 @@ bool Program::LoadShaderSource(std::string* out_str, const std::string& path) {
   return true;
 }
 
-bool Program::CompilerShader(GLuint shader_id, const char* shader_src) {
-  glShaderSource(shader_id, 1, &shader_src, nullptr);
-  glCompileShader(shader_id);
+std::string InsertShaderDefines(const std::string& src, 
+                                const std::string& defines) {
+  if (src.empty() || defines.empty()) {
+    return src;
+  }
 
-  // Check success of the fragment shader compilation 
-  GLint gl_result = GL_FALSE;
-  glGetShaderiv(shader_id, GL_COMPILE_STATUS, &gl_result);
+  size_t insert_pos = 0;
+  size_t version_pos = src.find("#version");
+  if (version_pos != std::string::npos) {
+    size_t line_end = src.find('\n', version_pos);
+    if (line_end == std::string::npos) {
+      return src + "\n" + defines;
+    }
+    insert_pos = line_end + 1;
+  }
 
-  if (gl_result == GL_FALSE) {
-    int log_length;
-    glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &log_length);
+  std::string defined_src = src;
+  defined_src.insert(insert_pos, defines);
+  return defined_src;
+}
 
-    if (log_length > 0) {
-      std::vector<GLchar> error_log(log_length);
-      glGetShaderInfoLog(shader_id, log_length, nullptr, &error_log[0]);
-      std::cerr << &error_log[0] << std::endl;
-    }
+bool ProgramBatch::AddFiles(Program* program, const std::string& name,
+                            const std::string& vert_shader_path, 
+                            const std::string& frag_shader_path,
+                            const std::string& geom_shader_path) {
+  auto begin_time = std::chrono::steady_clock::now();
+
+  if (!program->BeginCreateFromFiles(vert_shader_path, frag_shader_path, 
+                                     geom_shader_path)) {
+    std::cerr << "Could not create program " << name << std::endl;
+    has_failed_ = true;
+    return false;
+  }
+
+  AddEntry(program, name, begin_time);
+
+  return true;
+}
 
+bool ProgramBatch::AddSource(Program* program, const std::string& name,
+                             const std::string& vert_shader_src, 
+                             const std::string& frag_shader_src,
+                             const std::string& geom_shader_src) {
+  auto begin_time = std::chrono::steady_clock::now();
+
+  if (!program->BeginCreateFromSource(vert_shader_src, frag_shader_src, 
+                                      geom_shader_src)) {
+    std::cerr << "Could not create program " << name << std::endl;
+    has_failed_ = true;
     return false;
   }
 
+  AddEntry(program, name, begin_time);
+
   return true;
 }
 
+void ProgramBatch::AddEntry(Program* program, const std::string& name,
+                            std::chrono::steady_clock::time_point begin_time) {
+  if (entries_.empty()) {
+    begin_time_ = begin_time;
+  }
+
+  Entry entry;
+  entry.program = program;
+  entry.name = name;
+  entry.begin_time = begin_time;
+  entries_.push_back(entry);
+}
+
+bool ProgramBatch::Finish() {
+  size_t num_remaining = entries_.size();
+
+  while (num_remaining > 0) {
+    bool has_progressed = false;
+
+    for (Entry& entry : entries_) {
+      if (entry.is_finished || !entry.program->IsCreateComplete()) {
+        continue;
+      }
+
+      entry.is_created = entry.program->FinishCreate();
+      if (!entry.is_created) {
+        std::cerr << "Could not create program " << entry.name << std::endl;
+        has_failed_ = true;
+      }
+
+      entry.end_time = std::chrono::steady_clock::now();
+      entry.is_finished = true;
+
+      --num_remaining;
+      has_progressed = true;
+    }
+
+    // Every remaining program is still compiling on the driver's threads
+    if (!has_progressed) {
+      std::this_thread::yield();
+    }
+  }
+
+  PrintReport(std::chrono::steady_clock::now());
+
+  entries_.clear();
+
+  bool is_success = !has_failed_;
+  has_failed_ = false;
+
+  return is_success;
+}
+
+static double ToMs(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void ProgramBatch::PrintReport(
+    std::chrono::steady_clock::time_point end_time) const {
+  if (entries_.empty()) {
+    return;
+  }
+
+  std::ios::fmtflags flags = std::cout.flags();
+  std::streamsize precision = std::cout.precision();
+
+  std::cout << "Created " << entries_.size() << " programs in " 
+            << std::fixed << std::setprecision(2) 
+            << ToMs(end_time - begin_time_) << " ms" 
+            << (Program::IsParallelCompileSupported() ? 
+                " (parallel compile)" : "") 
+            << std::endl;
+
+  for (const Entry& entry : entries_) {
+    std::cout << "  " << entry.name << ": " 
+              << ToMs(entry.end_time - entry.begin_time) << " ms";
+
+    if (!entry.is_created) {
+      std::cout << " (failed)";
+    }
+    else if (entry.program->IsFromBinaryCache()) {
+      std::cout << " (binary cache)";
+    }
+    std::cout << std::endl;
+  }
+
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
+
 } // namespace gfx_utils
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include "gfx_utils/program_variants.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+namespace gfx_utils {
+
+static bool LoadSource(std::string* out_str, const std::string& path) {
+  std::ifstream stream(path, std::ios::in);
+  if (!stream.is_open()) {
+    return false;
+  }
+
+  std::stringstream str_stream;
+  str_stream << stream.rdbuf();
+  *out_str = str_stream.str();
+
+  return true;
+}
+
+// Lowest set bit of a non-zero mask
+static int CalcShift(uint32_t mask) {
+  int shift = 0;
+  while ((mask & 1) == 0) {
+    mask >>= 1;
+    ++shift;
+  }
+  return shift;
+}
+
+static bool IsSingleBit(uint32_t mask) {
+  return (mask & (mask - 1)) == 0;
+}
+
+bool ProgramVariants::CreateFromFiles(const std::string& name,
+                                      const std::string& vert_shader_path, 
+                                      const std::string& frag_shader_path,
+                                      const std::string& geom_shader_path) {
+  std::string vert_shader_src;
+  if (!LoadSource(&vert_shader_src, vert_shader_path)) {
+    std::cerr << "Failed to find vertex shader source at "
+              << vert_shader_path << std::endl;
+    return false;
+  }
+
+  std::string frag_shader_src;
+  if (!LoadSource(&frag_shader_src, frag_shader_path)) {
+    std::cerr << "Failed to find fragment shader source at: "
+              << frag_shader_path << std::endl;
+    return false;
+  }
+
+  std::string geom_shader_src;
+  if (!geom_shader_path.empty() && 
+      !LoadSource(&geom_shader_src, geom_shader_path)) {
+    std::cerr << "Failed to find geometry shader source at: "
+              << geom_shader_path << std::endl;
+    return false;
+  }
+
+  CreateFromSource(name, vert_shader_src, frag_shader_src, geom_shader_src);
+
+  return true;
+}
+
+void ProgramVariants::CreateFromSource(const std::string& name,
+                                       const std::string& vert_shader_src, 
+                                       const std::string& frag_shader_src,
+                                       const std::string& geom_shader_src) {
+  name_ = name;
+  vert_shader_src_ = vert_shader_src;
+  frag_shader_src_ = frag_shader_src;
+  geom_shader_src_ = geom_shader_src;
+}
+
+void ProgramVariants::Destroy() {
+  for (auto& entry : variants_) {
+    if (entry.second.is_created) {
+      entry.second.program.Destroy();
+    }
+  }
+
+  variants_.clear();
+}
+
+void ProgramVariants::AddFeature(uint32_t mask, const std::string& define) {
+  if (mask == 0) {
+    std::cerr << "Shader feature " << define << " has an empty mask" 
+              << std::endl;
+    return;
+  }
+
+  ShaderFeature feature;
+  feature.mask = mask;
+  feature.define = define;
+  features_.push_back(feature);
+}
+
+bool ProgramVariants::Precompile(const std::vector<uint32_t>& features_list) {
+  ProgramBatch batch;
+  std::vector<Variant*> added;
+
+  for (uint32_t features : features_list) {
+    if (variants_.count(features) > 0) {
+      continue;
+    }
+
+    Variant* variant = &variants_[features];
+    batch.AddSource(&variant->program, GetVariantName(features),
+                    GetSource(vert_shader_src_, features),
+                    GetSource(frag_shader_src_, features),
+                    GetSource(geom_shader_src_, features));
+    added.push_back(variant);
+  }
+
+  if (added.empty()) {
+    return true;
+  }
+
+  bool is_success = batch.Finish();
+
+  for (Variant* variant : added) {
+    variant->is_created = variant->program.IsCreated();
+    if (variant->is_created) {
+      SetupVariant(variant);
+    }
+  }
+
+  return is_success;
+}
+
+Program* ProgramVariants::GetVariant(uint32_t features) {
+  auto it = variants_.find(features);
+  if (it != variants_.end()) {
+    return it->second.is_created ? &it->second.program : nullptr;
+  }
+
+  Variant* variant = &variants_[features];
+
+  std::cout << "Compiling program variant " << GetVariantName(features) 
+            << std::endl;
+
+  variant->is_created = variant->program.CreateFromSource(
+      GetSource(vert_shader_src_, features),
+      GetSource(frag_shader_src_, features),
+      GetSource(geom_shader_src_, features));
+
+  if (!variant->is_created) {
+    std::cerr << "Could not create program variant " 
+              << GetVariantName(features) << std::endl;
+    return nullptr;
+  }
+
+  SetupVariant(variant);
+
+  return &variant->program;
+}
+
+std::string ProgramVariants::GetDefines(uint32_t features) const {
+  std::ostringstream defines;
+  defines << defines_;
+
+  for (const ShaderFeature& feature : features_) {
+    if (IsSingleBit(feature.mask)) {
+      if (features & feature.mask) {
+        defines << "#define " << feature.define << "\n";
+      }
+    }
+    else {
+      uint32_t value = (features & feature.mask) >> CalcShift(feature.mask);
+      defines << "#define " << feature.define << " " << value << "\n";
+    }
+  }
+
+  return defines.str();
+}
+
+std::string ProgramVariants::GetSource(const std::string& src, 
+                                       uint32_t features) const {
+  return InsertShaderDefines(src, GetDefines(features));
+}
+
+std::string ProgramVariants::GetVariantName(uint32_t features) const {
+  std::ostringstream name;
+  name << name_ << " [";
+
+  bool is_first = true;
+  for (const ShaderFeature& feature : features_) {
+    uint32_t value = (features & feature.mask) >> CalcShift(feature.mask);
+    if (IsSingleBit(feature.mask) && value == 0) {
+      continue;
+    }
+
+    name << (is_first ? "" : " ") << feature.define;
+    if (!IsSingleBit(feature.mask)) {
+      name << "=" << value;
+    }
+    is_first = false;
+  }
+
+  name << "]";
+  return name.str();
+}
+
+void ProgramVariants::SetupVariant(Variant* variant) {
+  if (!setup_) {
+    return;
+  }
+
+  // Variants can be created mid-frame, so the current program is restored
+  // for the caller's state tracking
+  GLint prev_program_id = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &prev_program_id);
+
+  glUseProgram(variant->program.GetProgramId());
+  setup_(variant->program);
+  glUseProgram(static_cast<GLuint>(prev_program_id));
+}
+
+} // namespace gfx_utils
\ No newline at end of file
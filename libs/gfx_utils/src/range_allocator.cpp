@@ -0,0 +1,102 @@
+#include "gfx_utils/range_allocator.h"
+
+#include <cassert>
+#include <iterator>
+
+namespace gfx_utils {
+
+RangeAllocator::RangeAllocator(uint32_t capacity) {
+  Grow(capacity);
+}
+
+bool RangeAllocator::Allocate(uint32_t size, uint32_t* out_offset) {
+  if (size == 0) {
+    *out_offset = 0;
+    return true;
+  }
+
+  for (auto it = free_blocks_.begin(); it != free_blocks_.end(); ++it) {
+    if (it->second < size) {
+      continue;
+    }
+
+    uint32_t offset = it->first;
+    uint32_t remaining = it->second - size;
+
+    free_blocks_.erase(it);
+    if (remaining > 0) {
+      free_blocks_[offset + size] = remaining;
+    }
+
+    used_ += size;
+    *out_offset = offset;
+    return true;
+  }
+
+  return false;
+}
+
+void RangeAllocator::Free(uint32_t offset, uint32_t size) {
+  if (size == 0) {
+    return;
+  }
+
+  assert(offset + size <= capacity_);
+  assert(used_ >= size);
+
+  used_ -= size;
+
+  auto next_it = free_blocks_.lower_bound(offset);
+  assert(next_it == free_blocks_.end() || next_it->first >= offset + size);
+
+  // Merge with the following block
+  if (next_it != free_blocks_.end() && next_it->first == offset + size) {
+    size += next_it->second;
+    next_it = free_blocks_.erase(next_it);
+  }
+
+  // Merge with the preceding block
+  if (next_it != free_blocks_.begin()) {
+    auto prev_it = std::prev(next_it);
+    if (prev_it->first + prev_it->second == offset) {
+      prev_it->second += size;
+      return;
+    }
+  }
+
+  free_blocks_[offset] = size;
+}
+
+void RangeAllocator::Grow(uint32_t new_capacity) {
+  if (new_capacity <= capacity_) {
+    return;
+  }
+
+  uint32_t old_capacity = capacity_;
+  capacity_ = new_capacity;
+
+  // The new space is free - mark it as used so that Free() can merge it
+  used_ += new_capacity - old_capacity;
+  Free(old_capacity, new_capacity - old_capacity);
+}
+
+void RangeAllocator::Clear() {
+  free_blocks_.clear();
+  used_ = 0;
+
+  if (capacity_ > 0) {
+    free_blocks_[0] = capacity_;
+  }
+}
+
+uint32_t RangeAllocator::GetLargestFreeBlock() const {
+  uint32_t largest = 0;
+  for (const auto& block : free_blocks_) {
+    if (block.second > largest) {
+      largest = block.second;
+    }
+  }
+  return largest;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
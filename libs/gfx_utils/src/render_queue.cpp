@@ -0,0 +1,156 @@
+#include "gfx_utils/render_queue.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace gfx_utils {
+
+static const int kRadixBits = 8;
+static const int kRadixSize = 1 << kRadixBits;
+static const int kNumRadixPasses = 64 / kRadixBits;
+
+static uint32_t GetFieldMask(int num_bits) {
+  return num_bits >= 32 ? 0xffffffffu : (1u << num_bits) - 1;
+}
+
+static uint32_t GetField(uint64_t key, int shift, int num_bits) {
+  return static_cast<uint32_t>(key >> shift) & GetFieldMask(num_bits);
+}
+
+// A field differs if its value changed, or if it holds the overflow value
+static bool IsFieldChanged(uint64_t prev_key, uint64_t key, int shift, 
+                           int num_bits) {
+  uint32_t value = GetField(key, shift, num_bits);
+  return value != GetField(prev_key, shift, num_bits) || 
+         value == GetFieldMask(num_bits);
+}
+
+RenderKeyIds::RenderKeyIds(int num_bits) 
+    : overflow_id_(GetFieldMask(num_bits)) {}
+
+uint32_t RenderKeyIds::GetId(uint64_t object) {
+  auto it = ids_.find(object);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  if (ids_.size() >= overflow_id_) {
+    return overflow_id_;
+  }
+
+  uint32_t id = static_cast<uint32_t>(ids_.size());
+  ids_[object] = id;
+  return id;
+}
+
+uint64_t RenderQueue::MakeKey(uint32_t pass, uint32_t program, 
+                              uint32_t material, uint32_t texture_set, 
+                              uint32_t depth) {
+  uint64_t key = 0;
+  key |= static_cast<uint64_t>(pass & GetFieldMask(kRenderKeyPassBits)) 
+         << kRenderKeyPassShift;
+  key |= static_cast<uint64_t>(program & GetFieldMask(kRenderKeyProgramBits)) 
+         << kRenderKeyProgramShift;
+  key |= static_cast<uint64_t>(
+             material & GetFieldMask(kRenderKeyMaterialBits)) 
+         << kRenderKeyMaterialShift;
+  key |= static_cast<uint64_t>(
+             texture_set & GetFieldMask(kRenderKeyTextureSetBits)) 
+         << kRenderKeyTextureSetShift;
+  key |= static_cast<uint64_t>(depth & GetFieldMask(kRenderKeyDepthBits)) 
+         << kRenderKeyDepthShift;
+  return key;
+}
+
+uint32_t RenderQueue::QuantizeDepth(float depth, float near_plane, 
+                                    float far_plane) {
+  float t = (depth - near_plane) / (far_plane - near_plane);
+  t = std::min(std::max(t, 0.f), 1.f);
+  return static_cast<uint32_t>(t * GetMaxDepth());
+}
+
+uint32_t RenderQueue::CalcChangedFields(uint64_t prev_key, uint64_t key) {
+  uint32_t changed_fields = 0;
+
+  if (IsFieldChanged(prev_key, key, kRenderKeyPassShift, 
+                     kRenderKeyPassBits)) {
+    changed_fields |= kRenderKeyPass;
+  }
+  if (IsFieldChanged(prev_key, key, kRenderKeyProgramShift, 
+                     kRenderKeyProgramBits)) {
+    changed_fields |= kRenderKeyProgram;
+  }
+  if (IsFieldChanged(prev_key, key, kRenderKeyMaterialShift, 
+                     kRenderKeyMaterialBits)) {
+    changed_fields |= kRenderKeyMaterial;
+  }
+  if (IsFieldChanged(prev_key, key, kRenderKeyTextureSetShift, 
+                     kRenderKeyTextureSetBits)) {
+    changed_fields |= kRenderKeyTextureSet;
+  }
+  // Depth has no state behind it, so it's only a plain comparison
+  if (GetField(prev_key, kRenderKeyDepthShift, kRenderKeyDepthBits) != 
+      GetField(key, kRenderKeyDepthShift, kRenderKeyDepthBits)) {
+    changed_fields |= kRenderKeyDepth;
+  }
+
+  return changed_fields;
+}
+
+void RenderQueue::Sort() {
+  num_sort_passes_ = 0;
+
+  size_t num_items = items_.size();
+  if (num_items < 2) {
+    return;
+  }
+
+  uint32_t histograms[kNumRadixPasses][kRadixSize];
+  memset(histograms, 0, sizeof(histograms));
+
+  for (const RenderItem& item : items_) {
+    uint64_t key = item.key;
+    for (int pass = 0; pass < kNumRadixPasses; ++pass) {
+      ++histograms[pass][(key >> (pass * kRadixBits)) & (kRadixSize - 1)];
+    }
+  }
+
+  scratch_.resize(num_items);
+
+  RenderItem* src = &items_[0];
+  RenderItem* dst = &scratch_[0];
+
+  for (int pass = 0; pass < kNumRadixPasses; ++pass) {
+    uint32_t* histogram = histograms[pass];
+    int shift = pass * kRadixBits;
+
+    // Every key has the same byte here, so the pass wouldn't move anything
+    uint32_t first_byte = (src[0].key >> shift) & (kRadixSize - 1);
+    if (histogram[first_byte] == num_items) {
+      continue;
+    }
+
+    // Turn the counts into the start offset of each bucket
+    uint32_t offset = 0;
+    for (int i = 0; i < kRadixSize; ++i) {
+      uint32_t count = histogram[i];
+      histogram[i] = offset;
+      offset += count;
+    }
+
+    for (size_t i = 0; i < num_items; ++i) {
+      uint32_t byte = (src[i].key >> shift) & (kRadixSize - 1);
+      dst[histogram[byte]++] = src[i];
+    }
+
+    std::swap(src, dst);
+    ++num_sort_passes_;
+  }
+
+  // An odd number of passes leaves the result in the scratch buffer
+  if (src != &items_[0]) {
+    items_.swap(scratch_);
+  }
+}
+
+} // namespace gfx_utils
\ No newline at end of file
@@ -6,6 +6,10 @@ void Renderer::SetResourceManager(GLResourceManager* manager) {
   resource_manager_ = manager;
 }
 
+void Renderer::SetStateCache(GLStateCache* state_cache) {
+  state_cache_ = state_cache;
+}
+
 void Renderer::SetWindow(Window* window) {
   window_ = window;
 }
@@ -18,6 +22,10 @@ GLResourceManager* Renderer::GetResourceManager() {
   return resource_manager_;
 }
 
+GLStateCache* Renderer::GetStateCache() {
+  return state_cache_;
+}
+
 Window* Renderer::GetWindow() {
   return window_;
 }
@@ -1,9 +1,14 @@
 #include "gfx_utils/renderers/simple_renderer.h"
 
 #include <cassert>
+#include <cstring>
+#include <iostream>
+#include <string>
 
 #include "glm/glm.hpp"
 
+#include "gfx_utils/frustum.h"
+
 namespace gfx_utils {
 
 static const char vert_shader_src[] = 
@@ -16,10 +21,13 @@ static const char vert_shader_src[] =
   "out vec2 frag_texcoord;\n"
   "flat out uint frag_mtl_id;\n"
   "\n"
-  "uniform mat4 mvp_mat;\n"
+  "// One matrix per instance. Injected, see kMaxInstancesPerDraw\n"
+  "layout(std140) uniform DrawTransforms {\n"
+  "  mat4 mvp_mats[MAX_INSTANCES_PER_DRAW];\n"
+  "};\n"
   "\n"
   "void main() {\n"
-  "  gl_Position = mvp_mat * vec4(vert_pos, 1.0);\n"
+  "  gl_Position = mvp_mats[gl_InstanceID] * vec4(vert_pos, 1.0);\n"
   "\n"
   "  frag_texcoord = vert_texcoord;\n"
   "  frag_mtl_id = vert_mtl_id;\n"
@@ -33,72 +41,256 @@ static const char frag_shader_src[] =
   "\n"
   "out vec4 out_color;\n"
   "\n"
+  "// Mirrors gfx_utils::MaterialBlock\n"
   "struct Material {\n"
-  "  vec3 ambient_color;\n"
-  "  vec3 diffuse_color;\n"
-  "  vec3 emission_color;\n"
+  "  vec4 ambient_color;\n"
+  "  vec4 diffuse_color;\n"
+  "  vec4 specular_color;\n"
+  "  vec4 emission_color;\n"
+  "  float shininess;\n"
   "  \n"
   "  bool has_ambient_tex;\n"
   "  bool has_diffuse_tex;\n"
+  "  bool has_specular_tex;\n"
+  "};\n"
+  "\n"
+  "// Injected from GetShaderBlockDefines()\n"
+  "layout(std140) uniform Materials {\n"
+  "  Material materials[MAX_MATERIALS_PER_BLOCK];\n"
+  "};\n"
+  "\n"
+  "uniform sampler2D ambient_texture;\n"
+  "uniform sampler2D diffuse_texture;\n"
+  "\n"
+  "void main() {\n"
+  "  vec3 ambient  = materials[frag_mtl_id].ambient_color.rgb * 0.5;\n"
+  "  vec3 diffuse  = materials[frag_mtl_id].diffuse_color.rgb * 0.5;\n"
+  "  vec3 emission = materials[frag_mtl_id].emission_color.rgb * 0.5;\n"
   "  \n"
-  "  sampler2D ambient_texture;\n"
-  "  sampler2D diffuse_texture;\n"
+  "#if defined(ALL_AMBIENT_TEX)\n"
+  "  ambient *= texture(ambient_texture, frag_texcoord).rgb;\n"
+  "#elif defined(ANY_AMBIENT_TEX)\n"
+  "  if (materials[frag_mtl_id].has_ambient_tex) {\n"
+  "    ambient *= texture(ambient_texture, frag_texcoord).rgb;\n"
+  "  }\n"
+  "#endif\n"
+  "#if defined(ALL_DIFFUSE_TEX)\n"
+  "  diffuse *= texture(diffuse_texture, frag_texcoord).rgb;\n"
+  "#elif defined(ANY_DIFFUSE_TEX)\n"
+  "  if (materials[frag_mtl_id].has_diffuse_tex) {\n"
+  "    diffuse *= texture(diffuse_texture, frag_texcoord).rgb;\n"
+  "  }\n"
+  "#endif\n"
+  "  \n"
+  "  out_color = vec4(emission + ambient + diffuse, 1.0);\n"
+  "}";
+
+// The indirect path reads the matrix and materials from shader storage,
+// indexed through the command's DrawBlock
+static const char indirect_vert_shader_src[] = 
+  "#version 430 core\n"
+  "#extension GL_ARB_shader_draw_parameters : require\n"
+  "\n"
+  "layout(location = 0) in vec3 vert_pos;\n"
+  "layout(location = 2) in vec2 vert_texcoord;\n"
+  "layout(location = 3) in uint vert_mtl_id;\n"
+  "\n"
+  "out vec2 frag_texcoord;\n"
+  "flat out uint frag_mtl_id;\n"
+  "\n"
+  "// Mirrors gfx_utils::DrawBlock\n"
+  "struct Draw {\n"
+  "  uint first_instance;\n"
+  "  uint first_material;\n"
   "};\n"
   "\n"
-  "uniform Material materials[5];\n"
+  "layout(std430) readonly buffer DrawTransforms {\n"
+  "  mat4 mvp_mats[];\n"
+  "};\n"
+  "\n"
+  "layout(std430) readonly buffer Draws {\n"
+  "  Draw draws[];\n"
+  "};\n"
   "\n"
   "void main() {\n"
-  "  vec3 ambient  = materials[frag_mtl_id].ambient_color * 0.5;\n"
-  "  vec3 diffuse  = materials[frag_mtl_id].diffuse_color * 0.5;\n"
-  "  vec3 emission = materials[frag_mtl_id].emission_color * 0.5;\n"
+  "  Draw draw = draws[gl_BaseInstanceARB];\n"
+  "  mat4 mvp_mat = mvp_mats[draw.first_instance + uint(gl_InstanceID)];\n"
+  "\n"
+  "  gl_Position = mvp_mat * vec4(vert_pos, 1.0);\n"
+  "\n"
+  "  frag_texcoord = vert_texcoord;\n"
+  "  frag_mtl_id = draw.first_material + vert_mtl_id;\n"
+  "}";
+
+static const char indirect_frag_shader_src[] = 
+  "#version 430 core\n"
+  "\n"
+  "in vec2 frag_texcoord;\n"
+  "flat in uint frag_mtl_id;\n"
+  "\n"
+  "out vec4 out_color;\n"
+  "\n"
+  "// Mirrors gfx_utils::MaterialBlock\n"
+  "struct Material {\n"
+  "  vec4 ambient_color;\n"
+  "  vec4 diffuse_color;\n"
+  "  vec4 specular_color;\n"
+  "  vec4 emission_color;\n"
+  "  float shininess;\n"
   "  \n"
+  "  bool has_ambient_tex;\n"
+  "  bool has_diffuse_tex;\n"
+  "  bool has_specular_tex;\n"
+  "};\n"
+  "\n"
+  "// The whole material buffer\n"
+  "layout(std430) readonly buffer Materials {\n"
+  "  Material materials[];\n"
+  "};\n"
+  "\n"
+  "uniform sampler2D ambient_texture;\n"
+  "uniform sampler2D diffuse_texture;\n"
+  "\n"
+  "void main() {\n"
+  "  vec3 ambient  = materials[frag_mtl_id].ambient_color.rgb * 0.5;\n"
+  "  vec3 diffuse  = materials[frag_mtl_id].diffuse_color.rgb * 0.5;\n"
+  "  vec3 emission = materials[frag_mtl_id].emission_color.rgb * 0.5;\n"
+  "  \n"
+  "#if defined(ALL_AMBIENT_TEX)\n"
+  "  ambient *= texture(ambient_texture, frag_texcoord).rgb;\n"
+  "#elif defined(ANY_AMBIENT_TEX)\n"
   "  if (materials[frag_mtl_id].has_ambient_tex) {\n"
-  "    ambient *= texture(materials[frag_mtl_id].ambient_texture,\n"
-  "                       frag_texcoord).rgb;\n"
+  "    ambient *= texture(ambient_texture, frag_texcoord).rgb;\n"
   "  }\n"
+  "#endif\n"
+  "#if defined(ALL_DIFFUSE_TEX)\n"
+  "  diffuse *= texture(diffuse_texture, frag_texcoord).rgb;\n"
+  "#elif defined(ANY_DIFFUSE_TEX)\n"
   "  if (materials[frag_mtl_id].has_diffuse_tex) {\n"
-  "    diffuse *= texture(materials[frag_mtl_id].diffuse_texture,\n"
-  "                       frag_texcoord).rgb;"
+  "    diffuse *= texture(diffuse_texture, frag_texcoord).rgb;\n"
   "  }\n"
+  "#endif\n"
   "  \n"
   "  out_color = vec4(emission + ambient + diffuse, 1.0);\n"
   "}";
 
+// Size of the direct path's DrawTransforms block
+static const uint32_t kMaxInstancesPerDraw = 
+    kMinUniformBlockSize / sizeof(glm::mat4);
+static const size_t kTransformsBlockSize = 
+    kMaxInstancesPerDraw * sizeof(glm::mat4);
+
+// Most draw calls the direct path can make in one frame
+static const size_t kMaxDirectDraws = 16384;
+
+// Most draws the indirect path can submit in one frame
+static const size_t kMaxIndirectDraws = 16384;
+
 bool SimpleRenderer::Initialize() {
   glEnable(GL_TEXTURE_2D);
   glEnable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS);
   glEnable(GL_CULL_FACE);
 
-  if (!program_.CreateFromSource(vert_shader_src, frag_shader_src)) {
+  program_variants_.SetDefines(
+      GetShaderBlockDefines() + "#define MAX_INSTANCES_PER_DRAW " + 
+      std::to_string(kMaxInstancesPerDraw) + "\n");
+  program_variants_.CreateFromSource("simple renderer", vert_shader_src, 
+                                     frag_shader_src);
+  AddMaterialFeatures(&program_variants_);
+
+  program_variants_.SetSetupFunc([](Program& program) {
+    if (!program.BindUniformBlock("DrawTransforms", 
+                                  kBlockBindingDrawTransforms) ||
+        !program.BindUniformBlock("Materials", kBlockBindingMaterials)) {
+      std::cerr << "Simple renderer program is missing a uniform block" 
+                << std::endl;
+    }
+
+    program.GetUniform("ambient_texture").Set(1);
+    program.GetUniform("diffuse_texture").Set(2);
+  });
+
+  // The untextured variant doubles as a check that the shaders compile
+  if (!program_variants_.GetVariant(0)) {
+    return false;
+  }
+
+  is_indirect_ = IsMultiDrawIndirectSupported() && InitializeIndirect();
+
+  // Every draw call binds a whole block, and in the worst case each has a
+  // single instance
+  if (!is_indirect_ && 
+      !transforms_buffer_.Initialize(
+          GL_UNIFORM_BUFFER, 
+          StreamBuffer::CalcRegionSize(GL_UNIFORM_BUFFER, sizeof(glm::mat4),
+                                       kMaxDirectDraws),
+          kTransformsBlockSize)) {
     return false;
   }
 
-  glUseProgram(program_.GetProgramId());
+  return true;
+}
+
+bool SimpleRenderer::InitializeIndirect() {
+  // Each draw is one command with one matrix and one draw block. The slack
+  // covers aligning the three arrays
+  size_t region_size = 
+      kMaxIndirectDraws * (sizeof(glm::mat4) + sizeof(DrawBlock) + 
+                           sizeof(DrawElementsIndirectCommand)) + 
+      3 * StreamBuffer::GetOffsetAlignment(GL_SHADER_STORAGE_BUFFER);
+  if (!stream_buffer_.Initialize(GL_SHADER_STORAGE_BUFFER, region_size)) {
+    return false;
+  }
 
-  glGenVertexArrays(1, &vao_id_);
+  indirect_variants_.CreateFromSource("simple renderer indirect", 
+                                      indirect_vert_shader_src, 
+                                      indirect_frag_shader_src);
+  AddMaterialFeatures(&indirect_variants_);
+
+  indirect_variants_.SetSetupFunc([](Program& program) {
+    program.BindShaderStorageBlock("DrawTransforms", 
+                                   kBlockBindingDrawTransforms);
+    program.BindShaderStorageBlock("Draws", kBlockBindingDraws);
+    program.BindShaderStorageBlock("Materials", kBlockBindingMaterials);
+
+    program.GetUniform("ambient_texture").Set(1);
+    program.GetUniform("diffuse_texture").Set(2);
+  });
+
+  if (!indirect_variants_.GetVariant(0)) {
+    std::cerr << "Falling back to direct draws in the simple renderer" 
+              << std::endl;
+    indirect_variants_.Destroy();
+    stream_buffer_.Destroy();
+    return false;
+  }
 
   return true;
 }
 
 void SimpleRenderer::Destroy() {
-  glDeleteVertexArrays(1, &vao_id_);
+  indirect_variants_.Destroy();
+  stream_buffer_.Destroy();
 
-  // TODO(colintan): Destroy the program only when it was successfully created
+  transforms_buffer_.Destroy();
+
+  program_variants_.Destroy();
 }
 
 void SimpleRenderer::Render(const EntityList& entities) {
   GLResourceManager* resource_manager = GetResourceManager();
+  GLStateCache* state_cache = GetStateCache();
   Window* window = GetWindow();
   Camera* camera = GetCamera();
   
   assert(resource_manager != nullptr);
+  assert(state_cache != nullptr);
   assert(window != nullptr);
   assert(camera != nullptr);
 
-  glUseProgram(program_.GetProgramId());
-
-  glViewport(0, 0, window->GetWindowWidth(), window->GetWindowHeight());
+  state_cache->Viewport(0, 0, window->GetWindowWidth(), 
+                        window->GetWindowHeight());
 
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -107,103 +299,278 @@ void SimpleRenderer::Render(const EntityList& entities) {
                                         window->GetAspectRatio(),
                                         0.1f, 1000.f);
 
+  // Every mesh lives in the geometry pool, so one cached VAO holds the vertex
+  // attribute setup for all the draws
+  state_cache->BindVertexArray(resource_manager->GetVertexArrayId(
+      kVertexLayoutPosition | kVertexLayoutTexcoord | kVertexLayoutMtlId));
+
+  draws_.clear();
+  culler_.Clear();
+  queue_.Clear();
+
+  program_ids_.Clear();
+  material_ids_.Clear();
+  texture_set_ids_.Clear();
+
+  ProgramVariants* variants = 
+      is_indirect_ ? &indirect_variants_ : &program_variants_;
+
   for (auto entity_ptr : entities) {
     if (!entity_ptr->HasModel()) {
       continue;
     }
 
+    glm::mat4 model_mat = entity_ptr->ComputeTransform();
+    glm::mat4 mv_mat = view_mat * model_mat;
+    glm::mat4 mvp_mat = proj_mat * mv_mat;
+
+    // The entity's origin stands in for its meshes' depth
+    uint32_t depth = RenderQueue::QuantizeDepth(-mv_mat[3].z, 0.1f, 1000.f);
+
     for (auto& mesh : entity_ptr->GetModel()->GetMeshes()) {
-      glm::mat4 model_mat = entity_ptr->ComputeTransform();
+      Draw draw;
+      draw.mesh = &mesh;
+      draw.range = resource_manager->GetMeshRange(mesh);
+      if (!draw.range) {
+        continue;
+      }
+
+      // The tightest variant for the mesh's materials
+      draw.program = variants->GetVariant(
+          CalcMaterialFeatures(mesh.material_list));
+      if (!draw.program) {
+        continue;
+      }
+
+      draw.mvp_mat = mvp_mat;
+
+      // One texture per slot, so the last material with one decides
+      for (const auto& mtl : mesh.material_list) {
+        if (mtl.ambient_texture) {
+          draw.ambient_tex_id = 
+              resource_manager->GetTextureId(*mtl.ambient_texture);
+        }
+        if (mtl.diffuse_texture) {
+          draw.diffuse_tex_id = 
+              resource_manager->GetTextureId(*mtl.diffuse_texture);
+        }
+      }
+
+      // Materials are bound per mesh, so the mesh is the material. Keying
+      // on it also keeps each mesh's draws together to be instanced
+      uint32_t material_id = 
+          material_ids_.GetId(reinterpret_cast<uintptr_t>(draw.mesh));
+      uint64_t texture_set = 
+          (static_cast<uint64_t>(draw.ambient_tex_id) << 32) | 
+          draw.diffuse_tex_id;
+      draw.key = RenderQueue::MakeKey(
+          0, program_ids_.GetId(draw.program->GetProgramId()), material_id,
+          texture_set_ids_.GetId(texture_set), depth);
+
+      // Draw i's box is box i of the culler
+      culler_.Add(mesh.bounds_min, mesh.bounds_max, model_mat);
+      draws_.push_back(draw);
+    }
+  }
 
-      SetTransformUniforms_Mesh(mesh, model_mat, view_mat, proj_mat);
+  culler_.Cull(ExtractFrustum(proj_mat * view_mat));
 
-      SetMaterialUniforms_Mesh(mesh);
+  for (size_t i = 0; i < draws_.size(); ++i) {
+    if (culler_.IsVisible(static_cast<uint32_t>(i))) {
+      queue_.Push(draws_[i].key, static_cast<uint32_t>(i));
+    }
+  }
 
-      glBindVertexArray(vao_id_);
+  queue_.Sort();
 
-      GLuint pos_vbo_id = 
-          resource_manager->GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypePosition);
-      glBindBuffer(GL_ARRAY_BUFFER, pos_vbo_id);
-      glEnableVertexAttribArray(0);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+  if (is_indirect_) {
+    SubmitIndirect();
+  }
+  else {
+    SubmitDirect();
+  }
+}
 
-      GLuint texcoord_vbo_id =
-          resource_manager->GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypeTexcoord);
-      glBindBuffer(GL_ARRAY_BUFFER, texcoord_vbo_id);
-      glEnableVertexAttribArray(2);
-      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+void SimpleRenderer::CollectRuns(uint32_t max_instances) {
+  runs_.clear();
+  instance_mvp_mats_.clear();
+
+  // The mesh is part of the key, so a run ends wherever the material (or
+  // anything before it in the key) changes
+  const uint32_t run_fields = 
+      kRenderKeyPass | kRenderKeyProgram | kRenderKeyMaterial | 
+      kRenderKeyTextureSet;
+
+  queue_.Submit([&](uint32_t payload, uint32_t changed_fields) {
+    const Draw& draw = draws_[payload];
+
+    if (runs_.empty() || (changed_fields & run_fields) ||
+        runs_.back().num_instances == max_instances) {
+      Run run;
+      run.draw = &draw;
+      run.changed_fields = changed_fields;
+      run.first_instance = static_cast<uint32_t>(instance_mvp_mats_.size());
+      runs_.push_back(run);
+    }
+
+    ++runs_.back().num_instances;
+    instance_mvp_mats_.push_back(draw.mvp_mat);
+  });
+}
 
-      GLuint mtl_vbo_id =
-          resource_manager->GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypeMtlId);
-      glBindBuffer(GL_ARRAY_BUFFER, mtl_vbo_id);
-      glEnableVertexAttribArray(3);
-      glVertexAttribPointer(3, 1, GL_UNSIGNED_INT, GL_FALSE, 0, (GLvoid*)0);
+void SimpleRenderer::SubmitDirect() {
+  GLResourceManager* resource_manager = GetResourceManager();
 
-      GLuint ibo_id = resource_manager->GetMeshIboId(mesh.id);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_id);
+  CollectRuns(kMaxInstancesPerDraw);
 
-      glDrawElements(GL_TRIANGLES, mesh.num_verts, GL_UNSIGNED_INT, (void*)0);
+  transforms_buffer_.BeginFrame();
+
+  // Every run's matrices are written before the upload
+  std::vector<StreamAllocation> run_transforms(runs_.size());
+  for (size_t i = 0; i < runs_.size(); ++i) {
+    const Run& run = runs_[i];
+    if (!transforms_buffer_.Allocate(run.num_instances * sizeof(glm::mat4),
+                                     &run_transforms[i])) {
+      std::cerr << "Simple renderer can't make more than " 
+                << kMaxDirectDraws << " draw calls" << std::endl;
+      runs_.resize(i);
+      break;
     }
-  }                                      
-}
 
+    memcpy(run_transforms[i].data, &instance_mvp_mats_[run.first_instance],
+           run.num_instances * sizeof(glm::mat4));
+  }
 
-void SimpleRenderer::SetTransformUniforms_Mesh(gfx_utils::Mesh& mesh,
-                                               glm::mat4& model_mat,
-                                               glm::mat4& view_mat,
-                                               glm::mat4& proj_mat) {
-  glm::mat4 mvp_mat = proj_mat * view_mat * model_mat;
+  transforms_buffer_.Flush();
 
-  program_.GetUniform("mvp_mat").Set(mvp_mat);                                          
+  for (size_t i = 0; i < runs_.size(); ++i) {
+    const Run& run = runs_[i];
+    const Draw& draw = *run.draw;
+
+    BindDrawState(draw, run.changed_fields);
+
+    // Colors and flags come from the material buffer
+    if (run.changed_fields & kRenderKeyMaterial) {
+      resource_manager->BindMaterials(*draw.mesh);
+    }
+
+    transforms_buffer_.BindRange(kBlockBindingDrawTransforms, 
+                                 run_transforms[i], kTransformsBlockSize);
+
+    DrawGeometryRangeInstanced(*draw.range, run.num_instances);
+  }
+
+  transforms_buffer_.EndFrame();
+
+  num_draw_calls_ = static_cast<uint32_t>(runs_.size());
 }
 
-void SimpleRenderer::SetMaterialUniforms_Mesh(gfx_utils::Mesh& mesh) {
+void SimpleRenderer::SubmitIndirect() {
   GLResourceManager* resource_manager = GetResourceManager();
+  GLStateCache* state_cache = GetStateCache();
 
-  const auto& mtl_list = mesh.material_list;
-  for (int i = 0; i < mtl_list.size(); ++i) {
-    const auto& mtl = mtl_list[i];
-
-    program_.GetUniform("materials", i, "ambient_color")
-            .Set(mtl.ambient_color);
-    program_.GetUniform("materials", i, "diffuse_color")
-            .Set(mtl.diffuse_color);
-    program_.GetUniform("materials", i, "emission_color")
-            .Set(mtl.emission_color);
-
-    if (!mtl.ambient_texname.empty()) {
-      program_.GetUniform("materials", i, "has_ambient_tex")
-              .Set(true);
-
-      glActiveTexture(GL_TEXTURE1);
-      GLuint tex_gl_id = 
-          resource_manager->GetTextureId(mtl.ambient_texname);
-      glBindTexture(GL_TEXTURE_2D, tex_gl_id);
-      program_.GetUniform("materials", i, "ambient_texture")
-              .Set(1);
-    }
-    else {
-      program_.GetUniform("materials", i, "has_ambient_tex")
-              .Set(false);
+  groups_.clear();
+  num_draw_calls_ = 0;
+
+  if (queue_.GetSize() == 0) {
+    return;
+  }
+
+  // Shader storage has no size limit, so a mesh's instances are one command
+  CollectRuns(0xffffffff);
+
+  size_t num_instances = instance_mvp_mats_.size();
+  size_t num_commands = runs_.size();
+
+  stream_buffer_.BeginFrame();
+
+  StreamAllocation mvp_mats;
+  StreamAllocation draw_blocks;
+  StreamAllocation commands;
+  if (!stream_buffer_.Allocate(num_instances * sizeof(glm::mat4), 
+                               &mvp_mats) ||
+      !stream_buffer_.Allocate(num_commands * sizeof(DrawBlock), 
+                               &draw_blocks) ||
+      !stream_buffer_.Allocate(
+          num_commands * sizeof(DrawElementsIndirectCommand), &commands)) {
+    std::cerr << "Simple renderer can't draw more than " 
+              << kMaxIndirectDraws << " meshes" << std::endl;
+    stream_buffer_.EndFrame();
+    return;
+  }
+
+  memcpy(mvp_mats.data, &instance_mvp_mats_[0], 
+         num_instances * sizeof(glm::mat4));
+
+  auto* dst_draw_blocks = static_cast<DrawBlock*>(draw_blocks.data);
+  auto* dst_commands = 
+      static_cast<DrawElementsIndirectCommand*>(commands.data);
+
+  // One command per run, in queue order. A new group starts wherever the
+  // program or a texture changes
+  for (uint32_t command_index = 0; command_index < num_commands; 
+       ++command_index) {
+    const Run& run = runs_[command_index];
+    const Draw& draw = *run.draw;
+
+    if (run.changed_fields & (kRenderKeyProgram | kRenderKeyTextureSet)) {
+      Group group;
+      group.draw = &draw;
+      group.changed_fields = run.changed_fields;
+      group.first_command = command_index;
+      groups_.push_back(group);
     }
 
-    if (!mtl.diffuse_texname.empty()) {
-      program_.GetUniform("materials", i, "has_diffuse_tex")
-              .Set(true);
+    ++groups_.back().num_commands;
+
+    DrawBlock draw_block;
+    draw_block.first_instance = run.first_instance;
+    resource_manager->GetFirstMaterialIndex(*draw.mesh, 
+                                            &draw_block.first_material);
+    dst_draw_blocks[command_index] = draw_block;
+
+    // The base instance doubles as the index of the command's DrawBlock
+    dst_commands[command_index] = 
+        MakeDrawCommand(*draw.range, run.num_instances, command_index);
+  }
+
+  stream_buffer_.Flush();
+
+  stream_buffer_.BindRange(kBlockBindingDrawTransforms, mvp_mats);
+  stream_buffer_.BindRange(kBlockBindingDraws, draw_blocks);
+  resource_manager->BindAllMaterials(GL_SHADER_STORAGE_BUFFER, 
+                                     kBlockBindingMaterials);
+
+  state_cache->BindBuffer(GL_DRAW_INDIRECT_BUFFER, 
+                          stream_buffer_.GetBufferId());
+
+  for (const Group& group : groups_) {
+    BindDrawState(*group.draw, group.changed_fields);
+
+    GLintptr offset = commands.offset + 
+        group.first_command * sizeof(DrawElementsIndirectCommand);
+    MultiDrawGeometryIndirect(offset, group.num_commands);
+  }
+
+  stream_buffer_.EndFrame();
+
+  num_draw_calls_ = static_cast<uint32_t>(groups_.size());
+}
+
+void SimpleRenderer::BindDrawState(const Draw& draw, 
+                                   uint32_t changed_fields) {
+  GLStateCache* state_cache = GetStateCache();
+
+  if (changed_fields & kRenderKeyProgram) {
+    state_cache->UseProgram(draw.program->GetProgramId());
+  }
 
-      glActiveTexture(GL_TEXTURE2);
-      GLuint tex_gl_id = 
-          resource_manager->GetTextureId(mtl.diffuse_texname);
-      glBindTexture(GL_TEXTURE_2D, tex_gl_id);
-      program_.GetUniform("materials", i, "diffuse_texture")
-              .Set(2);
+  if (changed_fields & kRenderKeyTextureSet) {
+    if (draw.ambient_tex_id != 0) {
+      state_cache->BindTexture(1, GL_TEXTURE_2D, draw.ambient_tex_id);
     }
-    else {
-      program_.GetUniform("materials", i, "has_diffuse_tex")
-              .Set(false);
+    if (draw.diffuse_tex_id != 0) {
+      state_cache->BindTexture(2, GL_TEXTURE_2D, draw.diffuse_tex_id);
     }
   }
 }
@@ -0,0 +1,23 @@
+#include "gfx_utils/residency.h"
+
+namespace gfx_utils {
+
+bool ParseResidencyPolicy(const std::string& str, 
+                          ResidencyPolicy* out_policy) {
+  if (str == "keep") {
+    *out_policy = kResidencyKeep;
+  }
+  else if (str == "drop") {
+    *out_policy = kResidencyDropAfterUpload;
+  }
+  else if (str == "positions") {
+    *out_policy = kResidencyKeepPositions;
+  }
+  else {
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
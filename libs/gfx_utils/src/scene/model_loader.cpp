@@ -46,6 +46,8 @@ std::shared_ptr<Model> ModelLoader::LoadModelFromFile(
 
     LoadMaterialData(&out_mesh, shape, material_data);
 
+    ComputeMeshBounds(&out_mesh);
+
     model_ptr->GetMeshes().push_back(std::move(out_mesh));
   }
 
@@ -6,8 +6,12 @@
 
 #include <iostream>
 #include <fstream>
+#include <cassert>
+#include <utility>
+#include <algorithm>
 
 #include "gfx_utils/texture.h"
+#include "gfx_utils/cubemap_filter.h"
 #include "gfx_utils/scene/data_source.h"
 #include "gfx_utils/scene/light_loader.h"
 
@@ -15,6 +19,25 @@ using json = nlohmann::json;
 
 namespace gfx_utils {
 
+Scene::Scene() {
+  texture_cache_ = std::make_shared<TextureCache>();
+}
+
+Scene::~Scene() {
+  // Entities can outlive the scene, so they must stop adding themselves to
+  // its move list
+  for (Entity* entity : bvh_entities_) {
+    if (entity) {
+      entity->SetBvhPrimitive(0, nullptr);
+    }
+  }
+
+  // Other scenes sharing the cache may release these textures' images now
+  for (const auto& it : texture_refs_) {
+    texture_cache_->RemoveSceneRef(it.first);
+  }
+}
+
 bool Scene::LoadSceneFromJson(const std::string& path) {
   std::ifstream json_fs(path);
   if (!json_fs.is_open()) {
@@ -32,6 +55,8 @@ bool Scene::LoadSceneFromJson(const std::string& path) {
     return false;
   }
 
+  TextureCacheStats prev_tex_stats = texture_cache_->GetStats();
+
   auto models_array = models_it.value();
   for (auto it = models_array.begin(); it != models_array.end(); ++it) {
     auto model_prop = it.value();
@@ -48,6 +73,17 @@ bool Scene::LoadSceneFromJson(const std::string& path) {
       std::cout << "Indexed: " << indexed << std::endl;
     }
 
+    // What CPU-side data the model keeps once it's uploaded to the GPU
+    ResidencyPolicy residency = kResidencyKeep;
+
+    auto residency_it = model_prop.find("residency");
+    if (residency_it != model_prop.end()) {
+      if (!ParseResidencyPolicy(residency_it->get<std::string>(), 
+                                &residency)) {
+        std::cerr << "Invalid residency for model: " << name << std::endl;
+      }
+    }
+
     auto model_ptr = model_loader_.LoadModelFromFile(
         name, mtl_dir, file, indexed);
 
@@ -56,44 +92,28 @@ bool Scene::LoadSceneFromJson(const std::string& path) {
       continue;
     }
 
+    for (gfx_utils::Mesh& mesh : model_ptr->GetMeshes()) {
+      mesh.residency = residency;
+    }
+
     models_[name] = model_ptr;
     models_list_.push_back(model_ptr);
 
     // Load the textures for the meshes in the model
+    ResolveTextures(model_ptr, mtl_dir);
 
-    for (gfx_utils::Mesh mesh : model_ptr->GetMeshes()) {
-      for (gfx_utils::Material mtl : mesh.material_list) {
-        // TODO(colintan): Store the texture strings as a collection in the
-        // material so that this code works even when we add or remove textures
-        // from the Material struct
-        std::string texnames[] = {
-          mtl.ambient_texname, mtl.diffuse_texname, mtl.specular_texname
-        };
-
-        for (const auto& texname : texnames) {
-          // Blank texname means there isn't a texture
-          if (texname.empty()) {
-            continue;
-          }
-
-          // TODO(colintan): Possibly set this during the loading of the model
-          mesh.is_textured = true;
+    AddTextureRefs(model_ptr);
 
-          // Already loaded the texture
-          if (textures_.find(texname) != textures_.end()) {
-            continue;
-          }
+    changes_.added_models.push_back(model_ptr);
+  }
 
-          auto tex_ptr = std::make_shared<Texture>();
-          if (!CreateTextureFromFile(tex_ptr.get(), mtl_dir, texname)) {
-            std::cerr << "Failed to load texture: " << texname << std::endl;
-            // TODO(colintan): Do better error handling here
-            continue;
-          }
-          textures_[texname] = tex_ptr;
-        }
-      }
-    }
+  const TextureCacheStats& tex_stats = texture_cache_->GetStats();
+  if (tex_stats.num_aliased > prev_tex_stats.num_aliased) {
+    std::cout << "Texture dedup: "
+              << (tex_stats.num_aliased - prev_tex_stats.num_aliased)
+              << " aliased textures, "
+              << (tex_stats.saved_bytes - prev_tex_stats.saved_bytes) / 1024
+              << " KB saved" << std::endl;
   }
 
   // Load the entities
@@ -139,6 +159,75 @@ bool Scene::LoadSceneFromJson(const std::string& path) {
     
     entities_[entity_name] = entity;
     entities_list_.push_back(entity);
+    is_bvh_dirty_ = true;
+  }
+
+  // Load the entity grids. Each one places counts[0] x counts[1] x counts[2]
+  // copies of a model, named "<name>_<index>", spacing apart from position
+
+  auto grids_it = json_obj.find("entity_grids");
+
+  if (grids_it != json_obj.end()) {
+    auto grids_array = grids_it.value();
+
+    for (auto it = grids_array.begin(); it != grids_array.end(); ++it) {
+      auto grid_prop = it.value();
+      const std::string& model_name = grid_prop["model"];
+
+      auto model_it = models_.find(model_name);
+      if (model_it == models_.end()) {
+        std::cerr << "Could not find model: " << model_name << std::endl;
+        continue;
+      }
+
+      const std::string& grid_name = grid_prop["name"];
+
+      auto counts_prop = grid_prop["counts"];
+      auto spacing_prop = grid_prop["spacing"];
+
+      glm::vec3 origin(0.f);
+      if (grid_prop.find("position") != grid_prop.end()) {
+        auto pos_prop = grid_prop["position"];
+        origin = glm::vec3(pos_prop[0].get<float>(), 
+                           pos_prop[1].get<float>(),
+                           pos_prop[2].get<float>());
+      }
+
+      glm::vec3 spacing(spacing_prop[0].get<float>(), 
+                        spacing_prop[1].get<float>(),
+                        spacing_prop[2].get<float>());
+
+      glm::vec3 scale(1.f);
+      if (grid_prop.find("scale") != grid_prop.end()) {
+        auto scale_prop = grid_prop["scale"];
+        scale = glm::vec3(scale_prop[0].get<float>(), 
+                          scale_prop[1].get<float>(),
+                          scale_prop[2].get<float>());
+      }
+
+      int count_x = counts_prop[0].get<int>();
+      int count_y = counts_prop[1].get<int>();
+      int count_z = counts_prop[2].get<int>();
+
+      int index = 0;
+      for (int z = 0; z < count_z; ++z) {
+        for (int y = 0; y < count_y; ++y) {
+          for (int x = 0; x < count_x; ++x) {
+            std::string entity_name = 
+                grid_name + "_" + std::to_string(index++);
+
+            auto entity = std::make_shared<Entity>(entity_name);
+            entity->SetModel(model_it->second);
+            entity->SetLocation(origin + spacing * glm::vec3(x, y, z));
+            entity->SetScale(scale);
+
+            entities_[entity_name] = entity;
+            entities_list_.push_back(entity);
+            is_bvh_dirty_ = true;
+          }
+        }
+      }
+    }
   }
 
   // Load the lights
@@ -217,7 +306,18 @@ bool Scene::LoadSceneFromJson(const std::string& path) {
         continue;
       }
 
+      // Generates the specular mip chain and irradiance map for image based
+      // lighting
+      auto prefilter_it = cubemap_prop.find("prefilter");
+      if (prefilter_it != cubemap_prop.end() && prefilter_it->get<bool>()) {
+        if (!PrefilterCubemap(cubemap_ptr.get())) {
+          std::cerr << "Failed to prefilter cubemap: " << name << std::endl;
+        }
+      }
+
       cubemaps_[name] = cubemap_ptr;
+
+      changes_.added_cubemaps.push_back(cubemap_ptr);
     }
   }
   else {
@@ -248,9 +348,345 @@ void Scene::AddEntity(EntityPtr entity) {
 
   entities_[entity_name] = entity;
   entities_list_.push_back(entity);
+  is_bvh_dirty_ = true;
 
   models_[model_name] = entity->GetModel();
   models_list_.push_back(entity->GetModel());
+
+  ResolveTextures(entity->GetModel(), "");
+  AddTextureRefs(entity->GetModel());
+
+  changes_.added_models.push_back(entity->GetModel());
+}
+
+// Removes every element equal to value
+template <typename T>
+static void EraseValue(std::vector<T>* vec, const T& value) {
+  vec->erase(std::remove(vec->begin(), vec->end(), value), vec->end());
+}
+
+bool Scene::RemoveEntity(const std::string& name) {
+  auto it = entities_.find(name);
+  if (it == entities_.end()) {
+    std::cerr << "Could not find entity: " << name << std::endl;
+    return false;
+  }
+
+  RemoveFromBvh(it->second.get());
+
+  EraseValue(&entities_list_, it->second);
+  entities_.erase(it);
+
+  return true;
+}
+
+bool Scene::RemoveModel(const std::string& name) {
+  auto it = models_.find(name);
+  if (it == models_.end()) {
+    std::cerr << "Could not find model: " << name << std::endl;
+    return false;
+  }
+
+  ModelPtr model_ptr = it->second;
+
+  for (auto entity_it = entities_.begin(); entity_it != entities_.end(); ) {
+    if (entity_it->second->GetModel() == model_ptr) {
+      RemoveFromBvh(entity_it->second.get());
+      EraseValue(&entities_list_, entity_it->second);
+      entity_it = entities_.erase(entity_it);
+    }
+    else {
+      ++entity_it;
+    }
+  }
+
+  RemoveTextureRefs(model_ptr);
+
+  EraseValue(&models_list_, model_ptr);
+  models_.erase(it);
+
+  // Pending changes to the model are moot now
+  EraseValue(&changes_.added_models, model_ptr);
+
+  auto& modified = changes_.modified_meshes;
+  modified.erase(std::remove_if(modified.begin(), modified.end(),
+                                [&](const MeshChange& change) {
+                                  return change.model == model_ptr;
+                                }),
+                 modified.end());
+
+  changes_.removed_models.push_back(model_ptr);
+
+  return true;
+}
+
+void Scene::MarkMeshModified(ModelPtr model, Mesh* mesh) {
+  // New vertices may not fit the old bounds
+  ComputeMeshBounds(mesh);
+  is_bvh_dirty_ = true;
+
+  MeshChange change;
+  change.model = model;
+  change.mesh = mesh;
+  changes_.modified_meshes.push_back(change);
+}
+
+void Scene::MarkTextureModified(const std::string& name) {
+  auto it = textures_.find(name);
+  if (it == textures_.end()) {
+    std::cerr << "Could not find texture: " << name << std::endl;
+    return;
+  }
+
+  changes_.modified_textures.push_back(it->second);
+}
+
+void Scene::TakeChanges(SceneChanges* out_changes) {
+  *out_changes = std::move(changes_);
+  changes_ = SceneChanges();
+}
+
+// World space box of the entity's meshes
+static Aabb ComputeEntityBounds(Entity* entity) {
+  glm::mat4 model_mat = entity->ComputeTransform();
+
+  Aabb bounds;
+  bounds.min = bounds.max = glm::vec3(model_mat[3]);
+
+  bool has_bounds = false;
+  glm::vec3 min;
+  glm::vec3 max;
+
+  for (Mesh& mesh : entity->GetModel()->GetMeshes()) {
+    if (!mesh.has_bounds) {
+      ComputeMeshBounds(&mesh);
+      if (!mesh.has_bounds) {
+        continue;
+      }
+    }
+
+    min = has_bounds ? glm::min(min, mesh.bounds_min) : mesh.bounds_min;
+    max = has_bounds ? glm::max(max, mesh.bounds_max) : mesh.bounds_max;
+    has_bounds = true;
+  }
+
+  if (has_bounds) {
+    TransformBox(model_mat, min, max, &bounds.min, &bounds.max);
+  }
+
+  return bounds;
+}
+
+void Scene::UpdateBvh() {
+  if (is_bvh_dirty_) {
+    RebuildBvh();
+    return;
+  }
+
+  if (moved_entities_.empty()) {
+    return;
+  }
+
+  for (Entity* entity : moved_entities_) {
+    entity->ClearMoved();
+    bvh_.Update(entity->GetBvhPrimitive(), ComputeEntityBounds(entity));
+
+    // Parented since the last rebuild
+    if (entity->GetParent() && 
+        std::find(bvh_child_entities_.begin(), bvh_child_entities_.end(), 
+                  entity) == bvh_child_entities_.end()) {
+      bvh_child_entities_.push_back(entity);
+    }
+  }
+  moved_entities_.clear();
+
+  // Setting a transform doesn't tell the children, so they are refit
+  // whenever anything moved
+  for (Entity* entity : bvh_child_entities_) {
+    bvh_.Update(entity->GetBvhPrimitive(), ComputeEntityBounds(entity));
+  }
+
+  if (bvh_.NeedsRebuild()) {
+    RebuildBvh();
+  }
+}
+
+void Scene::RebuildBvh() {
+  bvh_entities_.clear();
+  bvh_child_entities_.clear();
+  bvh_boxes_.clear();
+  moved_entities_.clear();
+
+  for (const EntityPtr& entity_ptr : entities_list_) {
+    Entity* entity = entity_ptr.get();
+
+    uint32_t prim = static_cast<uint32_t>(bvh_entities_.size());
+    entity->SetBvhPrimitive(prim, &moved_entities_);
+
+    bvh_entities_.push_back(entity);
+    bvh_boxes_.push_back(ComputeEntityBounds(entity));
+
+    if (entity->GetParent()) {
+      bvh_child_entities_.push_back(entity);
+    }
+  }
+
+  bvh_.Build(bvh_boxes_);
+
+  is_bvh_dirty_ = false;
+  ++num_bvh_rebuilds_;
+}
+
+void Scene::RemoveFromBvh(Entity* entity) {
+  // Its primitive stays in the tree until the rebuild, but the entity may
+  // be gone by then
+  uint32_t prim = entity->GetBvhPrimitive();
+  if (prim < bvh_entities_.size() && bvh_entities_[prim] == entity) {
+    bvh_entities_[prim] = nullptr;
+  }
+
+  EraseValue(&moved_entities_, entity);
+  EraseValue(&bvh_child_entities_, entity);
+
+  entity->SetBvhPrimitive(0, nullptr);
+
+  is_bvh_dirty_ = true;
+}
+
+void Scene::ResolveTextures(const ModelPtr& model, 
+                            const std::string& tex_directory) {
+  for (Mesh& mesh : model->GetMeshes()) {
+    for (Material& mtl : mesh.material_list) {
+      // TODO(colintan): Store the texture strings as a collection in the
+      // material so that this code works even when we add or remove textures
+      // from the Material struct
+      std::pair<const std::string*, TexturePtr*> textures[] = {
+        {&mtl.ambient_texname, &mtl.ambient_texture},
+        {&mtl.diffuse_texname, &mtl.diffuse_texture},
+        {&mtl.specular_texname, &mtl.specular_texture}
+      };
+
+      for (const auto& texture : textures) {
+        const std::string& texname = *texture.first;
+
+        // Blank texname means there isn't a texture
+        if (texname.empty()) {
+          continue;
+        }
+
+        // TODO(colintan): Possibly set this during the loading of the model
+        mesh.is_textured = true;
+
+        // Set up by hand
+        if (*texture.second) {
+          continue;
+        }
+
+        // Already loaded the texture
+        auto tex_it = textures_.find(texname);
+        if (tex_it != textures_.end()) {
+          tex_it->second->residency = 
+              MostResident(tex_it->second->residency, mesh.residency);
+          *texture.second = tex_it->second;
+          continue;
+        }
+
+        // The cache returns the existing texture if an identical file was
+        // loaded before under any name
+        auto tex_ptr = 
+            texture_cache_->LoadTexture(tex_directory, texname, 
+                                        mesh.residency);
+        if (!tex_ptr) {
+          std::cerr << "Failed to load texture: " << texname << std::endl;
+          // TODO(colintan): Do better error handling here
+          continue;
+        }
+        textures_[texname] = tex_ptr;
+        *texture.second = tex_ptr;
+
+        changes_.added_textures.push_back(tex_ptr);
+      }
+    }
+  }
+}
+
+void Scene::AddTextureRefs(const ModelPtr& model) {
+  for (Mesh& mesh : model->GetMeshes()) {
+    for (Material& mtl : mesh.material_list) {
+      std::pair<const std::string*, const TexturePtr*> textures[] = {
+        {&mtl.ambient_texname, &mtl.ambient_texture},
+        {&mtl.diffuse_texname, &mtl.diffuse_texture},
+        {&mtl.specular_texname, &mtl.specular_texture}
+      };
+
+      for (const auto& texture : textures) {
+        const TexturePtr& tex_ptr = *texture.second;
+        if (!tex_ptr) {
+          continue;
+        }
+
+        if (++texture_refs_[tex_ptr.get()] == 1) {
+          texture_cache_->AddSceneRef(tex_ptr.get());
+        }
+
+        // Textures set up by hand rather than loaded with the scene
+        const std::string& texname = *texture.first;
+        if (!texname.empty() && textures_.find(texname) == textures_.end()) {
+          textures_[texname] = tex_ptr;
+          changes_.added_textures.push_back(tex_ptr);
+        }
+      }
+    }
+  }
+}
+
+void Scene::RemoveTextureRefs(const ModelPtr& model) {
+  for (Mesh& mesh : model->GetMeshes()) {
+    for (Material& mtl : mesh.material_list) {
+      const TexturePtr* textures[] = {
+        &mtl.ambient_texture, &mtl.diffuse_texture, &mtl.specular_texture
+      };
+
+      for (const TexturePtr* texture : textures) {
+        const TexturePtr& tex_ptr = *texture;
+        if (!tex_ptr) {
+          continue;
+        }
+
+        auto ref_it = texture_refs_.find(tex_ptr.get());
+        if (ref_it == texture_refs_.end() || --ref_it->second > 0) {
+          continue;
+        }
+
+        texture_refs_.erase(ref_it);
+        texture_cache_->RemoveSceneRef(tex_ptr.get());
+
+        // The texture may be aliased under several names
+        for (auto it = textures_.begin(); it != textures_.end(); ) {
+          if (it->second == tex_ptr) {
+            it = textures_.erase(it);
+          }
+          else {
+            ++it;
+          }
+        }
+
+        EraseValue(&changes_.added_textures, tex_ptr);
+        EraseValue(&changes_.modified_textures, tex_ptr);
+
+        changes_.removed_textures.push_back(tex_ptr);
+      }
+    }
+  }
+}
+
+void Scene::SetTextureCache(std::shared_ptr<TextureCache> texture_cache) {
+  assert(texture_cache != nullptr);
+  texture_cache_ = texture_cache;
+}
+
+std::shared_ptr<TextureCache> Scene::GetTextureCache() {
+  return texture_cache_;
 }
 
 const ModelList& Scene::GetModels() {
@@ -0,0 +1,82 @@
+#include "gfx_utils/scene/texture_cache.h"
+
+#include <vector>
+
+#include "gfx_utils/hash.h"
+
+namespace gfx_utils {
+
+TexturePtr TextureCache::LoadTexture(const std::string& tex_directory,
+                                     const std::string& texname,
+                                     ResidencyPolicy residency) {
+  // No directory for texnames relative to the working directory
+  std::string path = 
+      tex_directory.empty() ? texname : tex_directory + "/" + texname;
+
+  auto path_it = path_map_.find(path);
+  if (path_it != path_map_.end()) {
+    // The image may have been released after its upload. Whoever asks for
+    // it again gets it decoded anew
+    TexturePtr& tex_ptr = path_it->second;
+    EnsureImageData(tex_ptr.get());
+    tex_ptr->residency = MostResident(tex_ptr->residency, residency);
+
+    ++stats_.num_aliased;
+    stats_.saved_bytes += GetImageByteSize(tex_ptr->image);
+    return tex_ptr;
+  }
+
+  std::vector<uint8_t> file_bytes;
+  if (!LoadFileBytes(&file_bytes, path)) {
+    return nullptr;
+  }
+
+  ContentHash hash = HashBytes(&file_bytes[0], file_bytes.size());
+
+  auto hash_it = hash_map_.find(hash);
+  if (hash_it != hash_map_.end()) {
+    TexturePtr& tex_ptr = hash_it->second;
+    EnsureImageData(tex_ptr.get());
+    tex_ptr->residency = MostResident(tex_ptr->residency, residency);
+
+    ++stats_.num_aliased;
+    stats_.saved_bytes += GetImageByteSize(tex_ptr->image);
+
+    path_map_[path] = tex_ptr;
+    return tex_ptr;
+  }
+
+  auto tex_ptr = std::make_shared<Texture>();
+  if (!LoadImageFromMemory(&tex_ptr->image, &file_bytes[0], file_bytes.size(),
+                           true)) {
+    return nullptr;
+  }
+  tex_ptr->hash = hash;
+  tex_ptr->path = path;
+  tex_ptr->residency = residency;
+
+  ++stats_.num_decoded;
+
+  hash_map_[hash] = tex_ptr;
+  path_map_[path] = tex_ptr;
+
+  return tex_ptr;
+}
+
+void TextureCache::AddSceneRef(const Texture* texture) {
+  ++scene_refs_[texture];
+}
+
+void TextureCache::RemoveSceneRef(const Texture* texture) {
+  auto it = scene_refs_.find(texture);
+  if (it != scene_refs_.end() && --it->second == 0) {
+    scene_refs_.erase(it);
+  }
+}
+
+uint32_t TextureCache::GetNumSceneRefs(const Texture& texture) const {
+  auto it = scene_refs_.find(&texture);
+  return it != scene_refs_.end() ? it->second : 0;
+}
+
+} // namespace gfx_utils
\ No newline at end of file
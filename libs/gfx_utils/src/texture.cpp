@@ -4,6 +4,11 @@
 #include <stb/stb_image.h>
 
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+
+#include "gfx_utils/hash.h"
 
 namespace gfx_utils {
 
@@ -23,23 +28,26 @@ Cubemap::Cubemap() {
   id = cubemap_id_counter;
 }
 
-bool LoadImageFromFile(Image* out_img, const std::string& path, bool flip) {
-  out_img->width = 0;
-  out_img->height = 0;
-  out_img->format = kImageFormatInvalid;
-  out_img->data.clear();
+// Flips the rows in place. Done here instead of with
+// stbi_set_flip_vertically_on_load() since that sets global state, which
+// would make concurrent loads race and sticks for all later loads
+static void FlipRows(uint8_t* pixels, int width, int height, int channels) {
+  size_t row_size = static_cast<size_t>(width) * channels;
+  std::vector<uint8_t> tmp_row(row_size);
 
-  int load_width = -1;
-  int load_height = -1;
-  int load_channels = -1;
+  for (int y = 0; y < height / 2; ++y) {
+    uint8_t* top_row = pixels + y * row_size;
+    uint8_t* bottom_row = pixels + (height - 1 - y) * row_size;
 
-  if (flip) {
-    stbi_set_flip_vertically_on_load(true);
+    std::memcpy(&tmp_row[0], top_row, row_size);
+    std::memcpy(top_row, bottom_row, row_size);
+    std::memcpy(bottom_row, &tmp_row[0], row_size);
   }
+}
 
-  stbi_uc *pixels = stbi_load(path.c_str(), &load_width, &load_height, 
-                              &load_channels, 0);
-  
+// Copies the pixels returned by stb into the image and frees them
+static bool StoreLoadedPixels(Image* out_img, stbi_uc* pixels, int load_width,
+                              int load_height, int load_channels, bool flip) {
   if (!pixels) {
     return false;
   }
@@ -57,16 +65,119 @@ bool LoadImageFromFile(Image* out_img, const std::string& path, bool flip) {
     out_img->format = kImageFormatInvalid;
   }
 
+  if (flip) {
+    FlipRows(pixels, load_width, load_height, load_channels);
+  }
+
   uint32_t load_size = load_width * load_height * load_channels;
   out_img->data = std::vector<unsigned char>(pixels, pixels + load_size);
 
+  stbi_image_free(pixels);
+
   return true;
 }
 
+static void ResetImage(Image* out_img) {
+  out_img->width = 0;
+  out_img->height = 0;
+  out_img->format = kImageFormatInvalid;
+  out_img->data.clear();
+}
+
+bool LoadImageFromFile(Image* out_img, const std::string& path, bool flip) {
+  ResetImage(out_img);
+
+  int load_width = -1;
+  int load_height = -1;
+  int load_channels = -1;
+
+  stbi_uc *pixels = stbi_load(path.c_str(), &load_width, &load_height, 
+                              &load_channels, 0);
+  
+  return StoreLoadedPixels(out_img, pixels, load_width, load_height,
+                           load_channels, flip);
+}
+
+bool LoadImageFromMemory(Image* out_img, const uint8_t* data, size_t size,
+                         bool flip) {
+  ResetImage(out_img);
+
+  int load_width = -1;
+  int load_height = -1;
+  int load_channels = -1;
+
+  stbi_uc *pixels = stbi_load_from_memory(data, static_cast<int>(size),
+                                          &load_width, &load_height,
+                                          &load_channels, 0);
+
+  return StoreLoadedPixels(out_img, pixels, load_width, load_height,
+                           load_channels, flip);
+}
+
+size_t GetImageByteSize(const Image& image) {
+  size_t num_channels = 0;
+  if (image.format == kImageFormatRGBA) {
+    num_channels = 4;
+  }
+  else if (image.format == kImageFormatRGB) {
+    num_channels = 3;
+  }
+
+  return static_cast<size_t>(image.width) * image.height * num_channels;
+}
+
+size_t ReleaseImageData(Image* image) {
+  size_t freed_bytes = image->data.capacity();
+
+  // Swap with an empty vector since clear() doesn't release the memory
+  std::vector<uint8_t>().swap(image->data);
+
+  return freed_bytes;
+}
+
+bool EnsureImageData(Texture* texture) {
+  if (!texture->image.data.empty()) {
+    return true;
+  }
+
+  if (texture->path.empty() || 
+      !LoadImageFromFile(&texture->image, texture->path, true)) {
+    std::cerr << "Could not reload texture " << texture->id << " (" 
+              << texture->path << ")" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool LoadFileBytes(std::vector<uint8_t>* out_bytes, const std::string& path) {
+  out_bytes->clear();
+
+  std::ifstream file_stream(path, std::ios::in | std::ios::binary);
+  if (!file_stream.is_open()) {
+    return false;
+  }
+
+  file_stream.seekg(0, std::ios::end);
+  std::streamoff file_size = file_stream.tellg();
+  file_stream.seekg(0, std::ios::beg);
+
+  if (file_size <= 0) {
+    return false;
+  }
+
+  out_bytes->resize(static_cast<size_t>(file_size));
+  file_stream.read(reinterpret_cast<char*>(&(*out_bytes)[0]), file_size);
+
+  return static_cast<bool>(file_stream);
+}
+
 bool CreateTextureFromFile(Texture* out_tex, const std::string& tex_directory,
                            const std::string& texname) {
   std::string path = tex_directory + "/" + texname;
 
+  out_tex->path = path;
+
   return LoadImageFromFile(&out_tex->image, path, true);
 }
 
@@ -78,17 +189,45 @@ bool CreateCubemapFromFiles(Cubemap* out_cubemap,
     "right.jpg", "left.jpg", "top.jpg", "bottom.jpg", "front.jpg", "back.jpg"
   };
 
-  for (int i = 0; i < filenames.size(); ++i) {
-    Image* img = &(out_cubemap->images[i]);
+  std::vector<ContentHash> face_hashes(filenames.size(), 0);
+  bool face_success[6] = {false, false, false, false, false, false};
+
+  // Decode the faces in parallel - decoding dominates the load time
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    threads.push_back(std::thread([&, i]() {
+      Image* img = &(out_cubemap->images[i]);
+
+      std::string path = directory + "/" + filenames[i];
+
+      std::vector<uint8_t> file_bytes;
+      if (!LoadFileBytes(&file_bytes, path)) {
+        return;
+      }
 
-    const std::string& filename = filenames[i];
-    std::string path = directory + "/" + filename;
+      face_hashes[i] = HashBytes(&file_bytes[0], file_bytes.size());
 
-    if (!LoadImageFromFile(img, path, false)) {
+      face_success[i] = LoadImageFromMemory(img, &file_bytes[0],
+                                            file_bytes.size(), false);
+    }));
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    if (!face_success[i]) {
+      std::cerr << "Failed to load cubemap face: " << directory << "/"
+                << filenames[i] << std::endl;
       return false;
     }
   }
 
+  out_cubemap->hash = HashBytes(&face_hashes[0], 
+                                face_hashes.size() * sizeof(ContentHash));
+
   return true;
 }
 
@@ -5,8 +5,12 @@
 
 namespace gfx_utils {
 
-const int kGLVersionMajor = 3;
-const int kGLVersionMinor = 3;
+// Context versions to try, newest first. Features past 3.3 (such as
+// persistent buffer mapping) are optional and checked through GLEW
+const int kGLVersions[][2] = {
+  {4, 6}, {4, 5}, {4, 4}, {4, 3}, {3, 3}
+};
+const int kNumGLVersions = sizeof(kGLVersions) / sizeof(kGLVersions[0]);
 const int kGLFWSamples = 4;
 const int kGLFWOpenGLProfile = GLFW_OPENGL_CORE_PROFILE;
 
@@ -40,8 +44,6 @@ bool Window::Inititalize(int window_width, int window_height,
     return false;
   }
   
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, kGLVersionMajor);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, kGLVersionMinor);
   glfwWindowHint(GLFW_OPENGL_PROFILE, kGLFWOpenGLProfile);
   glfwWindowHint(GLFW_SAMPLES, kGLFWSamples);
 
@@ -52,9 +54,15 @@ bool Window::Inititalize(int window_width, int window_height,
   window_height_ = window_height;
   window_name_ = window_name;
 
-  glfw_window_ = glfwCreateWindow(window_width_, window_height_, 
-                                  window_name_.c_str(),
-                                  nullptr, nullptr);
+  glfw_window_ = nullptr;
+  for (int i = 0; i < kNumGLVersions && glfw_window_ == nullptr; ++i) {
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, kGLVersions[i][0]);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, kGLVersions[i][1]);
+
+    glfw_window_ = glfwCreateWindow(window_width_, window_height_, 
+                                    window_name_.c_str(),
+                                    nullptr, nullptr);
+  }
   
   if (glfw_window_ == nullptr) {
     std::cerr << "Failed to create GLFW window" << std::endl;
@@ -70,6 +78,8 @@ bool Window::Inititalize(int window_width, int window_height,
     return false;
   }
 
+  std::cout << "OpenGL version: " << glGetString(GL_VERSION) << std::endl;
+
   is_initialized_ = true;
 
   glfwSetKeyCallback(glfw_window_, KeyboardInputCallback);
@@ -82,6 +92,28 @@ void Window::Destroy() {
   glfwTerminate();
 }
 
+GLFWwindow* Window::CreateSharedContext() {
+  assert(glfw_window_ != nullptr);
+
+  // The context version hints are still the ones the main window was
+  // created with
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow* context = glfwCreateWindow(1, 1, "", nullptr, glfw_window_);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+  if (context == nullptr) {
+    std::cerr << "Failed to create shared GL context" << std::endl;
+  }
+
+  return context;
+}
+
+void Window::DestroySharedContext(GLFWwindow* context) {
+  if (context != nullptr) {
+    glfwDestroyWindow(context);
+  }
+}
+
 void Window::SwapBuffers() {
   assert(glfw_window_ != nullptr);
 
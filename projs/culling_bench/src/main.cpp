@@ -0,0 +1,804 @@
+// Measures the CPU culling paths on synthetic scenes and checks them against
+// plain scalar versions of the same tests. Returns non-zero if any result
+// differs
+//
+// Frustum culling: FrustumCuller's SIMD Cull() against a box at a time, on
+// 100k randomly placed, rotated and scaled boxes
+//
+// BVH queries: Bvh's frustum, sphere and ray queries against testing all of
+// 20k boxes, while a fifth of the boxes move every frame
+//
+// Occlusion culling: OcclusionCuller with SIMD on and off and over a range
+// of thread counts, against the single threaded scalar depth buffer and box
+// tests. Its wall occluder's depth and what it hides are also checked
+//
+// Hi-Z selection: a port of HiZPyramid's reduction and of the texel and
+// level selection in deferred_sponza's geom_pass_cull.comp IsOccluded(), on
+// random depth buffers of odd and even sizes. A box must only be occluded
+// where every depth pixel under its screen rectangle is in front of it
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gfx_utils/bvh.h"
+#include "gfx_utils/cpu_timer.h"
+#include "gfx_utils/frustum.h"
+#include "gfx_utils/frustum_culler.h"
+#include "gfx_utils/occlusion_culler.h"
+
+static const uint32_t kNumBoxes = 100000;
+static const int kNumIterations = 100;
+
+// Camera directions, so boxes straddle every plane in some view
+static const int kNumViews = 6;
+
+// Half extent of the cube the boxes are scattered in
+static const float kSceneExtent = 200.f;
+
+static const uint32_t kNumBvhBoxes = 20000;
+static const int kNumBvhFrames = 20;
+static const int kNumBvhQueries = 8;
+
+static const int kOcclusionWidth = 640;
+static const int kOcclusionHeight = 384;
+static const int kNumOcclusionFrames = 20;
+static const uint32_t kNumOccluderTriangles = 5000;
+static const uint32_t kNumOccludees = 2000;
+
+// The wall is a square this far down -z, in front of the camera at the
+// origin, and hides what is behind its middle
+static const float kWallDistance = 10.f;
+static const float kWallHalfSize = 4.f;
+
+// Random depth buffer sizes, after deferred_sponza's 1920x1080
+static const int kNumHiZSizes = 200;
+static const int kMaxHiZSize = 300;
+static const uint32_t kNumHiZBoxes = 2000;
+
+struct WorldBox {
+  glm::vec3 center;
+  glm::vec3 extent;
+};
+
+// FrustumCuller::Add() spelled out, so the scalar test sees the same floats
+static WorldBox TransformBox(const glm::vec3& min, const glm::vec3& max,
+                             const glm::mat4& model_mat) {
+  glm::vec3 center = (min + max) * 0.5f;
+  glm::vec3 extent = (max - min) * 0.5f;
+
+  glm::mat3 abs_mat(glm::abs(glm::vec3(model_mat[0])), 
+                    glm::abs(glm::vec3(model_mat[1])), 
+                    glm::abs(glm::vec3(model_mat[2])));
+
+  WorldBox box;
+  box.center = glm::vec3(model_mat * glm::vec4(center, 1.f));
+  box.extent = abs_mat * extent;
+  return box;
+}
+
+// The test FrustumCuller::Cull() makes, a box and a plane at a time
+static bool IsBoxVisible(const gfx_utils::Frustum& frustum, 
+                         const WorldBox& box) {
+  for (const glm::vec4& plane : frustum.planes) {
+    float dist = (box.center.x * plane.x + box.center.y * plane.y) + 
+                 (box.center.z * plane.z + plane.w);
+    float radius = box.extent.x * std::abs(plane.x) + 
+                   box.extent.y * std::abs(plane.y) + 
+                   box.extent.z * std::abs(plane.z);
+    if (dist + radius < 0.f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool RunFrustumCulling() {
+  // Fixed seed so runs are comparable
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> pos_dist(-kSceneExtent, kSceneExtent);
+  std::uniform_real_distribution<float> angle_dist(0.f, 6.2831853f);
+  std::uniform_real_distribution<float> scale_dist(0.25f, 4.f);
+  std::uniform_real_distribution<float> axis_dist(-1.f, 1.f);
+
+  std::vector<glm::mat4> model_mats(kNumBoxes);
+  for (glm::mat4& model_mat : model_mats) {
+    glm::vec3 axis(axis_dist(rng), axis_dist(rng), axis_dist(rng));
+    if (glm::dot(axis, axis) < 1e-4f) {
+      axis = glm::vec3(0.f, 1.f, 0.f);
+    }
+
+    model_mat = glm::translate(
+        glm::mat4(1.f), glm::vec3(pos_dist(rng), pos_dist(rng), 
+                                  pos_dist(rng)));
+    model_mat = glm::rotate(model_mat, angle_dist(rng), 
+                            glm::normalize(axis));
+    model_mat = glm::scale(model_mat, glm::vec3(scale_dist(rng), 
+                                                scale_dist(rng), 
+                                                scale_dist(rng)));
+  }
+
+  const glm::vec3 box_min(-1.f, -0.5f, -2.f);
+  const glm::vec3 box_max(1.f, 0.5f, 2.f);
+
+  gfx_utils::FrustumCuller culler;
+  culler.Reserve(kNumBoxes);
+
+  gfx_utils::CpuTimer add_timer;
+  for (int iteration = 0; iteration < kNumIterations; ++iteration) {
+    add_timer.Begin();
+    culler.Clear();
+    for (const glm::mat4& model_mat : model_mats) {
+      culler.Add(box_min, box_max, model_mat);
+    }
+    add_timer.End();
+  }
+
+  std::vector<WorldBox> boxes;
+  boxes.reserve(kNumBoxes);
+  for (const glm::mat4& model_mat : model_mats) {
+    boxes.push_back(TransformBox(box_min, box_max, model_mat));
+  }
+
+  const glm::vec3 view_dirs[kNumViews] = {
+    glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 0.f, 1.f),
+    glm::vec3(1.f, 0.f, 0.f), glm::vec3(-1.f, 0.2f, 0.3f),
+    glm::vec3(0.3f, 1.f, 0.1f), glm::vec3(0.5f, -1.f, -0.4f)
+  };
+
+  glm::mat4 proj_mat = 
+      glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 150.f);
+
+  gfx_utils::CpuTimer simd_timer;
+  gfx_utils::CpuTimer scalar_timer;
+
+  size_t num_visible = 0;
+  size_t num_mismatches = 0;
+  std::vector<bool> scalar_visibility(kNumBoxes);
+
+  for (const glm::vec3& view_dir : view_dirs) {
+    glm::vec3 up = std::abs(glm::normalize(view_dir).y) > 0.9f ? 
+        glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+    glm::mat4 view_mat = glm::lookAt(glm::vec3(0.f), view_dir, up);
+    gfx_utils::Frustum frustum = gfx_utils::ExtractFrustum(proj_mat * view_mat);
+
+    for (int iteration = 0; iteration < kNumIterations; ++iteration) {
+      simd_timer.Begin();
+      culler.Cull(frustum);
+      simd_timer.End();
+
+      scalar_timer.Begin();
+      for (uint32_t i = 0; i < kNumBoxes; ++i) {
+        scalar_visibility[i] = IsBoxVisible(frustum, boxes[i]);
+      }
+      scalar_timer.End();
+    }
+
+    num_visible += culler.GetNumVisible();
+    for (uint32_t i = 0; i < kNumBoxes; ++i) {
+      if (culler.IsVisible(i) != scalar_visibility[i]) {
+        ++num_mismatches;
+      }
+    }
+  }
+
+  std::cout << "Frustum culling: " << kNumBoxes << " boxes, " << kNumViews 
+            << " views, average of " << kNumIterations << " iterations" 
+            << std::endl;
+  std::cout << "Add: " << add_timer.GetAverageMs() << " ms" << std::endl;
+  std::cout << "Cull (" << gfx_utils::FrustumCuller::GetSimdWidth() 
+            << " wide): " << simd_timer.GetAverageMs() << " ms" << std::endl;
+  std::cout << "Scalar: " << scalar_timer.GetAverageMs() << " ms" 
+            << std::endl;
+  std::cout << "Visible: " << num_visible / kNumViews << " per view" 
+            << std::endl;
+
+  if (num_mismatches > 0) {
+    std::cerr << "Frustum culling: " << num_mismatches 
+              << " boxes differ from the scalar test" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// Where the ray enters the box within max_dist, a slab at a time. Axes the
+// ray is parallel to bound it only by whether the origin is in the slab
+static bool IntersectRay(const glm::vec3& origin, const glm::vec3& dir, 
+                         const glm::vec3& inv_dir, const gfx_utils::Aabb& box,
+                         float max_dist, float* out_dist) {
+  float enter = 0.f;
+  float exit = max_dist;
+  for (int i = 0; i < 3; ++i) {
+    if (dir[i] == 0.f) {
+      if (origin[i] < box.min[i] || origin[i] > box.max[i]) {
+        return false;
+      }
+      continue;
+    }
+
+    float t0 = (box.min[i] - origin[i]) * inv_dir[i];
+    float t1 = (box.max[i] - origin[i]) * inv_dir[i];
+    enter = std::max(enter, std::min(t0, t1));
+    exit = std::min(exit, std::max(t0, t1));
+  }
+
+  *out_dist = enter;
+  return enter <= exit;
+}
+
+static bool RunBvhQueries() {
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> pos_dist(-kSceneExtent * 0.5f, 
+                                                 kSceneExtent * 0.5f);
+  std::uniform_real_distribution<float> size_dist(0.1f, 3.f);
+  std::uniform_real_distribution<float> move_dist(-5.f, 5.f);
+  std::uniform_real_distribution<float> dir_dist(-1.f, 1.f);
+  std::uniform_int_distribution<uint32_t> prim_dist(0, kNumBvhBoxes - 1);
+
+  std::vector<gfx_utils::Aabb> boxes(kNumBvhBoxes);
+  for (gfx_utils::Aabb& box : boxes) {
+    glm::vec3 center(pos_dist(rng), pos_dist(rng), pos_dist(rng));
+    glm::vec3 extent(size_dist(rng), size_dist(rng), size_dist(rng));
+    box.min = center - extent;
+    box.max = center + extent;
+  }
+
+  gfx_utils::Bvh bvh;
+  gfx_utils::CpuTimer build_timer;
+  build_timer.Begin();
+  bvh.Build(boxes);
+  build_timer.End();
+
+  glm::mat4 proj_mat = 
+      glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 150.f);
+
+  gfx_utils::CpuTimer update_timer;
+  gfx_utils::CpuTimer query_timer;
+  gfx_utils::CpuTimer brute_force_timer;
+
+  std::vector<uint32_t> bvh_prims;
+  std::vector<uint32_t> brute_force_prims;
+
+  size_t num_results = 0;
+  size_t num_mismatches = 0;
+  int num_rebuilds = 0;
+
+  // Sorted, as the BVH reports in traversal order
+  auto compare = [&]() {
+    std::sort(bvh_prims.begin(), bvh_prims.end());
+    num_results += bvh_prims.size();
+    if (bvh_prims != brute_force_prims) {
+      ++num_mismatches;
+    }
+    bvh_prims.clear();
+    brute_force_prims.clear();
+  };
+
+  for (int frame = 0; frame < kNumBvhFrames; ++frame) {
+    update_timer.Begin();
+    for (uint32_t i = 0; i < kNumBvhBoxes / 5; ++i) {
+      uint32_t prim = prim_dist(rng);
+      glm::vec3 offset(move_dist(rng), move_dist(rng), move_dist(rng));
+      boxes[prim].min += offset;
+      boxes[prim].max += offset;
+      bvh.Update(prim, boxes[prim]);
+    }
+    if (bvh.NeedsRebuild()) {
+      bvh.Build(boxes);
+      ++num_rebuilds;
+    }
+    update_timer.End();
+
+    glm::vec3 view_dir(dir_dist(rng), dir_dist(rng), dir_dist(rng));
+    glm::mat4 view_mat = glm::lookAt(
+        glm::vec3(pos_dist(rng), pos_dist(rng), pos_dist(rng)) * 0.5f, 
+        view_dir, glm::vec3(0.f, 1.f, 0.f));
+    gfx_utils::Frustum frustum = gfx_utils::ExtractFrustum(proj_mat * view_mat);
+
+    query_timer.Begin();
+    bvh.QueryFrustum(frustum, [&](uint32_t prim) {
+      bvh_prims.push_back(prim);
+    });
+    query_timer.End();
+
+    brute_force_timer.Begin();
+    for (uint32_t prim = 0; prim < kNumBvhBoxes; ++prim) {
+      if (gfx_utils::TestBoxInFrustum(frustum, boxes[prim].min, 
+                                      boxes[prim].max) != 
+              gfx_utils::kFrustumOutside) {
+        brute_force_prims.push_back(prim);
+      }
+    }
+    brute_force_timer.End();
+    compare();
+
+    for (int query = 0; query < kNumBvhQueries; ++query) {
+      glm::vec3 center(pos_dist(rng), pos_dist(rng), pos_dist(rng));
+      float radius = 20.f;
+
+      bvh.QuerySphere(center, radius, [&](uint32_t prim) {
+        bvh_prims.push_back(prim);
+      });
+      for (uint32_t prim = 0; prim < kNumBvhBoxes; ++prim) {
+        glm::vec3 offset = 
+            glm::clamp(center, boxes[prim].min, boxes[prim].max) - center;
+        if (glm::dot(offset, offset) <= radius * radius) {
+          brute_force_prims.push_back(prim);
+        }
+      }
+      compare();
+
+      // Every other ray runs along an axis over a face of a box, which the
+      // slab test sees as 0 * inf. The face's axis cycles through x, y, z
+      glm::vec3 origin;
+      glm::vec3 dir;
+      if (query % 2 == 0) {
+        origin = glm::vec3(-kSceneExtent, pos_dist(rng), pos_dist(rng));
+        dir = glm::normalize(glm::vec3(1.f, dir_dist(rng) * 0.1f, 
+                                       dir_dist(rng) * 0.1f));
+      }
+      else {
+        const gfx_utils::Aabb& box = boxes[prim_dist(rng)];
+        int face_axis = (query / 2) % 3;
+        int ray_axis = (face_axis + 1) % 3;
+
+        origin = (box.min + box.max) * 0.5f;
+        origin[face_axis] = box.min[face_axis];
+        origin[ray_axis] = -kSceneExtent;
+
+        dir = glm::vec3(0.f);
+        dir[ray_axis] = 1.f;
+      }
+      glm::vec3 inv_dir = 1.f / dir;
+      float max_dist = kSceneExtent * 2.f;
+
+      // Every box the ray enters, not just the closest
+      bvh.QueryRay(origin, dir, max_dist, [&](uint32_t prim, float) {
+        bvh_prims.push_back(prim);
+        return max_dist;
+      });
+      for (uint32_t prim = 0; prim < kNumBvhBoxes; ++prim) {
+        float dist = 0.f;
+        if (IntersectRay(origin, dir, inv_dir, boxes[prim], max_dist, 
+                         &dist)) {
+          brute_force_prims.push_back(prim);
+        }
+      }
+      compare();
+    }
+  }
+
+  std::cout << "BVH queries: " << kNumBvhBoxes << " boxes, " 
+            << kNumBvhFrames << " frames, " << num_rebuilds << " rebuilds" 
+            << std::endl;
+  std::cout << "Build: " << build_timer.GetAverageMs() << " ms" << std::endl;
+  std::cout << "Update: " << update_timer.GetAverageMs() << " ms" 
+            << std::endl;
+  std::cout << "Frustum query: " << query_timer.GetAverageMs() << " ms, " 
+            << brute_force_timer.GetAverageMs() << " ms testing every box" 
+            << std::endl;
+  std::cout << "Results: " << num_results << std::endl;
+
+  if (num_mismatches > 0) {
+    std::cerr << "BVH queries: " << num_mismatches 
+              << " queries differ from testing every box" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+struct OcclusionConfig {
+  bool is_simd_enabled;
+  uint32_t num_threads;
+};
+
+static bool RunOcclusionCulling() {
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> pos_dist(-kWallHalfSize * 2.f, 
+                                                 kWallHalfSize * 2.f);
+  std::uniform_real_distribution<float> depth_dist(-kWallDistance * 3.f, 
+                                                   -1.f);
+  std::uniform_real_distribution<float> offset_dist(-0.5f, 0.5f);
+
+  std::vector<glm::vec3> wall_positions = {
+    glm::vec3(-kWallHalfSize, -kWallHalfSize, -kWallDistance),
+    glm::vec3(kWallHalfSize, -kWallHalfSize, -kWallDistance),
+    glm::vec3(kWallHalfSize, kWallHalfSize, -kWallDistance),
+    glm::vec3(-kWallHalfSize, kWallHalfSize, -kWallDistance)
+  };
+  std::vector<uint32_t> wall_indices = {0, 1, 2, 0, 2, 3};
+
+  // Unindexed, some crossing the wall
+  std::vector<glm::vec3> debris_positions;
+  for (uint32_t i = 0; i < kNumOccluderTriangles; ++i) {
+    glm::vec3 center(pos_dist(rng), pos_dist(rng), depth_dist(rng));
+    for (int k = 0; k < 3; ++k) {
+      debris_positions.push_back(center + glm::vec3(offset_dist(rng), 
+                                                    offset_dist(rng), 
+                                                    offset_dist(rng)));
+    }
+  }
+  std::vector<uint32_t> no_indices;
+
+  std::vector<glm::vec3> occludee_centers(kNumOccludees);
+  for (glm::vec3& center : occludee_centers) {
+    center = glm::vec3(pos_dist(rng), pos_dist(rng), depth_dist(rng));
+  }
+  const glm::vec3 occludee_extent(0.25f);
+
+  glm::mat4 proj_mat = glm::perspective(
+      glm::radians(60.f), 
+      static_cast<float>(kOcclusionWidth) / kOcclusionHeight, 0.1f, 100.f);
+  glm::mat4 model_mat(1.f);
+
+  // The first, scalar on one thread, is the reference. 0 threads is one
+  // per hardware thread
+  std::vector<OcclusionConfig> configs;
+  for (bool is_simd_enabled : {false, true}) {
+    for (uint32_t num_threads : {1u, 2u, 4u, 0u}) {
+      configs.push_back({is_simd_enabled, num_threads});
+    }
+  }
+
+  std::vector<float> ref_depths;
+  std::vector<bool> ref_visibility;
+  bool is_matching = true;
+
+  std::cout << "Occlusion culling: " << kOcclusionWidth << "x" 
+            << kOcclusionHeight << ", " << kNumOccluderTriangles + 2 
+            << " occluder triangles, " << kNumOccludees 
+            << " boxes, average of " << kNumOcclusionFrames << " frames" 
+            << std::endl;
+
+  for (size_t c = 0; c < configs.size(); ++c) {
+    const OcclusionConfig& config = configs[c];
+
+    gfx_utils::OcclusionCuller culler;
+    if (!culler.Initialize(kOcclusionWidth, kOcclusionHeight, 
+                           config.num_threads)) {
+      return false;
+    }
+    culler.SetSimdEnabled(config.is_simd_enabled);
+
+    gfx_utils::CpuTimer rasterize_timer;
+    gfx_utils::CpuTimer test_timer;
+    std::vector<bool> visibility(kNumOccludees);
+
+    for (int frame = 0; frame < kNumOcclusionFrames; ++frame) {
+      rasterize_timer.Begin();
+      culler.BeginFrame(proj_mat);
+      culler.AddOccluder(wall_positions, wall_indices, model_mat);
+      culler.AddOccluder(debris_positions, no_indices, model_mat);
+      culler.RasterizeOccluders();
+      rasterize_timer.End();
+
+      test_timer.Begin();
+      for (uint32_t i = 0; i < kNumOccludees; ++i) {
+        visibility[i] = culler.TestBox(occludee_centers[i] - occludee_extent,
+                                       occludee_centers[i] + occludee_extent,
+                                       model_mat);
+      }
+      test_timer.End();
+    }
+
+    std::vector<float> depths;
+    depths.reserve(kOcclusionWidth * kOcclusionHeight);
+    for (int y = 0; y < kOcclusionHeight; ++y) {
+      for (int x = 0; x < kOcclusionWidth; ++x) {
+        depths.push_back(culler.GetDepth(x, y));
+      }
+    }
+
+    std::cout << (config.is_simd_enabled ? "SIMD " : "Scalar ") 
+              << (config.is_simd_enabled ? gfx_utils::OcclusionCuller::
+                                               GetSimdWidth() : 1)
+              << " wide, " << culler.GetNumThreads() << " threads: " 
+              << rasterize_timer.GetAverageMs() << " ms rasterizing, " 
+              << test_timer.GetAverageMs() << " ms testing, " 
+              << culler.GetNumOccluded() << " occluded" << std::endl;
+
+    if (c == 0) {
+      ref_depths = depths;
+      ref_visibility = visibility;
+      continue;
+    }
+
+    size_t num_depth_mismatches = 0;
+    for (size_t i = 0; i < depths.size(); ++i) {
+      if (depths[i] != ref_depths[i]) {
+        ++num_depth_mismatches;
+      }
+    }
+
+    size_t num_test_mismatches = 0;
+    for (uint32_t i = 0; i < kNumOccludees; ++i) {
+      if (visibility[i] != ref_visibility[i]) {
+        ++num_test_mismatches;
+      }
+    }
+
+    if (num_depth_mismatches > 0 || num_test_mismatches > 0) {
+      std::cerr << "Occlusion culling: " << num_depth_mismatches 
+                << " pixels and " << num_test_mismatches 
+                << " box tests differ from the scalar single thread ones" 
+                << std::endl;
+      is_matching = false;
+    }
+  }
+
+  // The wall is the nearest occluder at the middle of the screen, unless
+  // debris is in front of it there
+  glm::vec4 wall_clip = proj_mat * glm::vec4(0.f, 0.f, -kWallDistance, 1.f);
+  float wall_depth = wall_clip.z / wall_clip.w * 0.5f + 0.5f;
+  float center_depth = 
+      ref_depths[(kOcclusionHeight / 2) * kOcclusionWidth + 
+                 kOcclusionWidth / 2];
+  if (center_depth > wall_depth + 1e-5f) {
+    std::cerr << "Occlusion culling: depth " << center_depth 
+              << " behind the wall's " << wall_depth << std::endl;
+    is_matching = false;
+  }
+
+  gfx_utils::OcclusionCuller culler;
+  culler.Initialize(kOcclusionWidth, kOcclusionHeight, 1);
+  culler.BeginFrame(proj_mat);
+  culler.AddOccluder(wall_positions, wall_indices, model_mat);
+  culler.RasterizeOccluders();
+
+  glm::vec3 behind(0.f, 0.f, -kWallDistance * 2.f);
+  glm::vec3 in_front(0.f, 0.f, -kWallDistance * 0.5f);
+  glm::vec3 beside(kWallHalfSize * 3.f, 0.f, -kWallDistance * 2.f);
+  if (culler.TestBox(behind - occludee_extent, behind + occludee_extent, 
+                     model_mat) ||
+      !culler.TestBox(in_front - occludee_extent, 
+                      in_front + occludee_extent, model_mat) ||
+      !culler.TestBox(beside - occludee_extent, beside + occludee_extent, 
+                      model_mat)) {
+    std::cerr << "Occlusion culling: the wall hides the wrong boxes" 
+              << std::endl;
+    is_matching = false;
+  }
+
+  return is_matching;
+}
+
+// A level of the depth pyramid, or the depth buffer it is built from
+struct HiZLevel {
+  int width = 0;
+  int height = 0;
+  std::vector<float> depths;
+
+  float Fetch(int x, int y) const {
+    return depths[y * width + x];
+  }
+};
+
+// HiZPyramid::Initialize() and its reduction shader
+static std::vector<HiZLevel> BuildHiZPyramid(const HiZLevel& depth) {
+  int width = std::max(depth.width / 2, 1);
+  int height = std::max(depth.height / 2, 1);
+
+  int num_levels = 1;
+  for (int size = std::max(width, height); size > 1; size /= 2) {
+    ++num_levels;
+  }
+
+  std::vector<HiZLevel> levels(num_levels);
+  for (int level = 0; level < num_levels; ++level) {
+    const HiZLevel& src = level == 0 ? depth : levels[level - 1];
+    HiZLevel& dst = levels[level];
+
+    dst.width = width;
+    dst.height = height;
+    dst.depths.resize(width * height);
+
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        // The last texel of a row or column also covers the odd texel of
+        // the source
+        int last_x = std::min(x * 2 + 1, src.width - 1);
+        int last_y = std::min(y * 2 + 1, src.height - 1);
+        if (x == width - 1) {
+          last_x = src.width - 1;
+        }
+        if (y == height - 1) {
+          last_y = src.height - 1;
+        }
+
+        float max_depth = 0.f;
+        for (int src_y = y * 2; src_y <= last_y; ++src_y) {
+          for (int src_x = x * 2; src_x <= last_x; ++src_x) {
+            max_depth = std::max(max_depth, src.Fetch(src_x, src_y));
+          }
+        }
+        dst.depths[y * width + x] = max_depth;
+      }
+    }
+
+    width = std::max(width / 2, 1);
+    height = std::max(height / 2, 1);
+  }
+
+  return levels;
+}
+
+// GLSL's findMSB() for positive values
+static int FindMsb(int value) {
+  int msb = -1;
+  for (; value != 0; value >>= 1) {
+    ++msb;
+  }
+  return msb;
+}
+
+// What IsOccluded() picks for a box: its depth buffer rectangle, nearest
+// window space depth, and the farthest depth of the four texels fetched
+struct HiZSelection {
+  bool is_tested = false;
+  int pixel_min_x = 0;
+  int pixel_min_y = 0;
+  int pixel_max_x = 0;
+  int pixel_max_y = 0;
+  int texel_span = 0;
+  float box_depth = 0.f;
+  float hiz_depth = 0.f;
+};
+
+// geom_pass_cull.comp's IsOccluded() in the second phase, where the
+// pyramid is this frame's. Boxes crossing the near plane aren't tested
+static HiZSelection SelectHiZTexels(const std::vector<HiZLevel>& levels,
+                                    int depth_width, int depth_height,
+                                    const glm::mat4& view_proj_mat,
+                                    const glm::vec3& center, 
+                                    const glm::vec3& extent) {
+  HiZSelection selection;
+
+  glm::vec3 ndc_min(1e30f);
+  glm::vec3 ndc_max(-1e30f);
+
+  for (int i = 0; i < 8; ++i) {
+    glm::vec3 corner = center + extent * glm::vec3((i & 1) ? 1.f : -1.f,
+                                                   (i & 2) ? 1.f : -1.f,
+                                                   (i & 4) ? 1.f : -1.f);
+    glm::vec4 clip = view_proj_mat * glm::vec4(corner, 1.f);
+    if (clip.w <= 0.f || clip.z < -clip.w) {
+      return selection;
+    }
+
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    ndc_min = glm::min(ndc_min, ndc);
+    ndc_max = glm::max(ndc_max, ndc);
+  }
+
+  glm::vec2 depth_size(depth_width, depth_height);
+  glm::ivec2 pixel_min(glm::clamp(
+      (glm::vec2(ndc_min) * 0.5f + 0.5f) * depth_size, glm::vec2(0.f), 
+      depth_size - 1.f));
+  glm::ivec2 pixel_max(glm::clamp(
+      (glm::vec2(ndc_max) * 0.5f + 0.5f) * depth_size, glm::vec2(0.f), 
+      depth_size - 1.f));
+
+  glm::ivec2 texel_min = pixel_min / 2;
+  glm::ivec2 texel_max = pixel_max / 2;
+
+  int texel_extent = std::max(texel_max.x - texel_min.x, 
+                              texel_max.y - texel_min.y);
+  int level = texel_extent > 1 ? FindMsb(texel_extent - 1) + 1 : 0;
+  level = std::min(level, static_cast<int>(levels.size()) - 1);
+
+  const HiZLevel& hiz = levels[level];
+  glm::ivec2 level_max(hiz.width - 1, hiz.height - 1);
+  texel_min = glm::min(glm::ivec2(texel_min.x >> level, 
+                                  texel_min.y >> level), level_max);
+  texel_max = glm::min(glm::ivec2(texel_max.x >> level, 
+                                  texel_max.y >> level), level_max);
+
+  selection.is_tested = true;
+  selection.pixel_min_x = pixel_min.x;
+  selection.pixel_min_y = pixel_min.y;
+  selection.pixel_max_x = pixel_max.x;
+  selection.pixel_max_y = pixel_max.y;
+  selection.texel_span = std::max(texel_max.x - texel_min.x, 
+                                  texel_max.y - texel_min.y) + 1;
+  selection.box_depth = ndc_min.z * 0.5f + 0.5f;
+  selection.hiz_depth = std::max(
+      std::max(hiz.Fetch(texel_min.x, texel_min.y), 
+               hiz.Fetch(texel_max.x, texel_min.y)),
+      std::max(hiz.Fetch(texel_min.x, texel_max.y), 
+               hiz.Fetch(texel_max.x, texel_max.y)));
+  return selection;
+}
+
+static bool RunHiZSelection() {
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int> size_dist(1, kMaxHiZSize);
+  std::uniform_real_distribution<float> depth_dist(0.9f, 1.f);
+  std::uniform_real_distribution<float> pos_dist(-20.f, 20.f);
+  std::uniform_real_distribution<float> distance_dist(1.f, 60.f);
+  std::uniform_real_distribution<float> extent_dist(0.01f, 10.f);
+
+  size_t num_tested = 0;
+  size_t num_occluded = 0;
+  size_t num_wide_spans = 0;
+  size_t num_unconservative = 0;
+
+  for (int i = 0; i < kNumHiZSizes; ++i) {
+    HiZLevel depth;
+    depth.width = i == 0 ? 1920 : size_dist(rng);
+    depth.height = i == 0 ? 1080 : size_dist(rng);
+    depth.depths.resize(depth.width * depth.height);
+    for (float& value : depth.depths) {
+      value = depth_dist(rng);
+    }
+
+    std::vector<HiZLevel> levels = BuildHiZPyramid(depth);
+
+    glm::mat4 proj_mat = glm::perspective(
+        glm::radians(60.f), 
+        static_cast<float>(depth.width) / depth.height, 0.1f, 100.f);
+
+    for (uint32_t box = 0; box < kNumHiZBoxes; ++box) {
+      glm::vec3 center(pos_dist(rng), pos_dist(rng), -distance_dist(rng));
+      glm::vec3 extent(extent_dist(rng), extent_dist(rng), 
+                       extent_dist(rng));
+
+      HiZSelection selection = SelectHiZTexels(
+          levels, depth.width, depth.height, proj_mat, center, extent);
+      if (!selection.is_tested) {
+        continue;
+      }
+      ++num_tested;
+
+      // Four fetches must cover the rectangle
+      if (selection.texel_span > 2) {
+        ++num_wide_spans;
+      }
+
+      float max_depth = 0.f;
+      for (int y = selection.pixel_min_y; y <= selection.pixel_max_y; ++y) {
+        for (int x = selection.pixel_min_x; x <= selection.pixel_max_x; 
+             ++x) {
+          max_depth = std::max(max_depth, depth.Fetch(x, y));
+        }
+      }
+
+      // The pyramid may keep a box that is hidden, never the other way
+      if (selection.hiz_depth < max_depth) {
+        ++num_unconservative;
+      }
+      if (selection.box_depth > selection.hiz_depth) {
+        ++num_occluded;
+      }
+    }
+  }
+
+  std::cout << "Hi-Z selection: " << kNumHiZSizes << " depth buffers, " 
+            << num_tested << " boxes tested, " << num_occluded 
+            << " occluded" << std::endl;
+
+  if (num_wide_spans > 0 || num_unconservative > 0) {
+    std::cerr << "Hi-Z selection: " << num_wide_spans 
+              << " boxes span more than two texels, " << num_unconservative 
+              << " read a nearer depth than their pixels'" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+int main() {
+  bool is_matching = RunFrustumCulling();
+  is_matching = RunBvhQueries() && is_matching;
+  is_matching = RunOcclusionCulling() && is_matching;
+  is_matching = RunHiZSelection() && is_matching;
+
+  return is_matching ? 0 : 1;
+}
\ No newline at end of file
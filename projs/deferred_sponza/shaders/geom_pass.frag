@@ -8,24 +8,42 @@ in vec3 frag_normal;
 in vec2 frag_texcoord;
 flat in uint frag_mtl_id;
 
-// For now, only ambient component
+// Mirrors gfx_utils::MaterialBlock. For now, only the ambient component is
+// used
 struct Material {
-  vec3 ambient_color;
+  vec4 ambient_color;
+  vec4 diffuse_color;
+  vec4 specular_color;
+  vec4 emission_color;
+  float shininess;
+
   bool has_ambient_tex;
-  sampler2D ambient_texture;
+  bool has_diffuse_tex;
+  bool has_specular_tex;
+};
+
+// MAX_MATERIALS_PER_BLOCK is injected by the app, see
+// gfx_utils::GetShaderBlockDefines()
+layout(std140) uniform Materials {
+  Material materials[MAX_MATERIALS_PER_BLOCK];
 };
 
-uniform Material materials[5];
+uniform sampler2D ambient_texture;
 
 void main() {
   out_pos     = frag_pos;
   out_normal  = normalize(frag_normal);
   
-  vec3 mtl_ambient  = materials[frag_mtl_id].ambient_color;
+  vec3 mtl_ambient  = materials[frag_mtl_id].ambient_color.rgb;
+
+  // Specialized per mesh (see gfx_utils::MaterialFeature)
+#if defined(ALL_AMBIENT_TEX)
+  mtl_ambient *= texture(ambient_texture, frag_texcoord).rgb;
+#elif defined(ANY_AMBIENT_TEX)
   if (materials[frag_mtl_id].has_ambient_tex) {
-    mtl_ambient *= texture(materials[frag_mtl_id].ambient_texture, 
-                           frag_texcoord).rgb;
+    mtl_ambient *= texture(ambient_texture, frag_texcoord).rgb;
   }
+#endif
 
   out_ambient = mtl_ambient;
 }
\ No newline at end of file
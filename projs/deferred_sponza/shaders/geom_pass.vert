@@ -9,15 +9,35 @@ out vec3 frag_normal;
 out vec2 frag_texcoord;
 flat out uint frag_mtl_id;
 
-uniform mat4 mv_mat;
-uniform mat4 mvp_mat;
-uniform mat3 normal_mat;
+// Mirrors InstanceTransforms. normal_mat is a mat4 to match the padded
+// std140 layout the app writes
+struct Instance {
+  mat4 model_mat;
+  mat4 normal_mat;
+};
+
+// One element per instance of the draw. MAX_INSTANCES_PER_DRAW is injected
+// by the app
+layout(std140) uniform DrawTransforms {
+  Instance instances[MAX_INSTANCES_PER_DRAW];
+};
+
+uniform mat4 view_mat;
+uniform mat4 proj_mat;
 
 void main() {
-  frag_pos = (mv_mat * vec4(vert_pos, 1.0)).xyz;
-  frag_normal = normal_mat * vert_normal;
+  mat4 model_mat = instances[gl_InstanceID].model_mat;
+  mat3 normal_mat = mat3(instances[gl_InstanceID].normal_mat);
+
+  vec4 view_pos = view_mat * (model_mat * vec4(vert_pos, 1.0));
+
+  frag_pos = view_pos.xyz;
+
+  // The view matrix is rigid, so its rotation moves world space normals into
+  // view space as is
+  frag_normal = mat3(view_mat) * (normal_mat * vert_normal);
   frag_texcoord = vert_texcoord;
   frag_mtl_id = vert_mtl_id;
 
-  gl_Position = mvp_mat * vec4(vert_pos, 1.0);
+  gl_Position = proj_mat * view_pos;
 }
\ No newline at end of file
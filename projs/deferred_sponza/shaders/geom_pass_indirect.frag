@@ -0,0 +1,48 @@
+#version 430 core
+layout(location = 0) out vec3 out_pos;
+layout(location = 1) out vec3 out_normal;
+layout(location = 2) out vec3 out_ambient;
+
+in vec3 frag_pos;
+in vec3 frag_normal;
+in vec2 frag_texcoord;
+flat in uint frag_mtl_id;
+
+// Mirrors gfx_utils::MaterialBlock. For now, only the ambient component is
+// used
+struct Material {
+  vec4 ambient_color;
+  vec4 diffuse_color;
+  vec4 specular_color;
+  vec4 emission_color;
+  float shininess;
+
+  bool has_ambient_tex;
+  bool has_diffuse_tex;
+  bool has_specular_tex;
+};
+
+// Every mesh's materials, see GLResourceManager::BindAllMaterials()
+layout(std430) readonly buffer Materials {
+  Material materials[];
+};
+
+uniform sampler2D ambient_texture;
+
+void main() {
+  out_pos     = frag_pos;
+  out_normal  = normalize(frag_normal);
+  
+  vec3 mtl_ambient  = materials[frag_mtl_id].ambient_color.rgb;
+
+  // Specialized per mesh (see gfx_utils::MaterialFeature)
+#if defined(ALL_AMBIENT_TEX)
+  mtl_ambient *= texture(ambient_texture, frag_texcoord).rgb;
+#elif defined(ANY_AMBIENT_TEX)
+  if (materials[frag_mtl_id].has_ambient_tex) {
+    mtl_ambient *= texture(ambient_texture, frag_texcoord).rgb;
+  }
+#endif
+
+  out_ambient = mtl_ambient;
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+layout(location = 0) in vec3 vert_pos;
+layout(location = 1) in vec3 vert_normal;
+layout(location = 2) in vec2 vert_texcoord;
+layout(location = 3) in uint vert_mtl_id;
+
+out vec3 frag_pos;
+out vec3 frag_normal;
+out vec2 frag_texcoord;
+flat out uint frag_mtl_id;
+
+// Mirrors InstanceTransforms
+struct Instance {
+  mat4 model_mat;
+  mat4 normal_mat;
+};
+
+// Mirrors gfx_utils::DrawBlock
+struct Draw {
+  uint first_instance;
+  uint first_material;
+};
+
+// Every instance of the frame
+layout(std430) readonly buffer DrawTransforms {
+  Instance instances[];
+};
+
+// One element per command. Its base instance is its index
+layout(std430) readonly buffer Draws {
+  Draw draws[];
+};
+
+uniform mat4 view_mat;
+uniform mat4 proj_mat;
+
+void main() {
+  Draw draw = draws[gl_BaseInstanceARB];
+  uint instance = draw.first_instance + uint(gl_InstanceID);
+
+  mat4 model_mat = instances[instance].model_mat;
+  mat3 normal_mat = mat3(instances[instance].normal_mat);
+
+  vec4 view_pos = view_mat * (model_mat * vec4(vert_pos, 1.0));
+
+  frag_pos = view_pos.xyz;
+
+  // The view matrix is rigid, so its rotation moves world space normals into
+  // view space as is
+  frag_normal = mat3(view_mat) * (normal_mat * vert_normal);
+  frag_texcoord = vert_texcoord;
+
+  // Index into the whole material buffer
+  frag_mtl_id = draw.first_material + vert_mtl_id;
+
+  gl_Position = proj_mat * view_pos;
+}
\ No newline at end of file
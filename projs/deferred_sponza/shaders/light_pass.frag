@@ -8,36 +8,20 @@ uniform sampler2D normal_tex;
 uniform sampler2D ssao_tex;
 uniform sampler2D ambient_tex;
 
+// Mirrors gfx_utils::PointLightBlock
 struct PointLight {
-  bool is_active;
-
-  vec3 position; 
-  vec3 diffuse_intensity;
-  vec3 specular_intensity;
-
-  samplerCube shadow_tex;
-  float far_plane;
+  vec4 position; 
+  vec4 diffuse_intensity;
+  vec4 specular_intensity;
 };
 
-struct Material {
-  vec3 ambient_color;
-  vec3 diffuse_color;
-  vec3 specular_color;
-  vec3 emission_color;
-  float shininess;
-
-  bool has_ambient_tex;
-  bool has_diffuse_tex;
-  bool has_specular_tex;
-
-  sampler2D ambient_texture;
-  sampler2D diffuse_texture;
-  sampler2D specular_texture;
+// MAX_POINT_LIGHTS_PER_BLOCK is injected by the app, see
+// gfx_utils::GetShaderBlockDefines()
+layout(std140) uniform PointLights {
+  int num_point_lights;
+  PointLight point_lights[MAX_POINT_LIGHTS_PER_BLOCK];
 };
 
-uniform PointLight lights[5];
-uniform Material materials[5];
-
 uniform vec3 ambient_intensity;
 
 void main() {
@@ -3,6 +3,9 @@
 #include <iostream>
 #include <cstdlib>
 #include <random>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -23,6 +26,14 @@ static const int kWindowHeight = 1080;
 
 static const std::string kGeomPassVertShaderPath = "shaders/geom_pass.vert";
 static const std::string kGeomPassFragShaderPath = "shaders/geom_pass.frag";
+static const std::string kGeomPassIndirectVertShaderPath = 
+    "shaders/geom_pass_indirect.vert";
+static const std::string kGeomPassIndirectFragShaderPath = 
+    "shaders/geom_pass_indirect.frag";
+static const std::string kGeomPassCullShaderPath = 
+    "shaders/geom_pass_cull.comp";
+static const std::string kGeomPassCullCommandsShaderPath = 
+    "shaders/geom_pass_cull_commands.comp";
 
 static const std::string kSSAOPassVertShaderPath = "shaders/ssao_pass.vert";
 static const std::string kSSAOPassFragShaderPath = "shaders/ssao_pass.frag";
@@ -31,6 +42,63 @@ static const std::string kSSAOBlurFragShaderPath = "shaders/ssao_blur.frag";
 static const std::string kLightPassVertShaderPath = "shaders/light_pass.vert";
 static const std::string kLightPassFragShaderPath = "shaders/light_pass.frag";
 
+// How many frames the CPU timings are averaged over before being printed
+static const uint32_t kTimerReportFrames = 300;
+
+
+// Upper bound on the geometry pass instances of one frame
+static const size_t kMaxGeomPassInstances = 16384;
+
+// Size of the instances array in geom_pass.vert's DrawTransforms block,
+// injected as MAX_INSTANCES_PER_DRAW
+static const uint32_t kMaxGeomPassInstancesPerDraw = 
+    gfx_utils::kMinUniformBlockSize / sizeof(InstanceTransforms);
+
+// The whole DrawTransforms block, which every draw binds however few
+// instances it has
+static const size_t kGeomPassTransformsBlockSize = 
+    kMaxGeomPassInstancesPerDraw * sizeof(InstanceTransforms);
+
+static const gfx_utils::NameHash kViewMatName = 
+    gfx_utils::HashName("view_mat");
+static const gfx_utils::NameHash kProjMatName = 
+    gfx_utils::HashName("proj_mat");
+static const gfx_utils::NameHash kNumInstancesName = 
+    gfx_utils::HashName("num_instances");
+static const gfx_utils::NameHash kNumBatchesName = 
+    gfx_utils::HashName("num_batches");
+static const gfx_utils::NameHash kPhaseName = gfx_utils::HashName("phase");
+static const gfx_utils::NameHash kHasHiZName = 
+    gfx_utils::HashName("has_hiz");
+static const gfx_utils::NameHash kHiZViewProjMatName = 
+    gfx_utils::HashName("hiz_view_proj_mat");
+
+// Shader storage bindings of geom_pass_cull.comp's own blocks, after the
+// ones in gfx_utils::BlockBinding
+static const GLuint kCullBatchesBinding = 5;
+static const GLuint kInstanceBatchesBinding = 6;
+static const GLuint kCommandsBinding = 7;
+static const GLuint kDrawCountsBinding = 8;
+static const GLuint kInstanceFlagsBinding = 9;
+static const GLuint kCullStatsBinding = 10;
+static const GLuint kVisibleTransformsBinding = 11;
+static const GLuint kBatchCountsBinding = 12;
+
+// Texture unit of geom_pass_cull.comp's Hi-Z pyramid. The geometry pass
+// binds its ambient texture to unit 1
+static const GLuint kHiZTextureUnit = 2;
+
+// local_size_x of geom_pass_cull.comp and geom_pass_cull_commands.comp
+static const uint32_t kCullGroupSize = 64;
+
+// Occlusion culling depth buffer, a whole number of the culler's tiles. Far
+// smaller than the window, since only the occluders' coverage matters
+static const int kOcclusionBufferWidth = 320;
+static const int kOcclusionBufferHeight = 192;
+
+// Most triangles rasterized as occluders in a frame, of the largest meshes
+static const size_t kMaxOccluderTriangles = 50000;
+
 // Format of vertex - {pos_x, pos_y, pos_z, texcoord_u, texcoord_v}
 static const float kQuadVertices[] = {
   -1.f,  1.f, 0.f, 0.f, 1.f,
@@ -39,6 +107,41 @@ static const float kQuadVertices[] = {
    1.f, -1.f, 0.f, 1.f, 0.f
 };
 
+// Relative tolerance of --check-gpu-culling's plane distances.
+// geom_pass_cull.comp sums them in another order than FrustumCuller and may
+// fuse the multiply-adds, so boxes this close to a plane can go either way
+static const float kGpuCullingCheckEpsilon = 1e-5f;
+
+// True if the box moved by model_mat is within kGpuCullingCheckEpsilon of a
+// plane of the frustum, relative to the magnitude of the distance's terms
+static bool IsBoxNearFrustumPlane(const gfx_utils::Frustum& frustum,
+                                  const glm::vec3& bounds_min,
+                                  const glm::vec3& bounds_max,
+                                  const glm::mat4& model_mat) {
+  glm::vec3 local_center = (bounds_min + bounds_max) * 0.5f;
+  glm::vec3 local_extent = (bounds_max - bounds_min) * 0.5f;
+
+  glm::vec3 center = glm::vec3(model_mat * glm::vec4(local_center, 1.0f));
+  glm::vec3 extent = glm::mat3(glm::abs(glm::vec3(model_mat[0])), 
+                               glm::abs(glm::vec3(model_mat[1])),
+                               glm::abs(glm::vec3(model_mat[2]))) * 
+                     local_extent;
+
+  for (const glm::vec4& plane : frustum.planes) {
+    glm::vec3 normal = glm::vec3(plane);
+    float center_dist = glm::dot(normal, center);
+    float radius = glm::dot(glm::abs(normal), extent);
+
+    float dist = center_dist + plane.w + radius;
+    float scale = std::abs(center_dist) + std::abs(plane.w) + radius;
+    if (std::abs(dist) <= kGpuCullingCheckEpsilon * scale) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 void App::Run() {
   Startup();
 
@@ -51,13 +154,113 @@ void App::MainLoop() {
   bool should_quit = false;
 
   while (!should_quit) {
+    int num_pending_uploads = resource_manager_.GetNumPendingUploads();
+
+    // Meshes and textures become drawable as their uploads land. Evicting
+    // and reloading binds GL objects directly, so this goes before the state
+    // cache is reset
+    resource_manager_.BeginFrame();
+
+    if (num_pending_uploads > 0 && 
+        resource_manager_.GetNumPendingUploads() == 0) {
+      std::cout << "All asset uploads finished" << std::endl;
+    }
+
+    state_cache_.BeginFrame();
+
+    stream_buffer_.BeginFrame();
+    if (is_indirect_) {
+      indirect_stream_buffer_.BeginFrame();
+    }
+
+    // The counters are cumulative over the frame, so each pass's share is the
+    // difference to the snapshot taken before it
+    gfx_utils::GLStateCounters frame_start = state_cache_.GetCounters();
 
     GeometryPass();
 
+    gfx_utils::GLStateCounters geom_pass_end = state_cache_.GetCounters();
+
+    // Whatever copy of the culling stats the GPU finished last. Never waits
+    if (is_gpu_culling_) {
+      geom_pass_stats_readback_.Poll(&geom_pass_cull_stats_);
+    }
+
     SSAOPass();
 
+    gfx_utils::GLStateCounters ssao_pass_end = state_cache_.GetCounters();
+
     LightPass();
 
+    gfx_utils::GLStateCounters light_pass_end = state_cache_.GetCounters();
+
+    ++num_frames_;
+    if (num_frames_ % kTimerReportFrames == 0) {
+      ReportStateCounters("Geometry pass", geom_pass_end - frame_start);
+      ReportStateCounters("SSAO pass", ssao_pass_end - geom_pass_end);
+      ReportStateCounters("Light pass", light_pass_end - ssao_pass_end);
+
+      std::cout << "Geometry pass: " << geom_pass_instances_.size() 
+                << " mesh instances in " << geom_pass_num_commands_ 
+                << " draws, " << geom_pass_num_draw_calls_ 
+                << " draw calls, ";
+      if (is_gpu_culling_) {
+        std::cout << "culled on the GPU, " 
+                  << geom_pass_cull_stats_.num_first_phase << " drawn";
+        if (is_hiz_culling_) {
+          std::cout << " in the first phase and " 
+                    << geom_pass_cull_stats_.num_second_phase 
+                    << " in the second, " 
+                    << geom_pass_cull_stats_.num_occluded 
+                    << " occluded by the Hi-Z pyramid";
+        }
+        std::cout << " (" << geom_pass_stats_readback_.GetNumDropped() 
+                  << " stats readbacks dropped)" << std::endl;
+
+        if (is_gpu_culling_check_enabled_) {
+          std::cout << "GPU culling check: " << gpu_culling_check_compared_ 
+                    << " instances compared with the CPU culler, " 
+                    << gpu_culling_check_mismatches_ << " mismatches, " 
+                    << gpu_culling_check_near_plane_mismatches_ 
+                    << " more on a plane within rounding" << std::endl;
+          gpu_culling_check_compared_ = 0;
+          gpu_culling_check_mismatches_ = 0;
+          gpu_culling_check_near_plane_mismatches_ = 0;
+        }
+      }
+      else {
+        std::cout << geom_pass_num_culled_ << " culled (" 
+                  << static_cast<int>(
+                         geom_pass_culler_.GetCulledFraction() * 100.f + 0.5f) 
+                  << "%) after " << geom_pass_num_culled_entities_ 
+                  << " entities culled by the BVH" << std::endl;
+      }
+
+      if (is_occlusion_culling_) {
+        std::cout << "Occlusion culling: " << geom_pass_num_occluded_ 
+                  << " of " << occlusion_culler_.GetNumTested() 
+                  << " instances occluded (" 
+                  << static_cast<int>(
+                         occlusion_culler_.GetOccludedFraction() * 100.f + 
+                         0.5f)
+                  << "%), " << occlusion_culler_.GetNumOccluderTriangles() 
+                  << " occluder triangles rasterized in " 
+                  << occlusion_culler_.GetRasterizeMs() << " ms" 
+                  << std::endl;
+      }
+
+      ReportUniformCounters("SSAO pass", &ssao_pass_program_);
+      ReportUniformCounters("SSAO blur", &ssao_blur_program_);
+      ReportUniformCounters("Light pass", &light_pass_program_);
+
+      resource_manager_.GetMemoryTracker().Report();
+    }
+
+    stream_buffer_.EndFrame();
+    if (is_indirect_) {
+      indirect_stream_buffer_.EndFrame();
+    }
+
     window_.SwapBuffers();
     window_.TickMainLoop();
 
@@ -68,227 +271,817 @@ void App::MainLoop() {
 }
 
 void App::GeometryPass() {
-  glUseProgram(geom_pass_program_.GetProgramId());
-  glViewport(0, 0, kWindowWidth, kWindowHeight);
+  state_cache_.Viewport(0, 0, kWindowWidth, kWindowHeight);
   
-  glBindFramebuffer(GL_FRAMEBUFFER, gbuf_fbo_);
+  state_cache_.BindFramebuffer(GL_FRAMEBUFFER, gbuf_fbo_);
 
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glBindVertexArray(geom_pass_vao_);
+  // Every mesh lives in the geometry pool, so one cached VAO holds the vertex
+  // attribute setup for all the draws
+  state_cache_.BindVertexArray(
+      resource_manager_.GetVertexArrayId(gfx_utils::kVertexLayoutAll));
 
   glm::mat4 view_mat = camera_.CalcViewMatrix();
   glm::mat4 proj_mat = glm::perspective(glm::radians(30.f),
                                         window_.GetAspectRatio(),
                                         0.1f, 1000.f);    
 
-  const auto& entities = scene_.GetEntities();                                
+  geom_pass_timer_.Begin();
 
-  for (auto entity_ptr : entities) {
-    if (!entity_ptr->HasModel()) {
+  // Moved entities are refit before the BVH is queried
+  scene_.UpdateBvh();
+
+  // Without GPU culling, instances outside the frustum never get to the
+  // GPU
+  gfx_utils::Frustum frustum = gfx_utils::ExtractFrustum(proj_mat * view_mat);
+  CollectGeomPassInstances(view_mat, proj_mat, 
+                           is_gpu_culling_ ? nullptr : &frustum);
+
+  if (is_indirect_) {
+    SubmitGeomPassIndirect(view_mat, proj_mat);
+  }
+  else {
+    SubmitGeomPassInstanced(view_mat, proj_mat);
+  }
+
+  geom_pass_timer_.End();
+  geom_pass_timer_.ReportEvery(kTimerReportFrames, 
+                               "Geometry pass CPU submission");
+}
+
+void App::SubmitGeomPassInstanced(const glm::mat4& view_mat, 
+                                  const glm::mat4& proj_mat) {
+  // Instances of a mesh are drawn together, up to as many as one
+  // DrawTransforms block holds. Their transforms are written up front so
+  // they are uploaded in one go
+  geom_pass_draws_.clear();
+  geom_pass_queue_.Clear();
+
+  geom_pass_program_ids_.Clear();
+  geom_pass_material_ids_.Clear();
+  geom_pass_texture_ids_.Clear();
+
+  uint32_t max_instances_per_draw = 
+      is_instancing_enabled_ ? kMaxGeomPassInstancesPerDraw : 1;
+
+  for (const GeomPassBatch& batch : geom_pass_batches_) {
+    if (!batch.program) {
       continue;
     }
 
-    for (auto& mesh : entity_ptr->GetModel()->GetMeshes()) {
+    // Materials are bound per mesh, so the mesh is the material
+    uint64_t key = gfx_utils::RenderQueue::MakeKey(
+        0, 
+        geom_pass_program_ids_.GetId(batch.program->GetProgramId()),
+        geom_pass_material_ids_.GetId(reinterpret_cast<uintptr_t>(batch.mesh)),
+        geom_pass_texture_ids_.GetId(batch.ambient_tex_id),
+        batch.depth);
+
+    for (uint32_t first = 0; first < batch.num_instances; 
+         first += max_instances_per_draw) {
+      GeomPassDraw draw;
+      draw.batch = &batch;
+      draw.num_instances = 
+          std::min(batch.num_instances - first, max_instances_per_draw);
+
+      if (!stream_buffer_.Allocate(
+              draw.num_instances * sizeof(InstanceTransforms), 
+              &draw.transforms)) {
+        std::cerr << "Geometry pass ran out of stream buffer space" 
+                  << std::endl;
+        break;
+      }
+
+      auto* dst = static_cast<uint8_t*>(draw.transforms.data);
+      for (uint32_t i = 0; i < draw.num_instances; ++i) {
+        uint32_t transforms_index = 
+            geom_pass_instance_order_[batch.first_instance + first + i];
+        memcpy(dst + i * sizeof(InstanceTransforms), 
+               &geom_pass_transforms_[transforms_index], 
+               sizeof(InstanceTransforms));
+      }
+
+      geom_pass_queue_.Push(key, 
+                            static_cast<uint32_t>(geom_pass_draws_.size()));
+      geom_pass_draws_.push_back(draw);
+    }
+  }
+
+  stream_buffer_.Flush();
+
+  // Grouped by program, then materials, then texture, front to back within
+  // each group. Only the state that differs from the previous draw is set
+  geom_pass_queue_.Sort();
+
+  geom_pass_queue_.Submit([&](uint32_t payload, uint32_t changed_fields) {
+    const GeomPassDraw& draw = geom_pass_draws_[payload];
+    const GeomPassBatch& batch = *draw.batch;
+
+    if (changed_fields & gfx_utils::kRenderKeyProgram) {
+      state_cache_.UseProgram(batch.program->GetProgramId());
+
+      // Skipped by the program's uniform copy unless the camera moved
+      batch.program->GetUniform(kViewMatName).Set(view_mat);
+      batch.program->GetUniform(kProjMatName).Set(proj_mat);
+    }
+
+    // Colors and flags of all the mesh's materials in one bind
+    if (changed_fields & gfx_utils::kRenderKeyMaterial) {
+      resource_manager_.BindMaterials(*batch.mesh);
+    }
+
+    if ((changed_fields & gfx_utils::kRenderKeyTextureSet) && 
+        batch.ambient_tex_id != 0) {
+      state_cache_.BindTexture(1, GL_TEXTURE_2D, batch.ambient_tex_id);
+    }
+
+    stream_buffer_.BindRange(gfx_utils::kBlockBindingDrawTransforms, 
+                             draw.transforms, kGeomPassTransformsBlockSize);
+
+    gfx_utils::DrawGeometryRangeInstanced(*batch.range, draw.num_instances);
+  });
+
+  geom_pass_num_commands_ = static_cast<uint32_t>(geom_pass_draws_.size());
+  geom_pass_num_draw_calls_ = geom_pass_num_commands_;
+}
+
+void App::SubmitGeomPassIndirect(const glm::mat4& view_mat, 
+                                 const glm::mat4& proj_mat) {
+  geom_pass_queue_.Clear();
+  geom_pass_groups_.clear();
+
+  geom_pass_program_ids_.Clear();
+  geom_pass_texture_ids_.Clear();
+
+  geom_pass_num_commands_ = 0;
+  geom_pass_num_draw_calls_ = 0;
+
+  // Materials are read from the whole material buffer, so only the program
+  // and the texture split the commands into draw calls
+  for (size_t i = 0; i < geom_pass_batches_.size(); ++i) {
+    const GeomPassBatch& batch = geom_pass_batches_[i];
+    if (!batch.program || batch.num_instances == 0) {
+      continue;
+    }
+
+    uint64_t key = gfx_utils::RenderQueue::MakeKey(
+        0, 
+        geom_pass_program_ids_.GetId(batch.program->GetProgramId()),
+        0,
+        geom_pass_texture_ids_.GetId(batch.ambient_tex_id),
+        batch.depth);
+    geom_pass_queue_.Push(key, static_cast<uint32_t>(i));
+  }
+
+  if (geom_pass_queue_.GetSize() == 0) {
+    return;
+  }
+
+  geom_pass_queue_.Sort();
+
+  size_t num_instances = geom_pass_instance_order_.size();
+  size_t num_batches = geom_pass_queue_.GetSize();
+
+  // Each batch is at most one instanced command. On the GPU, batches with
+  // no visible instances get none
+  size_t num_commands = num_batches;
+
+  GeomPassCullInputs cull_inputs;
+  GeomPassCommands first_phase;
+  if (!indirect_stream_buffer_.Allocate(
+          num_instances * sizeof(InstanceTransforms), 
+          &cull_inputs.transforms) ||
+      !indirect_stream_buffer_.Allocate(
+          num_commands * sizeof(gfx_utils::DrawBlock), &first_phase.draws) ||
+      !indirect_stream_buffer_.Allocate(
+          num_commands * sizeof(gfx_utils::DrawElementsIndirectCommand), 
+          &first_phase.commands) ||
+      (is_gpu_culling_ && 
+       (!indirect_stream_buffer_.Allocate(
+            num_batches * sizeof(GeomPassCullBatch), 
+            &cull_inputs.cull_batches) ||
+        !indirect_stream_buffer_.Allocate(
+            num_instances * sizeof(uint32_t), 
+            &cull_inputs.instance_batches) ||
+        !indirect_stream_buffer_.Allocate(
+            num_instances * sizeof(uint32_t), 
+            &cull_inputs.instance_flags) ||
+        !indirect_stream_buffer_.Allocate(
+            num_instances * sizeof(InstanceTransforms), 
+            &first_phase.transforms)))) {
+    std::cerr << "Geometry pass ran out of stream buffer space" << std::endl;
+    return;
+  }
+
+  // Without GPU culling the draws read the instances as they are
+  if (!is_gpu_culling_) {
+    first_phase.transforms = cull_inputs.transforms;
+  }
+
+  // Each batch's transforms are already contiguous, so they go in as laid
+  // out and a batch's first instance is its offset in the array
+  auto* dst_transforms = 
+      static_cast<InstanceTransforms*>(cull_inputs.transforms.data);
+  for (size_t i = 0; i < num_instances; ++i) {
+    dst_transforms[i] = geom_pass_transforms_[geom_pass_instance_order_[i]];
+  }
+
+  auto* dst_draws = 
+      static_cast<gfx_utils::DrawBlock*>(first_phase.draws.data);
+  auto* dst_commands = static_cast<gfx_utils::DrawElementsIndirectCommand*>(
+      first_phase.commands.data);
+  auto* dst_cull_batches = 
+      static_cast<GeomPassCullBatch*>(cull_inputs.cull_batches.data);
+  auto* dst_instance_batches = 
+      static_cast<uint32_t*>(cull_inputs.instance_batches.data);
+
+  // Batches in queue order. A new group starts wherever the program or
+  // texture changes. Each batch reserves one command, which with GPU
+  // culling the GPU fills in if any of its instances are visible
+  uint32_t command_index = 0;
+  uint32_t batch_index = 0;
+
+  geom_pass_queue_.Submit([&](uint32_t payload, uint32_t changed_fields) {
+    const GeomPassBatch& batch = geom_pass_batches_[payload];
+
+    if (changed_fields & 
+        (gfx_utils::kRenderKeyProgram | gfx_utils::kRenderKeyTextureSet)) {
+      GeomPassGroup group;
+      group.batch = &batch;
+      group.changed_fields = changed_fields;
+      group.first_command = command_index;
+      geom_pass_groups_.push_back(group);
+    }
+
+    GeomPassGroup& group = geom_pass_groups_.back();
+
+    uint32_t first_material = 0;
+    resource_manager_.GetFirstMaterialIndex(*batch.mesh, &first_material);
+
+    if (is_gpu_culling_) {
+      GeomPassCullBatch cull_batch;
+      cull_batch.bounds_min = glm::vec4(batch.mesh->bounds_min, 0.f);
+      cull_batch.bounds_max = glm::vec4(batch.mesh->bounds_max, 0.f);
+      cull_batch.index_count = batch.range->index_count;
+      cull_batch.first_index = batch.range->first_index;
+      cull_batch.base_vertex = batch.range->base_vertex;
+      cull_batch.first_material = first_material;
+      cull_batch.group = static_cast<uint32_t>(geom_pass_groups_.size() - 1);
+      cull_batch.first_command = group.first_command;
+      cull_batch.first_instance = batch.first_instance;
+      dst_cull_batches[batch_index] = cull_batch;
+
+      for (uint32_t i = 0; i < batch.num_instances; ++i) {
+        dst_instance_batches[batch.first_instance + i] = batch_index;
+      }
+    }
+    else {
+      gfx_utils::DrawBlock draw;
+      draw.first_instance = batch.first_instance;
+      draw.first_material = first_material;
+      dst_draws[command_index] = draw;
+
+      // The base instance doubles as the index of the command's DrawBlock
+      dst_commands[command_index] = gfx_utils::MakeDrawCommand(
+          *batch.range, batch.num_instances, command_index);
+    }
+
+    ++group.num_commands;
+    ++command_index;
+    ++batch_index;
+  });
+
+  // One count per group and per batch, which the culling shaders increment
+  // from zero. The second phase appends to its own commands and compacted
+  // transforms, laid out like the first's
+  GeomPassCommands second_phase;
+  if (is_gpu_culling_) {
+    size_t counts_size = geom_pass_groups_.size() * sizeof(uint32_t);
+    size_t batch_counts_size = num_batches * sizeof(uint32_t);
+
+    if (!indirect_stream_buffer_.Allocate(counts_size, 
+                                          &first_phase.draw_counts) ||
+        !indirect_stream_buffer_.Allocate(batch_counts_size, 
+                                          &first_phase.batch_counts) ||
+        !indirect_stream_buffer_.Allocate(sizeof(GeomPassCullStats), 
+                                          &cull_inputs.stats) ||
+        (is_hiz_culling_ && 
+         (!indirect_stream_buffer_.Allocate(
+              num_instances * sizeof(InstanceTransforms), 
+              &second_phase.transforms) ||
+          !indirect_stream_buffer_.Allocate(
+              num_commands * sizeof(gfx_utils::DrawBlock), 
+              &second_phase.draws) ||
+          !indirect_stream_buffer_.Allocate(
+              num_commands * sizeof(gfx_utils::DrawElementsIndirectCommand), 
+              &second_phase.commands) ||
+          !indirect_stream_buffer_.Allocate(batch_counts_size, 
+                                            &second_phase.batch_counts) ||
+          !indirect_stream_buffer_.Allocate(counts_size, 
+                                            &second_phase.draw_counts)))) {
+      std::cerr << "Geometry pass ran out of stream buffer space" 
+                << std::endl;
+      return;
+    }
+
+    memset(first_phase.draw_counts.data, 0, counts_size);
+    memset(first_phase.batch_counts.data, 0, batch_counts_size);
+    memset(cull_inputs.stats.data, 0, sizeof(GeomPassCullStats));
+    if (is_hiz_culling_) {
+      memset(second_phase.draw_counts.data, 0, counts_size);
+      memset(second_phase.batch_counts.data, 0, batch_counts_size);
+    }
+  }
+
+  indirect_stream_buffer_.Flush();
+
+  glm::mat4 view_proj_mat = proj_mat * view_mat;
+  gfx_utils::Frustum frustum = gfx_utils::ExtractFrustum(view_proj_mat);
+
+  if (is_gpu_culling_) {
+    DispatchGeomPassCulling(1, frustum, hiz_view_proj_mat_, 
+                            static_cast<uint32_t>(num_instances), 
+                            static_cast<uint32_t>(num_batches),
+                            cull_inputs, first_phase);
+
+    if (is_gpu_culling_check_enabled_) {
+      CheckGpuCulling(frustum, cull_inputs);
+    }
+  }
+
+  DrawGeomPassGroups(first_phase, view_mat, proj_mat);
+
+  if (is_hiz_culling_) {
+    // The first phase drew what was visible last frame and still is, which
+    // decides what else the second phase draws. The next frame's first
+    // phase tests against the same pyramid: lacking the second phase's
+    // draws, it only hides less than it could
+    hiz_pyramid_.Build(gbuf_depth_tex_);
+    state_cache_.Invalidate();
+
+    hiz_view_proj_mat_ = view_proj_mat;
+    has_hiz_ = true;
+
+    DispatchGeomPassCulling(2, frustum, view_proj_mat, 
+                            static_cast<uint32_t>(num_instances), 
+                            static_cast<uint32_t>(num_batches),
+                            cull_inputs, second_phase);
+
+    DrawGeomPassGroups(second_phase, view_mat, proj_mat);
+  }
+
+  // Polled in MainLoop(), once the GPU is done with it
+  if (is_gpu_culling_) {
+    geom_pass_stats_readback_.Copy(indirect_stream_buffer_.GetBufferId(), 
+                                   cull_inputs.stats.offset);
+  }
+
+  geom_pass_num_commands_ = static_cast<uint32_t>(num_commands);
+  geom_pass_num_draw_calls_ = static_cast<uint32_t>(
+      geom_pass_groups_.size() * (is_hiz_culling_ ? 2 : 1));
+}
+
+void App::DrawGeomPassGroups(const GeomPassCommands& commands,
+                             const glm::mat4& view_mat, 
+                             const glm::mat4& proj_mat) {
+  if (is_gpu_culling_) {
+    state_cache_.BindBuffer(GL_PARAMETER_BUFFER, 
+                            indirect_stream_buffer_.GetBufferId());
+  }
+
+  indirect_stream_buffer_.BindRange(gfx_utils::kBlockBindingDrawTransforms, 
+                                    commands.transforms);
+  indirect_stream_buffer_.BindRange(gfx_utils::kBlockBindingDraws, 
+                                    commands.draws);
+  resource_manager_.BindAllMaterials(GL_SHADER_STORAGE_BUFFER, 
+                                     gfx_utils::kBlockBindingMaterials);
+
+  state_cache_.BindBuffer(GL_DRAW_INDIRECT_BUFFER, 
+                          indirect_stream_buffer_.GetBufferId());
+
+  for (size_t i = 0; i < geom_pass_groups_.size(); ++i) {
+    const GeomPassGroup& group = geom_pass_groups_[i];
+    const GeomPassBatch& batch = *group.batch;
+
+    if (group.changed_fields & gfx_utils::kRenderKeyProgram) {
+      state_cache_.UseProgram(batch.program->GetProgramId());
+
+      batch.program->GetUniform(kViewMatName).Set(view_mat);
+      batch.program->GetUniform(kProjMatName).Set(proj_mat);
+    }
+
+    if ((group.changed_fields & gfx_utils::kRenderKeyTextureSet) && 
+        batch.ambient_tex_id != 0) {
+      state_cache_.BindTexture(1, GL_TEXTURE_2D, batch.ambient_tex_id);
+    }
+
+    GLintptr offset = commands.commands.offset + group.first_command * 
+        sizeof(gfx_utils::DrawElementsIndirectCommand);
+
+    if (is_gpu_culling_) {
+      gfx_utils::MultiDrawGeometryIndirectCount(
+          offset, commands.draw_counts.offset + i * sizeof(uint32_t), 
+          group.num_commands);
+    }
+    else {
+      gfx_utils::MultiDrawGeometryIndirect(offset, group.num_commands);
+    }
+  }
+}
 
-      const auto& mtl_list = mesh.material_list;
+void App::DispatchGeomPassCulling(int phase, 
+                                  const gfx_utils::Frustum& frustum,
+                                  const glm::mat4& hiz_view_proj_mat,
+                                  uint32_t num_instances, 
+                                  uint32_t num_batches,
+                                  const GeomPassCullInputs& inputs,
+                                  const GeomPassCommands& out) {
+  state_cache_.UseProgram(geom_pass_cull_program_.GetProgramId());
+
+  for (int i = 0; i < gfx_utils::kNumFrustumPlanes; ++i) {
+    geom_pass_cull_program_.GetUniform("frustum_planes", i)
+                           .Set(frustum.planes[i]);
+  }
+  geom_pass_cull_program_.GetUniform(kNumInstancesName)
+                         .Set(static_cast<int>(num_instances));
+
+  geom_pass_cull_program_.GetUniform(kPhaseName).Set(phase);
+  geom_pass_cull_program_.GetUniform(kHasHiZName).Set(has_hiz_);
+
+  if (has_hiz_) {
+    geom_pass_cull_program_.GetUniform(kHiZViewProjMatName)
+                           .Set(hiz_view_proj_mat);
+    state_cache_.BindTexture(kHiZTextureUnit, GL_TEXTURE_2D, 
+                             hiz_pyramid_.GetTextureId());
+  }
+
+  indirect_stream_buffer_.BindRange(gfx_utils::kBlockBindingDrawTransforms, 
+                                    inputs.transforms);
+  indirect_stream_buffer_.BindRange(kCullBatchesBinding, 
+                                    inputs.cull_batches);
+  indirect_stream_buffer_.BindRange(kInstanceBatchesBinding, 
+                                    inputs.instance_batches);
+  indirect_stream_buffer_.BindRange(kInstanceFlagsBinding, 
+                                    inputs.instance_flags);
+  indirect_stream_buffer_.BindRange(kCullStatsBinding, inputs.stats);
+  indirect_stream_buffer_.BindRange(kVisibleTransformsBinding, 
+                                    out.transforms);
+  indirect_stream_buffer_.BindRange(kBatchCountsBinding, out.batch_counts);
+  indirect_stream_buffer_.BindRange(kCommandsBinding, out.commands);
+  indirect_stream_buffer_.BindRange(gfx_utils::kBlockBindingDraws, 
+                                    out.draws);
+  indirect_stream_buffer_.BindRange(kDrawCountsBinding, out.draw_counts);
+
+  glDispatchCompute((num_instances + kCullGroupSize - 1) / kCullGroupSize, 
+                    1, 1);
+
+  // The batch counts are final once every instance is tested
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  state_cache_.UseProgram(geom_pass_cull_commands_program_.GetProgramId());
+
+  geom_pass_cull_commands_program_.GetUniform(kNumBatchesName)
+                                  .Set(static_cast<int>(num_batches));
+
+  glDispatchCompute((num_batches + kCullGroupSize - 1) / kCullGroupSize, 
+                    1, 1);
+
+  // The draws read the commands and counts as indirect arguments and the
+  // draw blocks and transforms from shader storage, the second phase reads
+  // the instance flags, and the stats and flags are copied for readback
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | 
+                  GL_BUFFER_UPDATE_BARRIER_BIT);
+}
 
-      for (int i = 0; i < mtl_list.size(); ++i) {
-        const auto& mtl = mtl_list[i];
+void App::CheckGpuCulling(const gfx_utils::Frustum& frustum,
+                          const GeomPassCullInputs& inputs) {
+  size_t num_instances = geom_pass_instance_order_.size();
+  if (num_instances == 0) {
+    return;
+  }
 
-        geom_pass_program_.GetUniform("materials", i, "ambient_color")
-                          .Set(mtl.ambient_color);
+  // The same boxes as the GPU tested, each batch's instances together.
+  // Batches without a program were never submitted
+  gpu_culling_check_culler_.Clear();
+  for (const GeomPassBatch& batch : geom_pass_batches_) {
+    if (!batch.program) {
+      continue;
+    }
 
-        if (!mtl.ambient_texname.empty()) {
-          geom_pass_program_.GetUniform("materials", i, "has_ambient_tex")
-                            .Set(true);
+    for (uint32_t i = 0; i < batch.num_instances; ++i) {
+      uint32_t transforms_index = 
+          geom_pass_instance_order_[batch.first_instance + i];
+      gpu_culling_check_culler_.Add(
+          batch.mesh->bounds_min, batch.mesh->bounds_max,
+          geom_pass_transforms_[transforms_index].model_mat);
+    }
+  }
+  gpu_culling_check_culler_.Cull(frustum);
+
+  // Waits for the culling to finish
+  size_t flags_size = num_instances * sizeof(uint32_t);
+  gpu_culling_check_flags_.resize(num_instances);
+
+  glBindBuffer(GL_COPY_READ_BUFFER, indirect_stream_buffer_.GetBufferId());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, gpu_culling_check_buffer_);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+                      inputs.instance_flags.offset, 0, flags_size);
+  glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, flags_size, 
+                     &gpu_culling_check_flags_[0]);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+  uint32_t box_index = 0;
+  for (const GeomPassBatch& batch : geom_pass_batches_) {
+    if (!batch.program) {
+      continue;
+    }
 
-          glActiveTexture(GL_TEXTURE1);
-          GLuint tex_gl_id = 
-              resource_manager_.GetTextureId(mtl.ambient_texname);
-          glBindTexture(GL_TEXTURE_2D, tex_gl_id);
-          geom_pass_program_.GetUniform("materials", i, "ambient_texture")
-                            .Set(1);
+    for (uint32_t i = 0; i < batch.num_instances; ++i) {
+      uint32_t flags = gpu_culling_check_flags_[batch.first_instance + i];
+      bool is_gpu_visible = (flags & 1) != 0;
+      if (is_gpu_visible != gpu_culling_check_culler_.IsVisible(box_index)) {
+        uint32_t transforms_index = 
+            geom_pass_instance_order_[batch.first_instance + i];
+        if (IsBoxNearFrustumPlane(
+                frustum, batch.mesh->bounds_min, batch.mesh->bounds_max,
+                geom_pass_transforms_[transforms_index].model_mat)) {
+          ++gpu_culling_check_near_plane_mismatches_;
         }
         else {
-          geom_pass_program_.GetUniform("materials", i, "has_ambient_tex")
-                            .Set(false);
-        }           
-      }       
-
-      glm::mat4 model_mat = entity_ptr->ComputeTransform();
-      glm::mat4 mv_mat = view_mat * model_mat;
-      glm::mat4 mvp_mat = proj_mat * view_mat * model_mat;
-      glm::mat3 normal_mat = glm::transpose(glm::inverse(glm::mat3(mv_mat)));
-      
-      geom_pass_program_.GetUniform("mv_mat").Set(mv_mat);
-      geom_pass_program_.GetUniform("mvp_mat").Set(mvp_mat);
-      geom_pass_program_.GetUniform("normal_mat").Set(normal_mat);
-
-      // Set vertex attributes
-
-      GLuint pos_vbo_id = 
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypePosition);
-      glBindBuffer(GL_ARRAY_BUFFER, pos_vbo_id);
-      glEnableVertexAttribArray(0);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-      GLuint normal_vbo_id =
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypeNormal);
-      glBindBuffer(GL_ARRAY_BUFFER, normal_vbo_id);
-      glEnableVertexAttribArray(1);
-      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-      GLuint texcoord_vbo_id =
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypeTexcoord);
-      glBindBuffer(GL_ARRAY_BUFFER, texcoord_vbo_id);
-      glEnableVertexAttribArray(2);
-      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-      GLuint mtl_vbo_id =
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypeMtlId);
-      glBindBuffer(GL_ARRAY_BUFFER, mtl_vbo_id);
-      glEnableVertexAttribArray(3);
-      glVertexAttribPointer(3, 1, GL_UNSIGNED_INT, GL_FALSE, 0, (GLvoid*)0);
-
-      glDrawArrays(GL_TRIANGLES, 0, mesh.num_verts);
+          ++gpu_culling_check_mismatches_;
+        }
+      }
+      ++box_index;
     }
   }
+  gpu_culling_check_compared_ += box_index;
+}
 
-  glBindVertexArray(0);
+void App::CollectGeomPassInstances(const glm::mat4& view_mat, 
+                                   const glm::mat4& proj_mat,
+                                   const gfx_utils::Frustum* frustum) {
+  geom_pass_num_culled_ = 0;
+  geom_pass_num_culled_entities_ = 0;
+  geom_pass_num_occluded_ = 0;
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  geom_pass_entities_.clear();
+  geom_pass_transforms_.clear();
+  geom_pass_instances_.clear();
+  geom_pass_batches_.clear();
+  geom_pass_batch_ids_.clear();
+  geom_pass_culler_.Clear();
 
-  glUseProgram(0);
-}
+  gfx_utils::ProgramVariants* variants = 
+      is_indirect_ ? &geom_pass_indirect_variants_ : &geom_pass_variants_;
 
-void App::SSAOPass() {
-  glUseProgram(ssao_pass_program_.GetProgramId());
-  glViewport(0, 0, kWindowWidth, kWindowHeight);
+  const gfx_utils::EntityList& entities = scene_.GetEntities();
 
-  glBindFramebuffer(GL_FRAMEBUFFER, ssao_fbo_);
+  if (frustum) {
+    scene_.GetBvh().QueryFrustum(*frustum, [this](uint32_t prim) {
+      geom_pass_entities_.push_back(scene_.GetBvhEntity(prim));
+    });
 
-  glClear(GL_COLOR_BUFFER_BIT);
+    geom_pass_num_culled_entities_ = static_cast<uint32_t>(
+        entities.size() - geom_pass_entities_.size());
+  }
+  else {
+    for (const auto& entity_ptr : entities) {
+      geom_pass_entities_.push_back(entity_ptr.get());
+    }
+  }
 
-  for (int i = 0; i < 64; ++i) {
-    ssao_pass_program_.GetUniform("samples", i).Set(ssao_kernel_[i]);
+  for (gfx_utils::Entity* entity_ptr : geom_pass_entities_) {
+    if (!entity_ptr->HasModel()) {
+      continue;
+    }
+
+    // Once per entity, however many meshes its model has
+    glm::mat4 model_mat = entity_ptr->ComputeTransform();
+
+    InstanceTransforms transforms;
+    transforms.model_mat = model_mat;
+    transforms.normal_mat = 
+        glm::mat4(glm::transpose(glm::inverse(glm::mat3(model_mat))));
+
+    uint32_t transforms_index = 
+        static_cast<uint32_t>(geom_pass_transforms_.size());
+    geom_pass_transforms_.push_back(transforms);
+
+    // The entity's origin stands in for its meshes' depth
+    float view_depth = -(view_mat * model_mat)[3].z;
+    uint32_t depth = 
+        gfx_utils::RenderQueue::QuantizeDepth(view_depth, 0.1f, 1000.f);
+
+    for (auto& mesh : entity_ptr->GetModel()->GetMeshes()) {
+      const gfx_utils::GeometryRange* range = 
+          resource_manager_.GetMeshRange(mesh);
+      if (!range) {
+        continue;
+      }
+
+      auto inserted = geom_pass_batch_ids_.emplace(
+          &mesh, static_cast<uint32_t>(geom_pass_batches_.size()));
+      if (inserted.second) {
+        GeomPassBatch batch;
+        batch.mesh = &mesh;
+        batch.range = range;
+        batch.program = variants->GetVariant(
+            gfx_utils::CalcMaterialFeatures(mesh.material_list));
+
+        // The shader has one ambient sampler, so the last textured
+        // material decides what is bound
+        for (const auto& mtl : mesh.material_list) {
+          if (mtl.ambient_texture) {
+            batch.ambient_tex_id = 
+                resource_manager_.GetTextureId(*mtl.ambient_texture);
+          }
+        }
+
+        geom_pass_batches_.push_back(batch);
+      }
+
+      if (!geom_pass_batches_[inserted.first->second].program) {
+        continue;
+      }
+
+      // Instance i's box is box i of the culler. GPU culling tests the
+      // boxes itself
+      if (frustum) {
+        geom_pass_culler_.Add(mesh.bounds_min, mesh.bounds_max, model_mat);
+      }
+
+      GeomPassInstance instance;
+      instance.batch = inserted.first->second;
+      instance.transforms = transforms_index;
+      instance.depth = depth;
+      geom_pass_instances_.push_back(instance);
+    }
   }
 
-  glm::mat4 proj_mat = glm::perspective(glm::radians(30.f),
-                                        window_.GetAspectRatio(),
-                                        0.1f, 1000.f);   
+  // All the boxes at once, so they go through SIMD groups
+  if (frustum) {
+    geom_pass_culler_.Cull(*frustum);
 
-  ssao_pass_program_.GetUniform("proj_mat").Set(proj_mat);
+    geom_pass_num_culled_ = static_cast<uint32_t>(
+        geom_pass_culler_.GetNumBoxes() - geom_pass_culler_.GetNumVisible());
+  }
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, gbuf_pos_tex_);
-  ssao_pass_program_.GetUniform("pos_tex").Set(0);
+  if (is_occlusion_culling_) {
+    occlusion_timer_.Begin();
+    RasterizeOccluders(proj_mat * view_mat, frustum != nullptr);
+  }
 
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, gbuf_normal_tex_);         
-  ssao_pass_program_.GetUniform("normal_tex").Set(1);
+  size_t num_visible = 0;
+  for (size_t i = 0; i < geom_pass_instances_.size(); ++i) {
+    if (frustum && !geom_pass_culler_.IsVisible(static_cast<uint32_t>(i))) {
+      continue;
+    }
 
-  glActiveTexture(GL_TEXTURE2);
-  glBindTexture(GL_TEXTURE_2D, ssao_noise_tex_);      
-  ssao_pass_program_.GetUniform("noise_tex").Set(2);
+    const GeomPassInstance& instance = geom_pass_instances_[i];
+    GeomPassBatch& batch = geom_pass_batches_[instance.batch];
 
-  glBindVertexArray(ssao_pass_vao_);
+    if (is_occlusion_culling_ && 
+        !occlusion_culler_.TestBox(
+            batch.mesh->bounds_min, batch.mesh->bounds_max, 
+            geom_pass_transforms_[instance.transforms].model_mat)) {
+      continue;
+    }
 
-  glBindBuffer(GL_ARRAY_BUFFER, ssao_pass_quad_vbo_);
+    // Batches are drawn in the order of their nearest instance
+    batch.depth = std::min(batch.depth, instance.depth);
+    ++batch.num_instances;
 
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
-                        (void*)0);
+    geom_pass_instances_[num_visible++] = instance;
+  }
+  geom_pass_instances_.resize(num_visible);
 
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
-                        (void*)(3 * sizeof(float)));
+  if (is_occlusion_culling_) {
+    geom_pass_num_occluded_ = occlusion_culler_.GetNumOccluded();
 
-  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    occlusion_timer_.End();
+    occlusion_timer_.ReportEvery(kTimerReportFrames, 
+                                 "Occlusion culling CPU");
+  }
 
-  glBindVertexArray(0);
+  // Counting sort of the instances by batch, so each batch's transforms are
+  // contiguous in geom_pass_instance_order_
+  uint32_t first_instance = 0;
+  for (GeomPassBatch& batch : geom_pass_batches_) {
+    batch.first_instance = first_instance;
+    first_instance += batch.num_instances;
+  }
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  geom_pass_instance_order_.resize(geom_pass_instances_.size());
+  geom_pass_batch_fill_.assign(geom_pass_batches_.size(), 0);
 
-  // Apply blur to SSAO
+  for (const GeomPassInstance& instance : geom_pass_instances_) {
+    uint32_t& fill = geom_pass_batch_fill_[instance.batch];
+    geom_pass_instance_order_[
+        geom_pass_batches_[instance.batch].first_instance + fill++] = 
+        instance.transforms;
+  }
+}
 
-  glUseProgram(ssao_blur_program_.GetProgramId());
+void App::RasterizeOccluders(const glm::mat4& view_proj_mat, 
+                             bool is_culled) {
+  occlusion_culler_.BeginFrame(view_proj_mat);
 
-  glBindFramebuffer(GL_FRAMEBUFFER, ssao_blur_fbo_);
+  for (size_t i = 0; i < geom_pass_instances_.size(); ++i) {
+    if (is_culled && !geom_pass_culler_.IsVisible(static_cast<uint32_t>(i))) {
+      continue;
+    }
+
+    const GeomPassInstance& instance = geom_pass_instances_[i];
+    const gfx_utils::Mesh* mesh = geom_pass_batches_[instance.batch].mesh;
+    if (occluder_meshes_.count(mesh) == 0) {
+      continue;
+    }
+
+    occlusion_culler_.AddOccluder(
+        mesh->pos_data, mesh->index_data, 
+        geom_pass_transforms_[instance.transforms].model_mat);
+  }
+
+  occlusion_culler_.RasterizeOccluders();
+}
+
+void App::SSAOPass() {
+  state_cache_.UseProgram(ssao_pass_program_.GetProgramId());
+  state_cache_.Viewport(0, 0, kWindowWidth, kWindowHeight);
+
+  state_cache_.BindFramebuffer(GL_FRAMEBUFFER, ssao_fbo_);
 
   glClear(GL_COLOR_BUFFER_BIT);
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, ssao_color_tex_);
-  ssao_pass_program_.GetUniform("ssao_tex").Set(0);
+  // The kernel and sampler units are set once in SetupSSAOPass()
 
-  glBindVertexArray(ssao_pass_vao_);
+  glm::mat4 proj_mat = glm::perspective(glm::radians(30.f),
+                                        window_.GetAspectRatio(),
+                                        0.1f, 1000.f);   
 
-  glBindBuffer(GL_ARRAY_BUFFER, ssao_pass_quad_vbo_);
+  ssao_proj_mat_uniform_.Set(proj_mat);
 
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
-                        (void*)0);
+  state_cache_.BindTexture(0, GL_TEXTURE_2D, gbuf_pos_tex_);
+  state_cache_.BindTexture(1, GL_TEXTURE_2D, gbuf_normal_tex_);
+  state_cache_.BindTexture(2, GL_TEXTURE_2D, ssao_noise_tex_);
 
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
-                        (void*)(3 * sizeof(float)));
+  state_cache_.BindVertexArray(ssao_pass_vao_);
 
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-  glBindVertexArray(0);
+  // Apply blur to SSAO
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  state_cache_.UseProgram(ssao_blur_program_.GetProgramId());
 
-  glUseProgram(0);
-}
-
-void App::LightPass() {
-  glUseProgram(light_pass_program_.GetProgramId());
-  glViewport(0, 0, kWindowWidth, kWindowHeight);
+  state_cache_.BindFramebuffer(GL_FRAMEBUFFER, ssao_blur_fbo_);
 
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glClear(GL_COLOR_BUFFER_BIT);
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, gbuf_pos_tex_);
-  light_pass_program_.GetUniform("pos_tex").Set(0);
+  state_cache_.BindTexture(0, GL_TEXTURE_2D, ssao_color_tex_);
 
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, gbuf_normal_tex_);         
-  light_pass_program_.GetUniform("normal_tex").Set(1);
+  // Same quad as the SSAO pass, so the VAO is still bound
+  state_cache_.BindVertexArray(ssao_pass_vao_);
 
-  glActiveTexture(GL_TEXTURE2);
-  glBindTexture(GL_TEXTURE_2D, gbuf_ambient_tex_);         
-  light_pass_program_.GetUniform("ambient_tex").Set(2);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
-  glActiveTexture(GL_TEXTURE3);
-  glBindTexture(GL_TEXTURE_2D, ssao_blur_tex_);         
-  light_pass_program_.GetUniform("ssao_tex").Set(3);
+void App::LightPass() {
+  state_cache_.UseProgram(light_pass_program_.GetProgramId());
+  state_cache_.Viewport(0, 0, kWindowWidth, kWindowHeight);
 
-  light_pass_program_.GetUniform("ambient_intensity")
-                     .Set(glm::vec3(0.5f, 0.5f, 0.5f));
+  state_cache_.BindFramebuffer(GL_FRAMEBUFFER, 0);
 
-  glBindVertexArray(light_pass_vao_);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glBindBuffer(GL_ARRAY_BUFFER, light_pass_quad_vbo_);
+  // Sampler units and the ambient intensity are set once in 
+  // SetupLightPass()
+  state_cache_.BindTexture(0, GL_TEXTURE_2D, gbuf_pos_tex_);
+  state_cache_.BindTexture(1, GL_TEXTURE_2D, gbuf_normal_tex_);
+  state_cache_.BindTexture(2, GL_TEXTURE_2D, gbuf_ambient_tex_);
+  state_cache_.BindTexture(3, GL_TEXTURE_2D, ssao_blur_tex_);
 
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
-                        (void*)0);
+  point_lights_buffer_.BindBase(gfx_utils::kBlockBindingPointLights);
 
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
-                        (void*)(3 * sizeof(float)));
+  state_cache_.BindVertexArray(light_pass_vao_);
 
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
-  glBindVertexArray(0);
+void App::ReportStateCounters(const std::string& label,
+                              const gfx_utils::GLStateCounters& counters) {
+  std::cout << label << " GL state: " << counters.issued << " issued, "
+            << counters.skipped << " skipped" << std::endl;
+}
 
-  glUseProgram(0);
+void App::ReportUniformCounters(const std::string& label,
+                                gfx_utils::Program* program) {
+  const gfx_utils::UniformCounters& counters = program->GetUniformCounters();
+  std::cout << label << " uniforms: " << counters.issued << " issued, "
+            << counters.skipped << " skipped" << std::endl;
+
+  program->ResetUniformCounters();
 }
 
 void App::Startup() {
@@ -302,9 +1095,23 @@ void App::Startup() {
     exit(1);
   }
 
-  scene_.LoadSceneFromJson("scene/scene.json");
+  scene_.LoadSceneFromJson(scene_path_);
 
   resource_manager_.SetScene(&scene_);
+  resource_manager_.SetStateCache(&state_cache_);
+
+  // Upload on a second context so the window isn't frozen while a big scene
+  // goes to the GPU. Falls back to uploading synchronously
+  if (uploader_.Initialize(&window_)) {
+    resource_manager_.SetUploader(&uploader_);
+  }
+
+  // Leaves a quarter of the card to the driver and other applications. Not
+  // every driver reports its memory size, in which case nothing is evicted
+  size_t video_memory = gfx_utils::QueryDedicatedVideoMemory();
+  if (video_memory > 0) {
+    resource_manager_.SetMemoryBudget(video_memory / 4 * 3);
+  }
 
   resource_manager_.CreateGLResources();
 
@@ -315,22 +1122,318 @@ void App::Startup() {
   glDepthFunc(GL_LESS);
   glEnable(GL_CULL_FACE);
 
+  // Each draw's block starts on the buffer offset alignment, so size the
+  // region for every instance being drawn on its own. Draws bind a whole
+  // DrawTransforms block past their start
+  if (!stream_buffer_.Initialize(
+          GL_UNIFORM_BUFFER, 
+          gfx_utils::StreamBuffer::CalcRegionSize(
+              GL_UNIFORM_BUFFER, sizeof(InstanceTransforms), 
+              kMaxGeomPassInstances),
+          kGeomPassTransformsBlockSize)) {
+    std::cerr << "Could not create stream buffer." << std::endl;
+    exit(1);
+  }
+
+  // Drawing every mesh instance on its own is only for comparison, so it
+  // stays on the instanced path
+  is_indirect_ = is_indirect_enabled_ && is_instancing_enabled_ && 
+                 gfx_utils::IsMultiDrawIndirectSupported();
+
+  // Commands, draw blocks, cull batches and counts are at most one per
+  // instance and phase. The transforms are the input plus each phase's
+  // compacted copy. The slack covers the stats and aligning the fifteen
+  // arrays
+  if (is_indirect_ && 
+      !indirect_stream_buffer_.Initialize(
+          GL_SHADER_STORAGE_BUFFER,
+          kMaxGeomPassInstances * 
+              (3 * sizeof(InstanceTransforms) + 
+               2 * sizeof(gfx_utils::DrawBlock) + 
+               2 * sizeof(gfx_utils::DrawElementsIndirectCommand) + 
+               sizeof(GeomPassCullBatch) + 6 * sizeof(uint32_t)) + 
+          sizeof(GeomPassCullStats) + 
+          15 * gfx_utils::StreamBuffer::GetOffsetAlignment(
+                   GL_SHADER_STORAGE_BUFFER))) {
+    std::cerr << "Could not create indirect stream buffer, drawing the "
+              << "geometry pass directly" << std::endl;
+    is_indirect_ = false;
+  }
+
+  is_gpu_culling_ = is_indirect_ && is_gpu_culling_enabled_ && 
+                   gfx_utils::IsMultiDrawIndirectCountSupported();
+
+  std::cout << "Geometry pass submission: " 
+            << (is_indirect_ ? "multi-draw indirect" : "instanced") 
+            << ", culling on the " << (is_gpu_culling_ ? "GPU" : "CPU")
+            << std::endl;
+
+  SelectOccluders();
+
+  CreatePrograms();
+
+  // Readback copy of the instance flags
+  if (is_gpu_culling_ && is_gpu_culling_check_enabled_) {
+    glGenBuffers(1, &gpu_culling_check_buffer_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, gpu_culling_check_buffer_);
+    glBufferData(GL_COPY_WRITE_BUFFER, 
+                 kMaxGeomPassInstances * sizeof(uint32_t), NULL, 
+                 GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
   SetupGeometryPass();
 
   SetupSSAOPass();
 
   SetupLightPass();
+
+  TrackRenderTargetMemory();
 }
 
-void App::SetupGeometryPass() {
-  if (!geom_pass_program_.CreateFromFiles(kGeomPassVertShaderPath, 
-                                          kGeomPassFragShaderPath)) {
+void App::TrackRenderTargetMemory() {
+  gfx_utils::GpuMemoryTracker& tracker = resource_manager_.GetMemoryTracker();
+
+  // Render targets count against the memory budget but are never evicted
+  size_t gbuf_bytes = 
+      3 * gfx_utils::CalcTextureByteSize(GL_RGB16F, kWindowWidth, 
+                                         kWindowHeight) +
+      gfx_utils::CalcTextureByteSize(GL_DEPTH_COMPONENT, kWindowWidth, 
+                                     kWindowHeight);
+  size_t ssao_bytes = 
+      2 * gfx_utils::CalcTextureByteSize(GL_RED, kWindowWidth, kWindowHeight);
+
+  tracked_render_target_bytes_ = gbuf_bytes + ssao_bytes;
+
+  // The pyramid counts its whole mip chain
+  if (is_hiz_culling_) {
+    tracked_render_target_bytes_ += hiz_pyramid_.GetByteSize();
+  }
+
+  // The SSAO noise texture
+  tracked_texture_bytes_ = gfx_utils::CalcTextureByteSize(GL_RGB32F, 4, 4);
+
+  tracker.Add(gfx_utils::kGpuMemoryRenderTarget, 
+              tracked_render_target_bytes_);
+  tracker.Add(gfx_utils::kGpuMemoryTexture, tracked_texture_bytes_);
+}
+
+void App::UntrackRenderTargetMemory() {
+  gfx_utils::GpuMemoryTracker& tracker = resource_manager_.GetMemoryTracker();
+
+  tracker.Remove(gfx_utils::kGpuMemoryRenderTarget, 
+                 tracked_render_target_bytes_);
+  tracker.Remove(gfx_utils::kGpuMemoryTexture, tracked_texture_bytes_);
+
+  tracked_render_target_bytes_ = 0;
+  tracked_texture_bytes_ = 0;
+}
+
+void App::SelectOccluders() {
+  if (!is_occlusion_culling_enabled_) {
+    return;
+  }
+
+  // Meshes that drop their positions after upload can't be rasterized
+  std::vector<const gfx_utils::Mesh*> candidates;
+  for (const auto& model_ptr : scene_.GetModels()) {
+    for (const auto& mesh : model_ptr->GetMeshes()) {
+      if (mesh.residency != gfx_utils::kResidencyDropAfterUpload && 
+          mesh.has_bounds && !mesh.pos_data.empty()) {
+        candidates.push_back(&mesh);
+      }
+    }
+  }
+
+  // The largest meshes hide the most
+  std::sort(candidates.begin(), candidates.end(), 
+            [](const gfx_utils::Mesh* a, const gfx_utils::Mesh* b) {
+              return a->bounds_radius > b->bounds_radius;
+            });
+
+  size_t num_triangles = 0;
+  for (const gfx_utils::Mesh* mesh : candidates) {
+    size_t mesh_triangles = (mesh->index_data.empty() ? 
+        mesh->pos_data.size() : mesh->index_data.size()) / 3;
+    if (num_triangles + mesh_triangles > kMaxOccluderTriangles) {
+      continue;
+    }
+
+    num_triangles += mesh_triangles;
+    occluder_meshes_.insert(mesh);
+  }
+
+  if (occluder_meshes_.empty()) {
+    std::cout << "No meshes to occlude with, occlusion culling is off" 
+              << std::endl;
+    return;
+  }
+
+  if (!occlusion_culler_.Initialize(kOcclusionBufferWidth, 
+                                    kOcclusionBufferHeight)) {
+    std::cerr << "Could not initialize occlusion culling" << std::endl;
+    occluder_meshes_.clear();
+    return;
+  }
+
+  is_occlusion_culling_ = true;
+
+  std::cout << "Occlusion culling with " << occluder_meshes_.size() 
+            << " occluder meshes, " << num_triangles << " triangles, on " 
+            << occlusion_culler_.GetNumThreads() << " threads" << std::endl;
+}
+
+void App::CreatePrograms() {
+  // Submitted together so the driver can compile them in parallel
+  gfx_utils::ProgramBatch batch;
+  batch.AddFiles(&ssao_pass_program_, "ssao pass", 
+                 kSSAOPassVertShaderPath, kSSAOPassFragShaderPath);
+  batch.AddFiles(&ssao_blur_program_, "ssao blur", 
+                 kSSAOPassVertShaderPath, kSSAOBlurFragShaderPath);
+  light_pass_program_.SetDefines(gfx_utils::GetShaderBlockDefines());
+  batch.AddFiles(&light_pass_program_, "light pass", 
+                 kLightPassVertShaderPath, kLightPassFragShaderPath);
+
+  if (!batch.Finish()) {
+    std::cerr << "Could not create programs." << std::endl;
+    exit(1);
+  }
+
+  geom_pass_variants_.SetDefines(
+      gfx_utils::GetShaderBlockDefines() + "#define MAX_INSTANCES_PER_DRAW " +
+      std::to_string(kMaxGeomPassInstancesPerDraw) + "\n");
+  if (!geom_pass_variants_.CreateFromFiles("geometry pass",
+                                           kGeomPassVertShaderPath, 
+                                           kGeomPassFragShaderPath)) {
     std::cerr << "Could not create geometry pass program." << std::endl;
     exit(1);
   }
 
-  glGenVertexArrays(1, &geom_pass_vao_);
+  gfx_utils::AddMaterialFeatures(&geom_pass_variants_);
+
+  geom_pass_variants_.SetSetupFunc([](gfx_utils::Program& program) {
+    if (!program.BindUniformBlock("DrawTransforms", 
+                                  gfx_utils::kBlockBindingDrawTransforms) ||
+        !program.BindUniformBlock("Materials", 
+                                  gfx_utils::kBlockBindingMaterials)) {
+      std::cerr << "Geometry pass program is missing a uniform block" 
+                << std::endl;
+    }
+
+    program.GetUniform("ambient_texture").Set(1);
+  });
 
+  // The scene is loaded by now, so every variant it needs is known up front
+  std::vector<uint32_t> geom_pass_features;
+  for (auto entity_ptr : scene_.GetEntities()) {
+    if (!entity_ptr->HasModel()) {
+      continue;
+    }
+
+    for (auto& mesh : entity_ptr->GetModel()->GetMeshes()) {
+      uint32_t features = 
+          gfx_utils::CalcMaterialFeatures(mesh.material_list);
+      if (std::find(geom_pass_features.begin(), geom_pass_features.end(), 
+                    features) == geom_pass_features.end()) {
+        geom_pass_features.push_back(features);
+      }
+    }
+  }
+
+  if (!geom_pass_variants_.Precompile(geom_pass_features)) {
+    std::cerr << "Could not create geometry pass variants." << std::endl;
+    exit(1);
+  }
+
+  if (!is_indirect_) {
+    return;
+  }
+
+  // Same features, with the blocks in shader storage
+  if (!geom_pass_indirect_variants_.CreateFromFiles(
+          "geometry pass indirect", kGeomPassIndirectVertShaderPath, 
+          kGeomPassIndirectFragShaderPath)) {
+    std::cerr << "Could not create indirect geometry pass program." 
+              << std::endl;
+    exit(1);
+  }
+
+  gfx_utils::AddMaterialFeatures(&geom_pass_indirect_variants_);
+
+  geom_pass_indirect_variants_.SetSetupFunc([](gfx_utils::Program& program) {
+    program.BindShaderStorageBlock("DrawTransforms", 
+                                   gfx_utils::kBlockBindingDrawTransforms);
+    program.BindShaderStorageBlock("Draws", gfx_utils::kBlockBindingDraws);
+    program.BindShaderStorageBlock("Materials", 
+                                   gfx_utils::kBlockBindingMaterials);
+
+    program.GetUniform("ambient_texture").Set(1);
+  });
+
+  if (!geom_pass_indirect_variants_.Precompile(geom_pass_features)) {
+    std::cerr << "Could not create indirect geometry pass variants." 
+              << std::endl;
+    exit(1);
+  }
+
+  if (!is_gpu_culling_) {
+    return;
+  }
+
+  if (!geom_pass_cull_program_.CreateComputeFromFile(
+          kGeomPassCullShaderPath)) {
+    std::cerr << "Could not create culling program, culling on the CPU" 
+              << std::endl;
+    is_gpu_culling_ = false;
+    return;
+  }
+
+  geom_pass_cull_program_.BindShaderStorageBlock(
+      "DrawTransforms", gfx_utils::kBlockBindingDrawTransforms);
+  geom_pass_cull_program_.BindShaderStorageBlock("CullBatches", 
+                                                 kCullBatchesBinding);
+  geom_pass_cull_program_.BindShaderStorageBlock("InstanceBatches", 
+                                                 kInstanceBatchesBinding);
+  geom_pass_cull_program_.BindShaderStorageBlock("InstanceFlags", 
+                                                 kInstanceFlagsBinding);
+  geom_pass_cull_program_.BindShaderStorageBlock("CullStats", 
+                                                 kCullStatsBinding);
+  geom_pass_cull_program_.BindShaderStorageBlock("VisibleTransforms", 
+                                                 kVisibleTransformsBinding);
+  geom_pass_cull_program_.BindShaderStorageBlock("BatchCounts", 
+                                                 kBatchCountsBinding);
+
+  if (!geom_pass_cull_commands_program_.CreateComputeFromFile(
+          kGeomPassCullCommandsShaderPath)) {
+    std::cerr << "Could not create culling program, culling on the CPU" 
+              << std::endl;
+    geom_pass_cull_program_.Destroy();
+    is_gpu_culling_ = false;
+    return;
+  }
+
+  geom_pass_cull_commands_program_.BindShaderStorageBlock(
+      "CullBatches", kCullBatchesBinding);
+  geom_pass_cull_commands_program_.BindShaderStorageBlock(
+      "BatchCounts", kBatchCountsBinding);
+  geom_pass_cull_commands_program_.BindShaderStorageBlock(
+      "Commands", kCommandsBinding);
+  geom_pass_cull_commands_program_.BindShaderStorageBlock(
+      "Draws", gfx_utils::kBlockBindingDraws);
+  geom_pass_cull_commands_program_.BindShaderStorageBlock(
+      "DrawCounts", kDrawCountsBinding);
+
+  glUseProgram(geom_pass_cull_program_.GetProgramId());
+
+  geom_pass_cull_program_.GetUniform("hiz_tex")
+                         .Set(static_cast<int>(kHiZTextureUnit));
+  geom_pass_cull_program_.GetUniform("depth_width").Set(kWindowWidth);
+  geom_pass_cull_program_.GetUniform("depth_height").Set(kWindowHeight);
+
+  glUseProgram(0);
+}
+
+void App::SetupGeometryPass() {
   glGenFramebuffers(1, &gbuf_fbo_);
   glBindFramebuffer(GL_FRAMEBUFFER, gbuf_fbo_);
 
@@ -368,32 +1471,47 @@ void App::SetupGeometryPass() {
   };
   glDrawBuffers(3, gbuf_attachments);
 
-  glGenRenderbuffers(1, &gbuf_depth_rbo_);
-  glBindRenderbuffer(GL_RENDERBUFFER, gbuf_depth_rbo_);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, kWindowWidth, 
-                        kWindowHeight);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, 
-                            GL_RENDERBUFFER, gbuf_depth_rbo_);
+  // A texture rather than a renderbuffer, so the Hi-Z pyramid can be built
+  // from it
+  glGenTextures(1, &gbuf_depth_tex_);
+  glBindTexture(GL_TEXTURE_2D, gbuf_depth_tex_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, kWindowWidth, 
+               kWindowHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 
+                         gbuf_depth_tex_, 0);
   if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
     std::cerr << "Framebuffer not complete!" << std::endl;
   }
   
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
 
-void App::SetupSSAOPass() {
-  if (!ssao_pass_program_.CreateFromFiles(kSSAOPassVertShaderPath, 
-                                          kSSAOPassFragShaderPath)) {
-    std::cerr << "Could not create ssao pass program." << std::endl;
-    exit(1);
+  if (!is_gpu_culling_) {
+    return;
   }
 
-  if (!ssao_blur_program_.CreateFromFiles(kSSAOPassVertShaderPath, 
-                                          kSSAOBlurFragShaderPath)) {
-    std::cerr << "Could not create ssao blur program." << std::endl;
-    exit(1);
+  if (!geom_pass_stats_readback_.Initialize(sizeof(GeomPassCullStats))) {
+    std::cerr << "Could not create culling stats readback" << std::endl;
+  }
+
+  if (!is_hiz_culling_enabled_) {
+    return;
   }
 
+  if (!hiz_pyramid_.Initialize(kWindowWidth, kWindowHeight)) {
+    std::cerr << "Could not create Hi-Z pyramid, no occlusion culling on "
+              << "the GPU" << std::endl;
+    return;
+  }
+
+  is_hiz_culling_ = true;
+
+  std::cout << "Two-phase Hi-Z occlusion culling, " 
+            << hiz_pyramid_.GetNumLevels() << " pyramid levels" << std::endl;
+}
+
+void App::SetupSSAOPass() {
   glGenFramebuffers(1, &ssao_fbo_);
   glBindFramebuffer(GL_FRAMEBUFFER, ssao_fbo_);
 
@@ -420,12 +1538,25 @@ void App::SetupSSAOPass() {
                          ssao_blur_tex_, 0);                     
 
   glGenVertexArrays(1, &ssao_pass_vao_);
+  glBindVertexArray(ssao_pass_vao_);
 
   glGenBuffers(1, &ssao_pass_quad_vbo_);
   glBindBuffer(GL_ARRAY_BUFFER, ssao_pass_quad_vbo_);
   glBufferData(GL_ARRAY_BUFFER, sizeof(kQuadVertices), &kQuadVertices, 
                GL_STATIC_DRAW);
 
+  // The attribute setup is VAO state, so it only needs to be done once
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
+                        (void*)0);
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
+                        (void*)(3 * sizeof(float)));
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
   std::uniform_real_distribution<GLfloat> random_floats(0.f, 1.f);
   std::default_random_engine generator;
 
@@ -464,30 +1595,92 @@ void App::SetupSSAOPass() {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-}
 
-void App::SetupLightPass() {
-  if (!light_pass_program_.CreateFromFiles(kLightPassVertShaderPath, 
-                                           kLightPassFragShaderPath)) {
-    std::cerr << "Could not create light pass program." << std::endl;
-    exit(1);
+  // Uniform values are program state, so the ones that never change are
+  // set here instead of every frame
+  glUseProgram(ssao_pass_program_.GetProgramId());
+
+  for (int i = 0; i < 64; ++i) {
+    ssao_pass_program_.GetUniform("samples", i).Set(ssao_kernel_[i]);
   }
 
+  ssao_pass_program_.GetUniform("pos_tex").Set(0);
+  ssao_pass_program_.GetUniform("normal_tex").Set(1);
+  ssao_pass_program_.GetUniform("noise_tex").Set(2);
+
+  ssao_proj_mat_uniform_ = ssao_pass_program_.GetUniform("proj_mat");
+
+  glUseProgram(ssao_blur_program_.GetProgramId());
+
+  ssao_blur_program_.GetUniform("ssao_tex").Set(0);
+
+  glUseProgram(0);
+}
+
+void App::SetupLightPass() {
   glGenVertexArrays(1, &light_pass_vao_);
+  glBindVertexArray(light_pass_vao_);
 
   glGenBuffers(1, &light_pass_quad_vbo_);
   glBindBuffer(GL_ARRAY_BUFFER, light_pass_quad_vbo_);
   glBufferData(GL_ARRAY_BUFFER, sizeof(kQuadVertices), &kQuadVertices, 
                GL_STATIC_DRAW);
+
+  // The attribute setup is VAO state, so it only needs to be done once
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
+                        (void*)0);
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 
+                        (void*)(3 * sizeof(float)));
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glUseProgram(light_pass_program_.GetProgramId());
+
+  light_pass_program_.GetUniform("pos_tex").Set(0);
+  light_pass_program_.GetUniform("normal_tex").Set(1);
+  light_pass_program_.GetUniform("ambient_tex").Set(2);
+  light_pass_program_.GetUniform("ssao_tex").Set(3);
+
+  light_pass_program_.GetUniform("ambient_intensity")
+                     .Set(glm::vec3(0.5f, 0.5f, 0.5f));
+
+  glUseProgram(0);
+
+  // The light pass only shades ambient light so far, so the compiler may
+  // drop the unused PointLights block and there is nothing to bind
+  light_pass_program_.BindUniformBlock("PointLights", 
+                                       gfx_utils::kBlockBindingPointLights);
+
+  // The lights don't move, so they are written once. A light change would
+  // be one Write() of the refilled block. The data is the block's full
+  // declared size, so BindBase() binds all of it
+  std::vector<uint8_t> lights_data;
+  gfx_utils::FillPointLightsBlock(lights_, &lights_data);
+
+  if (!point_lights_buffer_.Initialize(GL_UNIFORM_BUFFER, 
+                                       lights_data.size())) {
+    std::cerr << "Could not create point lights buffer." << std::endl;
+    exit(1);
+  }
+
+  point_lights_buffer_.Write(0, lights_data.size(), &lights_data[0]);
 }
 
 void App::Cleanup() {
+  UntrackRenderTargetMemory();
+
   glDeleteBuffers(1, &light_pass_quad_vbo_);
 
   glDeleteVertexArrays(1, &light_pass_vao_);
 
   light_pass_program_.Destroy();
 
+  point_lights_buffer_.Destroy();
+
   glDeleteTextures(1, &ssao_noise_tex_);
 
   glDeleteBuffers(1, &ssao_pass_quad_vbo_);
@@ -501,7 +1694,10 @@ void App::Cleanup() {
   ssao_blur_program_.Destroy();
   ssao_pass_program_.Destroy();
 
-  glDeleteRenderbuffers(1, &gbuf_depth_rbo_);
+  hiz_pyramid_.Destroy();
+  geom_pass_stats_readback_.Destroy();
+
+  glDeleteTextures(1, &gbuf_depth_tex_);
 
   glDeleteTextures(1, &gbuf_ambient_tex_);
   glDeleteTextures(1, &gbuf_normal_tex_);
@@ -509,11 +1705,25 @@ void App::Cleanup() {
 
   glDeleteFramebuffers(1, &gbuf_fbo_);
 
-  glDeleteVertexArrays(1, &geom_pass_vao_);
+  glDeleteBuffers(1, &gpu_culling_check_buffer_);
+
+  if (geom_pass_cull_commands_program_.IsCreated()) {
+    geom_pass_cull_commands_program_.Destroy();
+  }
+  if (geom_pass_cull_program_.IsCreated()) {
+    geom_pass_cull_program_.Destroy();
+  }
+  geom_pass_indirect_variants_.Destroy();
+  geom_pass_variants_.Destroy();
 
-  geom_pass_program_.Destroy();
+  indirect_stream_buffer_.Destroy();
+  stream_buffer_.Destroy();
 
   resource_manager_.Cleanup();
 
+  occlusion_culler_.Destroy();
+
+  uploader_.Destroy();
+
   window_.Destroy();
 }
\ No newline at end of file
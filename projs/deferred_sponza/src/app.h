@@ -4,6 +4,8 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <GL/glew.h>
 #if defined(WIN32)
@@ -12,29 +14,253 @@
 
 #include "gfx_utils/window/window.h"
 #include "gfx_utils/window/camera.h"
+#include "gfx_utils/frustum.h"
+#include "gfx_utils/frustum_culler.h"
+#include "gfx_utils/occlusion_culler.h"
 #include "gfx_utils/program.h"
+#include "gfx_utils/program_variants.h"
+#include "gfx_utils/render_queue.h"
 #include "gfx_utils/scene/scene.h"
 #include "gfx_utils/lights.h"
 #include "gfx_utils/mesh.h"
+#include "gfx_utils/cpu_timer.h"
+#include "gfx_utils/gl/async_uploader.h"
+#include "gfx_utils/gl/block_buffer.h"
 #include "gfx_utils/gl/gl_resource_manager.h"
+#include "gfx_utils/gl/gl_state_cache.h"
+#include "gfx_utils/gl/hiz_pyramid.h"
+#include "gfx_utils/gl/readback_buffer.h"
+#include "gfx_utils/gl/shader_blocks.h"
+#include "gfx_utils/gl/stream_buffer.h"
+
+// Mirrors an element of the std140 DrawTransforms block in geom_pass.vert.
+// normal_mat is stored as a mat4 because a std140 mat3 pads each column to a
+// vec4
+struct InstanceTransforms {
+  glm::mat4 model_mat;
+  glm::mat4 normal_mat;
+};
+
+// Mirrors the std430 Batch struct in geom_pass_cull.comp and
+// geom_pass_cull_commands.comp. One per mesh batch, the template of the
+// instanced command its visible instances get
+struct GeomPassCullBatch {
+  // Object space box of the mesh, w unused
+  glm::vec4 bounds_min;
+  glm::vec4 bounds_max;
+
+  uint32_t index_count = 0;
+  uint32_t first_index = 0;
+  int32_t base_vertex = 0;
+  uint32_t first_material = 0;
+
+  // The batch's group and the group's first command
+  uint32_t group = 0;
+  uint32_t first_command = 0;
+
+  // Start of the batch's instances, in the input transforms and in the
+  // compacted ones the culling writes
+  uint32_t first_instance = 0;
+
+  uint32_t padding = 0;
+};
+
+// Mirrors the std430 CullStats block in geom_pass_cull.comp. Read back a
+// few frames late, for the report
+struct GeomPassCullStats {
+  // Instances drawn by the first phase, and by the second
+  uint32_t num_first_phase = 0;
+  uint32_t num_second_phase = 0;
+
+  // Instances in the frustum that neither phase drew
+  uint32_t num_occluded = 0;
+
+  uint32_t padding = 0;
+};
 
 class App {
+private:
+  // Every instance of one mesh in the frame
+  struct GeomPassBatch {
+    const gfx_utils::Mesh* mesh = nullptr;
+    const gfx_utils::Program* program = nullptr;
+    const gfx_utils::GeometryRange* range = nullptr;
+    GLuint ambient_tex_id = 0;
+
+    // Depth of the nearest instance, for the sort key
+    uint32_t depth = 0xffffffff;
+
+    // Range of the batch's instances in geom_pass_instance_order_
+    uint32_t first_instance = 0;
+    uint32_t num_instances = 0;
+  };
+
+  struct GeomPassInstance {
+    uint32_t batch;
+    uint32_t transforms;
+
+    // Of the entity, quantized for the sort key
+    uint32_t depth;
+  };
+
+  // Up to kMaxGeomPassInstancesPerDraw instances of a batch
+  struct GeomPassDraw {
+    const GeomPassBatch* batch = nullptr;
+    gfx_utils::StreamAllocation transforms;
+    uint32_t num_instances = 0;
+  };
+
+  // Consecutive indirect commands that share a program and texture, drawn
+  // with one glMultiDrawElementsIndirect()
+  struct GeomPassGroup {
+    const GeomPassBatch* batch = nullptr;
+    uint32_t changed_fields = 0;
+
+    uint32_t first_command = 0;
+    uint32_t num_commands = 0;
+  };
+
+  // What the indirect draws of one pass over the groups read. With GPU
+  // culling each phase gets its own: transforms holds the visible instances
+  // compacted per batch, batch_counts how many each batch has and
+  // draw_counts a count per group. Otherwise transforms are the inputs
+  struct GeomPassCommands {
+    gfx_utils::StreamAllocation transforms;
+    gfx_utils::StreamAllocation commands;
+    gfx_utils::StreamAllocation draws;
+    gfx_utils::StreamAllocation batch_counts;
+    gfx_utils::StreamAllocation draw_counts;
+  };
+
+  // Inputs of geom_pass_cull.comp, shared by both phases
+  struct GeomPassCullInputs {
+    gfx_utils::StreamAllocation transforms;
+    gfx_utils::StreamAllocation cull_batches;
+    gfx_utils::StreamAllocation instance_batches;
+
+    // Per instance, whether the first phase found it in the frustum, and
+    // occluded, for the second phase to test again
+    gfx_utils::StreamAllocation instance_flags;
+
+    gfx_utils::StreamAllocation stats;
+  };
+
 public:
   void Run();
 
+  void SetScenePath(const std::string& path) {
+    scene_path_ = path;
+  }
+
+  // Without instancing every entity's meshes are drawn on their own, for
+  // comparison
+  void SetInstancingEnabled(bool is_enabled) {
+    is_instancing_enabled_ = is_enabled;
+  }
+
+  // Multi-draw indirect submission of the geometry pass, used where the GL
+  // supports it. Without it the pass falls back to one instanced draw per
+  // mesh
+  void SetIndirectEnabled(bool is_enabled) {
+    is_indirect_enabled_ = is_enabled;
+  }
+
+  // Frustum culling of the indirect path in a compute shader, which writes
+  // the commands and their counts. Needs indirect count draws, and falls
+  // back to culling on the CPU, as the other paths always do
+  void SetGpuCullingEnabled(bool is_enabled) {
+    is_gpu_culling_enabled_ = is_enabled;
+  }
+
+  // Two-phase occlusion culling of the GPU culling path. The first phase
+  // tests instances against a Hi-Z pyramid of the previous frame's depth and
+  // draws the ones that pass. The pyramid is then rebuilt from that depth,
+  // and the second phase draws the instances the first rejected that it
+  // doesn't hide, so nothing that comes into view pops in a frame late
+  void SetHiZCullingEnabled(bool is_enabled) {
+    is_hiz_culling_enabled_ = is_enabled;
+  }
+
+  // Reads back which instances the GPU found in the frustum every frame and
+  // compares them with the CPU culler's results for the same boxes. Boxes
+  // that touch a plane within rounding are counted apart. Stalls the
+  // pipeline, so only for testing the compute path, e.g. on a software GL
+  void SetGpuCullingCheckEnabled(bool is_enabled) {
+    is_gpu_culling_check_enabled_ = is_enabled;
+  }
+
+  // Rasterizes the largest meshes into a small depth buffer on the CPU and
+  // drops the instances hidden behind them, before either culling path
+  void SetOcclusionCullingEnabled(bool is_enabled) {
+    is_occlusion_culling_enabled_ = is_enabled;
+  }
+
 private:
   void MainLoop();
 
   void GeometryPass();
+
+  // Groups this frame's mesh instances into geom_pass_batches_. Instances
+  // outside the frustum are dropped, unless it is null. Whole entities are
+  // culled with the scene's BVH first, and occluded instances are dropped
+  // last
+  void CollectGeomPassInstances(const glm::mat4& view_mat, 
+                                const glm::mat4& proj_mat,
+                                const gfx_utils::Frustum* frustum);
+
+  // Rasterizes the occluders among the instances that passed frustum
+  // culling
+  void RasterizeOccluders(const glm::mat4& view_proj_mat, bool is_culled);
+
+  // Draw the batches with an instanced draw per mesh, or with a
+  // multi-draw indirect call per program and texture
+  void SubmitGeomPassInstanced(const glm::mat4& view_mat, 
+                               const glm::mat4& proj_mat);
+  void SubmitGeomPassIndirect(const glm::mat4& view_mat, 
+                              const glm::mat4& proj_mat);
+
+  // Fills one phase's commands of the indirect path from the cull batches,
+  // an instanced command per batch with visible instances. 
+  // hiz_view_proj_mat is what the Hi-Z pyramid was rendered with
+  void DispatchGeomPassCulling(int phase, const gfx_utils::Frustum& frustum,
+                               const glm::mat4& hiz_view_proj_mat,
+                               uint32_t num_instances, uint32_t num_batches,
+                               const GeomPassCullInputs& inputs,
+                               const GeomPassCommands& out);
+
+  // Compares the first phase's frustum flags with the CPU culler's, see
+  // SetGpuCullingCheckEnabled()
+  void CheckGpuCulling(const gfx_utils::Frustum& frustum, 
+                       const GeomPassCullInputs& inputs);
+
+  // One multi-draw indirect call per group
+  void DrawGeomPassGroups(const GeomPassCommands& commands,
+                          const glm::mat4& view_mat, 
+                          const glm::mat4& proj_mat);
+
   void SSAOPass();
   void LightPass();
 
+  void ReportStateCounters(const std::string& label,
+                           const gfx_utils::GLStateCounters& counters);
+
+  // Counts since the last report
+  void ReportUniformCounters(const std::string& label,
+                             gfx_utils::Program* program);
+
   void Startup();
 
+  void CreatePrograms();
+  void SelectOccluders();
   void SetupGeometryPass();
   void SetupSSAOPass();
   void SetupLightPass();
 
+  // Adds the render targets and the SSAO noise texture to the resource
+  // manager's memory tracker, and removes them again on cleanup
+  void TrackRenderTargetMemory();
+  void UntrackRenderTargetMemory();
+
   void Cleanup();
 
 private:
@@ -42,16 +268,117 @@ private:
   gfx_utils::Camera camera_;
 
   gfx_utils::Scene scene_;
+  std::string scene_path_ = "scene/scene.json";
+
+  bool is_instancing_enabled_ = true;
+
+  // is_indirect_ is set at startup if it is both enabled and supported
+  bool is_indirect_enabled_ = true;
+  bool is_indirect_ = false;
+
+  // Same for is_gpu_culling_
+  bool is_gpu_culling_enabled_ = true;
+  bool is_gpu_culling_ = false;
+
+  // Same for is_hiz_culling_, which needs GPU culling
+  bool is_hiz_culling_enabled_ = true;
+  bool is_hiz_culling_ = false;
+
+  bool is_gpu_culling_check_enabled_ = false;
+
+  // Set at startup if enabled and there are meshes to occlude with
+  bool is_occlusion_culling_enabled_ = true;
+  bool is_occlusion_culling_ = false;
 
   gfx_utils::GLResourceManager resource_manager_;
 
+  gfx_utils::AsyncUploader uploader_;
+
+  gfx_utils::GLStateCache state_cache_;
+
+  // Per-draw data, rewritten every frame
+  gfx_utils::StreamBuffer stream_buffer_;
+
+  // Instance transforms, draw blocks and indirect commands of the indirect
+  // path, as shader storage
+  gfx_utils::StreamBuffer indirect_stream_buffer_;
+
+  uint32_t num_frames_ = 0;
+
   std::vector<std::shared_ptr<gfx_utils::PointLight>> lights_;
 
-  gfx_utils::Program geom_pass_program_;
-  GLuint geom_pass_vao_;
+  // Specialized on each mesh's material features
+  gfx_utils::ProgramVariants geom_pass_variants_;
+  gfx_utils::ProgramVariants geom_pass_indirect_variants_;
+
+  gfx_utils::Program geom_pass_cull_program_;
+  gfx_utils::Program geom_pass_cull_commands_program_;
+
+  gfx_utils::CpuTimer geom_pass_timer_;
+
+  // Kept between frames so their capacity is reused
+  std::vector<InstanceTransforms> geom_pass_transforms_;
+  std::vector<GeomPassInstance> geom_pass_instances_;
+  std::vector<GeomPassBatch> geom_pass_batches_;
+  std::unordered_map<const gfx_utils::Mesh*, uint32_t> geom_pass_batch_ids_;
+  std::vector<uint32_t> geom_pass_instance_order_;
+  std::vector<uint32_t> geom_pass_batch_fill_;
+  std::vector<GeomPassDraw> geom_pass_draws_;
+  std::vector<GeomPassGroup> geom_pass_groups_;
+
+  // The entities whose meshes are collected, which the BVH query fills
+  std::vector<gfx_utils::Entity*> geom_pass_entities_;
+
+  // Holds the box of each of geom_pass_instances_ while they are collected
+  gfx_utils::FrustumCuller geom_pass_culler_;
+
+  gfx_utils::OcclusionCuller occlusion_culler_;
+
+  // Meshes with CPU-side positions that are rasterized as occluders
+  std::unordered_set<const gfx_utils::Mesh*> occluder_meshes_;
+
+  gfx_utils::CpuTimer occlusion_timer_;
+
+  // Of the g-buffer depth after the first phase of the last frame, and the
+  // matrix it was rendered with. Invalid until the first frame is drawn
+  gfx_utils::HiZPyramid hiz_pyramid_;
+  glm::mat4 hiz_view_proj_mat_;
+  bool has_hiz_ = false;
+
+  gfx_utils::ReadbackBuffer geom_pass_stats_readback_;
+  GeomPassCullStats geom_pass_cull_stats_;
+
+  // See SetGpuCullingCheckEnabled(). The flags are copied to the buffer to
+  // be read back, and the culler holds the same boxes in the same order.
+  // Totals since the last report
+  GLuint gpu_culling_check_buffer_ = 0;
+  std::vector<uint32_t> gpu_culling_check_flags_;
+  gfx_utils::FrustumCuller gpu_culling_check_culler_;
+  uint64_t gpu_culling_check_compared_ = 0;
+  uint64_t gpu_culling_check_mismatches_ = 0;
+  uint64_t gpu_culling_check_near_plane_mismatches_ = 0;
+
+  // Of the last frame, for the report. With GPU culling the commands are
+  // the most the GPU could have written, and nothing is culled on the CPU
+  uint32_t geom_pass_num_commands_ = 0;
+  uint32_t geom_pass_num_draw_calls_ = 0;
+  uint32_t geom_pass_num_culled_ = 0;
+  uint32_t geom_pass_num_culled_entities_ = 0;
+  uint32_t geom_pass_num_occluded_ = 0;
+
+  // Holds indices into geom_pass_draws_, or into geom_pass_batches_ on the
+  // indirect path
+  gfx_utils::RenderQueue geom_pass_queue_;
+
+  gfx_utils::RenderKeyIds geom_pass_program_ids_{
+      gfx_utils::kRenderKeyProgramBits};
+  gfx_utils::RenderKeyIds geom_pass_material_ids_{
+      gfx_utils::kRenderKeyMaterialBits};
+  gfx_utils::RenderKeyIds geom_pass_texture_ids_{
+      gfx_utils::kRenderKeyTextureSetBits};
 
   GLuint gbuf_fbo_;
-  GLuint gbuf_depth_rbo_;
+  GLuint gbuf_depth_tex_;
 
   GLuint gbuf_pos_tex_;
   GLuint gbuf_normal_tex_;
@@ -60,6 +387,8 @@ private:
   gfx_utils::Program ssao_pass_program_;
   gfx_utils::Program ssao_blur_program_;
 
+  gfx_utils::Uniform ssao_proj_mat_uniform_;
+
   GLuint ssao_fbo_;
   GLuint ssao_color_tex_;
 
@@ -73,8 +402,14 @@ private:
 
   GLuint ssao_noise_tex_;
 
+  // What TrackRenderTargetMemory() added, by category
+  size_t tracked_render_target_bytes_ = 0;
+  size_t tracked_texture_bytes_ = 0;
+
   gfx_utils::Program light_pass_program_;
 
+  gfx_utils::BlockBuffer point_lights_buffer_;
+
   GLuint light_pass_vao_;
   GLuint light_pass_quad_vbo_;
 };
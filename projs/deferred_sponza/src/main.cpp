@@ -1,7 +1,41 @@
 #include "app.h"
 
+#include <cstring>
+
+// Usage: deferred_sponza [scene.json] [--no-instancing] [--no-indirect] [--cpu-culling]
+//                        [--no-occlusion-culling] [--no-hiz-culling]
+//                        [--check-gpu-culling]
+//
+// --check-gpu-culling reads back the GPU's frustum test every frame and
+// compares it with the CPU culler's. It runs on software GL too, e.g. Mesa
+// with LIBGL_ALWAYS_SOFTWARE=1
 int main(int argc, char* argv[]) {
   App app;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--no-instancing") == 0) {
+      app.SetInstancingEnabled(false);
+    }
+    else if (strcmp(argv[i], "--no-indirect") == 0) {
+      app.SetIndirectEnabled(false);
+    }
+    else if (strcmp(argv[i], "--cpu-culling") == 0) {
+      app.SetGpuCullingEnabled(false);
+    }
+    else if (strcmp(argv[i], "--no-occlusion-culling") == 0) {
+      app.SetOcclusionCullingEnabled(false);
+    }
+    else if (strcmp(argv[i], "--no-hiz-culling") == 0) {
+      app.SetHiZCullingEnabled(false);
+    }
+    else if (strcmp(argv[i], "--check-gpu-culling") == 0) {
+      app.SetGpuCullingCheckEnabled(true);
+    }
+    else {
+      app.SetScenePath(argv[i]);
+    }
+  }
+
   app.Run();
 
   return 0;
@@ -36,6 +36,9 @@ void App::MainLoop() {
   bool should_quit = false;
 
   while (!should_quit) {
+    gl_resource_manager_.BeginFrame();
+    state_cache_.BeginFrame();
+
     renderer_.Render(scene_.GetEntities());
 
     window_.SwapBuffers();
@@ -69,12 +72,14 @@ void App::Startup() {
   scene_.AddEntity(room_entity_ptr);
 
   gl_resource_manager_.SetScene(&scene_);
+  gl_resource_manager_.SetStateCache(&state_cache_);
 
   gl_resource_manager_.CreateGLResources();
 
   renderer_.Initialize();
 
   renderer_.SetResourceManager(&gl_resource_manager_);
+  renderer_.SetStateCache(&state_cache_);
   renderer_.SetWindow(&window_);
   renderer_.SetCamera(&camera_);
 }
@@ -17,6 +17,7 @@
 #include "gfx_utils/lights.h"
 #include "gfx_utils/mesh.h"
 #include "gfx_utils/gl/gl_resource_manager.h"
+#include "gfx_utils/gl/gl_state_cache.h"
 #include "gfx_utils/renderers/simple_renderer.h"
 
 class App {
@@ -40,6 +41,8 @@ private:
 
   gfx_utils::GLResourceManager gl_resource_manager_;
 
+  gfx_utils::GLStateCache state_cache_;
+
   gfx_utils::SimpleRenderer renderer_;
   
 };
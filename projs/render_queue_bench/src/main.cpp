@@ -0,0 +1,165 @@
+// Measures the render queue on a synthetic frame of draw items: the cost of
+// pushing and sorting them, and how many state changes the sorted order
+// saves over submitting them in the order they were pushed
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "gfx_utils/cpu_timer.h"
+#include "gfx_utils/render_queue.h"
+
+static const uint32_t kNumItems = 100000;
+static const int kNumIterations = 100;
+
+// Roughly a big scene: a few passes, tens of program variants and a few
+// thousand materials and texture sets
+static const uint32_t kNumPasses = 4;
+static const uint32_t kNumPrograms = 32;
+static const uint32_t kNumMaterials = 2048;
+static const uint32_t kNumTextureSets = 1024;
+
+struct StateChanges {
+  uint32_t passes = 0;
+  uint32_t programs = 0;
+  uint32_t materials = 0;
+  uint32_t texture_sets = 0;
+
+  uint32_t GetTotal() const {
+    return passes + programs + materials + texture_sets;
+  }
+};
+
+static void CountChanges(uint32_t changed_fields, StateChanges* changes) {
+  if (changed_fields & gfx_utils::kRenderKeyPass) {
+    ++changes->passes;
+  }
+  if (changed_fields & gfx_utils::kRenderKeyProgram) {
+    ++changes->programs;
+  }
+  if (changed_fields & gfx_utils::kRenderKeyMaterial) {
+    ++changes->materials;
+  }
+  if (changed_fields & gfx_utils::kRenderKeyTextureSet) {
+    ++changes->texture_sets;
+  }
+}
+
+static void PrintChanges(const std::string& label, 
+                         const StateChanges& changes) {
+  std::cout << label << ": " << changes.GetTotal() << " state changes (" 
+            << changes.passes << " pass, " << changes.programs 
+            << " program, " << changes.materials << " material, "
+            << changes.texture_sets << " texture set)" << std::endl;
+}
+
+int main() {
+  // Fixed seed so runs are comparable
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<uint32_t> pass_dist(0, kNumPasses - 1);
+  std::uniform_int_distribution<uint32_t> program_dist(0, kNumPrograms - 1);
+  std::uniform_int_distribution<uint32_t> material_dist(0, kNumMaterials - 1);
+  std::uniform_real_distribution<float> depth_dist(0.1f, 1000.f);
+
+  std::vector<uint64_t> keys(kNumItems);
+  for (uint64_t& key : keys) {
+    // Textures come with the material, as they do in loaded scenes, so
+    // materials sharing textures share a texture set
+    uint32_t material = material_dist(rng);
+    uint32_t texture_set = material % kNumTextureSets;
+
+    key = gfx_utils::RenderQueue::MakeKey(
+        pass_dist(rng), program_dist(rng), material, texture_set, 
+        gfx_utils::RenderQueue::QuantizeDepth(depth_dist(rng), 0.1f, 1000.f));
+  }
+
+  gfx_utils::RenderQueue queue;
+  queue.Reserve(kNumItems);
+
+  // What submitting in push order would cost
+  StateChanges unsorted_changes;
+  for (uint32_t i = 0; i < kNumItems; ++i) {
+    queue.Push(keys[i], i);
+  }
+  queue.Submit([&](uint32_t /*payload*/, uint32_t changed_fields) {
+    CountChanges(changed_fields, &unsorted_changes);
+  });
+
+  gfx_utils::CpuTimer push_timer;
+  gfx_utils::CpuTimer sort_timer;
+  gfx_utils::CpuTimer submit_timer;
+  gfx_utils::CpuTimer std_sort_timer;
+
+  StateChanges sorted_changes;
+  bool is_sorted = true;
+
+  std::vector<gfx_utils::RenderItem> std_sort_items;
+  std_sort_items.reserve(kNumItems);
+
+  for (int iteration = 0; iteration < kNumIterations; ++iteration) {
+    push_timer.Begin();
+    queue.Clear();
+    for (uint32_t i = 0; i < kNumItems; ++i) {
+      queue.Push(keys[i], i);
+    }
+    push_timer.End();
+
+    sort_timer.Begin();
+    queue.Sort();
+    sort_timer.End();
+
+    sorted_changes = StateChanges();
+    submit_timer.Begin();
+    queue.Submit([&](uint32_t /*payload*/, uint32_t changed_fields) {
+      CountChanges(changed_fields, &sorted_changes);
+    });
+    submit_timer.End();
+
+    // Baseline on the same items
+    std_sort_items.clear();
+    for (uint32_t i = 0; i < kNumItems; ++i) {
+      gfx_utils::RenderItem item;
+      item.key = keys[i];
+      item.payload = i;
+      std_sort_items.push_back(item);
+    }
+
+    std_sort_timer.Begin();
+    std::sort(std_sort_items.begin(), std_sort_items.end(),
+              [](const gfx_utils::RenderItem& a, 
+                 const gfx_utils::RenderItem& b) {
+                return a.key < b.key;
+              });
+    std_sort_timer.End();
+
+    const std::vector<gfx_utils::RenderItem>& items = queue.GetItems();
+    for (uint32_t i = 0; i < kNumItems; ++i) {
+      if (items[i].key != std_sort_items[i].key) {
+        is_sorted = false;
+        break;
+      }
+    }
+  }
+
+  std::cout << kNumItems << " draw items, average of " << kNumIterations 
+            << " iterations" << std::endl;
+  std::cout << "Push: " << push_timer.GetAverageMs() << " ms" << std::endl;
+  std::cout << "Radix sort: " << sort_timer.GetAverageMs() << " ms (" 
+            << queue.GetNumSortPasses() << " byte passes)" << std::endl;
+  std::cout << "std::sort: " << std_sort_timer.GetAverageMs() << " ms" 
+            << std::endl;
+  std::cout << "Submit walk: " << submit_timer.GetAverageMs() << " ms" 
+            << std::endl;
+
+  PrintChanges("Push order", unsorted_changes);
+  PrintChanges("Sorted", sorted_changes);
+
+  if (!is_sorted) {
+    std::cerr << "Radix sort order doesn't match std::sort" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -9,44 +9,54 @@ uniform vec3 camera_pos;
 
 out vec4 out_color;
 
+// Mirrors gfx_utils::PointLightBlock
 struct PointLight {
-  bool is_active;
-
-  vec3 position; 
-  vec3 diffuse_intensity;
-  vec3 specular_intensity;
-
-  samplerCube shadow_tex;
-  float far_plane;
+  vec4 position; 
+  vec4 diffuse_intensity;
+  vec4 specular_intensity;
 };
 
+// Mirrors gfx_utils::MaterialBlock
 struct Material {
-  vec3 ambient_color;
-  vec3 diffuse_color;
-  vec3 specular_color;
-  vec3 emission_color;
+  vec4 ambient_color;
+  vec4 diffuse_color;
+  vec4 specular_color;
+  vec4 emission_color;
   float shininess;
 
   bool has_ambient_tex;
   bool has_diffuse_tex;
   bool has_specular_tex;
+};
 
-  sampler2D ambient_texture;
-  sampler2D diffuse_texture;
-  sampler2D specular_texture;
+// The MAX_* sizes are injected by the app, see
+// gfx_utils::GetShaderBlockDefines()
+layout(std140) uniform PointLights {
+  int num_point_lights;
+  PointLight lights[MAX_POINT_LIGHTS_PER_BLOCK];
 };
 
-uniform PointLight lights[5];
-uniform Material materials[5];
+layout(std140) uniform Materials {
+  Material materials[MAX_MATERIALS_PER_BLOCK];
+};
+
+// Samplers can't live in blocks. The materials of a mesh share one texture
+// per kind, and only the first MAX_SHADOW_LIGHTS lights have a shadow map
+uniform sampler2D ambient_texture;
+uniform sampler2D diffuse_texture;
+uniform sampler2D specular_texture;
+
+uniform samplerCube shadow_texs[MAX_SHADOW_LIGHTS];
+uniform float far_plane;
 
 uniform vec3 ambient_intensity;
 
 float CalcShadowOcclusion(vec3 frag_pos, int light_idx) {
-  vec3 dist = frag_pos - lights[light_idx].position;
+  vec3 dist = frag_pos - lights[light_idx].position.xyz;
 
-  float closest_depth = texture(lights[light_idx].shadow_tex, dist).r;
+  float closest_depth = texture(shadow_texs[light_idx], dist).r;
 
-  float frag_depth = length(dist) / lights[light_idx].far_plane;
+  float frag_depth = length(dist) / far_plane;
 
   float shadow_occlude = frag_depth - 0.05 < closest_depth ? 1.0 : 0.0;
 
@@ -54,22 +64,19 @@ float CalcShadowOcclusion(vec3 frag_pos, int light_idx) {
 }
 
 void main() {   
-  vec3 mtl_emission = materials[frag_mtl_id].emission_color;
-  vec3 mtl_ambient  = materials[frag_mtl_id].ambient_color;
-  vec3 mtl_diffuse  = materials[frag_mtl_id].diffuse_color;
-  vec3 mtl_specular = materials[frag_mtl_id].specular_color;
+  vec3 mtl_emission = materials[frag_mtl_id].emission_color.rgb;
+  vec3 mtl_ambient  = materials[frag_mtl_id].ambient_color.rgb;
+  vec3 mtl_diffuse  = materials[frag_mtl_id].diffuse_color.rgb;
+  vec3 mtl_specular = materials[frag_mtl_id].specular_color.rgb;
 
   if (materials[frag_mtl_id].has_ambient_tex) {
-    mtl_ambient *= texture(materials[frag_mtl_id].ambient_texture, 
-                           frag_texcoord).rgb;
+    mtl_ambient *= texture(ambient_texture, frag_texcoord).rgb;
   }
   if (materials[frag_mtl_id].has_diffuse_tex) {
-    mtl_diffuse *= texture(materials[frag_mtl_id].diffuse_texture,
-                           frag_texcoord).rgb;
+    mtl_diffuse *= texture(diffuse_texture, frag_texcoord).rgb;
   }
   if (materials[frag_mtl_id].has_specular_tex) {
-    mtl_specular *= texture(materials[frag_mtl_id].specular_texture,
-                            frag_texcoord).rgb;
+    mtl_specular *= texture(specular_texture, frag_texcoord).rgb;
   }
 
   vec3 emission = mtl_emission;
@@ -77,14 +84,14 @@ void main() {
   vec3 diffuse  = vec3(0.0);
   vec3 specular = vec3(0.0);
 
-  // TODO(colintan): Should we have a uniform variable to tell us the number
-  // of light sources?
-  for (int i = 0; i < 5; ++i) {
-    if (lights[i].is_active == false) {
-      continue;
+  // Constant bounds, since GLSL 3.30 only indexes sampler arrays with
+  // constant expressions
+  for (int i = 0; i < MAX_SHADOW_LIGHTS; ++i) {
+    if (i >= num_point_lights) {
+      break;
     }
 
-    vec3 light_vec = lights[i].position - frag_pos;
+    vec3 light_vec = lights[i].position.xyz - frag_pos;
     vec3 view_vec = camera_pos - frag_pos; // Since we're in eye space
 
     float light_dist = length(light_vec);
@@ -107,8 +114,10 @@ void main() {
     float specular_coeff = shadow_occlude * attenuation *
         pow(specular_dot, materials[frag_mtl_id].shininess);
 
-    diffuse  += mtl_diffuse  * lights[i].diffuse_intensity  * diffuse_coeff;
-    specular += mtl_specular * lights[i].specular_intensity * specular_coeff;
+    diffuse  += mtl_diffuse  * lights[i].diffuse_intensity.rgb  * 
+                diffuse_coeff;
+    specular += mtl_specular * lights[i].specular_intensity.rgb * 
+                specular_coeff;
   }
 
   out_color = vec4(emission + ambient + diffuse + specular, 1.0);
@@ -9,6 +9,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "gfx_utils/primitives.h"
+#include "gfx_utils/gl/shader_blocks.h"
 
 static const float kPi = 3.14159265358979323846f;
 
@@ -28,6 +29,13 @@ static const int kShadowTexHeight = 1024;
 static const float kShadowNearPlane = 1.f;
 static const float kShadowFarPlane = 25.f;
 
+// Size of the shadow_texs array in simple_light.frag. Lights past it don't
+// contribute to the light pass
+static const int kMaxShadowLights = 5;
+
+// First texture unit of the shadow maps
+static const int kShadowTexUnit = 10;
+
 static const glm::vec3 cubemap_dirs[] = {
   {1.f, 0.f, 0.f}, {-1.f, 0.f, 0.f},
   {0.f, 1.f, 0.f}, {0.f, -1.f, 0.f},
@@ -75,7 +83,8 @@ void App::ShadowPass() {
     glBindFramebuffer(GL_FRAMEBUFFER, shadow_fbo_id_list_[i]);
     glClear(GL_DEPTH_BUFFER_BIT);
 
-    glBindVertexArray(shadow_pass_vao_id_);
+    glBindVertexArray(
+        resource_manager_.GetVertexArrayId(gfx_utils::kVertexLayoutPosition));
 
     float near_plane = kShadowNearPlane;
     float far_plane = kShadowFarPlane;
@@ -90,7 +99,13 @@ void App::ShadowPass() {
         continue;
       }
 
-      for (auto mesh: entity_ptr->GetModel()->GetMeshes()) {
+      for (auto& mesh: entity_ptr->GetModel()->GetMeshes()) {
+        const gfx_utils::GeometryRange* range = 
+            resource_manager_.GetMeshRange(mesh);
+        if (!range) {
+          continue;
+        }
+
         glm::mat4 model_mat = entity_ptr->ComputeTransform();
 
         shadow_pass_program_.GetUniform("model_mat").Set(model_mat);
@@ -109,17 +124,7 @@ void App::ShadowPass() {
           shadow_pass_program_.GetUniform("shadow_mats", i).Set(shadow_mat);
         }
 
-        GLuint pos_vbo_id = 
-            resource_manager_.GetMeshVboId(mesh.id, 
-                                          gfx_utils::kVertTypePosition);
-        glBindBuffer(GL_ARRAY_BUFFER, pos_vbo_id);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-        GLuint ibo_id = resource_manager_.GetMeshIboId(mesh.id);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_id);
-        glDrawElements(GL_TRIANGLES, mesh.num_verts, GL_UNSIGNED_INT,
-                        (void*)0);
+        gfx_utils::DrawGeometryRange(*range);
       }
     }
 
@@ -148,58 +153,37 @@ void App::LightPass() {
   light_pass_program_.GetUniform("ambient_intensity")
                      .Set(glm::vec3(0.5f, 0.5f, 0.5f));
 
+  point_lights_buffer_.BindBase(gfx_utils::kBlockBindingPointLights);
+
+  for (int i = 0; i < lights_.size() && i < kMaxShadowLights; ++i) {
+    glActiveTexture(GL_TEXTURE0 + kShadowTexUnit + i);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, shadow_tex_id_list_[i]);
+  }
+
   const auto& entities = scene_.GetEntities();
 
+  glBindVertexArray(
+      resource_manager_.GetVertexArrayId(gfx_utils::kVertexLayoutAll));
+
   for (auto entity_ptr : entities) {
     if (!entity_ptr->HasModel()) {
       continue;
     }
 
     for (auto& mesh : entity_ptr->GetModel()->GetMeshes()) {
+      const gfx_utils::GeometryRange* range = 
+          resource_manager_.GetMeshRange(mesh);
+      if (!range) {
+        continue;
+      }
+
       glm::mat4 model_mat = entity_ptr->ComputeTransform();
       
       LightPass_SetTransformUniforms_Mesh(mesh, model_mat, view_mat, proj_mat);
 
       LightPass_SetMaterialUniforms_Mesh(mesh);
 
-      LightPass_SetLightUniforms_Mesh(mesh);
-
-      // Set vertex attributes
-
-      glBindVertexArray(light_pass_vao_id_);
-
-      GLuint pos_vbo_id = 
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypePosition);
-      glBindBuffer(GL_ARRAY_BUFFER, pos_vbo_id);
-      glEnableVertexAttribArray(0);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-      GLuint normal_vbo_id =
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypeNormal);
-      glBindBuffer(GL_ARRAY_BUFFER, normal_vbo_id);
-      glEnableVertexAttribArray(1);
-      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-      GLuint texcoord_vbo_id =
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypeTexcoord);
-      glBindBuffer(GL_ARRAY_BUFFER, texcoord_vbo_id);
-      glEnableVertexAttribArray(2);
-      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-      GLuint mtl_vbo_id =
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypeMtlId);
-      glBindBuffer(GL_ARRAY_BUFFER, mtl_vbo_id);
-      glEnableVertexAttribArray(3);
-      glVertexAttribPointer(3, 1, GL_UNSIGNED_INT, GL_FALSE, 0, (GLvoid*)0);
-
-      GLuint ibo_id = resource_manager_.GetMeshIboId(mesh.id);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_id);
-
-      glDrawElements(GL_TRIANGLES, mesh.num_verts, GL_UNSIGNED_INT, (void*)0);
+      gfx_utils::DrawGeometryRange(*range);
     }
   }
 
@@ -219,93 +203,28 @@ void App::LightPass_SetTransformUniforms_Mesh(gfx_utils::Mesh& mesh,
 }
 
 void App::LightPass_SetMaterialUniforms_Mesh(gfx_utils::Mesh& mesh) {
-  const auto& mtl_list = mesh.material_list;
-  for (int i = 0; i < mtl_list.size(); ++i) {
-    const auto& mtl = mtl_list[i];
-
-    light_pass_program_.GetUniform("materials", i, "ambient_color")
-                       .Set(mtl.ambient_color);
-    light_pass_program_.GetUniform("materials", i, "diffuse_color")
-                       .Set(mtl.diffuse_color);
-    light_pass_program_.GetUniform("materials", i, "specular_color")
-                       .Set(mtl.specular_color);
-    light_pass_program_.GetUniform("materials", i, "emission_color")
-                       .Set(mtl.emission_color);
-    light_pass_program_.GetUniform("materials", i, "shininess")
-                       .Set(mtl.shininess);
-
-    if (!mtl.ambient_texname.empty()) {
-      light_pass_program_.GetUniform("materials", i, "has_ambient_tex")
-                         .Set(true);
+  // The colors are in the material buffer already, only the textures are
+  // bound per mesh. Its materials share one unit per kind of texture
+  resource_manager_.BindMaterials(mesh);
 
+  for (const auto& mtl : mesh.material_list) {
+    if (mtl.ambient_texture) {
       glActiveTexture(GL_TEXTURE1);
-      GLuint tex_gl_id = 
-          resource_manager_.GetTextureId(mtl.ambient_texname);
-      glBindTexture(GL_TEXTURE_2D, tex_gl_id);
-      light_pass_program_.GetUniform("materials", i, "ambient_texture")
-                         .Set(1);
-    }
-    else {
-      light_pass_program_.GetUniform("materials", i, "has_ambient_tex")
-                         .Set(false);
+      glBindTexture(GL_TEXTURE_2D, 
+                    resource_manager_.GetTextureId(*mtl.ambient_texture));
     }
 
-    if (!mtl.diffuse_texname.empty()) {
-      light_pass_program_.GetUniform("materials", i, "has_diffuse_tex")
-                         .Set(true);
-
+    if (mtl.diffuse_texture) {
       glActiveTexture(GL_TEXTURE2);
-      GLuint tex_gl_id = 
-          resource_manager_.GetTextureId(mtl.diffuse_texname);
-      glBindTexture(GL_TEXTURE_2D, tex_gl_id);
-      light_pass_program_.GetUniform("materials", i, "diffuse_texture")
-                         .Set(2);
-    }
-    else {
-      light_pass_program_.GetUniform("materials", i, "has_diffuse_tex")
-                         .Set(false);
+      glBindTexture(GL_TEXTURE_2D, 
+                    resource_manager_.GetTextureId(*mtl.diffuse_texture));
     }
 
-    if (!mtl.specular_texname.empty()) {
-      light_pass_program_.GetUniform("materials", i, "has_specular_tex")
-                         .Set(true);
-
+    if (mtl.specular_texture) {
       glActiveTexture(GL_TEXTURE3);
-      GLuint tex_gl_id = 
-          resource_manager_.GetTextureId(mtl.specular_texname);
-      glBindTexture(GL_TEXTURE_2D, tex_gl_id);
-      light_pass_program_.GetUniform("materials", i, "specular_texture")
-                         .Set(3);
+      glBindTexture(GL_TEXTURE_2D, 
+                    resource_manager_.GetTextureId(*mtl.specular_texture));
     }
-    else {
-      light_pass_program_.GetUniform("materials", i, "has_specular_tex")
-                         .Set(false);
-    }
-  }
-}
-
-void App::LightPass_SetLightUniforms_Mesh(gfx_utils::Mesh& mesh) {
-
-  for (int i = 0; i < lights_.size(); ++i) {  
-    auto light_ptr = lights_[i];
-
-    light_pass_program_.GetUniform("lights", i, "is_active").Set(1);
-
-    light_pass_program_.GetUniform("lights", i, "position")
-                       .Set(light_ptr->position);
-    light_pass_program_.GetUniform("lights", i, "diffuse_intensity")
-                       .Set(light_ptr->diffuse_intensity);
-    light_pass_program_.GetUniform("lights", i, "specular_intensity")
-                       .Set(light_ptr->specular_intensity);
-
-    // // TODO(colintan): Don't hardcode this
-    glActiveTexture(GL_TEXTURE10 + i);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, shadow_tex_id_list_[i]);
-
-    light_pass_program_.GetUniform("lights", i, "shadow_tex").Set(10 + i);
-
-    light_pass_program_.GetUniform("lights", i, "far_plane")
-                       .Set(kShadowFarPlane);
   }
 }
 
@@ -341,6 +260,9 @@ void App::Startup() {
   glDepthFunc(GL_LESS);
   glEnable(GL_CULL_FACE);
 
+  light_pass_program_.SetDefines(
+      gfx_utils::GetShaderBlockDefines() + "#define MAX_SHADOW_LIGHTS " + 
+      std::to_string(kMaxShadowLights) + "\n");
   if (!light_pass_program_.CreateFromFiles(kLightPassVertShaderPath, 
                                            kLightPassFragShaderPath)) {
     std::cerr << "Could not create light pass program." << std::endl;
@@ -348,7 +270,7 @@ void App::Startup() {
   }
   glUseProgram(light_pass_program_.GetProgramId());
 
-  glGenVertexArrays(1, &light_pass_vao_id_);
+  SetupLightPass();
 
   if (!shadow_pass_program_.CreateFromFiles(kShadowPassVertShaderPath,
                                             kShadowPassFragShaderPath,
@@ -384,13 +306,43 @@ void App::Startup() {
 
     shadow_fbo_id_list_.push_back(shadow_fbo_id);
   }
+}
+
+void App::SetupLightPass() {
+  light_pass_program_.GetUniform("ambient_texture").Set(1);
+  light_pass_program_.GetUniform("diffuse_texture").Set(2);
+  light_pass_program_.GetUniform("specular_texture").Set(3);
+
+  for (int i = 0; i < kMaxShadowLights; ++i) {
+    light_pass_program_.GetUniform("shadow_texs", i).Set(kShadowTexUnit + i);
+  }
+  light_pass_program_.GetUniform("far_plane").Set(kShadowFarPlane);
+
+  if (!light_pass_program_.BindUniformBlock(
+          "PointLights", gfx_utils::kBlockBindingPointLights) ||
+      !light_pass_program_.BindUniformBlock(
+          "Materials", gfx_utils::kBlockBindingMaterials)) {
+    std::cerr << "Light pass program is missing a uniform block." 
+              << std::endl;
+    exit(1);
+  }
 
-  glGenVertexArrays(1, &shadow_pass_vao_id_);
+  // The lights don't move, so the block is written once
+  std::vector<uint8_t> lights_data;
+  gfx_utils::FillPointLightsBlock(lights_, &lights_data);
+
+  if (!point_lights_buffer_.Initialize(GL_UNIFORM_BUFFER, 
+                                       lights_data.size())) {
+    std::cerr << "Could not create point lights buffer." << std::endl;
+    exit(1);
+  }
+
+  point_lights_buffer_.Write(0, lights_data.size(), &lights_data[0]);
 }
 
 void App::Cleanup() {
-  glDeleteVertexArrays(1, &shadow_pass_vao_id_);
-  
+  point_lights_buffer_.Destroy();
+
   glDeleteFramebuffers(static_cast<GLsizei>(shadow_fbo_id_list_.size()), 
                        &shadow_fbo_id_list_[0]);
 
@@ -399,8 +351,6 @@ void App::Cleanup() {
 
   shadow_pass_program_.Destroy();
 
-  glDeleteVertexArrays(1, &light_pass_vao_id_);
-  
   light_pass_program_.Destroy();
 
   resource_manager_.Cleanup();
@@ -17,6 +17,7 @@
 #include "gfx_utils/lights.h"
 #include "gfx_utils/mesh.h"
 #include "gfx_utils/gl/gl_resource_manager.h"
+#include "gfx_utils/gl/block_buffer.h"
 
 class App {
 public:
@@ -34,10 +35,12 @@ private:
                                            glm::mat4& view_mat,
                                            glm::mat4& proj_mat);
   void LightPass_SetMaterialUniforms_Mesh(gfx_utils::Mesh& mesh);
-  void LightPass_SetLightUniforms_Mesh(gfx_utils::Mesh& mesh);
 
   void Startup();
 
+  // Sampler units and the light block, once the program exists
+  void SetupLightPass();
+
   void Cleanup();
 
 private:
@@ -53,9 +56,8 @@ private:
 
   std::vector<std::shared_ptr<gfx_utils::PointLight>> lights_;
 
-  GLuint light_pass_vao_id_;
+  gfx_utils::BlockBuffer point_lights_buffer_;
 
-  GLuint shadow_pass_vao_id_;
   std::vector<GLuint> shadow_tex_id_list_;
   std::vector<GLuint> shadow_fbo_id_list_;
 };
@@ -8,10 +8,24 @@ in vec3 frag_normal;
 uniform vec3 camera_pos;
 uniform samplerCube cubemap;
 
+// Level i of the prefiltered cubemap is convolved with a GGX lobe of
+// roughness i / max_lod
+uniform samplerCube specular_cubemap;
+uniform float max_lod;
+uniform float roughness;
+
 void main() {
   vec3 incident_ray = normalize(frag_pos - camera_pos);
   vec3 reflect_ray = reflect(incident_ray, normalize(frag_normal));
 
-  out_color = vec4(texture(cubemap, reflect_ray).rgb, 1.0);
+  vec3 color;
+  if (roughness > 0.0) {
+    color = textureLod(specular_cubemap, reflect_ray, roughness * max_lod).rgb;
+  }
+  else {
+    color = texture(cubemap, reflect_ray).rgb;
+  }
+
+  out_color = vec4(color, 1.0);
   // out_color = vec4(1.0, 0.0, 0.0, 1.0);
 }
\ No newline at end of file
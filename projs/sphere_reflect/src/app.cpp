@@ -3,6 +3,7 @@
 #include <iostream>
 #include <cstdlib>
 #include <random>
+#include <algorithm>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -24,6 +25,11 @@ static const int kWindowHeight = 1080;
 static const std::string kReflectPassVertShaderPath = "shaders/reflection.vert";
 static const std::string kReflectPassFragShaderPath = "shaders/reflection.frag";
 
+static const float kRoughnessStep = 0.01f;
+
+// How many frames pass between printing the GL state counters
+static const uint32_t kStateReportFrames = 300;
+
 // Format of vertex - {pos_x, pos_y, pos_z, texcoord_u, texcoord_v}
 static const float kQuadVertices[] = {
   -1.f,  1.f, 0.f, 0.f, 1.f,
@@ -44,9 +50,20 @@ void App::MainLoop() {
   bool should_quit = false;
 
   while (!should_quit) {
+    resource_manager_.BeginFrame();
+    state_cache_.BeginFrame();
 
     ReflectPass();
 
+    ++num_frames_;
+    if (num_frames_ % kStateReportFrames == 0) {
+      const gfx_utils::GLStateCounters& counters = 
+          state_cache_.GetLastFrameCounters();
+      std::cout << "Reflect pass GL state: " << counters.issued 
+                << " issued, " << counters.skipped << " skipped" 
+                << std::endl;
+    }
+
     window_.SwapBuffers();
     window_.TickMainLoop();
 
@@ -57,12 +74,13 @@ void App::MainLoop() {
 }
 
 void App::ReflectPass() {
-  glUseProgram(reflect_pass_program_.GetProgramId());
-  glViewport(0, 0, kWindowWidth, kWindowHeight);
+  state_cache_.UseProgram(reflect_pass_program_.GetProgramId());
+  state_cache_.Viewport(0, 0, kWindowWidth, kWindowHeight);
 
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glBindVertexArray(reflect_pass_vao_);
+  state_cache_.BindVertexArray(resource_manager_.GetVertexArrayId(
+      gfx_utils::kVertexLayoutPosition | gfx_utils::kVertexLayoutNormal));
 
   glm::mat4 view_mat = camera_.CalcViewMatrix();
   glm::mat4 proj_mat = glm::perspective(glm::radians(30.f),
@@ -77,47 +95,47 @@ void App::ReflectPass() {
     }
 
     for (auto& mesh : entity_ptr->GetModel()->GetMeshes()) {
+      const gfx_utils::GeometryRange* range = 
+          resource_manager_.GetMeshRange(mesh);
+      if (!range) {
+        continue;
+      }
+
       glm::mat4 model_mat = entity_ptr->ComputeTransform();
 
       glm::mat4 mv_mat = view_mat * model_mat;
       glm::mat4 mvp_mat = proj_mat * view_mat * model_mat;
       glm::mat3 normal_mat = glm::transpose(glm::inverse(glm::mat3(mv_mat)));
       
-      reflect_pass_program_.GetUniform("mv_mat").Set(mv_mat);
-      reflect_pass_program_.GetUniform("mvp_mat").Set(mvp_mat);
-      reflect_pass_program_.GetUniform("normal_mat").Set(normal_mat);
+      reflect_uniforms_.mv_mat.Set(mv_mat);
+      reflect_uniforms_.mvp_mat.Set(mvp_mat);
+      reflect_uniforms_.normal_mat.Set(normal_mat);
 
-      reflect_pass_program_.GetUniform("camera_pos")
-                           .Set(camera_.GetCameraLocation());
+      reflect_uniforms_.camera_pos.Set(camera_.GetCameraLocation());
 
       GLuint cubemap_id = resource_manager_.GetCubemapId("skybox");
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_id);
-      reflect_pass_program_.GetUniform("cubemap").Set(1);
-
-      // Set vertex attributes
-
-      GLuint pos_vbo_id = 
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypePosition);
-      glBindBuffer(GL_ARRAY_BUFFER, pos_vbo_id);
-      glEnableVertexAttribArray(0);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-      GLuint normal_vbo_id =
-          resource_manager_.GetMeshVboId(mesh.id, 
-                                         gfx_utils::kVertTypeNormal);
-      glBindBuffer(GL_ARRAY_BUFFER, normal_vbo_id);
-      glEnableVertexAttribArray(1);
-      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-      glDrawArrays(GL_TRIANGLES, 0, mesh.num_verts);
+      state_cache_.BindTexture(1, GL_TEXTURE_CUBE_MAP, cubemap_id);
+      reflect_uniforms_.cubemap.Set(1);
+
+      // Falls back to the plain cubemap if the scene didn't prefilter it
+      GLuint specular_cubemap_id = 
+          resource_manager_.GetPrefilteredCubemapId("skybox");
+      int num_specular_levels = static_cast<int>(
+          scene_.GetCubemap("skybox")->specular_mips.size());
+      if (specular_cubemap_id == 0) {
+        specular_cubemap_id = cubemap_id;
+        num_specular_levels = 1;
+      }
+
+      state_cache_.BindTexture(2, GL_TEXTURE_CUBE_MAP, specular_cubemap_id);
+      reflect_uniforms_.specular_cubemap.Set(2);
+      reflect_uniforms_.max_lod.Set(
+          static_cast<float>(num_specular_levels - 1));
+      reflect_uniforms_.roughness.Set(roughness_);
+
+      gfx_utils::DrawGeometryRange(*range);
     }
   }
- 
-  glBindVertexArray(0);
-
-  glUseProgram(0);
 }
 
 void App::Startup() {
@@ -134,6 +152,7 @@ void App::Startup() {
   scene_.LoadSceneFromJson("scene/scene.json");
 
   resource_manager_.SetScene(&scene_);
+  resource_manager_.SetStateCache(&state_cache_);
 
   resource_manager_.CreateGLResources();
 
@@ -142,6 +161,16 @@ void App::Startup() {
   glDepthFunc(GL_LESS);
   glEnable(GL_CULL_FACE);
 
+  // Avoids visible seams between faces in the blurrier mip levels
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+  window_.RegisterKeyBinding(GLFW_KEY_R, gfx_utils::KEY_ACTION_HOLD, [this]() {
+    roughness_ = std::min(roughness_ + kRoughnessStep, 1.0f);
+  });
+  window_.RegisterKeyBinding(GLFW_KEY_F, gfx_utils::KEY_ACTION_HOLD, [this]() {
+    roughness_ = std::max(roughness_ - kRoughnessStep, 0.0f);
+  });
+
   SetupReflectPass();
 }
 
@@ -152,12 +181,21 @@ void App::SetupReflectPass() {
     exit(1);                
   }
 
-  glGenVertexArrays(1, &reflect_pass_vao_);
+  reflect_uniforms_.mv_mat = reflect_pass_program_.GetUniform("mv_mat");
+  reflect_uniforms_.mvp_mat = reflect_pass_program_.GetUniform("mvp_mat");
+  reflect_uniforms_.normal_mat = 
+      reflect_pass_program_.GetUniform("normal_mat");
+  reflect_uniforms_.camera_pos = 
+      reflect_pass_program_.GetUniform("camera_pos");
+  reflect_uniforms_.cubemap = reflect_pass_program_.GetUniform("cubemap");
+  reflect_uniforms_.specular_cubemap = 
+      reflect_pass_program_.GetUniform("specular_cubemap");
+  reflect_uniforms_.max_lod = reflect_pass_program_.GetUniform("max_lod");
+  reflect_uniforms_.roughness = 
+      reflect_pass_program_.GetUniform("roughness");
 }
 
 void App::Cleanup() {
-  glDeleteVertexArrays(1, &reflect_pass_vao_);
-
   resource_manager_.Cleanup();
 
   window_.Destroy();
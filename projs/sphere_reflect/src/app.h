@@ -17,12 +17,24 @@
 #include "gfx_utils/lights.h"
 #include "gfx_utils/mesh.h"
 #include "gfx_utils/gl/gl_resource_manager.h"
+#include "gfx_utils/gl/gl_state_cache.h"
 
 class App {
 public:
   void Run();
 
 private:
+  struct ReflectPassUniforms {
+    gfx_utils::Uniform mv_mat;
+    gfx_utils::Uniform mvp_mat;
+    gfx_utils::Uniform normal_mat;
+    gfx_utils::Uniform camera_pos;
+    gfx_utils::Uniform cubemap;
+    gfx_utils::Uniform specular_cubemap;
+    gfx_utils::Uniform max_lod;
+    gfx_utils::Uniform roughness;
+  };
+
   void MainLoop();
 
   void ReflectPass();
@@ -41,11 +53,20 @@ private:
 
   gfx_utils::GLResourceManager resource_manager_;
 
+  gfx_utils::GLStateCache state_cache_;
+
+  uint32_t num_frames_ = 0;
+
   gfx_utils::Program reflect_pass_program_;
-  GLuint reflect_pass_vao_;
+
+  // Fetched once in SetupReflectPass()
+  ReflectPassUniforms reflect_uniforms_;
 
   GLuint reflect_cubemap_tex_;
 
+  // Roughness of the reflection, sampled from the prefiltered cubemap
+  float roughness_ = 0.0f;
+
   // gfx_utils::Program geom_pass_program_;
   // GLuint geom_pass_vao_;
 
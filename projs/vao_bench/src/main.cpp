@@ -0,0 +1,180 @@
+// Measures the CPU side of submitting a geometry pass: setting up the vertex
+// attributes of every mesh before its draw, as before the geometry pool,
+// against binding the pool's cached VAO once per pass. GLEW's entry points
+// are pointed at no-op stubs, so no context is needed and only the app-side
+// work is timed; the driver's share has to be measured on real hardware
+// (deferred_sponza reports its geometry pass submission time)
+
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gfx_utils/cpu_timer.h"
+#include "gfx_utils/gl/geometry_pool.h"
+#include "gfx_utils/handle.h"
+
+// Roughly sponza's mesh count
+static const uint32_t kNumMeshes = 400;
+static const uint32_t kNumPasses = 10000;
+
+static uint64_t num_gl_calls = 0;
+
+static void GLAPIENTRY StubBindVertexArray(GLuint /*array*/) {
+  ++num_gl_calls;
+}
+
+static void GLAPIENTRY StubBindBuffer(GLenum /*target*/, GLuint /*buffer*/) {
+  ++num_gl_calls;
+}
+
+static void GLAPIENTRY StubEnableVertexAttribArray(GLuint /*index*/) {
+  ++num_gl_calls;
+}
+
+static void GLAPIENTRY StubVertexAttribPointer(GLuint /*index*/, 
+                                               GLint /*size*/, 
+                                               GLenum /*type*/, 
+                                               GLboolean /*normalized*/, 
+                                               GLsizei /*stride*/, 
+                                               const void* /*pointer*/) {
+  ++num_gl_calls;
+}
+
+static void GLAPIENTRY StubDrawElementsBaseVertex(GLenum /*mode*/, 
+                                                  GLsizei /*count*/, 
+                                                  GLenum /*type*/, 
+                                                  const void* /*indices*/, 
+                                                  GLint /*base_vertex*/) {
+  ++num_gl_calls;
+}
+
+static void InstallGLStubs() {
+  __glewBindVertexArray = StubBindVertexArray;
+  __glewBindBuffer = StubBindBuffer;
+  __glewEnableVertexAttribArray = StubEnableVertexAttribArray;
+  __glewVertexAttribPointer = StubVertexAttribPointer;
+  __glewDrawElementsBaseVertex = StubDrawElementsBaseVertex;
+}
+
+// One map per attribute from mesh id to buffer id, as GLResourceManager kept
+// them before the geometry pool
+struct LegacyBuffers {
+  std::unordered_map<uint32_t, GLuint> vbo_ids[gfx_utils::kNumVertTypes];
+};
+
+static const GLint kAttribSizes[gfx_utils::kNumVertTypes] = {3, 3, 2, 1};
+static const GLenum kAttribTypes[gfx_utils::kNumVertTypes] = {
+  GL_FLOAT, GL_FLOAT, GL_FLOAT, GL_UNSIGNED_INT
+};
+
+// The legacy pass drew with glDrawArrays. GL 1.1 entry points are exported by
+// the GL library itself and can't be stubbed, so it draws with
+// glDrawElementsBaseVertex here instead; the number of calls is the same
+static void SubmitLegacyPass(LegacyBuffers& buffers, 
+                             const std::vector<uint32_t>& mesh_ids,
+                             const std::vector<gfx_utils::GeometryRange>& 
+                                 ranges) {
+  glBindVertexArray(1);
+
+  for (uint32_t i = 0; i < mesh_ids.size(); ++i) {
+    uint32_t mesh_id = mesh_ids[i];
+
+    for (GLuint location = 0; location < gfx_utils::kNumVertTypes; 
+         ++location) {
+      glBindBuffer(GL_ARRAY_BUFFER, buffers.vbo_ids[location][mesh_id]);
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(location, kAttribSizes[location], 
+                            kAttribTypes[location], GL_FALSE, 0, nullptr);
+    }
+
+    glDrawElementsBaseVertex(GL_TRIANGLES, ranges[i].index_count, 
+                             GL_UNSIGNED_INT, nullptr, 0);
+  }
+
+  glBindVertexArray(0);
+}
+
+static void SubmitPooledPass(
+    const gfx_utils::HandlePool<gfx_utils::GeometryRange>& range_pool,
+    const std::vector<gfx_utils::Handle>& handles) {
+  glBindVertexArray(1);
+
+  for (gfx_utils::Handle handle : handles) {
+    const gfx_utils::GeometryRange* range = range_pool.Get(handle);
+    if (range) {
+      gfx_utils::DrawGeometryRange(*range);
+    }
+  }
+
+  glBindVertexArray(0);
+}
+
+static void PrintResult(const std::string& label, 
+                        const gfx_utils::CpuTimer& timer,
+                        uint64_t num_calls) {
+  std::cout << label << ": " << timer.GetAverageMs() * 1000.0 
+            << " us per pass, " << num_calls / kNumPasses 
+            << " GL calls per pass" << std::endl;
+}
+
+int main() {
+  InstallGLStubs();
+
+  LegacyBuffers legacy_buffers;
+  std::vector<uint32_t> mesh_ids;
+
+  gfx_utils::HandlePool<gfx_utils::GeometryRange> range_pool;
+  std::vector<gfx_utils::Handle> handles;
+  std::vector<gfx_utils::GeometryRange> ranges;
+
+  GLuint next_buffer_id = 1;
+  uint32_t next_index = 0;
+
+  for (uint32_t i = 0; i < kNumMeshes; ++i) {
+    // Mesh ids were sparse, as meshes were added and removed
+    uint32_t mesh_id = i * 7 + 3;
+    mesh_ids.push_back(mesh_id);
+
+    for (auto& vbo_ids : legacy_buffers.vbo_ids) {
+      vbo_ids[mesh_id] = next_buffer_id++;
+    }
+
+    gfx_utils::GeometryRange range;
+    range.base_vertex = static_cast<int32_t>(next_index);
+    range.first_index = next_index;
+    range.index_count = 3 * (64 + i % 512);
+    range.num_verts = range.index_count;
+    next_index += range.index_count;
+
+    ranges.push_back(range);
+    handles.push_back(range_pool.Add(range));
+  }
+
+  gfx_utils::CpuTimer legacy_timer;
+  num_gl_calls = 0;
+  for (uint32_t i = 0; i < kNumPasses; ++i) {
+    legacy_timer.Begin();
+    SubmitLegacyPass(legacy_buffers, mesh_ids, ranges);
+    legacy_timer.End();
+  }
+  uint64_t legacy_calls = num_gl_calls;
+
+  gfx_utils::CpuTimer pooled_timer;
+  num_gl_calls = 0;
+  for (uint32_t i = 0; i < kNumPasses; ++i) {
+    pooled_timer.Begin();
+    SubmitPooledPass(range_pool, handles);
+    pooled_timer.End();
+  }
+  uint64_t pooled_calls = num_gl_calls;
+
+  std::cout << kNumMeshes << " meshes, " << kNumPasses << " passes" 
+            << std::endl;
+  PrintResult("Per-mesh attribute setup", legacy_timer, legacy_calls);
+  PrintResult("Cached VAO", pooled_timer, pooled_calls);
+
+  return 0;
+}
\ No newline at end of file